@@ -56,7 +56,7 @@ const my %INDEX_FACTOR => ( 'bamToBw' => -1,
   # register processes
 	$threads->add_function('bamToBw', \&PCAP::BigWig::bamToBw);
 
-	$threads->run(scalar @{$options->{'sequences'}}, 'bamToBw', $options) if(!exists $options->{'process'} || $options->{'process'} eq 'bamToBw');
+	$threads->run(scalar @{$options->{'sequences'}}, 'bamToBw', $options) if(!PCAP::BigWig::native() && (!exists $options->{'process'} || $options->{'process'} eq 'bamToBw'));
 
   if(!exists $options->{'process'} || $options->{'process'} eq 'generateBw') {
     PCAP::BigWig::generateBw($options);
@@ -260,6 +260,9 @@ Elements include:
   bamToBw: jobs = number of chromosomes
   generateBw: 1 job
 
+When C<xam_bigwig> is installed the bamToBw jobs do nothing and generateBw writes the BigWig
+directly from the BAM/CRAM using B<-threads> in a single process.
+
 =item B<-index>
 
 Can be used in conjunction with B<-process> to send individual elements for parallel processing.
@@ -55,10 +55,17 @@ const my %INDEX_FACTOR => ( 'setup' => 1,
  	my $threads = PCAP::Threaded->new($options->{'threads'});
 
   # register processes
-  $threads->add_function('split', \&PCAP::Bwa::split_in, split_threads($options));
-  $threads->add_function('bwamem', \&PCAP::Bwa::bwa_mem, exists $options->{'index'} ? 1 : $options->{'map_threads'});
+  $threads->add_function('split', \&PCAP::Bwa::split_in, split_threads($options), \&PCAP::Bwa::split_in_cost);
+  $threads->add_function('bwamem', \&PCAP::Bwa::bwa_mem, exists $options->{'index'} ? 1 : $options->{'map_threads'}, \&PCAP::Bwa::bwa_mem_cost);
+  unless(exists $options->{'index'}) {
+    $threads->set_resources('split', PCAP::Bwa::split_in_resources($options));
+    $threads->set_resources('bwamem', PCAP::Bwa::bwa_mem_resources($options));
+    $threads->max_memory($options->{'max_mem'});
+  }
 
   PCAP::Bwa::mem_setup($options) if(!exists $options->{'process'} || $options->{'process'} eq 'setup');
+  # later steps may run as separate processes
+  PCAP::Bwa::ref_cache_env($options);
 
   $threads->run($options->{'max_split'}, 'split', $options) if(!exists $options->{'process'} || $options->{'process'} eq 'split');
 
@@ -86,7 +93,7 @@ sub split_threads {
     $div = 1;
     $threads_per_split = $options->{threads};
   }
-  elsif($options->{raw_files}->[0] =~ m/(bam|cram)$/) {
+  elsif($options->{raw_files}->[0] =~ m/(bam|cram|gz)$/) {
     my $inputs = scalar @{$options->{raw_files}};
     $threads_per_split = int ($options->{threads} / $inputs);
     $threads_per_split = 1 if($threads_per_split < 1);
@@ -99,6 +106,7 @@ sub split_threads {
 sub cleanup {
   my $options = shift;
   my $tmpdir = $options->{'tmp'};
+  PCAP::Threaded::write_telemetry(File::Spec->catdir($tmpdir, 'logs'));
   move(File::Spec->catdir($tmpdir, 'logs'), File::Spec->catdir($options->{'outdir'}, 'logs_bwamem_'.$options->{'sample'})) || die $!;
   remove_tree $tmpdir if(-e $tmpdir);
 	return 0;
@@ -113,6 +121,8 @@ sub setup {
               'seqslice' => 10000,
               'csi' => undef,
               'tags' => undef,
+              'max_mem' => 0,
+              'mark_shards' => 0,
              );
 
   GetOptions( 'h|help' => \$opts{'h'},
@@ -120,6 +130,8 @@ sub setup {
               'v|version' => \$opts{'v'},
               'j|jobs' => \$opts{'jobs'},
               't|threads:i' => \$opts{'threads'},
+              'mm|max_mem:i' => \$opts{'max_mem'},
+              'ms|mark_shards:i' => \$opts{'mark_shards'},
               'mt|map_threads:i' => \$opts{'map_threads'},
               'r|reference=s' => \$opts{'reference'},
               'o|outdir=s' => \$opts{'outdir'},
@@ -142,6 +154,7 @@ sub setup {
               'ss|seqslice:i' => \$opts{'seqslice'},
               'k|bwakit' => \$opts{'bwakit'},
               'tags:s' => \$opts{'tags'},
+              'cov|coverage:s' => \$opts{'coverage'},
   ) or pod2usage(2);
 
   pod2usage(-verbose => 1, -exitval => 0) if(defined $opts{'h'});
@@ -186,6 +199,8 @@ sub setup {
   delete $opts{'legacy'} unless(defined $opts{'legacy'});
   delete $opts{'bwakit'} unless(defined $opts{'bwakit'});
   delete $opts{'tags'} unless(defined $opts{'tags'});
+  delete $opts{'coverage'} unless(defined $opts{'coverage'});
+  PCAP::Cli::file_for_reading('coverage', $opts{'coverage'}) if(defined $opts{'coverage'} && length $opts{'coverage'});
 
   if(defined $opts{'bwamem2'} && defined $opts{'legacy'}) {
     warn "WARN: Use of options bwamem2 and legacy is suboptimal, proceeding but memory will be excessive.\n";
@@ -254,6 +269,7 @@ bwa_mem.pl [options] [file(s)...]
     -reference   -r    Path to reference genome file *.fa[.gz]
     -sample      -s    Sample name to be applied to output file.
     -threads     -t    Number of threads to use. [1]
+    -max_mem     -mm   Memory budget (MB) for parallel split/bwamem jobs [0, unlimited]
 
   Optional parameters:
     -bwamem2     -bm2  Use bwa-mem2 instead of bwa.
@@ -277,6 +293,9 @@ bwa_mem.pl [options] [file(s)...]
                         - Please see 'bwa_mem.pl -m'
     -mmqcfrac    -qf   Mismatch fraction for -mmqc [0.05]
     -dupmode     -d    see "samtools markdup -m" [t]
+    -mark_shards -ms   Merge and mark duplicates as N parallel contig shards [0, off]
+    -coverage    -cov  Write depth bins and histogram of the final file while generating the bas,
+                       optionally restricted to a bed|gff3 file of targets [flag|file]
     -legacy            Equivalent to PCAP-core<=5.0.5
                         - bamtofastq instead of samtools collate (for BAM/CRAM input)
                         - dupmode ignored as uses bammarkduplicates2
@@ -343,6 +362,8 @@ should the process fail B<only delete this if> you are unable to resume the proc
 
 Final output files include: <SAMPLE>.bam, <SAMPLE>.bam.bai, <SAMPLE>.md5, <SAMPLE>.met
 
+Per job timings, CPU, peak memory and I/O are summarised in logs_bwamem_<SAMPLE>/telemetry.(tsv|json).
+
 =item B<-reference>
 
 Path to genome.fa[.gz] file and associated indexes for BWA.
@@ -360,6 +381,12 @@ script calls other tools that will still utilise this appropriately.
 
 This also impacts the number of threads used by BWA mapping steps.
 
+=item B<-max_mem>
+
+Memory (MB) available to the parallel split and bwamem steps.  Concurrent jobs are packed against
+this and B<-threads>, each bwamem job is estimated from the index size plus sort buffers and the
+estimate is raised to the peak memory measured for completed jobs.  0 disables the memory check.
+
 =back
 
 =head2 OPTIONAL parameters
@@ -384,6 +411,19 @@ Disables duplicate marking, switching bammarkduplicates2 for bammerge.
 
 Switch between template and sequence based marking.  See "samtools markdup" man page for more details
 
+=item B<-mark_shards>
+
+Split the merge and duplicate marking into N jobs, each a contiguous group of contigs, plus one
+for unplaced reads.  Duplicate flags are synchronised for pairs and supplementary alignments that
+span shards and the shards are concatenated to form the final file.  Ignored with B<-legacy> or
+B<-nomarkdup>.  Duplicate metrics are summed across shards.
+
+=item B<-coverage>
+
+Write C<$sample.bam.coverage> (depth bins as C<xam_coverage_bins.pl>) and C<$sample.bam.depth> (depth
+histogram) from the same pass over the final file that generates the C<.bas>.  Memory is bounded by the
+longest read span rather than contig length.  Whole genome unless given a bed|gff3 file of targets.
+
 =item B<-legacy>
 
 Processing equivalent to versions of PCAP-core <= 5.0.5 (bamtofastq + bammarkduplicates2)
@@ -37,6 +37,7 @@ use File::Copy qw(copy move);
 use PCAP::Cli;
 use PCAP::Bam;
 use PCAP::Bwa;
+use PCAP::Threaded;
 use version;
 
 const my $QUERYNAME_SORT_ORDER => 'queryname';
@@ -62,6 +63,7 @@ const my %INDEX_FACTOR => ( 'setup' => 1,
 sub cleanup {
   my $options = shift;
   my $tmpdir = $options->{'tmp'};
+  PCAP::Threaded::write_telemetry(File::Spec->catdir($tmpdir, 'logs'));
   move(File::Spec->catdir($tmpdir, 'logs'), File::Spec->catdir($options->{'outdir'}, 'logs_merge_or_mark_'.$options->{'sample'})) || die $!;
   remove_tree $tmpdir if(-e $tmpdir);
 	return 0;
@@ -226,6 +228,8 @@ should the process fail B<only delete this if> you are unable to resume the proc
 
 Final output files include: <SAMPLE>.bam, <SAMPLE>.bam.bai, <SAMPLE>.bam.bas, <SAMPLE>.md5, <SAMPLE>.met
 
+Per job timings, CPU, peak memory and I/O are summarised in logs_merge_or_mark_<SAMPLE>/telemetry.(tsv|json).
+
 (substitute cram, crai, csi as appropriate)
 
 =item B<-reference>
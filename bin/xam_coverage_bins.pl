@@ -59,6 +59,7 @@ my %opts;
 					'r|target_file=s' => \$opts{'target'},
 					'o|output_file=s' => \$opts{'out'},
 					't|type=s' => \$opts{'type'},
+					'n|threads=i' => \$opts{'threads'},
 					) or pod2usage(2);
 
 	pod2usage(-verbose => 1) if(defined $opts{'h'});
@@ -91,6 +92,9 @@ xam_coverage_bins.pl [options]
     -output_file           -o    file to write JSON string output of coverage
     -type                  -t    Type of target file provided [bed|gff3]
 
+  Optional parameters:
+    -threads               -n    Number of contigs to process in parallel [1]
+
   Other:
     -version               -v   Print version and exit.
     -help                  -h   Brief help message.
@@ -104,6 +108,10 @@ xam_coverage_bins.pl [options]
 
 Type of target file passed [bed|gff]
 
+=item B<-threads>
+
+Number of contigs to process in parallel, only applies when the C<xam_coverage> binary is available.
+
 =item B<-xam_files>
 
 bam|cram file to check coverage.
@@ -79,6 +79,21 @@ cp bin/reheadSQ $INST_PATH/bin/.
 cp bin/diff_bams $INST_PATH/bin/.
 cp bin/mismatchQc $INST_PATH/bin/.
 cp bin/mmFlagModifier $INST_PATH/bin/.
+cp bin/fastq_split $INST_PATH/bin/.
+cp bin/fastq_slice $INST_PATH/bin/.
+cp bin/xam_split $INST_PATH/bin/.
+cp bin/xam_fanout $INST_PATH/bin/.
+cp bin/xam_dupsync $INST_PATH/bin/.
+cp bin/xam_coverage $INST_PATH/bin/.
+cp bin/xam_bigwig $INST_PATH/bin/.
+cp bin/xam_synth $INST_PATH/bin/.
+cp bin/ref_cache_build $INST_PATH/bin/.
+
+mkdir -p $INST_PATH/lib $INST_PATH/include
+cp c/libpcapcore.a $INST_PATH/lib/.
+cp c/libpcapcore.so $INST_PATH/lib/libpcapcore.so.1
+ln -sf libpcapcore.so.1 $INST_PATH/lib/libpcapcore.so
+cp c/pcapcore.h $INST_PATH/include/.
 
 rm -rf $REF_CACHE
 rm -rf $HTSLIB
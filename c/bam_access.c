@@ -23,6 +23,7 @@
 #include <string.h>
 #include "bam_access.h"
 #include "bam_stats_calcs.h"
+#include "stats_arena.h"
 
 int get_rg_index_from_rg_store(rg_info_t **grps, char *rg, int grps_size){
   int i=0;
@@ -32,27 +33,52 @@ int get_rg_index_from_rg_store(rg_info_t **grps, char *rg, int grps_size){
   return -1;
 }
 
+uint64_t bam_access_get_gc_count(bam1_t *b){
+  uint64_t gc = 0;
+  uint8_t *seq = bam_get_seq(b);
+  int i=0;
+  for(i=0;i<b->core.l_qseq;i++){
+    uint8_t base = bam_seqi(seq,i);
+    if(base==4||base==2) gc++; //Check for G/C
+  }
+  return gc;
+}
+
+int bam_access_add_insert(khash_t(ins) *inserts, uint32_t ins){
+  int res;
+  khint_t k;
+  k = kh_put(ins,inserts,ins,&res);
+  if(res<0) return -1;
+  if(res){
+    kh_value(inserts,k) = 1;
+  }else{
+    kh_value(inserts,k) = kh_value(inserts,k)+1;
+  }
+  return 0;
+}
+
 void parse_rg_line(char *tmp_line, rg_info_t *group) {
 //Now tokenise tmp_line on \t and read in
-  char *tag = strtok(tmp_line,"\t");
+  char *save = NULL;
+  char *tag = strtok_r(tmp_line,"\t",&save);
   assert(strcmp(tag,"@RG")==0);
   group->id = strdup("\0");
   group->sample = strdup("\0");
   group->platform = strdup("\0");
   group->platform_unit = strdup("\0");
   group->lib = strdup("\0");
-  tag = strtok(NULL,"\t");
+  tag = strtok_r(NULL,"\t",&save);
   while(tag != NULL){
     assert(tag[2]==':');
     tag[2]=0;
     char *val = tag+3;
-    if (strcmp("ID",tag)==0) group->id = strdup(val);
+    if (strcmp("ID",tag)==0){ free(group->id); group->id = strdup(val); }
     if (strlen(val)==0) val = ".";
-    if (strcmp("SM",tag)==0) group->sample = strdup(val);
-    if (strcmp("PL",tag)==0) group->platform = strdup(val);
-    if (strcmp("PU",tag)==0) group->platform_unit = strdup(val);
-    if (strcmp("LB",tag)==0) group->lib = strdup(val);
-    tag = strtok(NULL,"\t");
+    if (strcmp("SM",tag)==0){ free(group->sample); group->sample = strdup(val); }
+    if (strcmp("PL",tag)==0){ free(group->platform); group->platform = strdup(val); }
+    if (strcmp("PU",tag)==0){ free(group->platform_unit); group->platform_unit = strdup(val); }
+    if (strcmp("LB",tag)==0){ free(group->lib); group->lib = strdup(val); }
+    tag = strtok_r(NULL,"\t",&save);
   }//End of iterating through tags in this RG tmp_line
   return;
 }
@@ -60,24 +86,27 @@ void parse_rg_line(char *tmp_line, rg_info_t *group) {
 rg_info_t **bam_access_parse_header(bam_hdr_t *head, int *grps_size, stats_rd_t ****grp_stats){
   assert(head != NULL);
   char *line = NULL;
-  rg_info_t **groups;
+  rg_info_t **groups = NULL;
   int size = 0;
-  char *head_txt = head->text;
-  char *head_bac = strdup(head_txt);
-  //First pass counts read groups
-  line = strtok(head_txt,"\n");
+  // tokenise copies, the header text stays usable by the caller
+  char *head_txt = strdup(head->text);
+  char *head_bac = strdup(head->text);
+  check_mem(head_txt);
+  check_mem(head_bac);
+  //First pass counts read groups, strtok_r as headers may be parsed by several threads at once
+  char *ptr = NULL;
+  line = strtok_r(head_txt,"\n",&ptr);
   while(line != NULL){
 		//Check for a read group line
 		if(strncmp(line,"@RG",3)==0){
       size++;
     }
-    line = strtok(NULL,"\n");
+    line = strtok_r(NULL,"\n",&ptr);
   }
   if(size>0){
     //We now have the number of read groups, assign the RG id to each.
     groups = (rg_info_t**) malloc(sizeof(rg_info_t *) * size);
     check_mem(groups);
-    char *ptr = NULL;
     line = strtok_r(head_bac,"\n",&ptr);
     int idx = 0;
     while(line != NULL){
@@ -92,21 +121,22 @@ rg_info_t **bam_access_parse_header(bam_hdr_t *head, int *grps_size, stats_rd_t
         check((groups[idx]->id != NULL),"Error recognising ID from RG line. NULL found.");
         check((groups[idx]->id[0]!='\0'),"Error recognising ID from RG line. Empty string.");
         check((groups[idx]->sample != NULL),"Error recognising SM from RG line.");
-        if(groups[idx]->sample[0] == '\0') groups[idx]->sample = strdup(".");
+        if(groups[idx]->sample[0] == '\0'){ free(groups[idx]->sample); groups[idx]->sample = strdup("."); }
         check(groups[idx]->platform != NULL,"Error recognising PL from RG line.");
-        if(groups[idx]->platform[0] == '\0') groups[idx]->platform = strdup(".");
+        if(groups[idx]->platform[0] == '\0'){ free(groups[idx]->platform); groups[idx]->platform = strdup("."); }
         check(groups[idx]->lib != NULL,"Error recognising LB from RG line.");
-        if(groups[idx]->lib[0] == '\0') groups[idx]->lib = strdup(".");
+        if(groups[idx]->lib[0] == '\0'){ free(groups[idx]->lib); groups[idx]->lib = strdup("."); }
         check(groups[idx]->platform_unit != NULL,"Error recognising PU from RG line.");
-        if(groups[idx]->platform_unit[0] == '\0') groups[idx]->platform_unit = strdup(".");
+        if(groups[idx]->platform_unit[0] == '\0'){ free(groups[idx]->platform_unit); groups[idx]->platform_unit = strdup("."); }
         idx++;
       }//End of iteration through header lines.
       line = strtok_r(NULL,"\n",&ptr);
     }
-    if(line) free(line);
 	}else{ //Deal with a possible lack of @RG lines.
     groups = malloc(sizeof(rg_info_t*) * 1);
     check_mem(groups);
+    groups[0] = (rg_info_t *) malloc(sizeof(rg_info_t));
+    check_mem(groups[0]);
     groups[0]->id = strdup(".");
     groups[0]->sample = strdup(".");
     groups[0]->platform = strdup(".");
@@ -114,141 +144,155 @@ rg_info_t **bam_access_parse_header(bam_hdr_t *head, int *grps_size, stats_rd_t
     groups[0]->lib = strdup(".");
     size = 1;
 	}
-	*grp_stats = (stats_rd_t***) malloc(sizeof(stats_rd_t**) * (size));
-  check_mem(*grp_stats);
-  int j=0;
-  for(j=0; j<size; j++){
-    (*grp_stats)[j] = (stats_rd_t **) malloc((sizeof(stats_rd_t*)*2));
-    check_mem((*grp_stats)[j]);
-    (*grp_stats)[j][0] = (stats_rd_t *) malloc(sizeof(stats_rd_t));//Setup read one stats store
-    check_mem((*grp_stats)[j][0]);
-    (*grp_stats)[j][0]->length= 0;
-    (*grp_stats)[j][0]->count= 0;
-    (*grp_stats)[j][0]->dups= 0;
-    (*grp_stats)[j][0]->gc= 0;
-    (*grp_stats)[j][0]->umap= 0;
-    (*grp_stats)[j][0]->divergent= 0;
-    (*grp_stats)[j][0]->mapped_bases= 0;
-    (*grp_stats)[j][0]->proper= 0;
-    (*grp_stats)[j][0]->qc_fail= 0;
-    (*grp_stats)[j][0]->mapped_pairs= 0;
-    (*grp_stats)[j][0]->inter_chr_pairs= 0;
-    (*grp_stats)[j][0]->inserts = kh_init(ins);
-    (*grp_stats)[j][1] = (stats_rd_t *)malloc(sizeof(stats_rd_t));//Setup read two stats store
-    check_mem((*grp_stats)[j][1]);
-    (*grp_stats)[j][1]->length= 0;
-    (*grp_stats)[j][1]->count= 0;
-    (*grp_stats)[j][1]->dups= 0;
-    (*grp_stats)[j][1]->gc= 0;
-    (*grp_stats)[j][1]->umap= 0;
-    (*grp_stats)[j][1]->divergent= 0;
-    (*grp_stats)[j][1]->mapped_bases= 0;
-    (*grp_stats)[j][1]->proper= 0;
-    (*grp_stats)[j][1]->qc_fail= 0;
-  }
+  *grp_stats = NULL;
+  check(stats_arena_add(grp_stats, size) == 0, "Error allocating stats for %d read groups.", size);
   *grps_size = size;
+  free(head_txt);
+  free(head_bac);
 	return groups;
 
 error:
   if(groups) free(groups);
-  if(line) free(line);
-  if(grp_stats) free(grp_stats);
+  free(head_txt);
+  free(head_bac);
   return NULL;
 }
 
-int bam_access_process_reads(htsFile *input, bam_hdr_t *head, rg_info_t **grps, int grps_size, stats_rd_t ****grp_stats, int rna){
-  assert(input != NULL);
-  assert(head != NULL);
+void bam_access_free_groups(rg_info_t **grps, int grps_size, stats_rd_t ***grp_stats){
+  int i=0;
+  for(i=0;i<grps_size;i++){
+    if(grps && grps[i]){
+      free(grps[i]->id);
+      free(grps[i]->sample);
+      free(grps[i]->platform);
+      free(grps[i]->platform_unit);
+      free(grps[i]->lib);
+      free(grps[i]);
+    }
+  }
+  free(grps);
+  stats_arena_free(grp_stats);
+}
+
+int bam_access_process_read(bam1_t *b, rg_info_t **grps, int grps_size, stats_rd_t ***grp_stats, int rna){
+  assert(b != NULL);
   assert(grps != NULL);
 
-  bam1_t *b;
-  //Iterate through each read in bam file.
-  b = bam_init1();
-  int ret;
-  while((ret = sam_read1(input, head, b)) >= 0){
-    if (b->core.flag & BAM_FSECONDARY && rna == 0) continue; //skip secondary hits so no double counts
-    if (b->core.flag & BAM_FSUPPLEMENTARY) continue; // skip supplimentary
+  if (b->core.flag & BAM_FSECONDARY && rna == 0) return 0; //skip secondary hits so no double counts
+  if (b->core.flag & BAM_FSUPPLEMENTARY) return 0; // skip supplimentary
 
-    uint8_t read = 1; //second read
-    if (b->core.flag & BAM_FREAD1) read = 0; //first read
+  uint8_t read = 1; //second read
+  if (b->core.flag & BAM_FREAD1) read = 0; //first read
 
-    char *rg = bam_aux2Z(bam_aux_get(b,"RG"));
-    if(rg == NULL || strlen(rg)==0){
-      rg = ".";
-    }
+  char *rg = bam_aux2Z(bam_aux_get(b,"RG"));
+  if(rg == NULL || strlen(rg)==0){
+    rg = ".";
+  }
 
-    int rg_index = get_rg_index_from_rg_store(grps,rg,grps_size);
-    check(rg_index>=0, "Error assigning @RG ID index for ID:%s.", rg);
-    check(rg_index<grps_size, "Error assigning @RG ID index for ID:%s.", rg);
+  int rg_index = get_rg_index_from_rg_store(grps,rg,grps_size);
+  check(rg_index>=0, "Error assigning @RG ID index for ID:%s.", rg);
+  check(rg_index<grps_size, "Error assigning @RG ID index for ID:%s.", rg);
 
-    // grp_stats[rg_index][read]; Stats for this RG/read order combination
-    if((*grp_stats)[rg_index][read]->length == 0) (*grp_stats)[rg_index][read]->length = b->core.l_qseq;
+  // grp_stats[rg_index][read]; Stats for this RG/read order combination
+  stats_rd_t *stats = grp_stats[rg_index][read];
+  if(stats->length == 0) stats->length = b->core.l_qseq;
 
-    if (b->core.flag & BAM_FQCFAIL) (*grp_stats)[rg_index][read]->qc_fail++;
+  if (b->core.flag & BAM_FQCFAIL) stats->qc_fail++;
 
-    (*grp_stats)[rg_index][read]->count++;
-    if(b->core.flag & BAM_FDUP) (*grp_stats)[rg_index][read]->dups++;
+  stats->count++;
+  if(b->core.flag & BAM_FDUP) stats->dups++;
 
-    //Get the count of GCs in the sequence.
-    int i=0;
-    for(i=0;i<b->core.l_qseq;i++){
-      uint8_t base = bam_seqi(bam_get_seq(b),i);
-      if(base==4||base==2) (*grp_stats)[rg_index][read]->gc++; //Check for G/C
-    }
+  //Get the count of GCs in the sequence.
+  stats->gc += bam_access_get_gc_count(b);
 
-    //Count unmapped and go to next read as anything after this is for mapped only.
-    //QCFail is considered unmapped
-    if(b->core.flag & BAM_FUNMAP || b->core.flag & BAM_FQCFAIL){
-      (*grp_stats)[rg_index][read]->umap++;
-      continue;
-    }
+  //Count unmapped and go to next read as anything after this is for mapped only.
+  //QCFail is considered unmapped
+  if(b->core.flag & BAM_FUNMAP || b->core.flag & BAM_FQCFAIL){
+    stats->umap++;
+    return 0;
+  }
 
-    // everything after this point must require reads are mapped
+  // everything after this point must require reads are mapped
 
-    // Divergence calculation: Collect stats that will allow us to calculate the the number of bases that diverge from the reference.
-    //                         This requires collecting the value from the NM tag and the mapped proportion of the query string.
-    uint8_t *nm = 0;
-    nm = bam_aux_get(b,"NM");
+  // Divergence calculation: Collect stats that will allow us to calculate the the number of bases that diverge from the reference.
+  //                         This requires collecting the value from the NM tag and the mapped proportion of the query string.
+  uint8_t *nm = 0;
+  nm = bam_aux_get(b,"NM");
 
-    if(nm){
-      uint32_t nm_val = bam_aux2i(nm);
-      if(nm_val>0){
-        (*grp_stats)[rg_index][read]->divergent += nm_val;
-      }
+  if(nm){
+    uint32_t nm_val = bam_aux2i(nm);
+    if(nm_val>0){
+      stats->divergent += nm_val;
     }
-    (*grp_stats)[rg_index][read]->mapped_bases += bam_access_get_mapped_base_count_from_cigar(b);
-
-    // stats that only assess read 1
-    if(b->core.flag & BAM_FREAD1) {
-      // Count all the pairs where both ends are not unmapped
-      // already tested if this read is mapped above
-      if(!(b->core.flag & BAM_FMUNMAP)) {
-        // there will be slight skew due to QCFail handling
-        (*grp_stats)[rg_index][read]->mapped_pairs++;
-
-        // Insert size can only be calculated based on reads that are on same chr
-        // so it is more sensible to generate the distribution based on $PROPER-pairs.
-        // only assess read 1 as size is a factor of the pair
-        if(b->core.flag & BAM_FPROPER_PAIR){
-          (*grp_stats)[rg_index][read]->proper++;
-          uint32_t ins = abs(b->core.isize);
-          int res;
-          khint_t k;
-          k = kh_put(ins,(*grp_stats)[rg_index][read]->inserts,ins,&res);
-          if(res){
-            kh_value((*grp_stats)[rg_index][read]->inserts,k) = 1;
-          }else{
-            kh_value((*grp_stats)[rg_index][read]->inserts,k) = kh_value((*grp_stats)[rg_index][read]->inserts,k)+1;
-          }
-        }
-        else if(b->core.tid != b->core.mtid) {
-          // here count the reads where the chr are different
-          // there will be slight skew due to QCFail handling
-          (*grp_stats)[rg_index][read]->inter_chr_pairs++;
-        }
-      }
+  }
+  stats->mapped_bases += bam_access_get_mapped_base_count_from_cigar(b);
+
+  // stats that only assess read 1
+  if(b->core.flag & BAM_FREAD1) {
+    // Count all the pairs where both ends are not unmapped
+    // already tested if this read is mapped above
+    if(!(b->core.flag & BAM_FMUNMAP)) {
+      // there will be slight skew due to QCFail handling
+      stats->mapped_pairs++;
     }
 
+    // Insert size can only be calculated based on reads that are on same chr
+    // so it is more sensible to generate the distribution based on $PROPER-pairs.
+    // only assess read 1 as size is a factor of the pair
+    // the mate state is not considered, as PCAP::Bam::Stats
+    if(b->core.flag & BAM_FPROPER_PAIR){
+      stats->proper++;
+      check(bam_access_add_insert(stats->inserts,abs(b->core.isize))==0,"Error adding insert size to histogram.");
+    }
+    else if(b->core.tid != b->core.mtid) {
+      // here count the reads where the chr are different
+      // there will be slight skew due to QCFail handling
+      stats->inter_chr_pairs++;
+    }
+  }
+  return 0;
+  error:
+    return -1;
+}
+
+int bam_access_count_dup(bam1_t *b, rg_info_t **grps, int grps_size, stats_rd_t ***grp_stats, int rna){
+  assert(b != NULL);
+  assert(grps != NULL);
+
+  // same selection as bam_access_process_read so counts line up with merged shards
+  if (b->core.flag & BAM_FSECONDARY && rna == 0) return 0;
+  if (b->core.flag & BAM_FSUPPLEMENTARY) return 0;
+  if (!(b->core.flag & BAM_FDUP)) return 0;
+
+  uint8_t read = 1;
+  if (b->core.flag & BAM_FREAD1) read = 0;
+
+  char *rg = bam_aux2Z(bam_aux_get(b,"RG"));
+  if(rg == NULL || strlen(rg)==0){
+    rg = ".";
+  }
+
+  int rg_index = get_rg_index_from_rg_store(grps,rg,grps_size);
+  check(rg_index>=0, "Error assigning @RG ID index for ID:%s.", rg);
+  check(rg_index<grps_size, "Error assigning @RG ID index for ID:%s.", rg);
+
+  grp_stats[rg_index][read]->dups++;
+  return 0;
+  error:
+    return -1;
+}
+
+int bam_access_process_reads(htsFile *input, bam_hdr_t *head, rg_info_t **grps, int grps_size, stats_rd_t ****grp_stats, int rna){
+  assert(input != NULL);
+  assert(head != NULL);
+  assert(grps != NULL);
+
+  bam1_t *b;
+  //Iterate through each read in bam file.
+  b = bam_init1();
+  int ret;
+  while((ret = sam_read1(input, head, b)) >= 0){
+    check(bam_access_process_read(b, grps, grps_size, *grp_stats, rna)==0, "Error processing read.");
   }
   bam_destroy1(b);
   return 0;
@@ -56,10 +56,27 @@ typedef struct{
   char *sample;
 } rg_info_t;
 
+int get_rg_index_from_rg_store(rg_info_t **grps, char *rg, int grps_size);
+
+// grp_stats[rg][0|1] is backed by a stats_arena, see stats_arena.h.
 rg_info_t **bam_access_parse_header(bam_hdr_t *head, int *grps_size, stats_rd_t ****grp_stats);
 
+// Frees groups and stats from bam_access_parse_header or bam_stats_shard_merge.
+void bam_access_free_groups(rg_info_t **grps, int grps_size, stats_rd_t ***grp_stats);
+
+int bam_access_process_read(bam1_t *b, rg_info_t **grps, int grps_size, stats_rd_t ***grp_stats, int rna);
+
+// Only increments the duplicate count, for use when all other stats come from merged shards.
+int bam_access_count_dup(bam1_t *b, rg_info_t **grps, int grps_size, stats_rd_t ***grp_stats, int rna);
+
 int bam_access_process_reads(htsFile *input, bam_hdr_t *head, rg_info_t **grps, int grps_size, stats_rd_t ****grp_stats, int rna);
 
 uint64_t bam_access_get_mapped_base_count_from_cigar(bam1_t *b);
 
+// Count of G/C bases in the read sequence.
+uint64_t bam_access_get_gc_count(bam1_t *b);
+
+// Increment the insert size histogram, returns -1 if the hash could not grow.
+int bam_access_add_insert(khash_t(ins) *inserts, uint32_t ins);
+
 #endif
@@ -24,17 +24,48 @@
 #include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 #include "dbg.h"
+#include "hfile_readahead.h"
+#include "ref_cache.h"
 #include "bam_access.h"
 #include "htslib/thread_pool.h"
 #include "bam_stats_output.h"
+#include "bam_stats_calcs.h"
+#include "bam_stats_shard.h"
+#include "xam_part.h"
+#include "xam_sample.h"
+#include "coverage_window.h"
+#include "pcapcore.h"
+#include "hfile_tee.h"
 
 #include "khash.h"
 
 static char *input_file = NULL;
+static char *readahead_opt = NULL;
+static size_t readahead = 0;
+static char **input_files = NULL;
+static int input_files_size = 0;
+static char *output_dir = NULL;
+static int max_open = 4;
+static int passthrough = 0;
 static char *output_file = NULL;
 static char *ref_file = NULL;
 static int rna = 0;
+static double rna_sd = BAM_STATS_RNA_SD;
+static int rna_iter = BAM_STATS_RNA_ITERATIONS;
+static int rna_trim_set = 0;
+static int skip_qcfail = 0;
+static int part_rem = 0;
+static int part_mod = 0;
+static char *shard_out = NULL;
+static char **shard_in = NULL;
+static int shard_in_size = 0;
+static char *coverage_out = NULL;
+static char *depth_hist_out = NULL;
+static char *target_file = NULL;
+static double sample_fraction = 0;
+static char *estimate_out = NULL;
 int grps_size = 0;
 int nthreads = 0; // shared pool
 stats_rd_t*** grp_stats;
@@ -55,20 +86,59 @@ void print_version (int exit_code){
 
 void print_usage (int exit_code){
 
-	printf ("Usage: bam_stats -i file -o file [-p plots] [-r reference.fa.fai] [-h] [-v]\n\n");
+	printf ("Usage: bam_stats -i file -o file [-p plots] [-r reference.fa.fai] [-q] [-P rem/mod] [-S shard] [-m shard ...] [-C file] [-H file] [-t targets] [-s fraction [-E file]] [-T] [-h] [-v]\n");
+	printf ("       bam_stats -i file -i file ... -O dir [-j N] [-r reference.fa.fai] [-a] [-q] [-@ N]\n\n");
   printf ("-i --input          File path to read in.\n");
   printf ("-o --output         File path to output.\n\n");
+	printf ("Many inputs:\n");
+	printf ("-i --input          Repeat for each input, the .bas of each is written to -O as <input name>.bas.\n");
+	printf ("-O --outdir         Directory to write the .bas files to, required with more than one input.\n");
+	printf ("-j --max-open       Inputs processed at once, sharing the -@ thread pool [%d].\n\n", max_open);
 	printf ("Optional:\n");
-	printf ("-r --ref-file       File path to reference index (.fai) file.\n");
+	printf ("-r --ref-file       File path to reference index (.fai) file, or a ref_cache_build directory.\n");
 	printf ("                    NB. If cram format is supplied via -b and the reference listed in the cram header can't be found bam_stats may fail to work correctly.\n");
 	printf ("-a --rna            Uses the RNA method of calculating insert size (ignores anything outside ± ('sd'*standard_dev) of the mean in calculating a new mean)\n");
-	printf ("-@ --num_threads    Use thread pool with specified number of threads.\n\n");
+	printf ("                    and counts secondary alignments.\n");
+	printf ("-D --rna-sd         With -a, the 'sd' multiplier of the standard deviation [%.1f].\n", BAM_STATS_RNA_SD);
+	printf ("-I --rna-iter       With -a, number of times the trimming is repeated on the trimmed sizes [%d].\n", BAM_STATS_RNA_ITERATIONS);
+	printf ("-q --skip-qcfail    Ignore QC fail reads entirely (as PCAP::Bam::Stats), default counts them as unmapped.\n");
+	printf ("-P --part           Only process part 'rem' of 'mod' (0 based) disjoint parts of an indexed input,\n");
+	printf ("                    combine the parts with -S and -m.\n");
+	printf ("-R --readahead      Read the input through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+	printf ("                    default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
+	printf ("-@ --num_threads    Use thread pool with specified number of threads.\n");
+	printf ("-S --shard-out      Write the raw stats of the input to this shard file, .bas only written when -o is also given.\n");
+	printf ("-m --merge          Stats shard to sum into the output, repeat for each shard.\n");
+	printf ("                    With -i the input only contributes duplicate counts, without -i no reads are processed.\n");
+	printf ("-C --coverage       Write depth bins of the input to this file, as xam_coverage (coordinate sorted input only).\n");
+	printf ("-H --depth-hist     Write the depth histogram of the input to this file (coordinate sorted input only).\n");
+	printf ("-t --targets        Restrict -C and -H to the targets in this bed|gff3 file, default whole genome.\n");
+	printf ("-s --sample         Estimate the stats from this fraction (0-1) of an indexed input, read as evenly spaced\n");
+	printf ("                    windows via the index. Counts in the output are scaled to whole file estimates.\n");
+	printf ("-E --estimate       With -s, write the estimates and 95%% confidence intervals to this file,\n");
+	printf ("                    default the output file with '.estimate' appended (stderr when output is stdout).\n");
+	printf ("-T --passthrough    Forward the input bytes unchanged to stdout as they are read, so bam_stats can sit\n");
+	printf ("                    inline in a pipe. Requires -o and/or -S to name files.\n\n");
 	printf ("Other:\n");
 	printf ("-h --help           Display this usage information.\n");
 	printf ("-v --version        Prints the version number.\n\n");
   exit(exit_code);
 }
 
+/*
+ * A cache directory (-r) is exported once in main before any thread starts, as setenv
+ * can't run alongside the getenv of other threads, so only a fasta/fai is set per file.
+ */
+static int set_reference(htsFile *fp){
+  if(ref_file == NULL || ref_cache_is_cache(ref_file)) return 0;
+  return hts_set_fai_filename(fp, ref_file);
+}
+
+static const char *multi_basename(const char *file){
+  const char *base = strrchr(file,'/');
+  return base ? base+1 : file;
+}
+
 int options(int argc, char *argv[]){
 
   ref_file = NULL;
@@ -81,7 +151,22 @@ int options(int argc, char *argv[]){
               {"ref-file",required_argument,0,'r'},
               {"output",required_argument,0,'o'},
               {"rna",no_argument,0, 'a'},
+              {"rna-sd",required_argument,0, 'D'},
+              {"rna-iter",required_argument,0, 'I'},
+              {"skip-qcfail",no_argument,0, 'q'},
+              {"part",required_argument,0, 'P'},
 							{"num_threads",required_argument,0,'@'},
+							{"readahead",required_argument,0,'R'},
+              {"shard-out",required_argument,0,'S'},
+              {"merge",required_argument,0,'m'},
+              {"coverage",required_argument,0,'C'},
+              {"depth-hist",required_argument,0,'H'},
+              {"targets",required_argument,0,'t'},
+              {"sample",required_argument,0,'s'},
+              {"estimate",required_argument,0,'E'},
+              {"outdir",required_argument,0,'O'},
+              {"max-open",required_argument,0,'j'},
+              {"passthrough",no_argument,0,'T'},
               { NULL, 0, NULL, 0}
 
    }; //End of declaring opts
@@ -90,9 +175,12 @@ int options(int argc, char *argv[]){
    int iarg = 0;
 
    //Iterate through options
-   while((iarg = getopt_long(argc, argv, "i:o:r:@:vha", long_opts, &index)) != -1){
+   while((iarg = getopt_long(argc, argv, "i:o:r:@:R:S:m:P:C:H:t:s:E:O:j:D:I:vhaqT", long_opts, &index)) != -1){
    	switch(iarg){
    		case 'i':
+        input_files = realloc(input_files, sizeof(char *) * (input_files_size+1));
+        check_mem(input_files);
+        input_files[input_files_size++] = optarg;
         input_file = optarg;
         break;
 
@@ -108,10 +196,76 @@ int options(int argc, char *argv[]){
         rna = 1;
         break;
 
+   		case 'D':
+        check(sscanf(optarg, "%lf", &rna_sd)==1 && rna_sd > 0, "Error parsing -D argument '%s'. Should be a number > 0", optarg);
+        rna_trim_set = 1;
+        break;
+
+   		case 'I':
+        check(sscanf(optarg, "%i", &rna_iter)==1 && rna_iter >= 0, "Error parsing -I argument '%s'. Should be an integer >= 0", optarg);
+        rna_trim_set = 1;
+        break;
+
+			case 'R':
+				readahead_opt = optarg;
+				break;
+
 			case '@':
 				check(sscanf(optarg, "%i", &nthreads)==1, "Error parsing -@ argument '%s'. Should be an integer > 0", optarg);
 				break;
 
+   		case 'q':
+        skip_qcfail = 1;
+        break;
+
+   		case 'P':
+        check(sscanf(optarg, "%d/%d", &part_rem, &part_mod)==2, "Error parsing -P argument '%s'. Should be of the form rem/mod", optarg);
+        check(part_mod > 0 && part_rem >= 0 && part_rem < part_mod, "Error parsing -P argument '%s'. Requires 0 <= rem < mod", optarg);
+        break;
+
+   		case 'S':
+        shard_out = optarg;
+        break;
+
+   		case 'm':
+        shard_in = realloc(shard_in, sizeof(char *) * (shard_in_size+1));
+        check_mem(shard_in);
+        shard_in[shard_in_size++] = optarg;
+        break;
+
+   		case 'C':
+        coverage_out = optarg;
+        break;
+
+   		case 'H':
+        depth_hist_out = optarg;
+        break;
+
+   		case 't':
+        target_file = optarg;
+        break;
+
+   		case 's':
+        check(sscanf(optarg, "%lf", &sample_fraction)==1, "Error parsing -s argument '%s'. Should be a number", optarg);
+        check(sample_fraction > 0 && sample_fraction < 1, "Error parsing -s argument '%s'. Requires 0 < fraction < 1", optarg);
+        break;
+
+   		case 'E':
+        estimate_out = optarg;
+        break;
+
+   		case 'O':
+        output_dir = optarg;
+        break;
+
+   		case 'T':
+        passthrough = 1;
+        break;
+
+   		case 'j':
+        check(sscanf(optarg, "%i", &max_open)==1 && max_open > 0, "Error parsing -j argument '%s'. Should be an integer > 0", optarg);
+        break;
+
    		case 'h':
         print_usage(0);
         break;
@@ -131,19 +285,119 @@ int options(int argc, char *argv[]){
 
    }//End of iteration through options
 
+   //-R overrides $PCAP_READAHEAD
+   if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
+
    //Do some checking to ensure required arguments were passed and are accessible files
-   if (input_file==NULL || strcmp(input_file,"/dev/stdin")==0) {
+   if(rna_trim_set && !rna){
+     printf("Insert size trimming (-D/-I) only applies to the RNA method (-a).\n");
+     print_usage(1);
+   }
+   if(input_files_size > 1 || output_dir){
+     if(output_dir == NULL){
+       printf("More than one input (-i) requires an output directory (-O).\n");
+       print_usage(1);
+     }
+     if(check_exist(output_dir) != 1){
+       printf("Output directory (-O) %s does not exist.\n",output_dir);
+       print_usage(1);
+     }
+     if(output_file || passthrough || shard_out || shard_in_size > 0 || part_mod > 0
+          || coverage_out || depth_hist_out || sample_fraction > 0){
+       printf("Output directory (-O) can't be combined with -o, -T, -S, -m, -P, -C, -H or -s.\n");
+       print_usage(1);
+     }
+     int i=0, j=0;
+     for(i=0;i<input_files_size;i++){
+       if(check_exist(input_files[i]) != 1){
+         printf("Input file (-i) %s does not exist.\n",input_files[i]);
+         print_usage(1);
+       }
+       for(j=0;j<i;j++){
+         if(strcmp(multi_basename(input_files[i]),multi_basename(input_files[j])) == 0){
+           printf("Inputs (-i) %s and %s would write the same .bas in the output directory (-O).\n",input_files[j],input_files[i]);
+           print_usage(1);
+         }
+       }
+     }
+     if(ref_file && check_exist(ref_file) != 1){
+       printf("Reference fasta index file (-r) %s does not exist.\n",ref_file);
+       print_usage(1);
+     }
+     return 0;
+   }
+   if (input_file==NULL && shard_in_size > 0) {
+     // merging shards only, no reads to process
+   } else if (input_file==NULL || strcmp(input_file,"/dev/stdin")==0) {
     input_file = "-";   // htslib recognises this as a special case
    }
-   if (strcmp(input_file,"-") != 0) {
+   if (input_file && strcmp(input_file,"-") != 0) {
      if(check_exist(input_file) != 1){
    	  printf("Input file (-i) %s does not exist.\n",input_file);
    	  print_usage(1);
      }
    }
-   if (output_file==NULL || strcmp(output_file,"/dev/stdout")==0) {
+   if(part_mod > 0 && (input_file == NULL || strcmp(input_file,"-") == 0)){
+     printf("Partitioning (-P) requires an indexed input file (-i).\n");
+     print_usage(1);
+   }
+   if((coverage_out || depth_hist_out) && (input_file == NULL || part_mod > 0)){
+     printf("Coverage (-C/-H) requires all reads of the input (-i), it can't be used with -P or shards only.\n");
+     print_usage(1);
+   }
+   if(passthrough){
+     if(input_file == NULL){
+       printf("Passthrough (-T) requires reads to process (-i or stdin).\n");
+       print_usage(1);
+     }
+     if(output_file == NULL && shard_out == NULL){
+       printf("Passthrough (-T) writes the input to stdout, the .bas must be written to a file (-o).\n");
+       print_usage(1);
+     }
+     if(part_mod > 0 || sample_fraction > 0){
+       printf("Passthrough (-T) reads the whole input, it can't be combined with -P or -s.\n");
+       print_usage(1);
+     }
+   }
+   if(sample_fraction > 0){
+     if(input_file == NULL || strcmp(input_file,"-") == 0){
+       printf("Sampling (-s) requires an indexed input file (-i).\n");
+       print_usage(1);
+     }
+     if(part_mod > 0 || shard_in_size > 0 || shard_out || coverage_out || depth_hist_out){
+       printf("Sampling (-s) can't be combined with -P, -m, -S, -C or -H.\n");
+       print_usage(1);
+     }
+   }else if(estimate_out){
+     printf("Estimates (-E) only apply to sampling (-s).\n");
+     print_usage(1);
+   }
+   if(target_file){
+     if(coverage_out == NULL && depth_hist_out == NULL){
+       printf("Targets (-t) only apply to coverage (-C/-H).\n");
+       print_usage(1);
+     }
+     if(check_exist(target_file) != 1){
+       printf("Target file (-t) %s does not exist.\n",target_file);
+       print_usage(1);
+     }
+   }
+   int i=0;
+   for(i=0;i<shard_in_size;i++){
+     if(check_exist(shard_in[i]) != 1){
+       printf("Stats shard (-m) %s does not exist.\n",shard_in[i]);
+       print_usage(1);
+     }
+   }
+   if (output_file==NULL && shard_out != NULL) {
+     // shard only
+   } else if (output_file==NULL || strcmp(output_file,"/dev/stdout")==0) {
     output_file = "-";   // we recognise this as a special case
    }
+   if(passthrough && output_file && strcmp(output_file,"-") == 0){
+     printf("Passthrough (-T) writes the input to stdout, the .bas must be written to a file (-o).\n");
+     print_usage(1);
+   }
    if(ref_file){
      if(check_exist(ref_file) != 1){
       printf("Reference fasta index file (-r) %s does not exist.\n",ref_file);
@@ -156,55 +410,334 @@ error:
 	return 1;
 }
 
+typedef struct {
+  pthread_mutex_t lock;
+  int next;        // next input to start
+  int *status;     // per input, 0 on success
+  htsThreadPool *pool;
+} multi_queue_t;
+
+/*
+ * Stats for one input of a multi-input run, the BGZF/CRAM decode is done by
+ * the pool shared with the other open inputs.
+ */
+static int multi_stats_one(const char *file, htsThreadPool *pool){
+  htsFile *input = NULL;
+  bam_hdr_t *head = NULL;
+  bam1_t *b = NULL;
+  pcap_stats_t *st = NULL;
+  char *out = NULL;
+
+  input = hfile_readahead_hts_open(file, readahead);
+  check(input != NULL, "Error opening hts file for reading '%s'.",file);
+  check(set_reference(input) == 0, "Error setting reference '%s' for '%s'.", ref_file, file);
+  head = sam_hdr_read(input);
+  check(head != NULL, "Error reading header from opened hts file '%s'.",file);
+  if(pool->pool) hts_set_opt(input, HTS_OPT_THREAD_POOL, pool);
+
+  st = pcap_stats_init(head, (rna ? PCAP_STATS_RNA : 0) | (skip_qcfail ? PCAP_STATS_SKIP_QCFAIL : 0));
+  check(st != NULL, "Error fetching read groups from header of '%s'.",file);
+  if(rna) pcap_stats_set_rna_trim(st, rna_sd, rna_iter);
+  b = bam_init1();
+  check_mem(b);
+  int ret;
+  while((ret = sam_read1(input, head, b)) >= 0){
+    check(pcap_stats_add(st, b) == 0, "Error processing reads in '%s'.",file);
+  }
+  check(ret == -1, "Error reading input file '%s'.",file);
+
+  const char *base = multi_basename(file);
+  out = malloc(strlen(output_dir) + strlen(base) + strlen("/.bas") + 1);
+  check_mem(out);
+  sprintf(out, "%s/%s.bas", output_dir, base);
+  check(pcap_stats_write_bas(st, file, out) == 0, "Error writing bam_stats output to '%s'.",out);
+
+  free(out);
+  bam_destroy1(b);
+  pcap_stats_destroy(st);
+  bam_hdr_destroy(head);
+  check(hts_close(input) == 0, "Error closing '%s'.",file);
+  return 0;
+
+error:
+  if(out) free(out);
+  if(b) bam_destroy1(b);
+  pcap_stats_destroy(st);
+  if(head) bam_hdr_destroy(head);
+  if(input) hts_close(input);
+  return -1;
+}
+
+static void *multi_worker(void *arg){
+  multi_queue_t *queue = (multi_queue_t *) arg;
+  while(1){
+    pthread_mutex_lock(&queue->lock);
+    int i = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if(i >= input_files_size) break;
+    queue->status[i] = multi_stats_one(input_files[i], queue->pool);
+  }
+  return NULL;
+}
+
+// Each worker holds one input open at a time, so at most max_open inputs are open.
+static int multi_stats(void){
+  htsThreadPool p = {NULL, 0};
+  pthread_t *threads = NULL;
+  multi_queue_t queue;
+  int n_threads = 0;
+  int failed = 0;
+  int i=0;
+
+  memset(&queue, 0, sizeof(queue));
+  pthread_mutex_init(&queue.lock, NULL);
+  queue.pool = &p;
+  queue.status = calloc(input_files_size, sizeof(int));
+  check_mem(queue.status);
+  if (nthreads > 0) {
+    p.pool = hts_tpool_init(nthreads);
+    check(p.pool != NULL, "Error creating thread pool");
+  }
+
+  int workers = max_open < input_files_size ? max_open : input_files_size;
+  threads = malloc(sizeof(pthread_t) * workers);
+  check_mem(threads);
+  for(n_threads=0;n_threads<workers;n_threads++){
+    check(pthread_create(&threads[n_threads], NULL, multi_worker, &queue) == 0, "Error starting worker thread.");
+  }
+  for(i=0;i<n_threads;i++) pthread_join(threads[i], NULL);
+  n_threads = 0;
+
+  for(i=0;i<input_files_size;i++){
+    if(queue.status[i] != 0){
+      log_err("Failed to generate stats for '%s'.", input_files[i]);
+      failed++;
+    }
+  }
+  check(failed == 0, "%d of %d inputs failed.", failed, input_files_size);
+
+  free(threads);
+  free(queue.status);
+  pthread_mutex_destroy(&queue.lock);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return 0;
+
+error:
+  // let started workers finish, they only stop once the queue is drained
+  for(i=0;i<n_threads;i++) pthread_join(threads[i], NULL);
+  if(threads) free(threads);
+  if(queue.status) free(queue.status);
+  pthread_mutex_destroy(&queue.lock);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return -1;
+}
+
 int main(int argc, char *argv[]){
 	int err = options(argc, argv);
 	check(err==0,"Error parsing options");
+  if(ref_file && ref_cache_is_cache(ref_file)){
+    check(ref_cache_export(ref_file) == 0, "Error exporting reference cache '%s'.", ref_file);
+  }
+  if(output_dir){
+    err = multi_stats();
+    if(input_files) free(input_files);
+    return err == 0 ? 0 : 1;
+  }
 	htsFile *input = NULL;
 	bam_hdr_t *head = NULL;
   rg_info_t **grps = NULL;
+  bam1_t *b = NULL;
+  xam_part_t *part = NULL;
+  target_index_t *ti = NULL;
+  coverage_window_t *cw = NULL;
+  xam_sample_t *smp = NULL;
+  hFILE *tee = NULL;
+  FILE *est = NULL;
+  char *est_file = NULL;
 	htsThreadPool p = {NULL, 0};
-  //Open bam file as object
-  input = hts_open(input_file,"r");
-  check(input != NULL, "Error opening hts file for reading '%s'.",input_file);
+  int i=0;
+
+  if(input_file){
+    //Open bam file as object
+    if(passthrough){
+      hFILE *hin = hopen(input_file,"r");
+      check(hin != NULL, "Error opening '%s' for reading.",input_file);
+      // stdin is never wrapped, as hfile_readahead_hts_open
+      if(readahead && strcmp(input_file,"-") != 0){
+        hFILE *ra = hfile_readahead_wrap(hin, readahead);
+        if(ra == NULL) hclose(hin);
+        check(ra != NULL, "Error adding readahead to '%s'.",input_file);
+        hin = ra;
+      }
+      hFILE *hcopy = hopen("-","w");
+      if(hcopy == NULL) hclose(hin);
+      check(hcopy != NULL, "Error opening stdout for passthrough.");
+      tee = hfile_tee_wrap(hin, hcopy);
+      if(tee == NULL){
+        hclose(hin);
+        hclose(hcopy);
+      }
+      check(tee != NULL, "Error creating passthrough of '%s'.",input_file);
+      input = hts_hopen(tee, input_file, "r");
+      if(input == NULL) hclose(tee);
+      tee = input ? tee : NULL;
+    }else{
+      input = hfile_readahead_hts_open(input_file, readahead);
+    }
+    check(input != NULL, "Error opening hts file for reading '%s'.",input_file);
+
+    //Set reference index file
+    if(ref_file){
+      check(set_reference(input) == 0, "Error setting reference '%s'.", ref_file);
+    }else{
+      if(input->format.format == cram) log_warn("No reference file provided for a cram input file, if the reference described in the cram header can't be located bam_stats may fail.");
+    }
+
+    //Read header from bam file
+    head = sam_hdr_read(input);
+    check(head != NULL, "Error reading header from opened hts file '%s'.",input_file);
+
+  	// Create and share the thread pool
+  	if (nthreads > 0) {
+  			p.pool = hts_tpool_init(nthreads);
+  			check(p.pool != NULL, "Error creating thread pool");
+  			hts_set_opt(input,  HTS_OPT_THREAD_POOL, &p);
+  	}
+
+    grps = bam_access_parse_header(head, &grps_size, &grp_stats);
+    check(grps != NULL, "Error fetching read groups from header.");
+  }
 
-  //Set reference index file
-  if(ref_file){
-    hts_set_fai_filename(input, ref_file);
-  }else{
-    if(input->format.format == cram) log_warn("No reference file provided for a cram input file, if the reference described in the cram header can't be located bam_stats may fail.");
+  for(i=0;i<shard_in_size;i++){
+    int res = bam_stats_shard_merge(shard_in[i],&grps,&grps_size,&grp_stats);
+    check(res==0,"Error merging stats shard %s.",shard_in[i]);
   }
 
-  //Read header from bam file
-  head = sam_hdr_read(input);
-  check(head != NULL, "Error reading header from opened hts file '%s'.",input_file);
+  if(input_file && shard_in_size > 0){
+    // Shards were collected before duplicate marking, take only the duplicate counts from the input
+    for(i=0;i<grps_size;i++){
+      grp_stats[i][0]->dups = 0;
+      grp_stats[i][1]->dups = 0;
+    }
+    if(input->format.format == cram){
+      int fields = SAM_FLAG | SAM_RGAUX;
+      if(coverage_out || depth_hist_out) fields |= SAM_RNAME | SAM_POS | SAM_CIGAR;
+      hts_set_opt(input, CRAM_OPT_REQUIRED_FIELDS, fields);
+    }
+  }
 
-	// Create and share the thread pool
-	if (nthreads > 0) {
-			p.pool = hts_tpool_init(nthreads);
-			check(p.pool != NULL, "Error creating thread pool");
-			hts_set_opt(input,  HTS_OPT_THREAD_POOL, &p);
-	}
+  if(coverage_out || depth_hist_out){
+    if(target_file){
+      ti = target_index_load(target_file, target_index_is_gff(target_file), NULL);
+      check(ti != NULL, "Error loading targets from '%s'.", target_file);
+    }
+    cw = coverage_window_init(head, ti);
+    check(cw != NULL, "Error creating coverage window.");
+  }
 
-  grps = bam_access_parse_header(head, &grps_size, &grp_stats);
-  check(grps != NULL, "Error fetching read groups from header.");
+  if(input_file){
+    if(part_mod > 0){
+      part = xam_part_init(input, head, input_file, part_rem, part_mod);
+      check(part != NULL, "Error partitioning input file '%s'.", input_file);
+    }
+    if(sample_fraction > 0){
+      smp = xam_sample_init(input, head, input_file, sample_fraction);
+      check(smp != NULL, "Error setting up sampling of input file '%s'.", input_file);
+    }
+    b = bam_init1();
+    check_mem(b);
+    int ret;
+    while((ret = smp ? xam_sample_next(input, smp, b) : part ? xam_part_next(input, part, b) : sam_read1(input, head, b)) >= 0){
+      if(cw) check(coverage_window_add(cw, b) == 0, "Error adding read to coverage, input must be coordinate sorted.");
+      if(skip_qcfail && b->core.flag & BAM_FQCFAIL) continue;
+      int res;
+      if(shard_in_size > 0){
+        res = bam_access_count_dup(b, grps, grps_size, grp_stats, rna);
+      }else{
+        res = bam_access_process_read(b, grps, grps_size, grp_stats, rna);
+      }
+      check(res==0,"Error processing reads in bam file.");
+      if(smp) check(xam_sample_tally(smp, b, rna)==0,"Error recording sampled read.");
+    }
+    check(ret == -1,"Error reading input file '%s'.",input_file);
+    bam_destroy1(b);
+    b = NULL;
+    if(tee){
+      // the copy is complete, let the next process see the end of its input now
+      check(hfile_tee_drain(tee) == 0, "Error forwarding the end of '%s'.",input_file);
+      int closed = hts_close(input);
+      input = NULL;
+      tee = NULL;
+      check(closed == 0, "Error closing passthrough of '%s'.",input_file);
+    }
+  }
 
-  //Process every read in bam file.
-  int check = bam_access_process_reads(input,head,grps, grps_size, &grp_stats, rna);
-  check(check==0,"Error processing reads in bam file.");
+  if(smp){
+    check(xam_sample_scale(smp) > 0, "No reads were sampled from '%s', increase the sample fraction (-s).", input_file);
+    xam_sample_scale_stats(smp, grps_size, grp_stats);
+    if(estimate_out){
+      est_file = strdup(estimate_out);
+    }else if(strcmp(output_file,"-") != 0){
+      est_file = malloc(strlen(output_file) + strlen(".estimate") + 1);
+      check_mem(est_file);
+      sprintf(est_file, "%s.estimate", output_file);
+    }
+    if(est_file){
+      est = fopen(est_file, "w");
+      check(est != NULL, "Error opening estimates file '%s' for writing.", est_file);
+    }
+    check(xam_sample_write_estimates(smp, est ? est : stderr) == 0, "Error writing estimates.");
+    if(est) check(fclose(est) == 0, "Error closing estimates file '%s'.", est_file);
+    est = NULL;
+    log_info("Output is estimated from a sample of '%s', see the confidence intervals in %s.", input_file, est_file ? est_file : "the log");
+  }
 
-  int res = bam_stats_output_print_results(grps,grps_size,grp_stats,input_file,output_file);
-  check(res==0,"Error writing bam_stats output to file.");
+  if(cw){
+    check(coverage_window_finish(cw) == 0, "Error finishing coverage.");
+    check(coverage_window_write(cw, coverage_out, depth_hist_out) == 0, "Error writing coverage.");
+  }
 
-  bam_hdr_destroy(head);
-  hts_close(input);
+  if(shard_out){
+    int res = bam_stats_shard_write(grps,grps_size,grp_stats,shard_out);
+    check(res==0,"Error writing stats shard %s.",shard_out);
+  }
+
+  if(output_file){
+    int res;
+    if(rna){
+      res = bam_stats_output_print_results_trimmed(grps,grps_size,grp_stats,input_file ? input_file : output_file,output_file,rna_sd,rna_iter);
+    }else{
+      res = bam_stats_output_print_results(grps,grps_size,grp_stats,input_file ? input_file : output_file,output_file);
+    }
+    check(res==0,"Error writing bam_stats output to file.");
+  }
+
+  xam_part_destroy(part);
+  xam_sample_destroy(smp);
+  if(est_file) free(est_file);
+  coverage_window_destroy(cw);
+  target_index_destroy(ti);
+  if(head) bam_hdr_destroy(head);
+  if(input) hts_close(input);
 	if (p.pool) hts_tpool_destroy(p.pool);
+  if(shard_in) free(shard_in);
+  if(input_files) free(input_files);
 
   return 0;
 
   error:
+    if(b) bam_destroy1(b);
+    xam_part_destroy(part);
+    xam_sample_destroy(smp);
+    if(est) fclose(est);
+    if(est_file) free(est_file);
+    coverage_window_destroy(cw);
+    target_index_destroy(ti);
     if(grps) free(grps);
     if(head) bam_hdr_destroy(head);
     if(input) hts_close(input);
 		if (p.pool) hts_tpool_destroy(p.pool);
+    if(shard_in) free(shard_in);
+    if(input_files) free(input_files);
     return 1;
 }
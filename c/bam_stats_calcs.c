@@ -104,8 +104,101 @@ int bam_stats_calcs_calculate_mean_sd_median_insert_size(khash_t(ins) *inserts,d
         *sd = 0;
       }
 
-      kh_destroy(ins, inserts);
-
     } //End of if we have data to calculate from.
+  free(insert_bins);
+  return 0;
+}
+
+// Mean, SD and median of the sorted bins with lo <= size <= hi, returns the number of inserts used.
+static uint64_t bins_summary(const uint64_t *keys, const uint64_t *vals, int n, double lo, double hi,
+                              double *mean, double *sd, double *median){
+  uint64_t total = 0;
+  double sum = 0;
+  int j=0;
+  for(j=0;j<n;j++){
+    if(keys[j] < lo || keys[j] > hi) continue;
+    total += vals[j];
+    sum += (double) keys[j] * vals[j];
+  }
+  if(total == 0) return 0;
+  *mean = sum / total;
+
+  double ss = 0;
+  for(j=0;j<n;j++){
+    if(keys[j] < lo || keys[j] > hi) continue;
+    double diff = (double) keys[j] - *mean;
+    ss += diff * diff * vals[j];
+  }
+  *sd = sqrt(ss / total);
+
+  // same rule as the untrimmed median, the middle pair may straddle two bins
+  uint64_t midpoint2 = total / 2;
+  uint64_t midpoint = midpoint2 + 1;
+  uint64_t running_total = 0;
+  uint64_t prev_insert = 0;
+  uint64_t insert = 0;
+  uint64_t current_bin_count = 0;
+  for(j=0;j<n;j++){
+    if(keys[j] < lo || keys[j] > hi) continue;
+    insert = keys[j];
+    current_bin_count = vals[j];
+    running_total += vals[j];
+    if(running_total >= midpoint) break;
+    prev_insert = insert;
+  }
+  if(total % 2 == 0 && running_total - midpoint2 >= current_bin_count){
+    *median = ((double) insert + (double) prev_insert) / 2;
+  }else{
+    *median = (double) insert;
+  }
+  return total;
+}
+
+int bam_stats_calcs_calculate_trimmed_insert_size(khash_t(ins) *inserts, double sd_mult, int iterations,
+                                                  double *mean, double *sd, double *median){
+  uint64_t *keys = NULL;
+  uint64_t *vals = NULL;
+  khint_t k;
+  int n = kh_size(inserts);
+  int i=0;
+
+  *mean = 0;
+  *sd = 0;
+  *median = 0;
+  if(n == 0) return 0;
+
+  keys = malloc(sizeof(uint64_t) * n);
+  vals = malloc(sizeof(uint64_t) * n);
+  check_mem(keys);
+  check_mem(vals);
+  for(k=kh_begin(inserts); k!=kh_end(inserts); ++k){
+    if(kh_exist(inserts,k)) keys[i++] = kh_key(inserts,k);
+  }
+  qsort(keys, n, sizeof(uint64_t), compare);
+  for(i=0;i<n;i++) vals[i] = kh_val(inserts, kh_get(ins, inserts, keys[i]));
+
+  double lo = 0;
+  double hi = HUGE_VAL;
+  bins_summary(keys, vals, n, lo, hi, mean, sd, median);
+  for(i=0;i<iterations;i++){
+    double new_lo = *mean - sd_mult * *sd;
+    double new_hi = *mean + sd_mult * *sd;
+    if(new_lo == lo && new_hi == hi) break;
+    double t_mean, t_sd, t_median;
+    if(bins_summary(keys, vals, n, new_lo, new_hi, &t_mean, &t_sd, &t_median) == 0) break;
+    lo = new_lo;
+    hi = new_hi;
+    *mean = t_mean;
+    *sd = t_sd;
+    *median = t_median;
+  }
+
+  free(keys);
+  free(vals);
   return 0;
-}
\ No newline at end of file
+
+error:
+  if(keys) free(keys);
+  if(vals) free(vals);
+  return -1;
+}
@@ -24,4 +24,16 @@
 
 int bam_stats_calcs_calculate_mean_sd_median_insert_size(khash_t(ins) *inserts,double *mean, double *sd, double *median);
 
+#define BAM_STATS_RNA_SD 2.0
+#define BAM_STATS_RNA_ITERATIONS 1
+
+/*
+ * RNA insert size summary: after the untrimmed mean and SD, each iteration drops the
+ * sizes outside mean +/- sd_mult*SD and recalculates mean, SD and median from the rest.
+ * Stops early when the bounds stop changing, or would remove every insert.
+ * iterations 0 gives the untrimmed values.
+ */
+int bam_stats_calcs_calculate_trimmed_insert_size(khash_t(ins) *inserts, double sd_mult, int iterations,
+                                                  double *mean, double *sd, double *median);
+
 #endif
\ No newline at end of file
@@ -27,7 +27,9 @@ static char *bas_header = "bam_filename\tsample\tplatform\tplatform_unit\tlibrar
 static char *rg_line_pattern = "%s\t%s\t%s\t%s\t%s\t%s\t%"PRIu32"\t%"PRIu32"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%.3f\t%.3f\t%.3f\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\n";
 
 
-int bam_stats_output_print_results(rg_info_t **grps,int grps_size,stats_rd_t*** grp_stats,char *input_file,char *output_file){
+// trim is 0 for the untrimmed (DNA) insert size summary
+static int print_results(rg_info_t **grps,int grps_size,stats_rd_t*** grp_stats,char *input_file,char *output_file,
+                          int trim,double sd_mult,int iterations){
   FILE *out = NULL;
   check(output_file != NULL, "Output file was NULL");
   if (strcmp(output_file,"-")==0) {
@@ -93,7 +95,12 @@ int bam_stats_output_print_results(rg_info_t **grps,int grps_size,stats_rd_t***
       divergent_bases_r2 = grp_stats[i][1]->divergent;
       divergent_bases = grp_stats[i][0]->divergent + grp_stats[i][1]->divergent;
 
-      bam_stats_calcs_calculate_mean_sd_median_insert_size(grp_stats[i][0]->inserts,&mean_insert_size,&insert_size_sd,&median_insert_size);
+      if(trim){
+        check(bam_stats_calcs_calculate_trimmed_insert_size(grp_stats[i][0]->inserts,sd_mult,iterations,
+                &mean_insert_size,&insert_size_sd,&median_insert_size)==0,"Error calculating trimmed insert size.");
+      }else{
+        bam_stats_calcs_calculate_mean_sd_median_insert_size(grp_stats[i][0]->inserts,&mean_insert_size,&insert_size_sd,&median_insert_size);
+      }
       dup_reads = grp_stats[i][0]->dups + grp_stats[i][1]->dups;
     }
 
@@ -150,3 +157,12 @@ error:
   return -1;
 
 }
+
+int bam_stats_output_print_results(rg_info_t **grps,int grps_size,stats_rd_t*** grp_stats,char *input_file,char *output_file){
+  return print_results(grps,grps_size,grp_stats,input_file,output_file,0,0,0);
+}
+
+int bam_stats_output_print_results_trimmed(rg_info_t **grps,int grps_size,stats_rd_t*** grp_stats,char *input_file,char *output_file,
+                                            double sd_mult,int iterations){
+  return print_results(grps,grps_size,grp_stats,input_file,output_file,1,sd_mult,iterations);
+}
@@ -24,4 +24,8 @@
 
 int bam_stats_output_print_results(rg_info_t **grps,int grps_size,stats_rd_t*** grp_stats,char *input_file,char *output_file);
 
+// As bam_stats_output_print_results, insert size from bam_stats_calcs_calculate_trimmed_insert_size (RNA).
+int bam_stats_output_print_results_trimmed(rg_info_t **grps,int grps_size,stats_rd_t*** grp_stats,char *input_file,char *output_file,
+                                            double sd_mult,int iterations);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,220 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "bam_stats_shard.h"
+#include "stats_arena.h"
+
+#define SHARD_VERSION 1
+#define SHARD_LINE_MAX 4096
+
+static char *shard_magic = "#bam_stats_shard";
+static char *shard_rd_pattern = "R\t%d\t%"PRIu32"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\t%"PRIu64"\n";
+static char *shard_rd_scan = "R\t%d\t%"SCNu32"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64"\t%"SCNu64;
+
+int bam_stats_shard_write(rg_info_t **grps, int grps_size, stats_rd_t ***grp_stats, const char *file){
+  FILE *out = NULL;
+  check(file != NULL, "Shard file was NULL");
+  out = fopen(file,"w");
+  check(out != NULL, "Error trying to open shard file %s for writing.",file);
+  check(fprintf(out,"%s\t%d\n",shard_magic,SHARD_VERSION) > 0, "Error writing shard header to %s.",file);
+
+  int i=0;
+  for(i=0;i<grps_size;i++){
+    check(fprintf(out,"RG\t%s\t%s\t%s\t%s\t%s\n",grps[i]->id,grps[i]->sample,grps[i]->platform,grps[i]->platform_unit,grps[i]->lib) > 0,
+                    "Error writing RG line to shard %s.",file);
+    int rd=0;
+    for(rd=0;rd<2;rd++){
+      stats_rd_t *s = grp_stats[i][rd];
+      // pair level counts are only accumulated (and initialised) on read 1
+      uint64_t mapped_pairs = rd == 0 ? s->mapped_pairs : 0;
+      uint64_t inter_chr_pairs = rd == 0 ? s->inter_chr_pairs : 0;
+      check(fprintf(out,shard_rd_pattern,rd,s->length,s->count,s->dups,s->gc,s->umap,s->divergent,
+                      s->mapped_bases,s->proper,mapped_pairs,inter_chr_pairs,s->qc_fail) > 0,
+                      "Error writing read line to shard %s.",file);
+    }
+    khash_t(ins) *ins = grp_stats[i][0]->inserts;
+    khint_t k;
+    for(k=kh_begin(ins); k!=kh_end(ins); ++k){
+      if(!kh_exist(ins,k)) continue;
+      check(fprintf(out,"I\t%"PRIu32"\t%"PRIu64"\n",(uint32_t)kh_key(ins,k),kh_value(ins,k)) > 0,
+                      "Error writing insert line to shard %s.",file);
+    }
+  }
+  check(fclose(out)==0, "Error closing shard file %s.",file);
+  return 0;
+
+error:
+  if(out) fclose(out);
+  return -1;
+}
+
+static int add_group(char *fields[5], rg_info_t ***grps, int *grps_size, stats_rd_t ****grp_stats){
+  int size = *grps_size;
+  rg_info_t **new_grps = (rg_info_t **) realloc(*grps, sizeof(rg_info_t *) * (size+1));
+  check_mem(new_grps);
+  *grps = new_grps;
+
+  rg_info_t *rg = (rg_info_t *) malloc(sizeof(rg_info_t));
+  check_mem(rg);
+  rg->id = strdup(fields[0]);
+  rg->sample = strdup(fields[1]);
+  rg->platform = strdup(fields[2]);
+  rg->platform_unit = strdup(fields[3]);
+  rg->lib = strdup(fields[4]);
+  new_grps[size] = rg;
+
+  check(stats_arena_add(grp_stats, 1) == size, "Error allocating stats for RG %s.",fields[0]);
+
+  *grps_size = size+1;
+  return size;
+error:
+  return -1;
+}
+
+static void sum_rd_stats(stats_rd_t *s, const stats_rd_t *v, int rd){
+  if(s->length == 0) s->length = v->length;
+  s->count += v->count;
+  s->dups += v->dups;
+  s->gc += v->gc;
+  s->umap += v->umap;
+  s->divergent += v->divergent;
+  s->mapped_bases += v->mapped_bases;
+  s->proper += v->proper;
+  s->qc_fail += v->qc_fail;
+  if(rd == 0){
+    s->mapped_pairs += v->mapped_pairs;
+    s->inter_chr_pairs += v->inter_chr_pairs;
+  }
+}
+
+static int sum_insert(khash_t(ins) *inserts, uint32_t ins, uint64_t count){
+  int res;
+  khint_t k = kh_put(ins,inserts,ins,&res);
+  if(res < 0) return -1;
+  if(res){
+    kh_value(inserts,k) = count;
+  }else{
+    kh_value(inserts,k) += count;
+  }
+  return 0;
+}
+
+static int find_group(const char *id, rg_info_t **grps, int grps_size){
+  int i=0;
+  for(i=0;i<grps_size;i++){
+    if(strcmp(grps[i]->id,id)==0) return i;
+  }
+  return -1;
+}
+
+int bam_stats_shard_merge(const char *file, rg_info_t ***grps, int *grps_size, stats_rd_t ****grp_stats){
+  FILE *in = NULL;
+  char line[SHARD_LINE_MAX];
+  int version = 0;
+  int rg_index = -1;
+  int line_no = 0;
+
+  check(file != NULL, "Shard file was NULL");
+  in = fopen(file,"r");
+  check(in != NULL, "Error trying to open shard file %s for reading.",file);
+
+  while(fgets(line,SHARD_LINE_MAX,in) != NULL){
+    line_no++;
+    size_t len = strlen(line);
+    check(len > 0 && line[len-1] == '\n', "Line %d of shard %s is truncated or too long.",line_no,file);
+    line[len-1] = '\0';
+
+    if(line_no == 1){
+      char magic[32];
+      check(sscanf(line,"%31s\t%d",magic,&version)==2 && strcmp(magic,shard_magic)==0,
+                "File %s is not a bam_stats shard.",file);
+      check(version == SHARD_VERSION, "Unsupported shard version %d in %s.",version,file);
+      continue;
+    }
+
+    if(strncmp(line,"RG\t",3)==0){
+      char *fields[5];
+      char *ptr = NULL;
+      int f = 0;
+      char *tok = strtok_r(line+3,"\t",&ptr);
+      while(tok != NULL && f<5){
+        fields[f++] = tok;
+        tok = strtok_r(NULL,"\t",&ptr);
+      }
+      check(f==5, "Malformed RG line %d in shard %s.",line_no,file);
+      rg_index = find_group(fields[0],*grps,*grps_size);
+      if(rg_index < 0){
+        rg_index = add_group(fields,grps,grps_size,grp_stats);
+        check(rg_index >= 0, "Error adding RG %s from shard %s.",fields[0],file);
+      }
+    }else if(strncmp(line,"R\t",2)==0){
+      check(rg_index >= 0, "Read line %d precedes any RG line in shard %s.",line_no,file);
+      int rd;
+      stats_rd_t v;
+      int got = sscanf(line,shard_rd_scan,&rd,&v.length,&v.count,&v.dups,&v.gc,&v.umap,&v.divergent,
+                        &v.mapped_bases,&v.proper,&v.mapped_pairs,&v.inter_chr_pairs,&v.qc_fail);
+      check(got==12 && (rd==0 || rd==1), "Malformed read line %d in shard %s.",line_no,file);
+      sum_rd_stats((*grp_stats)[rg_index][rd],&v,rd);
+    }else if(strncmp(line,"I\t",2)==0){
+      check(rg_index >= 0, "Insert line %d precedes any RG line in shard %s.",line_no,file);
+      uint32_t ins;
+      uint64_t count;
+      check(sscanf(line,"I\t%"SCNu32"\t%"SCNu64,&ins,&count)==2, "Malformed insert line %d in shard %s.",line_no,file);
+      check(sum_insert((*grp_stats)[rg_index][0]->inserts,ins,count)==0, "Error storing insert size from shard %s.",file);
+    }else{
+      sentinel("Unrecognised line %d in shard %s.",line_no,file);
+    }
+  }
+  check(line_no > 0, "Shard %s is empty.",file);
+  fclose(in);
+  return 0;
+
+error:
+  if(in) fclose(in);
+  return -1;
+}
+
+int bam_stats_shard_sum(rg_info_t **src_grps, int src_size, stats_rd_t ***src_stats,
+                          rg_info_t ***grps, int *grps_size, stats_rd_t ****grp_stats){
+  int i=0, rd=0;
+  for(i=0;i<src_size;i++){
+    int rg_index = find_group(src_grps[i]->id,*grps,*grps_size);
+    if(rg_index < 0){
+      char *fields[5] = {src_grps[i]->id, src_grps[i]->sample, src_grps[i]->platform, src_grps[i]->platform_unit, src_grps[i]->lib};
+      rg_index = add_group(fields,grps,grps_size,grp_stats);
+      check(rg_index >= 0, "Error adding RG %s.",src_grps[i]->id);
+    }
+    for(rd=0;rd<2;rd++) sum_rd_stats((*grp_stats)[rg_index][rd],src_stats[i][rd],rd);
+    khash_t(ins) *ins = src_stats[i][0]->inserts;
+    khint_t k;
+    for(k=kh_begin(ins); k!=kh_end(ins); ++k){
+      if(!kh_exist(ins,k)) continue;
+      check(sum_insert((*grp_stats)[rg_index][0]->inserts,kh_key(ins,k),kh_value(ins,k))==0,
+              "Error storing insert size for RG %s.",src_grps[i]->id);
+    }
+  }
+  return 0;
+error:
+  return -1;
+}
@@ -0,0 +1,55 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __bam_stats_shard_h__
+#define __bam_stats_shard_h__
+
+#include "bam_access.h"
+
+/*
+ * A stats shard is the raw (unsummarised) content of the per read group
+ * stats_rd_t stores, written as text so that the shards of independently
+ * processed parts of a run can be summed into one .bas file.
+ *
+ *   #bam_stats_shard <version>
+ *   RG <id> <sample> <platform> <platform_unit> <library>
+ *   R <0|1> <length> <count> <dups> <gc> <umap> <divergent> <mapped_bases> <proper> <mapped_pairs> <inter_chr_pairs> <qc_fail>
+ *   I <insert_size> <count>
+ *
+ * R and I lines belong to the preceding RG line, I lines are only recorded for read 1.
+ */
+
+int bam_stats_shard_write(rg_info_t **grps, int grps_size, stats_rd_t ***grp_stats, const char *file);
+
+/*
+ * Sums the content of a shard into grp_stats. Read groups not already present in
+ * grps are appended, so merging can start from an empty store (*grps_size == 0)
+ * or one populated from a header via bam_access_parse_header.
+ */
+int bam_stats_shard_merge(const char *file, rg_info_t ***grps, int *grps_size, stats_rd_t ****grp_stats);
+
+/*
+ * Sums in memory stores (from bam_access_parse_header or a merge) into grps/grp_stats,
+ * with the same read group handling as bam_stats_shard_merge.
+ */
+int bam_stats_shard_sum(rg_info_t **src_grps, int src_size, stats_rd_t ***src_stats,
+                          rg_info_t ***grps, int *grps_size, stats_rd_t ****grp_stats);
+
+#endif
@@ -0,0 +1,330 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+// Micro-benchmarks for the per-record kernels used by bam_stats and mismatchQc.
+// Records are synthetic 150bp pairs with the tag set bwa-mem and the PCAP
+// post-processing leave behind (RG, NM, MD, MC, AS, XS and occasionally mm).
+// Output is tab separated, one line per kernel:
+//   kernel  records  ns_per_record  records_per_sec
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dbg.h"
+#include "bam_access.h"
+#include "bam_stats_calcs.h"
+#include "mismatch_access.h"
+
+#define READ_LEN 150
+#define N_GROUPS 8
+
+static int n_records = 100000;
+static int n_rounds = 20;
+static unsigned int seed = 42;
+
+// sink for kernel results so the timed loops can't be optimised away
+static volatile uint64_t sink = 0;
+
+// mostly full length matches, with the clipping and indels seen in real data
+static const char *cigar_tmpls[] = {
+  "150M", "150M", "150M", "150M", "150M", "150M",
+  "75M2I73M", "60M3D90M", "20S130M", "140M10S", "30M1I50M2D69M",
+};
+
+void print_usage (int exit_code){
+  printf ("Usage: bam_kernels_bench [-n records] [-r rounds] [-s seed]\n\n");
+  printf ("-n --records   Number of synthetic records [%d].\n", n_records);
+  printf ("-r --rounds    Timed passes over the records per kernel [%d].\n", n_rounds);
+  printf ("-s --seed      Seed for record generation [%u].\n\n", seed);
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] = {
+    {"records", required_argument, 0, 'n'},
+    {"rounds", required_argument, 0, 'r'},
+    {"seed", required_argument, 0, 's'},
+    {"help", no_argument, 0, 'h'},
+    { NULL, 0, NULL, 0}
+  };
+
+  int iarg = 0;
+  while((iarg = getopt_long(argc, argv, "n:r:s:h", long_opts, NULL)) != -1){
+    switch(iarg){
+      case 'n':
+        n_records = atoi(optarg);
+        break;
+      case 'r':
+        n_rounds = atoi(optarg);
+        break;
+      case 's':
+        seed = (unsigned int) strtoul(optarg, NULL, 10);
+        break;
+      case 'h':
+        print_usage(0);
+        break;
+      case '?':
+        print_usage (1);
+        break;
+      default:
+        print_usage (1);
+    };
+  }
+  check(n_records > 0, "--records must be greater than 0.");
+  check(n_rounds > 0, "--rounds must be greater than 0.");
+  return 0;
+  error:
+    return 1;
+}
+
+static double rand_unit(){
+  return (double) rand() / ((double) RAND_MAX + 1.0);
+}
+
+static char rand_base(){
+  // ~41% GC, roughly human
+  double r = rand_unit();
+  if(r < 0.295) return 'A';
+  if(r < 0.5) return 'C';
+  if(r < 0.705) return 'G';
+  return 'T';
+}
+
+// Roughly normal insert size around 350bp
+static int32_t rand_insert(){
+  double s = 0;
+  int i;
+  for(i=0;i<12;i++) s += rand_unit();
+  return (int32_t) (350 + (s - 6.0) * 50);
+}
+
+static int parse_cigar(const char *str, uint32_t *cigar){
+  int n = 0;
+  while(*str){
+    char *end;
+    long len = strtol(str, &end, 10);
+    cigar[n++] = bam_cigar_gen(len, bam_cigar_table[(unsigned char) *end]);
+    str = end + 1;
+  }
+  return n;
+}
+
+// Build an MD string consistent with the cigar, returns the edit distance for NM.
+static int build_md(uint32_t *cigar, int n_cigar, char *md){
+  int nm = 0, run = 0, i, j;
+  char *p = md;
+  for(i=0;i<n_cigar;i++){
+    int op = bam_cigar_op(cigar[i]);
+    int len = bam_cigar_oplen(cigar[i]);
+    if(op == BAM_CMATCH){
+      for(j=0;j<len;j++){
+        if(rand_unit() < 0.01){
+          p += sprintf(p, "%d%c", run, rand_base());
+          run = 0;
+          nm++;
+        }else{
+          run++;
+        }
+      }
+    }else if(op == BAM_CDEL){
+      p += sprintf(p, "%d^", run);
+      for(j=0;j<len;j++) *p++ = rand_base();
+      run = 0;
+      nm += len;
+    }else if(op == BAM_CINS){
+      nm += len;
+    }
+  }
+  sprintf(p, "%d", run);
+  return nm;
+}
+
+static int make_record(bam1_t *b, int idx, char **rg_ids){
+  uint32_t cigar[16];
+  char seq[READ_LEN + 1], qual[READ_LEN], qname[64], md[READ_LEN * 4];
+  int i;
+
+  int n_cigar = parse_cigar(cigar_tmpls[rand() % (sizeof(cigar_tmpls) / sizeof(cigar_tmpls[0]))], cigar);
+  for(i=0;i<READ_LEN;i++){
+    seq[i] = rand_base();
+    qual[i] = 20 + rand() % 21;
+  }
+  seq[READ_LEN] = '\0';
+  int qname_len = sprintf(qname, "HX1_1234:5:%d:%d:%d", 1101 + idx % 24, idx, idx / 7);
+
+  uint16_t flag = BAM_FPAIRED | BAM_FPROPER_PAIR | (idx % 2 ? BAM_FREAD2 | BAM_FREVERSE : BAM_FREAD1 | BAM_FMREVERSE);
+  if(idx % 50 == 0) flag |= BAM_FDUP;
+  int32_t isize = rand_insert();
+  if(flag & BAM_FREVERSE) isize = -isize;
+  hts_pos_t pos = 10000 + (hts_pos_t) idx * 100;
+
+  check(bam_set1(b, qname_len, qname, flag, 0, pos, 60, n_cigar, cigar, 0, pos + isize, isize,
+                  READ_LEN, seq, qual, 256) >= 0, "Error building synthetic record %d.", idx);
+
+  int32_t nm = build_md(cigar, n_cigar, md);
+  int32_t as = READ_LEN - nm * 5;
+  int32_t xs = as / 2;
+  char *rg = rg_ids[idx % N_GROUPS];
+  check(bam_aux_append(b, "RG", 'Z', strlen(rg) + 1, (uint8_t *) rg) == 0, "Error appending RG.");
+  check(bam_aux_append(b, "NM", 'i', 4, (uint8_t *) &nm) == 0, "Error appending NM.");
+  check(bam_aux_append(b, "MD", 'Z', strlen(md) + 1, (uint8_t *) md) == 0, "Error appending MD.");
+  check(bam_aux_append(b, "MC", 'Z', 5, (uint8_t *) "150M") == 0, "Error appending MC.");
+  check(bam_aux_append(b, "AS", 'i', 4, (uint8_t *) &as) == 0, "Error appending AS.");
+  check(bam_aux_append(b, "XS", 'i', 4, (uint8_t *) &xs) == 0, "Error appending XS.");
+  if(idx % 20 == 0){
+    char yes = MM_YES;
+    check(bam_aux_append(b, MM_TAG, 'A', 1, (uint8_t *) &yes) == 0, "Error appending mm.");
+  }
+  return 0;
+  error:
+    return -1;
+}
+
+static double now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+static void report(const char *kernel, uint64_t records, double elapsed_ns){
+  double per = elapsed_ns / (double) records;
+  printf("%s\t%"PRIu64"\t%.2f\t%.0f\n", kernel, records, per, 1e9 / per);
+}
+
+int main(int argc, char *argv[]){
+  bam1_t **recs = NULL;
+  rg_info_t **grps = NULL;
+  char *rg_ids[N_GROUPS];
+  khash_t(ins) *inserts = NULL;
+  khash_t(ins) *hist = NULL;
+  int i, r;
+  double start;
+  uint64_t total;
+
+  for(i=0;i<N_GROUPS;i++) rg_ids[i] = NULL;
+  check(options(argc, argv) == 0, "Error parsing options.");
+  srand(seed);
+  total = (uint64_t) n_records * n_rounds;
+
+  recs = calloc(n_records, sizeof(bam1_t *));
+  check_mem(recs);
+  grps = calloc(N_GROUPS, sizeof(rg_info_t *));
+  check_mem(grps);
+  for(i=0;i<N_GROUPS;i++){
+    char id[32];
+    sprintf(id, "%d", 29976 + i);
+    rg_ids[i] = strdup(id);
+    check_mem(rg_ids[i]);
+    grps[i] = calloc(1, sizeof(rg_info_t));
+    check_mem(grps[i]);
+    grps[i]->id = rg_ids[i];
+  }
+  for(i=0;i<n_records;i++){
+    recs[i] = bam_init1();
+    check_mem(recs[i]);
+    check(make_record(recs[i], i, rg_ids) == 0, "Error generating records.");
+  }
+
+  printf("kernel\trecords\tns_per_record\trecords_per_sec\n");
+
+  start = now_ns();
+  for(r=0;r<n_rounds;r++)
+    for(i=0;i<n_records;i++) sink += bam_access_get_gc_count(recs[i]);
+  report("gc_count", total, now_ns() - start);
+
+  start = now_ns();
+  for(r=0;r<n_rounds;r++)
+    for(i=0;i<n_records;i++) sink += bam_access_get_mapped_base_count_from_cigar(recs[i]);
+  report("mapped_bases", total, now_ns() - start);
+
+  // as bam_access_process_read resolves it
+  start = now_ns();
+  for(r=0;r<n_rounds;r++){
+    for(i=0;i<n_records;i++){
+      char *rg = bam_aux2Z(bam_aux_get(recs[i], "RG"));
+      sink += get_rg_index_from_rg_store(grps, rg, N_GROUPS);
+    }
+  }
+  report("rg_lookup", total, now_ns() - start);
+
+  inserts = kh_init(ins);
+  check_mem(inserts);
+  start = now_ns();
+  for(r=0;r<n_rounds;r++){
+    for(i=0;i<n_records;i++){
+      check(bam_access_add_insert(inserts, llabs(recs[i]->core.isize)) == 0, "Error adding insert size.");
+    }
+  }
+  report("insert_add", total, now_ns() - start);
+
+  // The summary runs once per read group, so charge it to the records that built the histogram.
+  hist = kh_init(ins);
+  check_mem(hist);
+  for(i=0;i<n_records;i++){
+    check(bam_access_add_insert(hist, llabs(recs[i]->core.isize)) == 0, "Error adding insert size.");
+  }
+  start = now_ns();
+  for(r=0;r<n_rounds;r++){
+    double mean, sd, median;
+    check(bam_stats_calcs_calculate_mean_sd_median_insert_size(hist, &mean, &sd, &median) == 0, "Error calculating insert size summary.");
+    sink += (uint64_t) median;
+  }
+  report("insert_median", total, now_ns() - start);
+
+  start = now_ns();
+  for(r=0;r<n_rounds;r++)
+    for(i=0;i<n_records;i++) sink += (uint64_t) (infer_mis_match_rate(recs[i]) * 1000);
+  report("mismatch_rate", total, now_ns() - start);
+
+  start = now_ns();
+  for(r=0;r<n_rounds;r++)
+    for(i=0;i<n_records;i++) sink += check_mm_tag(recs[i]);
+  report("mm_tag", total, now_ns() - start);
+
+  kh_destroy(ins, inserts);
+  kh_destroy(ins, hist);
+  for(i=0;i<n_records;i++) bam_destroy1(recs[i]);
+  free(recs);
+  for(i=0;i<N_GROUPS;i++){
+    free(grps[i]);
+    free(rg_ids[i]);
+  }
+  free(grps);
+  return 0;
+
+  error:
+    if(inserts) kh_destroy(ins, inserts);
+    if(hist) kh_destroy(ins, hist);
+    if(recs){
+      for(i=0;i<n_records;i++) if(recs[i]) bam_destroy1(recs[i]);
+      free(recs);
+    }
+    if(grps){
+      for(i=0;i<N_GROUPS;i++) free(grps[i]);
+      free(grps);
+    }
+    for(i=0;i<N_GROUPS;i++) free(rg_ids[i]);
+    return 1;
+}
@@ -0,0 +1,259 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+// Throughput of hfile_readahead against the default hFILE buffering.
+// A file is read end to end by a consumer that pulls 16KB at a time and
+// spends a fixed CPU cost per KB, as BGZF decoding does. Each mode is run
+// on local storage and on a simulated slow store that adds a fixed latency
+// per request and caps bandwidth, the pattern of a busy network filesystem.
+// Output is tab separated, one line per storage/mode:
+//   storage  mode  buffer  megabytes  seconds  mb_per_sec
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hfile_backend.h"
+#include "dbg.h"
+#include "hfile_readahead.h"
+
+#define CONSUME_CHUNK 16384
+
+static int megabytes = 256;
+static char *buffer_opt = "16M";
+static int latency_us = 2000;
+static int bandwidth_mb = 500;
+static int consume_ns = 1000;
+static char *dir = "/tmp";
+
+// sink for consumed bytes so the read loops can't be optimised away
+static volatile uint64_t sink = 0;
+
+void print_usage (int exit_code){
+  printf ("Usage: hfile_readahead_bench [-m megabytes] [-b size] [-l us] [-w MB/s] [-c ns] [-d dir]\n\n");
+  printf ("-m --megabytes  Size of the file read [%d].\n", megabytes);
+  printf ("-b --buffer     Readahead buffer size [%s].\n", buffer_opt);
+  printf ("-l --latency    Simulated slow storage latency per request in microseconds [%d].\n", latency_us);
+  printf ("-w --bandwidth  Simulated slow storage bandwidth in MB/s [%d].\n", bandwidth_mb);
+  printf ("-c --consume    Consumer CPU cost per KB in nanoseconds [%d].\n", consume_ns);
+  printf ("-d --dir        Directory for the temporary file, put on the storage to measure [%s].\n\n", dir);
+  printf ("Other:\n");
+  printf ("-h --help       Display this usage information.\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] = {
+    {"megabytes", required_argument, 0, 'm'},
+    {"buffer", required_argument, 0, 'b'},
+    {"latency", required_argument, 0, 'l'},
+    {"bandwidth", required_argument, 0, 'w'},
+    {"consume", required_argument, 0, 'c'},
+    {"dir", required_argument, 0, 'd'},
+    {"help", no_argument, 0, 'h'},
+    { NULL, 0, NULL, 0}
+  };
+
+  int iarg = 0;
+  while((iarg = getopt_long(argc, argv, "m:b:l:w:c:d:h", long_opts, NULL)) != -1){
+    switch(iarg){
+      case 'm':
+        megabytes = atoi(optarg);
+        break;
+      case 'b':
+        buffer_opt = optarg;
+        break;
+      case 'l':
+        latency_us = atoi(optarg);
+        break;
+      case 'w':
+        bandwidth_mb = atoi(optarg);
+        break;
+      case 'c':
+        consume_ns = atoi(optarg);
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      case 'h':
+        print_usage(0);
+        break;
+      case '?':
+        print_usage (1);
+        break;
+      default:
+        print_usage (1);
+    };
+  }
+  check(megabytes > 0, "--megabytes must be greater than 0.");
+  check(latency_us >= 0, "--latency must not be negative.");
+  check(bandwidth_mb > 0, "--bandwidth must be greater than 0.");
+  check(consume_ns >= 0, "--consume must not be negative.");
+  return 0;
+  error:
+    return 1;
+}
+
+static double now_ns(){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+static void sleep_ns(double ns){
+  struct timespec ts;
+  ts.tv_sec = (time_t) (ns / 1e9);
+  ts.tv_nsec = (long) (ns - (double) ts.tv_sec * 1e9);
+  while(nanosleep(&ts, &ts) != 0 && errno == EINTR);
+}
+
+// Simulated slow storage, a plain fd whose requests pay latency and bandwidth
+typedef struct {
+  hFILE base;
+  int fd;
+} hFILE_slow;
+
+static ssize_t slow_read(hFILE *fpv, void *buffer, size_t nbytes){
+  hFILE_slow *fp = (hFILE_slow *) fpv;
+  ssize_t n = read(fp->fd, buffer, nbytes);
+  if(n > 0) sleep_ns(latency_us * 1e3 + (double) n * 1e3 / bandwidth_mb);
+  return n;
+}
+
+static ssize_t slow_write(hFILE *fpv, const void *buffer, size_t nbytes){
+  errno = EBADF;
+  return -1;
+}
+
+static off_t slow_seek(hFILE *fpv, off_t offset, int whence){
+  hFILE_slow *fp = (hFILE_slow *) fpv;
+  return lseek(fp->fd, offset, whence);
+}
+
+static int slow_flush(hFILE *fpv){
+  return 0;
+}
+
+static int slow_close(hFILE *fpv){
+  hFILE_slow *fp = (hFILE_slow *) fpv;
+  return close(fp->fd);
+}
+
+static const struct hFILE_backend slow_backend = {
+  slow_read, slow_write, slow_seek, slow_flush, slow_close
+};
+
+static hFILE *slow_open(const char *file){
+  hFILE_slow *fp = (hFILE_slow *) hfile_init(sizeof(hFILE_slow), "r", 0);
+  check(fp != NULL, "Error creating slow hFILE.");
+  fp->fd = open(file, O_RDONLY);
+  check(fp->fd >= 0, "Error opening %s.", file);
+  fp->base.backend = &slow_backend;
+  return &fp->base;
+  error:
+    if(fp) hfile_destroy(&fp->base);
+    return NULL;
+}
+
+static int write_file(const char *file, size_t bytes){
+  char *block = NULL;
+  FILE *out = NULL;
+  size_t i, done;
+  block = malloc(1 << 20);
+  check_mem(block);
+  for(i=0;i<(1 << 20);i++) block[i] = (char) rand();
+  out = fopen(file, "wb");
+  check(out != NULL, "Error creating %s.", file);
+  for(done=0;done<bytes;done+=(1 << 20)){
+    check(fwrite(block, 1, 1 << 20, out) == (1 << 20), "Error writing %s.", file);
+  }
+  check(fclose(out) == 0, "Error closing %s.", file);
+  free(block);
+  return 0;
+  error:
+    if(out) fclose(out);
+    free(block);
+    return -1;
+}
+
+// Reads hfp to the end, busy waiting consume_ns per KB to stand in for decoding
+static int consume(const char *storage, const char *mode, const char *buffer, hFILE *hfp, size_t bytes){
+  char chunk[CONSUME_CHUNK];
+  size_t total = 0;
+  ssize_t n;
+  check(hfp != NULL, "Error opening %s/%s input.", storage, mode);
+  double start = now_ns();
+  while((n = hread(hfp, chunk, sizeof(chunk))) > 0){
+    double until = now_ns() + (double) n * consume_ns / 1024;
+    sink += (unsigned char) chunk[n - 1];
+    while(now_ns() < until);
+    total += n;
+  }
+  double elapsed = (now_ns() - start) / 1e9;
+  check(n == 0, "Error reading %s/%s input.", storage, mode);
+  check(total == bytes, "%s/%s read %zu bytes, expected %zu.", storage, mode, total, bytes);
+  check(hclose(hfp) == 0, "Error closing %s/%s input.", storage, mode);
+  printf("%s\t%s\t%s\t%d\t%.3f\t%.1f\n", storage, mode, buffer, megabytes, elapsed, megabytes / elapsed);
+  return 0;
+  error:
+    if(hfp) hclose_abruptly(hfp);
+    return -1;
+}
+
+int main(int argc, char *argv[]){
+  char *file = NULL;
+  size_t ra_size = 0;
+  size_t bytes;
+  int fd = -1;
+
+  check(options(argc, argv) == 0, "Error parsing options.");
+  check(hfile_readahead_size(buffer_opt, &ra_size) == 0 && ra_size > 0, "Invalid --buffer '%s'.", buffer_opt);
+  bytes = (size_t) megabytes << 20;
+
+  file = malloc(strlen(dir) + 32);
+  check_mem(file);
+  sprintf(file, "%s/readahead_bench.XXXXXX", dir);
+  fd = mkstemp(file);
+  check(fd >= 0, "Error creating temporary file in %s.", dir);
+  close(fd);
+  check(write_file(file, bytes) == 0, "Error writing benchmark input.");
+
+  printf("storage\tmode\tbuffer\tmegabytes\tseconds\tmb_per_sec\n");
+  check(consume("local", "default", "-", hopen(file, "r"), bytes) == 0, "Error in local default run.");
+  check(consume("local", "readahead", buffer_opt, hfile_readahead_wrap(hopen(file, "r"), ra_size), bytes) == 0, "Error in local readahead run.");
+  check(consume("slow", "default", "-", slow_open(file), bytes) == 0, "Error in slow default run.");
+  check(consume("slow", "readahead", buffer_opt, hfile_readahead_wrap(slow_open(file), ra_size), bytes) == 0, "Error in slow readahead run.");
+
+  unlink(file);
+  free(file);
+  return 0;
+
+  error:
+    if(file){
+      unlink(file);
+      free(file);
+    }
+    return 1;
+}
@@ -0,0 +1,111 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+# End-to-end throughput of the C tools on xam_synth data.
+# Writes tab separated tool/format/threads/records/seconds/records_per_sec to stdout.
+
+usage () {
+  echo "Usage: $0 [-n pairs] [-t 'threads ...'] [-f 'bam cram'] [-s seed] [-w workdir] [-b bindir] [-r readahead]" 1>&2
+  exit $1
+}
+
+PAIRS=1000000
+THREADS="1 2 4"
+FORMATS="bam cram"
+SEED=1
+WORK_DIR=
+BIN_DIR=`dirname $0`/../../bin
+READAHEAD=
+
+while getopts "n:t:f:s:w:b:r:h" OPT; do
+  case $OPT in
+    n) PAIRS=$OPTARG ;;
+    t) THREADS=$OPTARG ;;
+    f) FORMATS=$OPTARG ;;
+    s) SEED=$OPTARG ;;
+    w) WORK_DIR=$OPTARG ;;
+    b) BIN_DIR=$OPTARG ;;
+    r) READAHEAD=$OPTARG ;;
+    h) usage 0 ;;
+    *) usage 1 ;;
+  esac
+done
+
+if [ -z "$WORK_DIR" ]; then
+  WORK_DIR=`mktemp -d`
+  trap "rm -rf $WORK_DIR" EXIT
+fi
+mkdir -p $WORK_DIR
+
+RECORDS=`expr $PAIRS \* 2`
+REF=$WORK_DIR/synth.fa
+
+# run_tool name format threads command...
+run_tool () {
+  TOOL=$1; FMT=$2; NT=$3
+  shift 3
+  START=`date +%s%N`
+  "$@" > $WORK_DIR/$TOOL.log 2>&1
+  if [ "$?" != "0" ]; then
+    echo "ERROR running $*, see below" 1>&2
+    cat $WORK_DIR/$TOOL.log 1>&2
+    exit 1
+  fi
+  END=`date +%s%N`
+  awk -v t=$TOOL -v f=$FMT -v n=$NT -v r=$RECORDS -v ns=`expr $END - $START` \
+    'BEGIN {s = ns / 1e9; printf "%s\t%s\t%d\t%d\t%.3f\t%.0f\n", t, f, n, r, s, r / s}'
+}
+
+# same seed for each format so every format holds the same records
+for FMT in $FORMATS; do
+  $BIN_DIR/xam_synth -o $WORK_DIR/synth.$FMT -O $FMT -R $REF -n $PAIRS -s $SEED -@ 4 \
+    -c chr1:50000000,chr2:30000000,chr3:20000000 2> $WORK_DIR/xam_synth.log
+  if [ "$?" != "0" ]; then
+    echo "ERROR generating $FMT input" 1>&2
+    cat $WORK_DIR/xam_synth.log 1>&2
+    exit 1
+  fi
+done
+
+printf "tool\tformat\tthreads\trecords\tseconds\trecords_per_sec\n"
+for FMT in $FORMATS; do
+  IN=$WORK_DIR/synth.$FMT
+  if [ "$FMT" = "cram" ]; then
+    STATS_REF="-r $REF.fai"
+    OUT_REF="-C -r $REF"
+    DIFF_REF="-r $REF"
+  else
+    STATS_REF=
+    OUT_REF=
+    DIFF_REF=
+  fi
+  for NT in $THREADS; do
+    run_tool bam_stats $FMT $NT $BIN_DIR/bam_stats -i $IN -o $WORK_DIR/out.bas -@ $NT $STATS_REF
+    if [ -n "$READAHEAD" ]; then
+      run_tool bam_stats_readahead $FMT $NT $BIN_DIR/bam_stats -R $READAHEAD -i $IN -o $WORK_DIR/out.bas -@ $NT $STATS_REF
+    fi
+    run_tool mismatchQc $FMT $NT $BIN_DIR/mismatchQc -i $IN -o $WORK_DIR/mm.$FMT -@ $NT $OUT_REF
+    run_tool mmFlagModifier $FMT $NT $BIN_DIR/mmFlagModifier -i $WORK_DIR/mm.$FMT -o $WORK_DIR/mmf.$FMT -m -@ $NT $OUT_REF
+    run_tool diff_bams $FMT $NT $BIN_DIR/diff_bams -a $IN -b $IN -@ $NT $DIFF_REF
+  done
+done
+
+exit 0
@@ -18,6 +18,7 @@
 *#########LICENCE#########*/
 
 #include <inttypes.h>
+#include <math.h>
 #include "minunit.h"
 #include "bam_stats_calcs.h"
 #include "khash.h"
@@ -68,9 +69,53 @@ char *bam_stats_calcs_calculate_mean_sd_median_insert_size_test(){
   return NULL;
 }
 
+char *bam_stats_calcs_calculate_trimmed_insert_size_test(){
+  int res;
+  khash_t(ins) *inserts;
+  inserts = kh_init(ins);
+  khint_t k;
+  k = kh_put(ins,inserts,200,&res);
+  kh_value(inserts,k) = 100;
+  k = kh_put(ins,inserts,210,&res);
+  kh_value(inserts,k) = 100;
+  // a single chimeric pair well outside 2 SD of the mean
+  k = kh_put(ins,inserts,10000,&res);
+  kh_value(inserts,k) = 1;
+
+  double mean;
+  double sd;
+  double median;
+
+  int check = bam_stats_calcs_calculate_trimmed_insert_size(inserts, BAM_STATS_RNA_SD, BAM_STATS_RNA_ITERATIONS, &mean, &sd, &median);
+  if(check != 0) {
+    sprintf(err,"Trimmed calculation failed to complete\n");
+    return err;
+  }
+  if(mean != 205 || sd != 5 || median != 205){
+    sprintf(err,"Trimmed mean %f, sd %f, median %f not as expected 205, 5, 205\n",mean,sd,median);
+    return err;
+  }
+
+  // no iterations gives the untrimmed values
+  double u_mean, u_sd, u_median;
+  check = bam_stats_calcs_calculate_trimmed_insert_size(inserts, BAM_STATS_RNA_SD, 0, &mean, &sd, &median);
+  check += bam_stats_calcs_calculate_mean_sd_median_insert_size(inserts, &u_mean, &u_sd, &u_median);
+  if(check != 0) {
+    sprintf(err,"Untrimmed calculation failed to complete\n");
+    return err;
+  }
+  if(fabs(mean - u_mean) > 1e-6 || fabs(sd - u_sd) > 1e-6 * u_sd || median != u_median){
+    sprintf(err,"Zero iteration trim sd %f differs from untrimmed %f\n",sd,u_sd);
+    return err;
+  }
+  kh_destroy(ins,inserts);
+  return NULL;
+}
+
 char *all_tests() {
    mu_suite_start();
    mu_run_test(bam_stats_calcs_calculate_mean_sd_median_insert_size_test);
+   mu_run_test(bam_stats_calcs_calculate_trimmed_insert_size_test);
    return NULL;
 }
 
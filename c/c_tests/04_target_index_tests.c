@@ -0,0 +1,108 @@
+/*########LICENCE#########
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2016 ICGC PanCancer Project
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*#########LICENCE#########*/
+
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include "minunit.h"
+#include "target_index.h"
+
+char err[200];
+char bed_file[] = "/tmp/target_index_testXXXXXX";
+char sidecar[] = "/tmp/target_index_test_tixXXXXXX";
+
+// overlapping, abutting, duplicate and unsorted targets
+char *bed_content = "# comment\n"
+                    "1\t100\t200\n"
+                    "1\t150\t250\n"
+                    "2\t10\t20\n"
+                    "1\t250\t300\n"
+                    "1\t500\t600\n"
+                    "1\t500\t600\n";
+
+char *check_index(target_index_t *ti){
+  if(ti == NULL) return "Target index not created";
+  if(ti->n_contigs != 2){
+    sprintf(err,"Expected 2 contigs, got %d", ti->n_contigs);
+    return err;
+  }
+  int c1 = target_index_contig(ti, "1");
+  if(c1 != 0 || target_index_contig(ti, "2") != 1 || target_index_contig(ti, "X") != -1) return "Contig lookup incorrect";
+  ti_contig_t *c = &ti->contigs[c1];
+  if(c->n != 2 || c->iv[0].beg != 100 || c->iv[0].end != 300 || c->iv[1].beg != 500 || c->iv[1].end != 600){
+    sprintf(err,"Intervals on contig 1 not merged as expected, got %d", c->n);
+    return err;
+  }
+  if(target_index_total(ti) != 310){
+    sprintf(err,"Total bases %"PRIu64" not as expected 310", target_index_total(ti));
+    return err;
+  }
+  return NULL;
+}
+
+char *test_target_index_parse(){
+  int fd = mkstemp(bed_file);
+  mu_assert(fd >= 0, "Unable to create temporary bed file");
+  mu_assert(write(fd, bed_content, strlen(bed_content)) == (ssize_t) strlen(bed_content), "Unable to write temporary bed file");
+  close(fd);
+  target_index_t *ti = target_index_parse(bed_file, 0);
+  char *res = check_index(ti);
+  target_index_destroy(ti);
+  return res;
+}
+
+char *test_target_index_queries(){
+  target_index_t *ti = target_index_parse(bed_file, 0);
+  mu_assert(ti != NULL, "Target index not created");
+  int first = -1;
+  mu_assert(target_index_overlaps(ti, 0, 0, 100, &first) == 0, "No overlap expected before first target");
+  mu_assert(target_index_overlaps(ti, 0, 299, 501, &first) == 2 && first == 0, "Expected overlap of both targets");
+  mu_assert(target_index_overlaps(ti, 0, 300, 500, &first) == 0 && first == 1, "Expected no overlap between targets");
+  mu_assert(target_index_contains(ti, 0, 100) == 1, "Start of target is contained");
+  mu_assert(target_index_contains(ti, 0, 300) == 0, "End of target is exclusive");
+  mu_assert(target_index_contains(ti, 1, 15) == 1, "Position on contig 2 is contained");
+  target_index_destroy(ti);
+  return NULL;
+}
+
+char *test_target_index_sidecar(){
+  int fd = mkstemp(sidecar);
+  mu_assert(fd >= 0, "Unable to create temporary sidecar file");
+  close(fd);
+  unlink(sidecar);
+  target_index_t *ti = target_index_load(bed_file, 0, sidecar);
+  mu_assert(ti != NULL, "Target index not created with sidecar");
+  target_index_destroy(ti);
+  ti = target_index_read(sidecar, bed_file);
+  char *res = check_index(ti);
+  target_index_destroy(ti);
+  unlink(sidecar);
+  unlink(bed_file);
+  return res;
+}
+
+char *all_tests() {
+   mu_suite_start();
+   mu_run_test(test_target_index_parse);
+   mu_run_test(test_target_index_queries);
+   mu_run_test(test_target_index_sidecar);
+   return NULL;
+}
+
+RUN_TESTS(all_tests);
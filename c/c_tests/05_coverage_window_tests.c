@@ -0,0 +1,207 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include "minunit.h"
+#include "coverage_window.h"
+
+char err[200];
+char bed_file[] = "/tmp/coverage_window_testXXXXXX";
+
+// contig 1 of 1000 bases, contig 2 of 50 bases which never has reads
+bam_hdr_t *make_header(){
+  bam_hdr_t *head = bam_hdr_init();
+  head->n_targets = 2;
+  head->target_len = (uint32_t *) malloc(sizeof(uint32_t) * 2);
+  head->target_name = (char **) malloc(sizeof(char *) * 2);
+  head->target_len[0] = 1000;
+  head->target_len[1] = 50;
+  head->target_name[0] = strdup("1");
+  head->target_name[1] = strdup("2");
+  return head;
+}
+
+int add_read(coverage_window_t *cw, bam1_t *b, int32_t tid, hts_pos_t pos, uint32_t len, uint16_t flag){
+  uint32_t cigar = bam_cigar_gen(len, BAM_CMATCH);
+  if(bam_set1(b, 1, "r", flag, tid, pos, 60, 1, &cigar, -1, -1, 0, 0, NULL, NULL, 0) < 0) return -1;
+  return coverage_window_add(cw, b);
+}
+
+// 1:101-200 and 1:151-250 overlap, the duplicate is ignored
+int add_reads(coverage_window_t *cw){
+  bam1_t *b = bam_init1();
+  int res = add_read(cw, b, 0, 100, 100, 0)
+          | add_read(cw, b, 0, 120, 100, BAM_FDUP)
+          | add_read(cw, b, 0, 150, 100, 0);
+  bam_destroy1(b);
+  return res;
+}
+
+char *test_coverage_window_genome(){
+  bam_hdr_t *head = make_header();
+  coverage_window_t *cw = coverage_window_init(head, NULL);
+  mu_assert(cw != NULL, "Coverage window not created");
+  mu_assert(add_reads(cw) == 0, "Error adding reads");
+  mu_assert(coverage_window_finish(cw) == 0, "Error finishing coverage window");
+  if(cw->bins.total_bases != 1050 || cw->hist[0] != 900 || cw->hist[1] != 100 || cw->hist[2] != 50){
+    sprintf(err,"Unexpected genome histogram total %"PRIu64", 0:%"PRIu64" 1:%"PRIu64" 2:%"PRIu64,
+            cw->bins.total_bases, cw->hist[0], cw->hist[1], cw->hist[2]);
+    coverage_window_destroy(cw);
+    bam_hdr_destroy(head);
+    return err;
+  }
+  coverage_window_destroy(cw);
+  bam_hdr_destroy(head);
+  return NULL;
+}
+
+char *test_coverage_window_targets(){
+  // target beyond the end of contig 1 and one on a contig not in the header
+  char *bed_content = "1\t140\t160\n1\t240\t260\n1\t990\t1010\nX\t0\t10\n";
+  int fd = mkstemp(bed_file);
+  mu_assert(fd >= 0, "Unable to create temporary bed file");
+  mu_assert(write(fd, bed_content, strlen(bed_content)) == (ssize_t) strlen(bed_content), "Unable to write temporary bed file");
+  close(fd);
+  target_index_t *ti = target_index_parse(bed_file, 0);
+  unlink(bed_file);
+  mu_assert(ti != NULL, "Target index not created");
+  bam_hdr_t *head = make_header();
+  coverage_window_t *cw = coverage_window_init(head, ti);
+  mu_assert(cw != NULL, "Coverage window not created");
+  mu_assert(add_reads(cw) == 0, "Error adding reads");
+  mu_assert(coverage_window_finish(cw) == 0, "Error finishing coverage window");
+  // 141-150:1 151-160:2 241-250:1 251-260:0 991-1010:0 X:0
+  if(cw->bins.total_bases != 70 || cw->hist[0] != 40 || cw->hist[1] != 20 || cw->hist[2] != 10){
+    sprintf(err,"Unexpected target histogram total %"PRIu64", 0:%"PRIu64" 1:%"PRIu64" 2:%"PRIu64,
+            cw->bins.total_bases, cw->hist[0], cw->hist[1], cw->hist[2]);
+    coverage_window_destroy(cw);
+    bam_hdr_destroy(head);
+    target_index_destroy(ti);
+    return err;
+  }
+  coverage_window_destroy(cw);
+  bam_hdr_destroy(head);
+  target_index_destroy(ti);
+  return NULL;
+}
+
+char *test_coverage_window_unsorted(){
+  bam_hdr_t *head = make_header();
+  coverage_window_t *cw = coverage_window_init(head, NULL);
+  bam1_t *b = bam_init1();
+  mu_assert(add_read(cw, b, 0, 500, 10, 0) == 0, "Error adding read");
+  mu_assert(add_read(cw, b, 0, 400, 10, 0) == -1, "Unsorted position not detected");
+  mu_assert(add_read(cw, b, 1, 10, 10, 0) == 0, "Error adding read");
+  mu_assert(add_read(cw, b, 0, 600, 10, 0) == -1, "Unsorted contig not detected");
+  bam_destroy1(b);
+  coverage_window_destroy(cw);
+  bam_hdr_destroy(head);
+  return NULL;
+}
+
+// a read longer than the initial window forces it to grow with reads in flight
+char *test_coverage_window_grow(){
+  bam_hdr_t *head = make_header();
+  head->target_len[0] = 100000;
+  coverage_window_t *cw = coverage_window_init(head, NULL);
+  bam1_t *b = bam_init1();
+  mu_assert(add_read(cw, b, 0, 10, 100, 0) == 0, "Error adding read");
+  mu_assert(add_read(cw, b, 0, 50, 5000, 0) == 0, "Error adding long read");
+  mu_assert(add_read(cw, b, 0, 60, 10, 0) == 0, "Error adding read");
+  mu_assert(coverage_window_finish(cw) == 0, "Error finishing coverage window");
+  // 11-50:1 51-60:2 61-70:3 71-110:2 111-5050:1
+  mu_assert(cw->hist[1] == 40 + 4940 && cw->hist[2] == 50 && cw->hist[3] == 10, "Unexpected histogram after growing window");
+  mu_assert(cw->hist[0] == 100050 - 5040, "Unexpected zero depth bases after growing window");
+  bam_destroy1(b);
+  coverage_window_destroy(cw);
+  bam_hdr_destroy(head);
+  return NULL;
+}
+
+typedef struct {
+  int n;
+  hts_pos_t beg[10];
+  hts_pos_t end[10];
+  int32_t depth[10];
+} runs_t;
+
+// merges touching runs of equal depth as a consumer would
+int collect_run(void *data, int tid, hts_pos_t beg, hts_pos_t end, int32_t depth){
+  runs_t *runs = (runs_t *) data;
+  if(tid != 1) return -1;
+  if(runs->n && runs->end[runs->n-1] == beg && runs->depth[runs->n-1] == depth){
+    runs->end[runs->n-1] = end;
+    return 0;
+  }
+  if(runs->n == 10) return -1;
+  runs->beg[runs->n] = beg;
+  runs->end[runs->n] = end;
+  runs->depth[runs->n] = depth;
+  runs->n++;
+  return 0;
+}
+
+// a per-contig worker, only aligned spans of a read are added
+char *test_coverage_window_runs(){
+  bam_hdr_t *head = make_header();
+  coverage_window_t *cw = coverage_window_init(head, NULL);
+  runs_t runs;
+  memset(&runs, 0, sizeof(runs_t));
+  coverage_window_set_runs(cw, collect_run, &runs);
+  mu_assert(coverage_window_seek(cw, 1) == 0, "Error seeking to contig 2");
+  mu_assert(coverage_window_advance(cw, 1, 5) == 0, "Error advancing");
+  mu_assert(coverage_window_add_span(cw, 5, 10) == 0 && coverage_window_add_span(cw, 7, 12) == 0, "Error adding spans");
+  mu_assert(coverage_window_advance(cw, 1, 8) == 0, "Error advancing");
+  mu_assert(coverage_window_add_span(cw, 5, 6) == -1, "Span before the window not detected");
+  mu_assert(coverage_window_finish_contig(cw) == 0, "Error finishing contig");
+  hts_pos_t exp_beg[] = {0, 5, 7, 10, 12};
+  hts_pos_t exp_end[] = {5, 7, 10, 12, 50};
+  int32_t exp_depth[] = {0, 1, 2, 1, 0};
+  mu_assert(runs.n == 5, "Unexpected number of runs");
+  int i;
+  for(i=0; i<5; i++){
+    if(runs.beg[i] != exp_beg[i] || runs.end[i] != exp_end[i] || runs.depth[i] != exp_depth[i]){
+      sprintf(err,"Run %d unexpected %"PRIhts_pos"-%"PRIhts_pos":%d", i, runs.beg[i], runs.end[i], runs.depth[i]);
+      coverage_window_destroy(cw);
+      bam_hdr_destroy(head);
+      return err;
+    }
+  }
+  mu_assert(cw->hist[0] == 43, "Contig before the seek was visited");
+  coverage_window_destroy(cw);
+  bam_hdr_destroy(head);
+  return NULL;
+}
+
+char *all_tests() {
+   mu_suite_start();
+   mu_run_test(test_coverage_window_genome);
+   mu_run_test(test_coverage_window_targets);
+   mu_run_test(test_coverage_window_unsorted);
+   mu_run_test(test_coverage_window_grow);
+   mu_run_test(test_coverage_window_runs);
+   return NULL;
+}
+
+RUN_TESTS(all_tests);
@@ -0,0 +1,124 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "minunit.h"
+#include "pcapcore.h"
+
+char *test_bam = "../t/data/Stats.bam";
+char bas_all[] = "/tmp/pcapcore_allXXXXXX";
+char bas_merged[] = "/tmp/pcapcore_mergedXXXXXX";
+
+int same_file(char *a, char *b){
+  char cmd[200];
+  snprintf(cmd, sizeof(cmd), "cmp -s %s %s", a, b);
+  return system(cmd) == 0;
+}
+
+// one pass over everything must match two halves merged into an empty accumulator
+char *test_pcap_stats_merge(){
+  htsFile *input = hts_open(test_bam, "r");
+  mu_assert(input != NULL, "Error opening test bam");
+  sam_hdr_t *head = sam_hdr_read(input);
+  mu_assert(head != NULL, "Error reading header");
+  pcap_stats_t *all = pcap_stats_init(head, 0);
+  pcap_stats_t *half[2] = {pcap_stats_init(head, 0), pcap_stats_init(head, 0)};
+  pcap_stats_t *merged = pcap_stats_init(NULL, 0);
+  mu_assert(all && half[0] && half[1] && merged, "Error creating accumulators");
+  bam1_t *b = bam_init1();
+  int n = 0;
+  while(sam_read1(input, head, b) >= 0){
+    mu_assert(pcap_stats_add(all, b) == 0, "Error adding read");
+    mu_assert(pcap_stats_add(half[n++ % 2], b) == 0, "Error adding read to half");
+  }
+  mu_assert(pcap_stats_merge(merged, half[0]) == 0 && pcap_stats_merge(merged, half[1]) == 0, "Error merging");
+
+  int fd = mkstemp(bas_all);
+  close(fd);
+  fd = mkstemp(bas_merged);
+  close(fd);
+  mu_assert(pcap_stats_write_bas(all, "Stats.bam", bas_all) == 0, "Error writing bas");
+  mu_assert(pcap_stats_write_bas(merged, "Stats.bam", bas_merged) == 0, "Error writing merged bas");
+  // writing is repeatable
+  mu_assert(pcap_stats_write_bas(merged, "Stats.bam", bas_merged) == 0, "Error rewriting merged bas");
+  mu_assert(same_file(bas_all, bas_merged), "Merged bas differs from single pass");
+  unlink(bas_all);
+  unlink(bas_merged);
+
+  bam_destroy1(b);
+  pcap_stats_destroy(all);
+  pcap_stats_destroy(half[0]);
+  pcap_stats_destroy(half[1]);
+  pcap_stats_destroy(merged);
+  sam_hdr_destroy(head);
+  hts_close(input);
+  return NULL;
+}
+
+bam1_t *make_read(uint16_t flag, char *md){
+  uint32_t cigar = bam_cigar_gen(10, BAM_CMATCH);
+  bam1_t *b = bam_init1();
+  if(bam_set1(b, 1, "r", flag, 0, 100, 60, 1, &cigar, 0, 300, 0, 10, "ACGTACGTAC", NULL, 32) < 0) return NULL;
+  if(md && bam_aux_append(b, "MD", 'Z', strlen(md) + 1, (uint8_t *) md) != 0) return NULL;
+  return b;
+}
+
+char *test_pcap_mismatch(){
+  bam1_t *b = make_read(BAM_FPAIRED | BAM_FPROPER_PAIR, "3A6");
+  mu_assert(b != NULL, "Error creating read");
+  // 1 mismatch in 10 bases
+  mu_assert(pcap_mismatch_rate(b) > 0.099 && pcap_mismatch_rate(b) < 0.101, "Unexpected mismatch rate");
+  mu_assert(pcap_mismatch_mark(b, 0.2) == 0, "Read marked below threshold");
+  mu_assert(!(b->core.flag & BAM_FQCFAIL), "QC fail set below threshold");
+  mu_assert(pcap_mismatch_mark(b, 0.05) == 1, "Read not marked above threshold");
+  mu_assert(b->core.flag & BAM_FQCFAIL, "QC fail not set");
+
+  mu_assert(pcap_mm_modify_flag(b, PCAP_MM_REMOVE) == 1, "mm tag not found");
+  mu_assert(!(b->core.flag & BAM_FQCFAIL), "QC fail not removed");
+  // removing again leaves the other flags alone
+  mu_assert(pcap_mm_modify_flag(b, PCAP_MM_REMOVE) == 1, "mm tag not found");
+  mu_assert(b->core.flag == (BAM_FPAIRED | BAM_FPROPER_PAIR), "Flags changed by second removal");
+  mu_assert(pcap_mm_modify_flag(b, PCAP_MM_REPLACE) == 1, "mm tag not found");
+  mu_assert(b->core.flag & BAM_FQCFAIL, "QC fail not reinstated");
+
+  // both reads forward, not a valid proper pair
+  pcap_proper_pair_correct(b);
+  mu_assert(!(b->core.flag & BAM_FPROPER_PAIR), "Proper pair flag not removed");
+  bam_destroy1(b);
+
+  b = make_read(0, "10");
+  mu_assert(b != NULL, "Error creating read");
+  mu_assert(pcap_mm_modify_flag(b, PCAP_MM_REPLACE) == 0, "mm tag found on untagged read");
+  mu_assert(!(b->core.flag & BAM_FQCFAIL), "QC fail set on untagged read");
+  bam_destroy1(b);
+  return NULL;
+}
+
+char *all_tests() {
+   mu_suite_start();
+   mu_run_test(test_pcap_stats_merge);
+   mu_run_test(test_pcap_mismatch);
+   return NULL;
+}
+
+RUN_TESTS(all_tests);
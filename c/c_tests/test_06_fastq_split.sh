@@ -0,0 +1,104 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+# 3 pairs, split into chunks of 2 pairs
+for i in 1 2 3; do cat ../t/data/1_1.fq; done | gzip -c > $TMP_DIR/in_1.fq.gz
+for i in 1 2 3; do cat ../t/data/1_2.fq; done | gzip -c > $TMP_DIR/in_2.fq.gz
+
+mkdir $TMP_DIR/paired
+../bin/fastq_split -1 $TMP_DIR/in_1.fq.gz -2 $TMP_DIR/in_2.fq.gz -n 2 -o $TMP_DIR/paired
+if [ "$?" != "0" ];
+then
+  echo "ERROR running ../bin/fastq_split on paired input"
+  exit 1;
+fi
+
+for f in pairedfq1.000.gz pairedfq1.001.gz pairedfq2.000.gz pairedfq2.001.gz; do
+  if [ ! -s $TMP_DIR/paired/$f ];
+  then
+    echo "ERROR in "$0": expected chunk $f not created"
+    exit 1;
+  fi
+done
+
+if [ "`gunzip -c $TMP_DIR/paired/pairedfq1.001.gz | wc -l`" != "4" ];
+then
+  echo "ERROR in "$0": final chunk should hold a single record"
+  exit 1;
+fi
+
+gunzip -c $TMP_DIR/paired/pairedfq2.*.gz | diff - <(gunzip -c $TMP_DIR/in_2.fq.gz)
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": concatenated chunks differ from input"
+  exit 1;
+fi
+
+# interleaved
+(for i in 1 2 3; do cat ../t/data/1.fq; done) | gzip -c > $TMP_DIR/in_i.fq.gz
+mkdir $TMP_DIR/inter
+../bin/fastq_split -i $TMP_DIR/in_i.fq.gz -n 2 -o $TMP_DIR/inter
+if [ "$?" != "0" ] || [ ! -s $TMP_DIR/inter/i.001.gz ];
+then
+  echo "ERROR running ../bin/fastq_split on interleaved input"
+  exit 1;
+fi
+
+# virtual split of plain fastq, reassembled with fastq_slice
+for i in 1 2 3; do cat ../t/data/1_1.fq; done > $TMP_DIR/in_1.fq
+for i in 1 2 3; do cat ../t/data/1_2.fq; done > $TMP_DIR/in_2.fq
+mkdir $TMP_DIR/virtual
+../bin/fastq_split -x -1 $TMP_DIR/in_1.fq -2 $TMP_DIR/in_2.fq -n 2 -o $TMP_DIR/virtual
+if [ "$?" != "0" ] || [ ! -s $TMP_DIR/virtual/pairedfq2.001.fqs ];
+then
+  echo "ERROR running ../bin/fastq_split -x on paired input"
+  exit 1;
+fi
+
+(../bin/fastq_slice -i $TMP_DIR/virtual/pairedfq1.000.fqs && ../bin/fastq_slice -i $TMP_DIR/virtual/pairedfq1.001.fqs) | diff - $TMP_DIR/in_1.fq
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": fastq_slice output differs from input"
+  exit 1;
+fi
+
+# slice byte spans cover the plain input exactly
+SPAN=`cat $TMP_DIR/virtual/pairedfq1.*.fqs | awk -F'\t' '{s+=$4} END {print s}'`
+if [ "$SPAN" != "`wc -c < $TMP_DIR/in_1.fq`" ];
+then
+  echo "ERROR in "$0": slice byte spans ($SPAN) do not cover the input"
+  exit 1;
+fi
+
+# ends out of sync must fail
+cat ../t/data/1_2.fq | gzip -c > $TMP_DIR/short_2.fq.gz
+mkdir $TMP_DIR/bad
+../bin/fastq_split -1 $TMP_DIR/in_1.fq.gz -2 $TMP_DIR/short_2.fq.gz -n 2 -o $TMP_DIR/bad 2> /dev/null
+if [ "$?" == "0" ];
+then
+  echo "ERROR in "$0": mismatched read counts were not detected"
+  exit 1;
+fi
+
+exit 0
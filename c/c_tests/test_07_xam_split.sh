@@ -0,0 +1,160 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+# pair adjacent input without readgroups is written to the unknown file
+../bin/xam_split -i ../t/data/paired.bam -o $TMP_DIR
+if [ "$?" != "0" ] || [ ! -s $TMP_DIR/unknown.bam ];
+then
+  echo "ERROR running ../bin/xam_split -i ../t/data/paired.bam"
+  exit 1;
+fi
+
+# coordinate sorted input must request collation
+../bin/xam_split -i ../t/data/mismatch_test.bam -o $TMP_DIR 2> /dev/null
+if [ "$?" != "3" ];
+then
+  echo "ERROR in "$0": coordinate sorted input was not reported as requiring collation"
+  exit 1;
+fi
+
+# name grouped SAM: PAIRS pairs over two readgroups (every third in rgB), an unpaired read in rgB,
+# a pair without a readgroup then ORPHANS paired reads without a mate
+make_sam () {
+  awk -v so=$1 -v pairs=$2 -v orphans=$3 'BEGIN{
+    OFS="\t"; seq="ACGTACGTAC"; qual="IIIIIIIIII";
+    print "@HD","VN:1.6","SO:"so;
+    print "@SQ","SN:chr1","LN:100000";
+    print "@RG","ID:rgA","SM:s";
+    print "@RG","ID:rgB","SM:s";
+    for(i=1;i<=pairs;i++){
+      rg = (i%3==0) ? "rgB" : "rgA";
+      name = sprintf("pair%06d",i);
+      print name,99,"chr1",i,60,"10M","=",i+100,110,seq,qual,"RG:Z:"rg;
+      print name,147,"chr1",i+100,60,"10M","=",i,-110,seq,qual,"RG:Z:"rg;
+    }
+    print "single",0,"chr1",1,60,"10M","*",0,0,seq,qual,"RG:Z:rgB";
+    print "norg",99,"chr1",1,60,"10M","=",101,110,seq,qual;
+    print "norg",147,"chr1",101,60,"10M","=",1,-110,seq,qual;
+    for(i=1;i<=orphans;i++){
+      print sprintf("orphan%06d",i),73,"chr1",i,60,"10M","=",i,0,seq,qual,"RG:Z:rgA";
+    }
+  }'
+}
+
+# sum of records over all output files
+count_out () {
+  TOTAL=0
+  for F in $1/*.bam; do
+    TOTAL=$((TOTAL + $(samtools view -c $F)))
+  done
+  echo $TOTAL
+}
+
+# per readgroup chunks, pairs never separated
+PAIRS=50
+CHUNK=7
+make_sam queryname $PAIRS 0 > $TMP_DIR/grouped.sam
+mkdir $TMP_DIR/chunks
+../bin/xam_split -i $TMP_DIR/grouped.sam -o $TMP_DIR/chunks -n $CHUNK
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to split name grouped input into chunks"
+  exit 1;
+fi
+# rgA holds 34 pairs, rgB 16 pairs and the unpaired read
+for EXP in rgA:5 rgB:3; do
+  RG=${EXP%:*}
+  N=$(ls $TMP_DIR/chunks/${RG}_i.[0-9][0-9][0-9].bam | wc -l)
+  if [ "$N" != "${EXP#*:}" ];
+  then
+    echo "ERROR in "$0": expected ${EXP#*:} chunks for $RG, found $N"
+    exit 1;
+  fi
+  for F in $TMP_DIR/chunks/${RG}_i.*.bam; do
+    if [ $(samtools view -c $F) -gt $((CHUNK * 2)) ];
+    then
+      echo "ERROR in "$0": $F holds more than $CHUNK pairs"
+      exit 1;
+    fi
+    if [ $(samtools view $F | grep -vc "RG:Z:$RG") != "0" ];
+    then
+      echo "ERROR in "$0": $F holds reads from another readgroup"
+      exit 1;
+    fi
+  done
+done
+if [ ! -s $TMP_DIR/chunks/unknown.bam ] || [ $(samtools view -c $TMP_DIR/chunks/unknown.bam) != "2" ];
+then
+  echo "ERROR in "$0": pair without readgroup not written to unknown.bam"
+  exit 1;
+fi
+SPLIT=$(for F in $TMP_DIR/chunks/*.bam; do samtools view $F | cut -f 1 | sort -u; done | sort | uniq -d)
+if [ -n "$SPLIT" ];
+then
+  echo "ERROR in "$0": pairs separated across outputs: $SPLIT"
+  exit 1;
+fi
+if [ $(count_out $TMP_DIR/chunks) != $((PAIRS * 2 + 3)) ];
+then
+  echo "ERROR in "$0": output record count differs from input"
+  exit 1;
+fi
+
+# orphans are tolerated in name grouped input up to the floor
+PAIRS=200
+make_sam queryname $PAIRS 1000 > $TMP_DIR/orphans.sam
+mkdir $TMP_DIR/orphans
+../bin/xam_split -i $TMP_DIR/orphans.sam -o $TMP_DIR/orphans 2> /dev/null
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": orphans up to the floor were not tolerated"
+  exit 1;
+fi
+if [ $(count_out $TMP_DIR/orphans) != $((PAIRS * 2 + 3 + 1000)) ];
+then
+  echo "ERROR in "$0": output record count differs from input with orphans"
+  exit 1;
+fi
+
+# beyond the floor and 1% of reads collation is requested
+make_sam queryname $PAIRS 1002 > $TMP_DIR/too_many.sam
+mkdir $TMP_DIR/too_many
+../bin/xam_split -i $TMP_DIR/too_many.sam -o $TMP_DIR/too_many 2> /dev/null
+if [ "$?" != "3" ];
+then
+  echo "ERROR in "$0": orphans beyond the floor were not reported as requiring collation"
+  exit 1;
+fi
+
+# without SO:queryname any orphan requests collation
+make_sam unsorted $PAIRS 2 > $TMP_DIR/unsorted.sam
+mkdir $TMP_DIR/unsorted
+../bin/xam_split -i $TMP_DIR/unsorted.sam -o $TMP_DIR/unsorted 2> /dev/null
+if [ "$?" != "3" ];
+then
+  echo "ERROR in "$0": orphan in input not declared as grouped was not reported as requiring collation"
+  exit 1;
+fi
+
+exit 0
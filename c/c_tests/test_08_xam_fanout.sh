@@ -0,0 +1,56 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+../bin/xam_fanout -i ../t/data/mismatch_test.bam -o $TMP_DIR/out.bam -x $TMP_DIR/out.bam.bai -m $TMP_DIR/out.bam.md5 -b $TMP_DIR/out.bam.bas
+if [ "$?" != "0" ] || [ ! -s $TMP_DIR/out.bam ] || [ ! -s $TMP_DIR/out.bam.bai ];
+then
+  echo "ERROR running ../bin/xam_fanout -i ../t/data/mismatch_test.bam"
+  exit 1;
+fi
+
+# md5 is of the bytes written
+if [ "`md5sum $TMP_DIR/out.bam | cut -f 1 -d ' '`" != "`cat $TMP_DIR/out.bam.md5`" ];
+then
+  echo "ERROR in "$0": md5 does not match output file"
+  exit 1;
+fi
+
+# md5sum -b format as the legacy merge pipeline wrote
+../bin/xam_fanout -i ../t/data/mismatch_test.bam -o $TMP_DIR/sum.bam -m $TMP_DIR/sum.bam.md5 -M
+if [ "`md5sum -b < $TMP_DIR/sum.bam`" != "`cat $TMP_DIR/sum.bam.md5`" ];
+then
+  echo "ERROR in "$0": md5 file is not in md5sum -b format"
+  exit 1;
+fi
+
+# stats match a separate bam_stats pass over the output
+../bin/bam_stats -i $TMP_DIR/out.bam -o $TMP_DIR/expected.bas
+diff -q $TMP_DIR/expected.bas $TMP_DIR/out.bam.bas
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": bas output differs from bam_stats"
+  exit 1;
+fi
+
+exit 0
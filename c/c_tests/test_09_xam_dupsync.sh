@@ -0,0 +1,44 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+# mate of this read is on contig 23
+echo 'HX3_16095:1:1105:12286:65424' > $TMP_DIR/in.names
+printf "1\t0\t249250621\n" > $TMP_DIR/shard.bed
+
+../bin/xam_dupsync -i ../t/data/mismatch_test.bam -o $TMP_DIR/flagged.bam -n $TMP_DIR/in.names 2> $TMP_DIR/flag.log
+if [ "$?" != "0" ] || ! grep -q ' 1 reads flagged' $TMP_DIR/flag.log;
+then
+  echo "ERROR running ../bin/xam_dupsync -n, expected 1 read flagged"
+  exit 1;
+fi
+
+# the flagged read is reported as crossing the shard
+../bin/xam_dupsync -i $TMP_DIR/flagged.bam -o $TMP_DIR/collect.bam -L $TMP_DIR/shard.bed -N $TMP_DIR/out.names 2> /dev/null
+if [ "$?" != "0" ] || ! diff -q $TMP_DIR/in.names $TMP_DIR/out.names > /dev/null;
+then
+  echo "ERROR in "$0": duplicate with mate outside of shard not collected"
+  exit 1;
+fi
+
+exit 0
@@ -0,0 +1,69 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+INPUT=../t/data/Stats.bam
+
+../bin/bam_stats -i $INPUT -o $TMP_DIR/expected.bas
+../bin/bam_stats -i $INPUT -S $TMP_DIR/Stats.stats
+if [ "$?" != "0" ] || [ ! -s $TMP_DIR/Stats.stats ];
+then
+  echo "ERROR in "$0": failed to write stats shard"
+  exit 1;
+fi
+
+# shard for all content, duplicates from the input
+../bin/bam_stats -i $INPUT -m $TMP_DIR/Stats.stats -o $TMP_DIR/merged.bas
+diff -q $TMP_DIR/expected.bas $TMP_DIR/merged.bas
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": shard merged bas differs from bam_stats"
+  exit 1;
+fi
+
+# shard only, bam_filename column differs
+../bin/bam_stats -m $TMP_DIR/Stats.stats -o $TMP_DIR/shard_only.bas
+diff -q <(cut -f 2- $TMP_DIR/expected.bas) <(cut -f 2- $TMP_DIR/shard_only.bas)
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": shard only bas differs from bam_stats"
+  exit 1;
+fi
+
+# fanout writes the same shard and sums them for the final bas
+../bin/xam_fanout -i $INPUT -o $TMP_DIR/split.bam -s $TMP_DIR/split.stats
+diff -q $TMP_DIR/Stats.stats $TMP_DIR/split.stats
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": xam_fanout shard differs from bam_stats shard"
+  exit 1;
+fi
+../bin/xam_fanout -i $INPUT -o $TMP_DIR/out.bam -b $TMP_DIR/out.bam.bas -S $TMP_DIR/split.stats
+diff -q <(cut -f 2- $TMP_DIR/expected.bas) <(cut -f 2- $TMP_DIR/out.bam.bas)
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": xam_fanout shard merged bas differs from bam_stats"
+  exit 1;
+fi
+
+exit 0
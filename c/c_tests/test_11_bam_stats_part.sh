@@ -0,0 +1,91 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+# indexed copy of the input
+../bin/xam_fanout -i ../t/data/Stats.bam -o $TMP_DIR/Stats.bam -x $TMP_DIR/Stats.bam.bai
+INPUT=$TMP_DIR/Stats.bam
+
+../bin/bam_stats -i $INPUT -o $TMP_DIR/expected.bas
+
+MERGE=""
+for REM in 0 1 2; do
+  ../bin/bam_stats -i $INPUT -P $REM/3 -S $TMP_DIR/part_$REM.stats
+  if [ "$?" != "0" ];
+  then
+    echo "ERROR in "$0": failed to process part $REM/3"
+    exit 1;
+  fi
+  MERGE="$MERGE -m $TMP_DIR/part_$REM.stats"
+done
+
+# bam_filename column differs
+../bin/bam_stats $MERGE -o $TMP_DIR/parts.bas
+diff -q <(cut -f 2- $TMP_DIR/expected.bas) <(cut -f 2- $TMP_DIR/parts.bas)
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": merged parts differ from single pass"
+  exit 1;
+fi
+
+# more parts than references, one dominant reference and one too short to get reads (chrD),
+# BAM (bai) and CRAM (crai)
+../bin/xam_synth -o $TMP_DIR/synth.bam -R $TMP_DIR/ref.fa -n 3000 -g 2 -c chrA:5000000,chrD:1000,chrB:20000,chrC:5000 -s 5 2> /dev/null
+for EXT in bam cram; do
+  IDX=bai
+  if [ "$EXT" == "cram" ]; then IDX=crai; fi
+  ../bin/xam_fanout -i $TMP_DIR/synth.bam -r $TMP_DIR/ref.fa -o $TMP_DIR/part_in.$EXT -x $TMP_DIR/part_in.$EXT.$IDX
+  if [ "$?" != "0" ];
+  then
+    echo "ERROR in "$0": failed to write indexed $EXT"
+    exit 1;
+  fi
+  ../bin/bam_stats -i $TMP_DIR/part_in.$EXT -r $TMP_DIR/ref.fa -o $TMP_DIR/expected.$EXT.bas
+  MERGE=""
+  for REM in 0 1 2 3 4 5 6; do
+    ../bin/bam_stats -i $TMP_DIR/part_in.$EXT -r $TMP_DIR/ref.fa -P $REM/7 -S $TMP_DIR/part_$EXT.$REM.stats
+    if [ "$?" != "0" ];
+    then
+      echo "ERROR in "$0": failed to process $EXT part $REM/7"
+      exit 1;
+    fi
+    MERGE="$MERGE -m $TMP_DIR/part_$EXT.$REM.stats"
+  done
+  ../bin/bam_stats $MERGE -o $TMP_DIR/parts.$EXT.bas
+  diff -q <(cut -f 2- $TMP_DIR/expected.$EXT.bas) <(cut -f 2- $TMP_DIR/parts.$EXT.bas)
+  if [ "$?" != "0" ];
+  then
+    echo "ERROR in "$0": merged $EXT parts differ from single pass"
+    exit 1;
+  fi
+done
+
+# partitioning requires an index
+../bin/bam_stats -i ../t/data/Stats.bam -P 0/2 -S $TMP_DIR/fail.stats > /dev/null 2>&1
+if [ "$?" == "0" ];
+then
+  echo "ERROR in "$0": partitioning without an index should fail"
+  exit 1;
+fi
+
+exit 0
@@ -0,0 +1,52 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+# expected result as t/pcapCoverage.t
+EXPECTED='0:0,1-10:1.0000,11-20:1.0000,21-30:0.0000,31-40:0.0000,41-50:0.0000,51-100:0.0000,101-200:0.0000,201-500:0.0000,501+:0.0000'
+
+for TARGETS in ../t/data/coverage_exons.bed ../t/data/coverage_exons.gff3; do
+  ../bin/xam_coverage -i ../t/data/coverage.bam -t $TARGETS -@ 2 -o $TMP_DIR/out.txt
+  if [ "$?" != "0" ];
+  then
+    echo "ERROR running ../bin/xam_coverage -i ../t/data/coverage.bam -t $TARGETS"
+    exit 1;
+  fi
+  if [ "`cat $TMP_DIR/out.txt`" != "$EXPECTED" ];
+  then
+    echo "ERROR in "$0": unexpected bins for $TARGETS: `cat $TMP_DIR/out.txt`"
+    exit 1;
+  fi
+done
+
+# second run uses the target index created by the first
+for RUN in 1 2; do
+  ../bin/xam_coverage -i ../t/data/coverage.bam -t ../t/data/coverage_exons.gff3 -x $TMP_DIR/targets.tix -o $TMP_DIR/out.txt
+  if [ "$?" != "0" ] || [ ! -s $TMP_DIR/targets.tix ] || [ "`cat $TMP_DIR/out.txt`" != "$EXPECTED" ];
+  then
+    echo "ERROR in "$0": unexpected result with target index, run $RUN"
+    exit 1;
+  fi
+done
+
+exit 0
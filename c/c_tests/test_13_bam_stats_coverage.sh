@@ -0,0 +1,65 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+# expected result as t/pcapCoverage.t and test_12_xam_coverage.sh
+EXPECTED='0:0,1-10:1.0000,11-20:1.0000,21-30:0.0000,31-40:0.0000,41-50:0.0000,51-100:0.0000,101-200:0.0000,201-500:0.0000,501+:0.0000'
+# the single target is 5 bases
+TARGET_BASES=5
+
+../bin/bam_stats -i ../t/data/coverage.bam -o $TMP_DIR/out.bas -t ../t/data/coverage_exons.bed -C $TMP_DIR/bam_stats.cov -H $TMP_DIR/bam_stats.hist
+if [ "$?" != "0" ];
+then
+  echo "ERROR running bam_stats with coverage"
+  exit 1;
+fi
+../bin/xam_fanout -i ../t/data/coverage.bam -o $TMP_DIR/out.bam -t ../t/data/coverage_exons.bed -C $TMP_DIR/xam_fanout.cov -H $TMP_DIR/xam_fanout.hist
+if [ "$?" != "0" ];
+then
+  echo "ERROR running xam_fanout with coverage"
+  exit 1;
+fi
+
+for TOOL in bam_stats xam_fanout; do
+  if [ "`cat $TMP_DIR/$TOOL.cov`" != "$EXPECTED" ];
+  then
+    echo "ERROR in "$0": unexpected bins from $TOOL: `cat $TMP_DIR/$TOOL.cov`"
+    exit 1;
+  fi
+  HIST_BASES=`awk 'NR>1 {sum+=$2} END {print sum}' $TMP_DIR/$TOOL.hist`
+  if [ "$HIST_BASES" != "$TARGET_BASES" ];
+  then
+    echo "ERROR in "$0": depth histogram from $TOOL covers $HIST_BASES bases, expected $TARGET_BASES"
+    exit 1;
+  fi
+done
+
+# bas output is unaffected
+../bin/bam_stats -i ../t/data/coverage.bam -o $TMP_DIR/plain.bas
+if [ "`diff $TMP_DIR/out.bas $TMP_DIR/plain.bas`" != "" ];
+then
+  echo "ERROR in "$0": bas differs when coverage is requested"
+  exit 1;
+fi
+
+exit 0
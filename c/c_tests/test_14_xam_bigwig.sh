@@ -0,0 +1,49 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+for THREADS in 1 3; do
+  ../bin/xam_bigwig -i ../t/data/coverage.bam -o $TMP_DIR/out_$THREADS.bw -z -a -@ $THREADS
+  if [ "$?" != "0" ];
+  then
+    echo "ERROR running ../bin/xam_bigwig -i ../t/data/coverage.bam -@ $THREADS"
+    exit 1;
+  fi
+done
+
+# BigWig magic, little endian
+MAGIC=`od -A n -t x1 -N 4 $TMP_DIR/out_1.bw | tr -d ' \n'`
+if [ "$MAGIC" != "26fc8f88" ];
+then
+  echo "ERROR in "$0": output is not a BigWig file, magic $MAGIC"
+  exit 1;
+fi
+
+# contigs are always written in header order, the number of workers can't change the file
+if ! cmp -s $TMP_DIR/out_1.bw $TMP_DIR/out_3.bw;
+then
+  echo "ERROR in "$0": output differs with the number of threads"
+  exit 1;
+fi
+
+exit 0
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+PAIRS=2000
+SYNTH_ARGS="-n $PAIRS -g 2 -c chrA:200000,chrB:50000 -m 0.01 -x 0.001 -D 0.05 -s 11"
+
+for RUN in 1 2; do
+  ../bin/xam_synth -o $TMP_DIR/out_$RUN.bam -R $TMP_DIR/ref.fa $SYNTH_ARGS 2> /dev/null
+  if [ "$?" != "0" ];
+  then
+    echo "ERROR running ../bin/xam_synth $SYNTH_ARGS"
+    exit 1;
+  fi
+done
+
+# same seed, same file
+if ! cmp -s $TMP_DIR/out_1.bam $TMP_DIR/out_2.bam;
+then
+  echo "ERROR in "$0": output differs between runs with the same seed"
+  exit 1;
+fi
+
+../bin/xam_synth -o $TMP_DIR/out.cram -O cram -R $TMP_DIR/ref.fa $SYNTH_ARGS -q 2> /dev/null
+if [ "$?" != "0" ];
+then
+  echo "ERROR running ../bin/xam_synth -O cram -q $SYNTH_ARGS"
+  exit 1;
+fi
+
+# every read is counted once, split over the two read groups
+../bin/bam_stats -i $TMP_DIR/out_1.bam -o $TMP_DIR/out.bas
+if [ "$?" != "0" ];
+then
+  echo "ERROR running bam_stats on xam_synth output"
+  exit 1;
+fi
+TOTAL=`awk -F'\t' 'NR>1 {sum+=$15} END {print sum}' $TMP_DIR/out.bas`
+if [ "$TOTAL" != "`expr $PAIRS \* 2`" ];
+then
+  echo "ERROR in "$0": bam_stats counted $TOTAL reads, expected `expr $PAIRS \* 2`"
+  exit 1;
+fi
+GROUPS=`awk 'NR>1' $TMP_DIR/out.bas | wc -l`
+if [ "$GROUPS" != "2" ];
+then
+  echo "ERROR in "$0": expected 2 read groups, got $GROUPS"
+  exit 1;
+fi
+
+exit 0
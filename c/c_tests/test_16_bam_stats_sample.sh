@@ -0,0 +1,78 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+PAIRS=20000
+../bin/xam_synth -o $TMP_DIR/synth.bam -R $TMP_DIR/ref.fa -n $PAIRS -g 2 -c chrA:2000000,chrB:500000 -D 0.1 -s 7 2> /dev/null
+../bin/xam_fanout -i $TMP_DIR/synth.bam -o $TMP_DIR/in.bam -x $TMP_DIR/in.bam.bai
+INPUT=$TMP_DIR/in.bam
+
+../bin/bam_stats -i $INPUT -o $TMP_DIR/full.bas
+../bin/bam_stats -i $INPUT -o $TMP_DIR/sample.bas -s 0.2
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to run sampled bam_stats"
+  exit 1;
+fi
+
+# same layout as a full run, so the .bas can be read by PCAP::Bam::Bas
+diff -q <(head -n 1 $TMP_DIR/full.bas) <(head -n 1 $TMP_DIR/sample.bas) && diff -q <(cut -f 2-6 $TMP_DIR/full.bas) <(cut -f 2-6 $TMP_DIR/sample.bas)
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": sampled .bas layout differs from a full run"
+  exit 1;
+fi
+
+# scaled read counts close to the real ones
+FULL=`awk -F'\t' 'NR>1 {sum+=$15} END {print sum}' $TMP_DIR/full.bas`
+EST=`awk -F'\t' 'NR>1 {sum+=$15} END {print sum}' $TMP_DIR/sample.bas`
+if ! awk -v f=$FULL -v e=$EST 'BEGIN {exit !(e > 0.9*f && e < 1.1*f)}';
+then
+  echo "ERROR in "$0": estimated $EST reads, expected about $FULL"
+  exit 1;
+fi
+
+# estimates with intervals next to the output
+for METRIC in total_reads mapped_fraction duplicate_rate divergence_rate median_insert_size insert_size_sd; do
+  if ! awk -F'\t' -v m=$METRIC '$1==m && $3<=$2 && $2<=$4 {found=1} END {exit !found}' $TMP_DIR/sample.bas.estimate;
+  then
+    echo "ERROR in "$0": no valid estimate of $METRIC"
+    exit 1;
+  fi
+done
+
+# sampling requires an index and a whole input
+../bin/bam_stats -i $TMP_DIR/synth.bam -o $TMP_DIR/fail.bas -s 0.2 > /dev/null 2>&1
+if [ "$?" == "0" ];
+then
+  echo "ERROR in "$0": sampling without an index should fail"
+  exit 1;
+fi
+../bin/bam_stats -i $INPUT -P 0/2 -S $TMP_DIR/fail.stats -s 0.2 > /dev/null 2>&1
+if [ "$?" == "0" ];
+then
+  echo "ERROR in "$0": sampling a part should fail"
+  exit 1;
+fi
+
+exit 0
@@ -0,0 +1,62 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+mkdir -p $TMP_DIR/in $TMP_DIR/out
+cp ../t/data/Stats.bam $TMP_DIR/in/one.bam
+cp ../t/data/Stats.bam $TMP_DIR/in/two.bam
+../bin/xam_synth -o $TMP_DIR/in/three.bam -R $TMP_DIR/ref.fa -n 2000 -g 2 -c chrA:200000 -s 3 2> /dev/null
+
+INPUTS=""
+for NAME in one two three; do
+  ../bin/bam_stats -i $TMP_DIR/in/$NAME.bam -o $TMP_DIR/$NAME.bam.bas
+  INPUTS="$INPUTS -i $TMP_DIR/in/$NAME.bam"
+done
+
+../bin/bam_stats $INPUTS -O $TMP_DIR/out -j 2 -@ 2
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to process many inputs"
+  exit 1;
+fi
+
+for NAME in one two three; do
+  diff -q $TMP_DIR/$NAME.bam.bas $TMP_DIR/out/$NAME.bam.bas
+  if [ "$?" != "0" ];
+  then
+    echo "ERROR in "$0": output for $NAME differs from a single input run"
+    exit 1;
+  fi
+done
+
+# outputs would collide
+mkdir -p $TMP_DIR/in/sub
+cp ../t/data/Stats.bam $TMP_DIR/in/sub/one.bam
+../bin/bam_stats -i $TMP_DIR/in/one.bam -i $TMP_DIR/in/sub/one.bam -O $TMP_DIR/out > /dev/null 2>&1
+if [ "$?" == "0" ];
+then
+  echo "ERROR in "$0": inputs with the same name should fail"
+  exit 1;
+fi
+
+exit 0
@@ -0,0 +1,65 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+INPUT=../t/data/Stats.bam
+../bin/bam_stats -i $INPUT -o $TMP_DIR/expected.bas
+
+# from a pipe, the input comes out unchanged
+cat $INPUT | ../bin/bam_stats -T -o $TMP_DIR/piped.bas > $TMP_DIR/piped.bam
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to run bam_stats -T on a pipe"
+  exit 1;
+fi
+if ! cmp -s $INPUT $TMP_DIR/piped.bam;
+then
+  echo "ERROR in "$0": passthrough output differs from the input"
+  exit 1;
+fi
+# bam_filename column differs
+diff -q <(cut -f 2- $TMP_DIR/expected.bas) <(cut -f 2- $TMP_DIR/piped.bas)
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": passthrough stats differ from a normal run"
+  exit 1;
+fi
+
+# inline ahead of another reader
+../bin/bam_stats -T -i $INPUT -o $TMP_DIR/inline.bas | ../bin/bam_stats -o $TMP_DIR/downstream.bas
+diff -q $TMP_DIR/expected.bas $TMP_DIR/inline.bas && diff -q <(cut -f 2- $TMP_DIR/expected.bas) <(cut -f 2- $TMP_DIR/downstream.bas)
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": inline passthrough stats differ from a normal run"
+  exit 1;
+fi
+
+# stdout is taken by the passthrough
+../bin/bam_stats -T -i $INPUT > /dev/null 2>&1
+if [ "$?" == "0" ];
+then
+  echo "ERROR in "$0": passthrough with the .bas on stdout should fail"
+  exit 1;
+fi
+
+exit 0
@@ -0,0 +1,93 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+INPUT=../t/data/Stats.bam
+../bin/bam_stats -i $INPUT -o $TMP_DIR/expected.bas
+
+# smallest buffers so the prefetch cycles many times over the input
+../bin/bam_stats -R 64K -i $INPUT -o $TMP_DIR/readahead.bas
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to run bam_stats -R"
+  exit 1;
+fi
+diff -q $TMP_DIR/expected.bas $TMP_DIR/readahead.bas
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": readahead stats differ from a normal run"
+  exit 1;
+fi
+
+# selected by the environment, -R 0 turns it back off
+PCAP_READAHEAD=64K ../bin/bam_stats -i $INPUT -o $TMP_DIR/env.bas && PCAP_READAHEAD=bad ../bin/bam_stats -R 0 -i $INPUT -o $TMP_DIR/off.bas
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to run bam_stats with PCAP_READAHEAD"
+  exit 1;
+fi
+diff -q $TMP_DIR/expected.bas $TMP_DIR/env.bas && diff -q $TMP_DIR/expected.bas $TMP_DIR/off.bas
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": PCAP_READAHEAD stats differ from a normal run"
+  exit 1;
+fi
+
+# same records out of the QC tools
+../bin/mismatchQc -i ../t/data/mismatch_test.bam -o $TMP_DIR/mm.bam 2> /dev/null
+../bin/mismatchQc -R 64K -i ../t/data/mismatch_test.bam -o $TMP_DIR/mm_ra.bam 2> /dev/null
+../bin/diff_bams -R 64K -a $TMP_DIR/mm.bam -b $TMP_DIR/mm_ra.bam > /dev/null
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": mismatchQc output differs with readahead"
+  exit 1;
+fi
+# each contig seeks via the index, inside and outside the buffered data
+../bin/xam_coverage -R 64K -i ../t/data/coverage.bam -t ../t/data/coverage_exons.bed -o $TMP_DIR/cov_ra.txt && ../bin/xam_coverage -i ../t/data/coverage.bam -t ../t/data/coverage_exons.bed -o $TMP_DIR/cov.txt
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to run xam_coverage -R"
+  exit 1;
+fi
+diff -q $TMP_DIR/cov.txt $TMP_DIR/cov_ra.txt
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": xam_coverage output differs with readahead"
+  exit 1;
+fi
+
+# sizes are validated
+../bin/bam_stats -R 12Q -i $INPUT -o $TMP_DIR/fail.bas > /dev/null 2>&1
+if [ "$?" == "0" ];
+then
+  echo "ERROR in "$0": an invalid readahead size should fail"
+  exit 1;
+fi
+../bin/bam_stats -R 1K -i $INPUT -o $TMP_DIR/fail.bas > /dev/null 2>&1
+if [ "$?" == "0" ];
+then
+  echo "ERROR in "$0": a readahead size below the minimum should fail"
+  exit 1;
+fi
+
+exit 0
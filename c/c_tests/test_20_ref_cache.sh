@@ -0,0 +1,80 @@
+#!/bin/bash
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+TMP_DIR=`mktemp -d`
+trap "rm -rf $TMP_DIR" EXIT
+
+# only the cache built here may supply sequence
+unset REF_PATH REF_CACHE
+
+SYNTH_ARGS="-n 2000 -g 2 -c chrA:200000,chrB:50000 -s 11"
+../bin/xam_synth -o $TMP_DIR/synth.bam -R $TMP_DIR/ref.fa $SYNTH_ARGS 2> /dev/null
+../bin/xam_synth -o $TMP_DIR/synth.cram -O cram -R $TMP_DIR/ref.fa $SYNTH_ARGS 2> /dev/null
+
+../bin/ref_cache_build -i $TMP_DIR/ref.fa -o $TMP_DIR/cache -D $TMP_DIR/ref.dict 2> /dev/null
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to run ref_cache_build"
+  exit 1;
+fi
+
+# each sequence at its M5 in the REF_CACHE layout, uppercase with no line breaks
+for SQ in `grep '^@SQ' $TMP_DIR/ref.dict | cut -f 3,4 | sed 's/LN://; s/M5://; s/\t/:/'`; do
+  LEN=${SQ%%:*}
+  M5=${SQ##*:}
+  CACHED=$TMP_DIR/cache/${M5:0:2}/${M5:2:2}/${M5:4}
+  if [ "`wc -c < $CACHED`" != "$LEN" ] || [ "`md5sum < $CACHED | cut -c 1-32`" != "$M5" ] || grep -q '[a-z]' $CACHED;
+  then
+    echo "ERROR in "$0": cache entry for $M5 is missing or wrong"
+    exit 1;
+  fi
+done
+if [ "`grep -c '^@SQ' $TMP_DIR/ref.dict`" != "2" ];
+then
+  echo "ERROR in "$0": expected 2 sequences in the dict"
+  exit 1;
+fi
+
+# rebuilding keeps what is there
+../bin/ref_cache_build -i $TMP_DIR/ref.fa -o $TMP_DIR/cache 2> /dev/null
+if [ "$?" != "0" ] || [ "`find $TMP_DIR/cache -type f | wc -l`" != "2" ];
+then
+  echo "ERROR in "$0": rebuilding the cache failed or left extra files"
+  exit 1;
+fi
+
+# CRAM decoded from the cache alone gives the same stats as the BAM
+rm -f $TMP_DIR/ref.fa $TMP_DIR/ref.fa.fai
+../bin/bam_stats -i $TMP_DIR/synth.bam -o $TMP_DIR/bam.bas
+../bin/bam_stats -r $TMP_DIR/cache -i $TMP_DIR/synth.cram -o $TMP_DIR/cram.bas
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": failed to run bam_stats on CRAM with -r cache"
+  exit 1;
+fi
+diff -q <(cut -f 2- $TMP_DIR/bam.bas) <(cut -f 2- $TMP_DIR/cram.bas)
+if [ "$?" != "0" ];
+then
+  echo "ERROR in "$0": CRAM stats from the cache differ from the BAM"
+  exit 1;
+fi
+
+exit 0
@@ -0,0 +1,66 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "coverage_bins.h"
+
+static const uint32_t ranges[COVERAGE_BINS_N+1] = COVERAGE_BINS_RANGES;
+
+void coverage_bins_add(coverage_bins_t *bins, uint32_t depth, uint64_t n){
+  int i = COVERAGE_BINS_N-1;
+  while(depth < ranges[i]) i--;
+  bins->bases[i] += n;
+}
+
+void coverage_bins_merge(coverage_bins_t *dest, const coverage_bins_t *src){
+  int i;
+  for(i=0; i<COVERAGE_BINS_N; i++) dest->bases[i] += src->bases[i];
+  dest->total_bases += src->total_bases;
+}
+
+int coverage_bins_print(const coverage_bins_t *bins, FILE *out){
+  check(bins->total_bases > 0, "No target bases to calculate coverage fractions from.");
+  uint64_t at_least[COVERAGE_BINS_N];
+  uint64_t cum = 0;
+  int i;
+  for(i=COVERAGE_BINS_N-1; i>=0; i--){
+    cum += bins->bases[i];
+    at_least[i] = cum;
+  }
+  // bin '0' is only reported as 1 - fraction of '1-10', using the rounded value as perl does
+  for(i=1; i<COVERAGE_BINS_N; i++){
+    char frac[32];
+    snprintf(frac, sizeof(frac), "%.4f", (double) at_least[i] / (double) bins->total_bases);
+    if(i == 1){
+      check(fprintf(out, "0:%.15g,", 1 - strtod(frac, NULL)) > 0, "Error writing coverage bins.");
+    }
+    if(i == COVERAGE_BINS_N-1){
+      check(fprintf(out, "%"PRIu32"+:%s", ranges[i], frac) > 0, "Error writing coverage bins.");
+    }else{
+      check(fprintf(out, "%"PRIu32"-%"PRIu32":%s,", ranges[i], ranges[i+1]-1, frac) > 0, "Error writing coverage bins.");
+    }
+  }
+  return 0;
+error:
+  return -1;
+}
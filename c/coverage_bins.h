@@ -0,0 +1,48 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __coverage_bins_h__
+#define __coverage_bins_h__
+
+#include <stdio.h>
+#include <stdint.h>
+
+// as @depth_ranges in PCAP::Bam::Coverage, the final value only terminates the last bin
+#define COVERAGE_BINS_RANGES {0,1,11,21,31,41,51,101,201,501,100000000}
+#define COVERAGE_BINS_N 10
+
+typedef struct {
+  uint64_t bases[COVERAGE_BINS_N]; // positions with depth in [range[i], range[i+1]), last bin unbounded
+  uint64_t total_bases;            // positions covered by targets, including those never seen in the input
+} coverage_bins_t;
+
+// Adds n positions at the given depth.
+void coverage_bins_add(coverage_bins_t *bins, uint32_t depth, uint64_t n);
+
+void coverage_bins_merge(coverage_bins_t *dest, const coverage_bins_t *src);
+
+/*
+ * Writes the bin string exactly as PCAP::Bam::Coverage::build_final_bins, e.g.
+ * '0:0,1-10:1.0000,11-20:1.0000,...,501+:0.0000', fractions are of bases at or above
+ * the lower bound of each bin. No trailing newline.
+ */
+int coverage_bins_print(const coverage_bins_t *bins, FILE *out);
+
+#endif
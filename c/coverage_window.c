@@ -0,0 +1,287 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "coverage_window.h"
+
+// as xam_coverage and PCAP::Bam::Coverage
+static const uint16_t depth_filter = BAM_FUNMAP | BAM_FSECONDARY | BAM_FQCFAIL | BAM_FDUP;
+
+#define COVERAGE_WINDOW_INIT 1024
+
+static int add_bases(coverage_window_t *cw, int32_t depth, uint64_t n){
+  if(n == 0) return 0;
+  uint32_t d = (uint32_t) depth;
+  if(d >= cw->hist_size){
+    uint32_t size = cw->hist_size;
+    while(d >= size) size *= 2;
+    uint64_t *hist = (uint64_t *) realloc(cw->hist, sizeof(uint64_t) * size);
+    check_mem(hist);
+    memset(hist + cw->hist_size, 0, sizeof(uint64_t) * (size - cw->hist_size));
+    cw->hist = hist;
+    cw->hist_size = size;
+  }
+  cw->hist[d] += n;
+  coverage_bins_add(&cw->bins, d, n);
+  cw->bins.total_bases += n;
+  return 0;
+error:
+  return -1;
+}
+
+// records [beg,end) at depth, clipped to the targets when there are any
+static int emit(coverage_window_t *cw, hts_pos_t beg, hts_pos_t end, int32_t depth){
+  if(cw->run_fn) check(cw->run_fn(cw->run_data, cw->tid, beg, end, depth) == 0, "Error passing on depth run.");
+  if(cw->ti == NULL) return add_bases(cw, depth, end - beg);
+  if(cw->ti_contig < 0) return 0;
+  const ti_contig_t *c = &cw->ti->contigs[cw->ti_contig];
+  // runs arrive in position order so targets wholly before this one are done with
+  while(cw->next_iv < c->n && c->iv[cw->next_iv].end <= beg) cw->next_iv++;
+  int k;
+  for(k=cw->next_iv; k<c->n && c->iv[k].beg < end; k++){
+    hts_pos_t s = beg > c->iv[k].beg ? beg : c->iv[k].beg;
+    hts_pos_t e = end < c->iv[k].end ? end : c->iv[k].end;
+    check(add_bases(cw, depth, e - s) == 0, "Error adding bases to depth histogram.");
+  }
+  return 0;
+error:
+  return -1;
+}
+
+// makes depth final for every base before pos on the current contig
+static int flush_to(coverage_window_t *cw, hts_pos_t pos){
+  // diff can only be non-zero up to max_end
+  hts_pos_t stop = pos < cw->max_end + 1 ? pos : cw->max_end + 1;
+  if(cw->flushed < stop){
+    hts_pos_t run_beg = cw->flushed;
+    int32_t depth = cw->depth;
+    hts_pos_t p;
+    for(p=cw->flushed; p<stop; p++){
+      int32_t *d = &cw->diff[p & cw->mask];
+      int32_t next = depth + *d;
+      *d = 0;
+      if(p > run_beg && next != depth){
+        check(emit(cw, run_beg, p, depth) == 0, "Error flushing depth.");
+        run_beg = p;
+      }
+      depth = next;
+    }
+    check(emit(cw, run_beg, stop, depth) == 0, "Error flushing depth.");
+    cw->depth = depth;
+    cw->flushed = stop;
+  }
+  // past the end of every read seen so far
+  if(cw->flushed < pos){
+    check(emit(cw, cw->flushed, pos, 0) == 0, "Error flushing depth.");
+    cw->flushed = pos;
+  }
+  return 0;
+error:
+  return -1;
+}
+
+// ring buffer must hold flushed..end inclusive
+static int grow(coverage_window_t *cw, hts_pos_t end){
+  hts_pos_t size = cw->mask + 1;
+  if(end - cw->flushed < size) return 0;
+  while(end - cw->flushed >= size) size *= 2;
+  int32_t *diff = (int32_t *) calloc(size, sizeof(int32_t));
+  check_mem(diff);
+  hts_pos_t p;
+  for(p=cw->flushed; p<=cw->max_end; p++) diff[p & (size-1)] = cw->diff[p & cw->mask];
+  free(cw->diff);
+  cw->diff = diff;
+  cw->mask = size - 1;
+  return 0;
+error:
+  return -1;
+}
+
+static int contig_end(coverage_window_t *cw){
+  cw->contig_done = 1;
+  hts_pos_t limit = cw->head->target_len[cw->tid];
+  // as xam_coverage, targets running off the end of a contig count at depth 0
+  if(cw->ti_contig >= 0){
+    const ti_contig_t *c = &cw->ti->contigs[cw->ti_contig];
+    if(c->n && c->iv[c->n-1].end > limit) limit = c->iv[c->n-1].end;
+  }
+  return flush_to(cw, limit);
+}
+
+static void contig_start(coverage_window_t *cw, int tid){
+  cw->tid = tid;
+  cw->contig_done = 0;
+  cw->ti_contig = cw->ti ? target_index_contig(cw->ti, cw->head->target_name[tid]) : -1;
+  cw->next_iv = 0;
+  cw->flushed = 0;
+  cw->max_end = -1;
+  cw->last_pos = -1;
+  cw->depth = 0;
+}
+
+// finishes the current contig and any without reads up to tid
+static int advance_to(coverage_window_t *cw, int tid){
+  while(cw->tid < tid){
+    if(cw->tid >= 0 && !cw->contig_done) check(contig_end(cw) == 0, "Error finishing contig %s.", cw->head->target_name[cw->tid]);
+    contig_start(cw, cw->tid + 1);
+  }
+  return 0;
+error:
+  return -1;
+}
+
+coverage_window_t *coverage_window_init(const bam_hdr_t *head, const target_index_t *ti){
+  coverage_window_t *cw = (coverage_window_t *) calloc(1, sizeof(coverage_window_t));
+  check_mem(cw);
+  cw->head = head;
+  cw->ti = ti;
+  cw->tid = -1;
+  cw->diff = (int32_t *) calloc(COVERAGE_WINDOW_INIT, sizeof(int32_t));
+  check_mem(cw->diff);
+  cw->mask = COVERAGE_WINDOW_INIT - 1;
+  cw->hist = (uint64_t *) calloc(COVERAGE_WINDOW_INIT, sizeof(uint64_t));
+  check_mem(cw->hist);
+  cw->hist_size = COVERAGE_WINDOW_INIT;
+  return cw;
+error:
+  coverage_window_destroy(cw);
+  return NULL;
+}
+
+void coverage_window_set_runs(coverage_window_t *cw, coverage_window_run_f fn, void *data){
+  cw->run_fn = fn;
+  cw->run_data = data;
+}
+
+int coverage_window_seek(coverage_window_t *cw, int tid){
+  check(tid >= 0 && tid < cw->head->n_targets, "Contig %d not in the header.", tid);
+  if(cw->tid >= 0 && !cw->contig_done) check(contig_end(cw) == 0, "Error finishing contig %s.", cw->head->target_name[cw->tid]);
+  contig_start(cw, tid);
+  return 0;
+error:
+  return -1;
+}
+
+int coverage_window_finish_contig(coverage_window_t *cw){
+  if(cw->tid < 0 || cw->contig_done) return 0;
+  return contig_end(cw);
+}
+
+int coverage_window_advance(coverage_window_t *cw, int tid, hts_pos_t pos){
+  check(tid < cw->head->n_targets, "Read on contig %d not in the header.", tid);
+  check(tid >= cw->tid, "Input is not coordinate sorted, found %s after %s.",
+        cw->head->target_name[tid], cw->head->target_name[cw->tid]);
+  check(advance_to(cw, tid) == 0, "Error advancing depth to %s.", cw->head->target_name[tid]);
+  check(pos >= cw->last_pos, "Input is not coordinate sorted, %s:%"PRIhts_pos" after %s:%"PRIhts_pos".",
+        cw->head->target_name[tid], pos+1, cw->head->target_name[tid], cw->last_pos+1);
+  cw->last_pos = pos;
+  check(flush_to(cw, pos) == 0, "Error flushing depth to %s:%"PRIhts_pos".", cw->head->target_name[tid], pos+1);
+  return 0;
+error:
+  return -1;
+}
+
+int coverage_window_add_span(coverage_window_t *cw, hts_pos_t beg, hts_pos_t end){
+  if(end <= beg) return 0;
+  check(beg >= cw->flushed, "Span %"PRIhts_pos"-%"PRIhts_pos" starts before the window.", beg+1, end);
+  check(grow(cw, end) == 0, "Error growing depth window.");
+  cw->diff[beg & cw->mask]++;
+  cw->diff[end & cw->mask]--;
+  if(end > cw->max_end) cw->max_end = end;
+  return 0;
+error:
+  return -1;
+}
+
+int coverage_window_add(coverage_window_t *cw, const bam1_t *b){
+  if(b->core.tid < 0) return 0; // unplaced, always after the placed reads
+  // filtered reads still have to be in order
+  check(coverage_window_advance(cw, b->core.tid, b->core.pos) == 0, "Error adding read to depth.");
+  if(b->core.flag & depth_filter) return 0;
+  return coverage_window_add_span(cw, b->core.pos, bam_endpos(b));
+error:
+  return -1;
+}
+
+int coverage_window_finish(coverage_window_t *cw){
+  if(cw->head->n_targets > 0){
+    check(advance_to(cw, cw->head->n_targets - 1) == 0, "Error finishing depth.");
+    check(coverage_window_finish_contig(cw) == 0, "Error finishing depth.");
+    cw->tid = cw->head->n_targets; // nothing more can be added
+  }
+  if(cw->ti){
+    int i;
+    for(i=0; i<cw->ti->n_contigs; i++){
+      const ti_contig_t *c = &cw->ti->contigs[i];
+      if(sam_hdr_name2tid((sam_hdr_t *) cw->head, c->name) >= 0) continue;
+      int k;
+      for(k=0; k<c->n; k++){
+        check(add_bases(cw, 0, c->iv[k].end - c->iv[k].beg) == 0, "Error adding bases to depth histogram.");
+      }
+    }
+  }
+  return 0;
+error:
+  return -1;
+}
+
+int coverage_window_print_hist(const coverage_window_t *cw, FILE *out){
+  check(fprintf(out, "depth\tbases\n") > 0, "Error writing depth histogram.");
+  uint32_t d;
+  for(d=0; d<cw->hist_size; d++){
+    if(cw->hist[d] == 0) continue;
+    check(fprintf(out, "%"PRIu32"\t%"PRIu64"\n", d, cw->hist[d]) > 0, "Error writing depth histogram.");
+  }
+  return 0;
+error:
+  return -1;
+}
+
+int coverage_window_write(const coverage_window_t *cw, const char *bins_file, const char *hist_file){
+  FILE *out = NULL;
+  if(bins_file){
+    out = strcmp(bins_file, "-") == 0 ? stdout : fopen(bins_file, "w");
+    check(out != NULL, "Error opening coverage output '%s'.", bins_file);
+    check(coverage_bins_print(&cw->bins, out) == 0 && fputc('\n', out) != EOF, "Error writing coverage to '%s'.", bins_file);
+    if(out != stdout) check(fclose(out) == 0, "Error closing coverage output '%s'.", bins_file);
+    out = NULL;
+  }
+  if(hist_file){
+    out = strcmp(hist_file, "-") == 0 ? stdout : fopen(hist_file, "w");
+    check(out != NULL, "Error opening depth histogram output '%s'.", hist_file);
+    check(coverage_window_print_hist(cw, out) == 0, "Error writing depth histogram to '%s'.", hist_file);
+    if(out != stdout) check(fclose(out) == 0, "Error closing depth histogram output '%s'.", hist_file);
+    out = NULL;
+  }
+  return 0;
+error:
+  if(out && out != stdout) fclose(out);
+  return -1;
+}
+
+void coverage_window_destroy(coverage_window_t *cw){
+  if(cw == NULL) return;
+  free(cw->diff);
+  free(cw->hist);
+  free(cw);
+}
@@ -0,0 +1,93 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __coverage_window_h__
+#define __coverage_window_h__
+
+#include <stdio.h>
+#include <stdint.h>
+#include "htslib/sam.h"
+#include "coverage_bins.h"
+#include "target_index.h"
+
+/*
+ * Depth of coordinate sorted reads as they stream past, without a pass of its own.
+ * Read starts and ends go into a ring buffer difference array which is flushed up to
+ * the start of each new read, so memory is bounded by the longest read span rather
+ * than contig length. Every base of the header contigs (or of the targets when given)
+ * lands in the depth histogram and the @depth_ranges bins of PCAP::Bam::Coverage.
+ */
+// Receives each final run of equal depth, before any target clipping. Non-zero return is an error.
+typedef int (*coverage_window_run_f)(void *data, int tid, hts_pos_t beg, hts_pos_t end, int32_t depth);
+
+typedef struct {
+  const bam_hdr_t *head;
+  const target_index_t *ti; // NULL for genome wide
+  int32_t *diff;            // ring buffer, position p at diff[p & mask]
+  hts_pos_t mask;
+  int tid;                  // contig being flushed, -1 before the first read
+  int contig_done;          // tid has been flushed to its end
+  int ti_contig;            // index of tid in ti, -1 when it has no targets
+  int next_iv;              // first target of ti_contig not wholly flushed
+  hts_pos_t flushed;        // bases before this on tid are final
+  hts_pos_t max_end;        // furthest read end added on tid
+  hts_pos_t last_pos;       // for the sort order check
+  int32_t depth;            // depth at flushed-1 after applying diff
+  uint64_t *hist;           // bases at each depth
+  uint32_t hist_size;
+  coverage_bins_t bins;
+  coverage_window_run_f run_fn;
+  void *run_data;
+} coverage_window_t;
+
+coverage_window_t *coverage_window_init(const bam_hdr_t *head, const target_index_t *ti);
+
+// Adds a read, reads filtered as xam_coverage are ignored. -1 when input is not coordinate sorted.
+int coverage_window_add(coverage_window_t *cw, const bam1_t *b);
+
+/*
+ * Lower level than coverage_window_add for callers that count part of a read, e.g. aligned
+ * blocks only. Advance to each read's start and then add spans at or after it.
+ */
+int coverage_window_advance(coverage_window_t *cw, int tid, hts_pos_t pos);
+int coverage_window_add_span(coverage_window_t *cw, hts_pos_t beg, hts_pos_t end);
+
+// Passes every run to fn as well as the histogram.
+void coverage_window_set_runs(coverage_window_t *cw, coverage_window_run_f fn, void *data);
+
+/*
+ * For per-contig workers, starts contig tid without visiting the contigs before it,
+ * and flushes the current contig to its end.
+ */
+int coverage_window_seek(coverage_window_t *cw, int tid);
+int coverage_window_finish_contig(coverage_window_t *cw);
+
+// Flushes the remaining bases of every contig (and targets on contigs not in the header) as depth 0.
+int coverage_window_finish(coverage_window_t *cw);
+
+// 'depth<TAB>bases' for each depth seen, in depth order, after a header line.
+int coverage_window_print_hist(const coverage_window_t *cw, FILE *out);
+
+// Writes the bins line and/or the histogram, either file may be NULL, "-" is stdout.
+int coverage_window_write(const coverage_window_t *cw, const char *bins_file, const char *hist_file);
+
+void coverage_window_destroy(coverage_window_t *cw);
+
+#endif
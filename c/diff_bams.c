@@ -24,12 +24,16 @@
 #include "htslib/thread_pool.h"
 #include "khash.h"
 #include "dbg.h"
+#include "hfile_readahead.h"
+#include "ref_cache.h"
 
 KHASH_MAP_INIT_INT(posn,int32_t)
 KHASH_MAP_INIT_INT(chrom,khash_t(posn))
 
 char *bam_a_loc = NULL;
 char *bam_b_loc = NULL;
+char *readahead_opt = NULL;
+size_t readahead = 0;
 char *ref_file = NULL;
 int skip_z = 0;
 int count_flag_diff = 0;
@@ -56,8 +60,10 @@ void print_usage (int exit_code){
 	printf ("-a --bam_a          The first BAM|CRAM file.\n");
 	printf ("-b --bam_b          The second BAM|CRAM file.\n\n");
 	printf ("Other:\n");
-  printf ("-r --ref            Required for CRAM, genome.fa with co-located fai.\n");
+  printf ("-r --ref            Required for CRAM, genome.fa with co-located fai or a ref_cache_build directory.\n");
   printf ("-c --count          Count flag differences.\n");
+	printf ("-R --readahead      Read the inputs through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+	printf ("                    default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
 	printf ("-@ --num_threads    Use thread pool with specified number of threads.\n");
   printf ("-s --skip           Don't include reads with MAPQ=0 in comparison.\n\n");
   printf ("-h --help           Display this usage information.\n");
@@ -77,6 +83,7 @@ int options(int argc, char *argv[]){
               {"skip",no_argument,0,'s'},
               {"count",no_argument,0,'c'},
 							{"num_threads",required_argument,0,'@'},
+							{"readahead",required_argument,0,'R'},
               { NULL, 0, NULL, 0}
 
    }; //End of declaring opts
@@ -85,7 +92,7 @@ int options(int argc, char *argv[]){
    int iarg = 0;
 
      //Iterate through options
-   while((iarg = getopt_long(argc, argv, "a:b:r:@:scvh", long_opts, &index)) != -1){
+   while((iarg = getopt_long(argc, argv, "a:b:r:@:R:scvh", long_opts, &index)) != -1){
     switch(iarg){
       case 's':
         skip_z = 1;
@@ -115,6 +122,10 @@ int options(int argc, char *argv[]){
         print_version(0);
         break;
 
+			case 'R':
+				readahead_opt = optarg;
+				break;
+
 			case '@':
 				check(sscanf(optarg, "%i", &nthreads)==1, "Error parsing -@ argument '%s'. Should be an integer > 0", optarg);
 				break;
@@ -130,6 +141,9 @@ int options(int argc, char *argv[]){
 
    }//End of iteration through options
 
+   //-R overrides $PCAP_READAHEAD
+   if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
+
    //Do some checking to ensure required arguments were passed and are accessible files
   if(ref_file != NULL){
     if(check_exist(ref_file) != 1){
@@ -176,15 +190,15 @@ int main(int argc, char *argv[]){
   int err = options(argc, argv);
 	check(err==0,"Error parsing options.");
 	//Open bam file a
-  htsa = hts_open(bam_a_loc,"r");
+  htsa = hfile_readahead_hts_open(bam_a_loc, readahead);
   check(htsa != NULL, "Error opening hts file 'a' for reading '%s'.",bam_a_loc);
   //Open bam file b
-  htsb = hts_open(bam_b_loc,"r");
+  htsb = hfile_readahead_hts_open(bam_b_loc, readahead);
   check(htsb != NULL, "Error opening hts file 'b' for reading '%s'.",bam_b_loc);
 
   if(ref_file){
-    hts_set_fai_filename(htsa, ref_file);
-    hts_set_fai_filename(htsb, ref_file);
+    ref_cache_set_reference(htsa, ref_file);
+    ref_cache_set_reference(htsb, ref_file);
   }
 
   heada = sam_hdr_read(htsa);
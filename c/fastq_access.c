@@ -0,0 +1,124 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "fastq_access.h"
+
+fastq_reader_t *fastq_access_open(const char *file, htsThreadPool *p){
+  fastq_reader_t *fq = calloc(1, sizeof(fastq_reader_t));
+  check_mem(fq);
+  fq->fp = bgzf_open(file, "r");
+  check(fq->fp != NULL, "Error opening fastq file for reading '%s'.", file);
+  // Only has an effect for BGZF input, plain gzip is decompressed on the calling thread
+  if(p != NULL && p->pool != NULL){
+    check(bgzf_thread_pool(fq->fp, p->pool, p->qsize)==0, "Error attaching thread pool to '%s'.", file);
+  }
+  return fq;
+
+error:
+  if(fq){
+    if(fq->fp) bgzf_close(fq->fp);
+    free(fq);
+  }
+  return NULL;
+}
+
+/*
+ * Reads the next four line record into fq->rec.
+ * Returns 1 when a record was read, 0 at a clean EOF and -1 on error or truncated/malformed record.
+ */
+int fastq_access_next(fastq_reader_t *fq){
+  int i = 0;
+  int ret = 0;
+  size_t seq_len = 0;
+  fq->rec.l = 0;
+  fq->offset = bgzf_tell(fq->fp);
+  for(i=0; i<4; i++){
+    ret = bgzf_getline(fq->fp, '\n', &fq->line);
+    if(ret == -1 && i == 0) return 0; // EOF between records
+    check(ret >= 0, "Truncated fastq record after %"PRIu64" complete records.", fq->n_records);
+    switch(i){
+      case 0:
+        check(fq->line.l > 1 && fq->line.s[0] == '@', "Malformed fastq header line after %"PRIu64" records: '%s'.", fq->n_records, fq->line.s);
+        break;
+      case 1:
+        seq_len = fq->line.l;
+        break;
+      case 2:
+        check(fq->line.l > 0 && fq->line.s[0] == '+', "Malformed fastq separator line after %"PRIu64" records.", fq->n_records);
+        break;
+      case 3:
+        check(fq->line.l == seq_len, "Sequence and quality lengths differ after %"PRIu64" records.", fq->n_records);
+        break;
+    }
+    check(kputsn(fq->line.s, fq->line.l, &fq->rec) >= 0 && kputc('\n', &fq->rec) >= 0, "Error buffering fastq record.");
+  }
+  // name runs from after '@' to first whitespace, less any /1 or /2
+  size_t name_len = strcspn(fq->rec.s+1, " \t\n");
+  if(name_len > 2 && fq->rec.s[name_len-1] == '/' && (fq->rec.s[name_len] == '1' || fq->rec.s[name_len] == '2')){
+    name_len -= 2;
+  }
+  fq->name_len = name_len;
+  fq->n_records++;
+  return 1;
+
+error:
+  return -1;
+}
+
+int fastq_access_seek(fastq_reader_t *fq, int64_t offset){
+  check(bgzf_seek(fq->fp, offset, SEEK_SET) >= 0, "Error seeking to virtual offset %"PRId64".", offset);
+  return 0;
+
+error:
+  return -1;
+}
+
+/*
+ * Plain and BGZF compressed files can be positioned with bgzf_seek, plain gzip can only be streamed.
+ * Returns 1 if seekable, 0 if not and -1 on error.
+ */
+int fastq_access_is_seekable(const char *file){
+  BGZF *fp = bgzf_open(file, "r");
+  check(fp != NULL, "Error opening fastq file for reading '%s'.", file);
+  int compression = bgzf_compression(fp);
+  bgzf_close(fp);
+  return compression == 1 ? 0 : 1;
+
+error:
+  return -1;
+}
+
+int fastq_access_names_match(const char *name1, size_t len1, const char *name2, size_t len2){
+  if(len1 != len2) return 0;
+  return memcmp(name1, name2, len1) == 0;
+}
+
+int fastq_access_close(fastq_reader_t *fq){
+  int ret = 0;
+  if(fq == NULL) return 0;
+  if(fq->fp) ret = bgzf_close(fq->fp);
+  free(fq->line.s);
+  free(fq->rec.s);
+  free(fq);
+  return ret;
+}
@@ -0,0 +1,51 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __fastq_access_h__
+#define __fastq_access_h__
+
+#include <stdint.h>
+#include "htslib/bgzf.h"
+#include "htslib/kstring.h"
+#include "htslib/thread_pool.h"
+#include "dbg.h"
+
+typedef struct {
+  BGZF *fp;
+  kstring_t line;
+  kstring_t rec;    //Current record, all four lines newline terminated
+  size_t name_len;  //Length of the read name in rec (after '@'), excluding any /1 /2 suffix
+  int64_t offset;   //Virtual offset of the start of rec, valid for plain and BGZF input
+  uint64_t n_records;
+} fastq_reader_t;
+
+fastq_reader_t *fastq_access_open(const char *file, htsThreadPool *p);
+
+int fastq_access_next(fastq_reader_t *fq);
+
+int fastq_access_seek(fastq_reader_t *fq, int64_t offset);
+
+int fastq_access_is_seekable(const char *file);
+
+int fastq_access_names_match(const char *name1, size_t len1, const char *name2, size_t len2);
+
+int fastq_access_close(fastq_reader_t *fq);
+
+#endif
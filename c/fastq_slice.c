@@ -0,0 +1,190 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <getopt.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "htslib/thread_pool.h"
+#include "fastq_access.h"
+
+char *slice_file = NULL;
+char *output_file = NULL;
+int nthreads = 0;
+int debug = 0;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: fastq_slice -i file.fqs [-o file] [-@ threads] [-h] [-v]\n\n");
+  printf ("Streams the records of a fastq slice, as described by 'fastq_split --virtual', as plain text.\n\n");
+  printf ("-i --input                  Slice descriptor (*.fqs) to read.\n\n");
+  printf ("Optional:\n");
+  printf ("-o --output                 Path to output [stdout].\n");
+  printf ("-@ --threads                Number of BGZF decompression threads [0].\n\n");
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-d --debug     Turn on debug mode.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"debug",no_argument,0,'d'},
+            {"input",required_argument,0,'i'},
+            {"output",required_argument,0,'o'},
+            {"threads",required_argument,0,'@'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "i:o:@:vdh", long_opts, &index)) != -1){
+    switch(iarg){
+      case 'i':
+        slice_file = optarg;
+        break;
+
+      case 'o':
+        output_file = optarg;
+        break;
+
+      case '@':
+        if(sscanf(optarg, "%i", &nthreads) != 1){
+          sentinel("Error parsing -@ nThreads) argument '%s'. Should be an integer",optarg);
+        }
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case 'd':
+        debug=1;
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  if(slice_file == NULL && optind < argc) slice_file = argv[optind];
+  if(slice_file == NULL || check_exist(slice_file) != 1){
+    printf("Slice file (-i) %s does not exist.\n", slice_file ? slice_file : "");
+    print_usage(1);
+  }
+  if (output_file==NULL || strcmp(output_file,"/dev/stdout")==0) {
+    output_file = "-";
+  }
+  return 0;
+
+  error:
+    return 1;
+}
+
+int main(int argc, char *argv[]){
+  FILE *desc = NULL;
+  FILE *out = NULL;
+  fastq_reader_t *fq = NULL;
+  char *fastq = NULL;
+  int64_t offset = 0;
+  uint64_t records = 0;
+  uint64_t written = 0;
+  htsThreadPool p = {NULL, 0};
+  int ret = 0;
+
+  int problem = options(argc,argv);
+  check(problem==0,"Error parsing options.");
+
+  desc = fopen(slice_file, "r");
+  check(desc != NULL, "Error opening slice file '%s'.", slice_file);
+  check(fscanf(desc, "%m[^\t]\t%"SCNd64"\t%"SCNu64, &fastq, &offset, &records) == 3, "Malformed slice file '%s'.", slice_file);
+  fclose(desc);
+  desc = NULL;
+  if(debug==1) fprintf(stderr,"Reading %"PRIu64" records from %s at virtual offset %"PRId64".\n", records, fastq, offset);
+
+  if (nthreads > 0) {
+    p.pool = hts_tpool_init(nthreads);
+    check(p.pool != NULL,"Error creating thread pool");
+  }
+
+  fq = fastq_access_open(fastq, &p);
+  check(fq != NULL, "Error opening fastq '%s'.", fastq);
+  check(fastq_access_seek(fq, offset) == 0, "Error positioning '%s' for slice '%s'.", fastq, slice_file);
+
+  if(strcmp(output_file, "-") == 0){
+    out = stdout;
+  }
+  else{
+    out = fopen(output_file, "w");
+    check(out != NULL, "Error opening output file '%s'.", output_file);
+  }
+  setvbuf(out, NULL, _IOFBF, 1<<20);
+
+  while(written < records && (ret = fastq_access_next(fq)) == 1){
+    check(fwrite(fq->rec.s, 1, fq->rec.l, out) == fq->rec.l, "Error writing record to '%s'.", output_file);
+    written++;
+  }
+  check(ret >= 0, "Error reading fastq '%s'.", fastq);
+  check(written == records, "Slice '%s' expected %"PRIu64" records, only %"PRIu64" available.", slice_file, records, written);
+
+  check(fflush(out) == 0, "Error flushing output '%s'.", output_file);
+  if(out != stdout) fclose(out);
+  fastq_access_close(fq);
+  free(fastq);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return 0;
+
+error:
+  if(desc) fclose(desc);
+  if(out && out != stdout) fclose(out);
+  if(fq) fastq_access_close(fq);
+  free(fastq);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return 1;
+}
@@ -0,0 +1,408 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <getopt.h>
+#include <pthread.h>
+#include <limits.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "htslib/bgzf.h"
+#include "htslib/thread_pool.h"
+#include "fastq_access.h"
+
+char *fq1_file = NULL;
+char *fq2_file = NULL;
+char *fqi_file = NULL;
+char *out_dir = NULL;
+uint64_t pairs_per_chunk = 10000000;
+int nthreads = 0;
+int clevel = 1;
+int is_virtual = 0;
+int debug = 0;
+
+typedef struct {
+  const char *in_file;
+  char *real_path;
+  const char *prefix;
+  uint64_t records_per_chunk;
+  int interleaved;
+  htsThreadPool *pool;
+  // results
+  int status;
+  uint64_t n_records;
+  int n_chunks;
+  kstring_t *chunk_names; //First read name of each chunk, used to confirm ends are in sync
+} split_job_t;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: fastq_split -1 file -2 file -o dir [-n pairs] [-@ threads] [-h] [-v]\n");
+  printf ("       fastq_split -i file -o dir [-n pairs] [-@ threads] [-h] [-v]\n\n");
+  printf ("Splits (gzip/bgzip/plain) paired fastq into gzip compressed chunks of whole read pairs.\n");
+  printf ("Output is written as <dir>/pairedfq1.NNN.gz and <dir>/pairedfq2.NNN.gz, or <dir>/i.NNN.gz for interleaved input.\n");
+  printf ("With --virtual and plain or bgzip input only slice descriptors (*.NNN.fqs) are written, read them with fastq_slice.\n\n");
+  printf ("-1 --read1                  File path for read 1 fastq.\n");
+  printf ("-2 --read2                  File path for read 2 fastq.\n");
+  printf ("-i --interleaved            File path for interleaved fastq (instead of -1/-2).\n");
+  printf ("-o --outdir                 Folder to write chunks to.\n\n");
+  printf ("Optional:\n");
+  printf ("-n --pairs                  Number of read pairs per chunk [%"PRIu64"].\n", pairs_per_chunk);
+  printf ("-@ --threads                Number of additional (de)compression threads [0].\n");
+  printf ("                            Ends are always read in parallel for paired input.\n");
+  printf ("-l --compression-level      0-9: set output compression level [%d].\n", clevel);
+  printf ("-x --virtual                Record offsets of each chunk instead of writing the data.\n");
+  printf ("                            Falls back to writing chunks when any input is plain gzip.\n\n");
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-d --debug     Turn on debug mode.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"debug",no_argument,0,'d'},
+            {"read1",required_argument,0,'1'},
+            {"read2",required_argument,0,'2'},
+            {"interleaved",required_argument,0,'i'},
+            {"outdir",required_argument,0,'o'},
+            {"pairs",required_argument,0,'n'},
+            {"threads",required_argument,0,'@'},
+            {"compression-level",required_argument,0,'l'},
+            {"virtual",no_argument,0,'x'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "1:2:i:o:n:@:l:xvdh", long_opts, &index)) != -1){
+    switch(iarg){
+      case '1':
+        fq1_file = optarg;
+        break;
+
+      case '2':
+        fq2_file = optarg;
+        break;
+
+      case 'i':
+        fqi_file = optarg;
+        break;
+
+      case 'o':
+        out_dir = optarg;
+        break;
+
+      case 'n':
+        if(sscanf(optarg, "%"SCNu64, &pairs_per_chunk) != 1 || pairs_per_chunk == 0){
+          sentinel("Error parsing -n (pairs) argument '%s'. Should be a positive integer",optarg);
+        }
+        break;
+
+      case '@':
+        if(sscanf(optarg, "%i", &nthreads) != 1){
+          sentinel("Error parsing -@ nThreads) argument '%s'. Should be an integer",optarg);
+        }
+        break;
+
+      case 'l':
+        if(sscanf(optarg, "%i", &clevel) != 1 || clevel < 0 || clevel > 9){
+          sentinel("Error parsing -l (compression level) argument '%s'. Should be an integer 0-9",optarg);
+        }
+        break;
+
+      case 'x':
+        is_virtual = 1;
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case 'd':
+        debug=1;
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  if(fqi_file == NULL && (fq1_file == NULL || fq2_file == NULL)){
+    printf("Either -1 and -2, or -i must be defined.\n");
+    print_usage(1);
+  }
+  if(fqi_file != NULL && (fq1_file != NULL || fq2_file != NULL)){
+    printf("-i cannot be combined with -1/-2.\n");
+    print_usage(1);
+  }
+  if(out_dir == NULL){
+    printf("Output folder (-o) must be defined.\n");
+    print_usage(1);
+  }
+  char *to_check[3] = {fq1_file, fq2_file, fqi_file};
+  int i=0;
+  for(i=0;i<3;i++){
+    if(to_check[i] != NULL && check_exist(to_check[i]) != 1){
+      printf("Input file %s does not exist.\n",to_check[i]);
+      print_usage(1);
+    }
+  }
+  return 0;
+
+  error:
+    return 1;
+}
+
+BGZF *open_chunk(split_job_t *job, kstring_t *fname, int chunk){
+  char mode[4];
+  BGZF *out = NULL;
+  fname->l = 0;
+  check(ksprintf(fname, "%s/%s.%03d.gz", out_dir, job->prefix, chunk) >= 0, "Error building chunk file name.");
+  sprintf(mode, "w%d", clevel);
+  out = bgzf_open(fname->s, mode);
+  check(out != NULL, "Error opening chunk for writing '%s'.", fname->s);
+  if(job->pool->pool){
+    check(bgzf_thread_pool(out, job->pool->pool, job->pool->qsize)==0, "Error attaching thread pool to '%s'.", fname->s);
+  }
+  return out;
+
+error:
+  if(out) bgzf_close(out);
+  return NULL;
+}
+
+// Position in the file on disk, compressed bytes for bgzip and plain bytes otherwise
+static int64_t file_pos(BGZF *fp, int64_t offset){
+  return fp->is_compressed ? offset >> 16 : (offset >> 16) + (offset & 0xFFFF);
+}
+
+int write_slice(split_job_t *job, kstring_t *fname, int chunk, int64_t offset, uint64_t records, int64_t bytes){
+  FILE *out = NULL;
+  fname->l = 0;
+  check(ksprintf(fname, "%s/%s.%03d.fqs", out_dir, job->prefix, chunk) >= 0, "Error building slice file name.");
+  out = fopen(fname->s, "w");
+  check(out != NULL, "Error opening slice for writing '%s'.", fname->s);
+  check(fprintf(out, "%s\t%"PRId64"\t%"PRIu64"\t%"PRId64"\n", job->real_path, offset, records, bytes) > 0, "Error writing slice '%s'.", fname->s);
+  check(fclose(out) == 0, "Error closing slice '%s'.", fname->s);
+  return 0;
+
+error:
+  return -1;
+}
+
+/*
+ * Each end is split by an independent thread so decompression of R1 and R2 proceeds in parallel.
+ * Cuts are only made on record boundaries and at identical record counts, the first read name of
+ * each chunk is retained so the caller can confirm the ends are still in sync.
+ */
+void *split_end(void *arg){
+  split_job_t *job = (split_job_t *)arg;
+  fastq_reader_t *fq = NULL;
+  BGZF *out = NULL;
+  kstring_t fname = {0,0,NULL};
+  kstring_t prev_name = {0,0,NULL};
+  uint64_t in_chunk = 0;
+  int64_t chunk_start = 0;
+  int ret;
+
+  job->status = 1;
+  fq = fastq_access_open(job->in_file, job->pool);
+  check(fq != NULL, "Error opening fastq '%s'.", job->in_file);
+
+  while((ret = fastq_access_next(fq)) == 1){
+    if(in_chunk == 0){
+      if(is_virtual){
+        chunk_start = fq->offset;
+      }
+      else{
+        out = open_chunk(job, &fname, job->n_chunks);
+        check(out != NULL, "Error creating chunk %d for '%s'.", job->n_chunks, job->in_file);
+      }
+      job->chunk_names = realloc(job->chunk_names, sizeof(kstring_t) * (job->n_chunks+1));
+      check_mem(job->chunk_names);
+      kstring_t first = {0,0,NULL};
+      check(kputsn(fq->rec.s+1, fq->name_len, &first) >= 0, "Error storing read name.");
+      job->chunk_names[job->n_chunks++] = first;
+    }
+    if(job->interleaved){
+      if(fq->n_records % 2 == 1){
+        prev_name.l = 0;
+        check(kputsn(fq->rec.s+1, fq->name_len, &prev_name) >= 0, "Error storing read name.");
+      }
+      else{
+        check(fastq_access_names_match(prev_name.s, prev_name.l, fq->rec.s+1, fq->name_len),
+                "Interleaved records out of sync at record %"PRIu64" of '%s'.", fq->n_records, job->in_file);
+      }
+    }
+    if(!is_virtual){
+      check(bgzf_write(out, fq->rec.s, fq->rec.l) == (ssize_t)fq->rec.l, "Error writing to '%s'.", fname.s);
+    }
+    if(++in_chunk == job->records_per_chunk){
+      if(is_virtual){
+        int64_t bytes = file_pos(fq->fp, bgzf_tell(fq->fp)) - file_pos(fq->fp, chunk_start);
+        check(write_slice(job, &fname, job->n_chunks-1, chunk_start, in_chunk, bytes)==0, "Error recording slice for '%s'.", job->in_file);
+      }
+      else{
+        check(bgzf_close(out) == 0, "Error closing '%s'.", fname.s);
+        out = NULL;
+      }
+      in_chunk = 0;
+    }
+  }
+  check(ret == 0, "Error reading fastq '%s'.", job->in_file);
+  if(in_chunk > 0){
+    if(is_virtual){
+      int64_t bytes = file_pos(fq->fp, bgzf_tell(fq->fp)) - file_pos(fq->fp, chunk_start);
+      check(write_slice(job, &fname, job->n_chunks-1, chunk_start, in_chunk, bytes)==0, "Error recording slice for '%s'.", job->in_file);
+    }
+    else{
+      check(bgzf_close(out) == 0, "Error closing '%s'.", fname.s);
+      out = NULL;
+    }
+  }
+  job->n_records = fq->n_records;
+  check(!job->interleaved || job->n_records % 2 == 0, "Odd number of records in interleaved fastq '%s'.", job->in_file);
+  if(debug==1) fprintf(stderr,"%s: %"PRIu64" records in %d chunks.\n", job->in_file, job->n_records, job->n_chunks);
+
+  check(fastq_access_close(fq) == 0, "Error closing fastq '%s'.", job->in_file);
+  free(fname.s);
+  free(prev_name.s);
+  job->status = 0;
+  return NULL;
+
+error:
+  if(out) bgzf_close(out);
+  if(fq) fastq_access_close(fq);
+  free(fname.s);
+  free(prev_name.s);
+  return NULL;
+}
+
+void free_job(split_job_t *job){
+  int i=0;
+  free(job->real_path);
+  for(i=0;i<job->n_chunks;i++) free(job->chunk_names[i].s);
+  free(job->chunk_names);
+}
+
+int main(int argc, char *argv[]){
+  split_job_t jobs[2];
+  int n_jobs = 0;
+  int i = 0;
+  htsThreadPool p = {NULL, 0};
+  pthread_t tid[2];
+
+  int problem = options(argc,argv);
+  check(problem==0,"Error parsing options.");
+
+  if (nthreads > 0) {
+    p.pool = hts_tpool_init(nthreads);
+    check(p.pool != NULL,"Error creating thread pool");
+  }
+
+  memset(jobs, 0, sizeof(jobs));
+  if(fqi_file != NULL){
+    jobs[0].in_file = fqi_file;
+    jobs[0].prefix = "i";
+    jobs[0].records_per_chunk = pairs_per_chunk * 2;
+    jobs[0].interleaved = 1;
+    n_jobs = 1;
+  }
+  else{
+    jobs[0].in_file = fq1_file;
+    jobs[0].prefix = "pairedfq1";
+    jobs[1].in_file = fq2_file;
+    jobs[1].prefix = "pairedfq2";
+    jobs[0].records_per_chunk = jobs[1].records_per_chunk = pairs_per_chunk;
+    n_jobs = 2;
+  }
+
+  for(i=0;i<n_jobs;i++){
+    if(is_virtual){
+      int seekable = fastq_access_is_seekable(jobs[i].in_file);
+      check(seekable >= 0, "Error checking compression of '%s'.", jobs[i].in_file);
+      if(seekable == 0){
+        fprintf(stderr, "%s is not bgzip compressed, writing physical chunks.\n", jobs[i].in_file);
+        is_virtual = 0;
+      }
+    }
+    // descriptors must remain valid whatever the working directory of the reader
+    jobs[i].real_path = realpath(jobs[i].in_file, NULL);
+    check(jobs[i].real_path != NULL, "Error resolving path of '%s'.", jobs[i].in_file);
+  }
+
+  for(i=0;i<n_jobs;i++){
+    jobs[i].pool = &p;
+    check(pthread_create(&tid[i], NULL, split_end, &jobs[i]) == 0, "Error starting split thread for '%s'.", jobs[i].in_file);
+  }
+  for(i=0;i<n_jobs;i++){
+    check(pthread_join(tid[i], NULL) == 0, "Error joining split thread for '%s'.", jobs[i].in_file);
+  }
+  for(i=0;i<n_jobs;i++){
+    check(jobs[i].status == 0, "Failed to split '%s'.", jobs[i].in_file);
+  }
+
+  if(n_jobs == 2){
+    check(jobs[0].n_records == jobs[1].n_records, "Read 1 and read 2 fastq have different record counts (%"PRIu64" vs %"PRIu64").", jobs[0].n_records, jobs[1].n_records);
+    for(i=0;i<jobs[0].n_chunks;i++){
+      check(fastq_access_names_match(jobs[0].chunk_names[i].s, jobs[0].chunk_names[i].l, jobs[1].chunk_names[i].s, jobs[1].chunk_names[i].l),
+              "Read names out of sync at start of chunk %d: '%s' vs '%s'.", i, jobs[0].chunk_names[i].s, jobs[1].chunk_names[i].s);
+    }
+  }
+
+  for(i=0;i<n_jobs;i++) free_job(&jobs[i]);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return 0;
+
+error:
+  for(i=0;i<n_jobs;i++) free_job(&jobs[i]);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return 1;
+}
@@ -0,0 +1,65 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __hfile_backend_h__
+#define __hfile_backend_h__
+
+/*
+ * The hFILE backend interface used by hfile_md5, hfile_tee and hfile_readahead.
+ * htslib keeps it in hfile_internal.h, which an installed htslib does not ship,
+ * so the few declarations needed are copied here from htslib 1.20
+ * (Copyright (C) 2013-2021 Genome Research Ltd., MIT licence, see htslib LICENSE).
+ * libhts exports these symbols for its own hFILE plugins and the layout has not
+ * changed since plugins were introduced; the guard below refuses older htslib.
+ */
+
+#include <sys/types.h>
+#include "htslib/hts.h"
+#include "htslib/hfile.h"
+
+#if !defined(HTS_VERSION) || HTS_VERSION < 101000
+#error "htslib >= 1.10 is required for the hFILE backend interface"
+#endif
+
+// htslib's own copy has already been included, it is identical
+#ifndef HFILE_INTERNAL_H
+
+struct hFILE_backend {
+  ssize_t (*read)(hFILE *fp, void *buffer, size_t nbytes);
+  ssize_t (*write)(hFILE *fp, const void *buffer, size_t nbytes);
+  off_t (*seek)(hFILE *fp, off_t offset, int whence);
+  int (*flush)(hFILE *fp);
+  int (*close)(hFILE *fp);
+};
+
+/*
+ * Allocates struct_size bytes (a struct whose first member is hFILE) with a
+ * capacity byte buffer, 0 for the default.
+ */
+hFILE *hfile_init(size_t struct_size, const char *mode, size_t capacity);
+
+/*
+ * Frees an hFILE from hfile_init that was never handed out, errno is preserved.
+ */
+void hfile_destroy(hFILE *fp);
+
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <errno.h>
+#include "hfile_backend.h"
+#include "dbg.h"
+#include "hfile_md5.h"
+
+typedef struct {
+  hFILE base;
+  hFILE *inner;
+  hts_md5_context *ctx;
+} hFILE_md5;
+
+static ssize_t md5_read(hFILE *fpv, void *buffer, size_t nbytes){
+  errno = EBADF;
+  return -1;
+}
+
+static ssize_t md5_write(hFILE *fpv, const void *buffer, size_t nbytes){
+  hFILE_md5 *fp = (hFILE_md5 *) fpv;
+  ssize_t n = hwrite(fp->inner, buffer, nbytes);
+  if(n > 0) hts_md5_update(fp->ctx, buffer, n);
+  return n;
+}
+
+static off_t md5_seek(hFILE *fpv, off_t offset, int whence){
+  // htell() is answered by the base hFILE, any real seek would invalidate the digest
+  errno = ESPIPE;
+  return -1;
+}
+
+static int md5_flush(hFILE *fpv){
+  hFILE_md5 *fp = (hFILE_md5 *) fpv;
+  return hflush(fp->inner);
+}
+
+static int md5_close(hFILE *fpv){
+  hFILE_md5 *fp = (hFILE_md5 *) fpv;
+  return hclose(fp->inner);
+}
+
+static const struct hFILE_backend md5_backend = {
+  md5_read, md5_write, md5_seek, md5_flush, md5_close
+};
+
+hFILE *hfile_md5_wrap(hFILE *inner, hts_md5_context *ctx){
+  hFILE_md5 *fp = NULL;
+  check(inner != NULL, "No hFILE to wrap.");
+  check(ctx != NULL, "No md5 context provided.");
+  fp = (hFILE_md5 *) hfile_init(sizeof(hFILE_md5), "w", 0);
+  check(fp != NULL, "Error creating md5 hFILE.");
+  fp->inner = inner;
+  fp->ctx = ctx;
+  fp->base.backend = &md5_backend;
+  return &fp->base;
+
+error:
+  return NULL;
+}
+
+int hfile_md5_write_hex(hts_md5_context *ctx, const char *file, const char *name){
+  unsigned char digest[16];
+  char hex[33];
+  FILE *out = NULL;
+  hts_md5_final(digest, ctx);
+  hts_md5_hex(hex, digest);
+  out = fopen(file, "w");
+  check(out != NULL, "Error opening '%s' for writing.", file);
+  if(name){
+    check(fprintf(out, "%s *%s\n", hex, name) > 0, "Error writing md5 to '%s'.", file);
+  }else{
+    check(fputs(hex, out) >= 0, "Error writing md5 to '%s'.", file);
+  }
+  check(fclose(out) == 0, "Error closing '%s'.", file);
+  return 0;
+
+error:
+  if(out) fclose(out);
+  return -1;
+}
@@ -0,0 +1,40 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __hfile_md5_h__
+#define __hfile_md5_h__
+
+#include "htslib/hfile.h"
+#include "htslib/hts.h"
+
+/*
+ * Wraps an open hFILE so that every byte written through it is also added to ctx.
+ * The returned handle owns inner (closed via hclose) but not ctx, so the digest
+ * can be finalised after the file is closed. Write only, seeking is refused.
+ */
+hFILE *hfile_md5_wrap(hFILE *inner, hts_md5_context *ctx);
+
+/*
+ * Finalises ctx and writes the lowercase hex digest (no newline) to file.
+ * When name is set the line is written as 'md5sum -b' would for that name.
+ */
+int hfile_md5_write_hex(hts_md5_context *ctx, const char *file, const char *name);
+
+#endif
@@ -0,0 +1,290 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include "hfile_backend.h"
+#include "dbg.h"
+#include "hfile_readahead.h"
+
+typedef struct {
+  char *data;
+  off_t offset; // file offset of data[0]
+  ssize_t len;  // bytes held, 0 at EOF, -1 after a failed read
+  int full;     // filled and not yet consumed, only the reader clears it
+} ra_buf_t;
+
+typedef struct {
+  hFILE base;
+  hFILE *inner;
+  size_t size;
+  ra_buf_t buf[2];
+  int cur;      // buffer the reader is consuming
+  size_t pos;   // bytes of buf[cur] consumed
+  off_t next;   // offset of the next fill
+  int err;      // errno of a failed read or seek
+  int stop;
+  int running;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} hFILE_readahead;
+
+// Prefetch thread, alternates between the buffers until EOF, an error or stop
+static void *ra_fill(void *arg){
+  hFILE_readahead *fp = (hFILE_readahead *) arg;
+  int i = fp->cur;
+  pthread_mutex_lock(&fp->lock);
+  while(!fp->stop){
+    ra_buf_t *buf = &fp->buf[i];
+    if(buf->full){
+      pthread_cond_wait(&fp->cond, &fp->lock);
+      continue;
+    }
+    // after a seek the first read only runs to the next aligned offset
+    off_t offset = fp->next;
+    size_t want = fp->size - (offset % HFILE_READAHEAD_ALIGN);
+    buf->offset = offset;
+    pthread_mutex_unlock(&fp->lock);
+    ssize_t n = hread(fp->inner, buf->data, want);
+    int err = errno;
+    pthread_mutex_lock(&fp->lock);
+    buf->len = n;
+    buf->full = 1;
+    if(n < 0) fp->err = err;
+    else fp->next = offset + n;
+    pthread_cond_broadcast(&fp->cond);
+    if(n <= 0) break; // the reader finds EOF or the error in this buffer
+    i ^= 1;
+  }
+  pthread_mutex_unlock(&fp->lock);
+  return NULL;
+}
+
+static int ra_start(hFILE_readahead *fp, off_t offset){
+  int res;
+  fp->buf[0].full = 0;
+  fp->buf[1].full = 0;
+  fp->buf[0].offset = offset;
+  fp->cur = 0;
+  fp->pos = 0;
+  fp->next = offset;
+  fp->err = 0;
+  fp->stop = 0;
+  res = pthread_create(&fp->thread, NULL, ra_fill, fp);
+  if(res != 0){
+    errno = res;
+    return -1;
+  }
+  fp->running = 1;
+  return 0;
+}
+
+static void ra_stop(hFILE_readahead *fp){
+  if(!fp->running) return;
+  pthread_mutex_lock(&fp->lock);
+  fp->stop = 1;
+  pthread_cond_broadcast(&fp->cond);
+  pthread_mutex_unlock(&fp->lock);
+  pthread_join(fp->thread, NULL);
+  fp->running = 0;
+}
+
+// Leaves the handle returning err from every read until a successful seek
+static void ra_fail(hFILE_readahead *fp, int err){
+  fp->cur = 0;
+  fp->pos = 0;
+  fp->buf[0].len = -1;
+  fp->buf[0].full = 1;
+  fp->err = err;
+}
+
+static ssize_t ra_read(hFILE *fpv, void *buffer, size_t nbytes){
+  hFILE_readahead *fp = (hFILE_readahead *) fpv;
+  ra_buf_t *buf = &fp->buf[fp->cur];
+  pthread_mutex_lock(&fp->lock);
+  while(!buf->full) pthread_cond_wait(&fp->cond, &fp->lock);
+  pthread_mutex_unlock(&fp->lock);
+  if(buf->len < 0){
+    errno = fp->err;
+    return -1;
+  }
+  size_t n = buf->len - fp->pos;
+  if(n > nbytes) n = nbytes;
+  memcpy(buffer, buf->data + fp->pos, n);
+  fp->pos += n;
+  if(buf->len > 0 && fp->pos == (size_t) buf->len){
+    // hand the buffer back for the block after the one now in buf[cur ^ 1]
+    pthread_mutex_lock(&fp->lock);
+    buf->full = 0;
+    fp->cur ^= 1;
+    fp->pos = 0;
+    pthread_cond_broadcast(&fp->cond);
+    pthread_mutex_unlock(&fp->lock);
+  }
+  return n;
+}
+
+static ssize_t ra_write(hFILE *fpv, const void *buffer, size_t nbytes){
+  errno = EBADF;
+  return -1;
+}
+
+static off_t ra_seek(hFILE *fpv, off_t offset, int whence){
+  hFILE_readahead *fp = (hFILE_readahead *) fpv;
+  int i;
+  // hseek() has already made SEEK_CUR absolute
+  if(whence == SEEK_SET){
+    pthread_mutex_lock(&fp->lock);
+    for(i=0;i<2;i++){
+      int b = fp->cur ^ i;
+      ra_buf_t *buf = &fp->buf[b];
+      if(!buf->full || buf->len <= 0 || offset < buf->offset || offset >= buf->offset + buf->len) continue;
+      // a full buffer other than cur always holds the block following it
+      if(b != fp->cur){
+        fp->buf[fp->cur].full = 0;
+        fp->cur = b;
+        pthread_cond_broadcast(&fp->cond);
+      }
+      fp->pos = offset - buf->offset;
+      pthread_mutex_unlock(&fp->lock);
+      return offset;
+    }
+    pthread_mutex_unlock(&fp->lock);
+  }
+  ra_stop(fp);
+  off_t pos = hseek(fp->inner, offset, whence);
+  if(pos < 0 || ra_start(fp, pos) != 0){
+    int err = errno;
+    ra_fail(fp, err);
+    errno = err;
+    return -1;
+  }
+  return pos;
+}
+
+static int ra_flush(hFILE *fpv){
+  return 0;
+}
+
+static int ra_close(hFILE *fpv){
+  hFILE_readahead *fp = (hFILE_readahead *) fpv;
+  ra_stop(fp);
+  free(fp->buf[0].data);
+  free(fp->buf[1].data);
+  pthread_cond_destroy(&fp->cond);
+  pthread_mutex_destroy(&fp->lock);
+  return hclose(fp->inner);
+}
+
+static const struct hFILE_backend ra_backend = {
+  ra_read, ra_write, ra_seek, ra_flush, ra_close
+};
+
+hFILE *hfile_readahead_wrap(hFILE *inner, size_t buffer_size){
+  hFILE_readahead *fp = NULL;
+  int i;
+  check(inner != NULL, "No hFILE to wrap.");
+  check(buffer_size >= HFILE_READAHEAD_MIN && buffer_size % HFILE_READAHEAD_ALIGN == 0,
+          "Readahead buffer size %zu is not a multiple of %d of at least %d.",buffer_size,HFILE_READAHEAD_ALIGN,HFILE_READAHEAD_MIN);
+  fp = (hFILE_readahead *) hfile_init(sizeof(hFILE_readahead), "r", 0);
+  check(fp != NULL, "Error creating readahead hFILE.");
+  fp->inner = inner;
+  fp->size = buffer_size;
+  fp->buf[0].data = NULL;
+  fp->buf[1].data = NULL;
+  fp->running = 0;
+  pthread_mutex_init(&fp->lock, NULL);
+  pthread_cond_init(&fp->cond, NULL);
+  for(i=0;i<2;i++){
+    check(posix_memalign((void **) &fp->buf[i].data, HFILE_READAHEAD_ALIGN, buffer_size) == 0, "Error allocating readahead buffer.");
+  }
+  check(ra_start(fp, htell(inner)) == 0, "Error starting readahead thread.");
+  fp->base.backend = &ra_backend;
+  return &fp->base;
+
+error:
+  if(fp){
+    free(fp->buf[0].data);
+    free(fp->buf[1].data);
+    pthread_cond_destroy(&fp->cond);
+    pthread_mutex_destroy(&fp->lock);
+    hfile_destroy(&fp->base);
+  }
+  return NULL;
+}
+
+int hfile_readahead_size(const char *str, size_t *size){
+  unsigned long long val;
+  char *end = NULL;
+  *size = 0;
+  if(str == NULL) str = getenv(HFILE_READAHEAD_ENV);
+  if(str == NULL || *str == '\0' || strcasecmp(str, "off") == 0) return 0;
+  check(isdigit((unsigned char) *str), "Readahead size '%s' is not a number.", str);
+  errno = 0;
+  val = strtoull(str, &end, 10);
+  check(errno == 0, "Readahead size '%s' is out of range.", str);
+  switch(toupper((unsigned char) *end)){
+    case 'G':
+      val <<= 10;
+      /* fall through */
+    case 'M':
+      val <<= 10;
+      /* fall through */
+    case 'K':
+      val <<= 10;
+      end++;
+      break;
+  }
+  check(*end == '\0', "Unrecognised readahead size '%s', expected e.g. 65536, 512K, 16M or 1G.", str);
+  if(val == 0) return 0;
+  val = (val + HFILE_READAHEAD_ALIGN - 1) / HFILE_READAHEAD_ALIGN * HFILE_READAHEAD_ALIGN;
+  check(val >= HFILE_READAHEAD_MIN, "Readahead size '%s' is below the minimum of %d.", str, HFILE_READAHEAD_MIN);
+  *size = val;
+  return 0;
+
+error:
+  return -1;
+}
+
+htsFile *hfile_readahead_hts_open(const char *fn, size_t buffer_size){
+  hFILE *hfp = NULL;
+  hFILE *ra = NULL;
+  htsFile *hts = NULL;
+  if(buffer_size == 0 || strcmp(fn, "-") == 0 || strstr(fn, HTS_IDX_DELIM) != NULL) return hts_open(fn, "r");
+  hfp = hopen(fn, "r");
+  check(hfp != NULL, "Error opening '%s'.", fn);
+  ra = hfile_readahead_wrap(hfp, buffer_size);
+  check(ra != NULL, "Error adding readahead to '%s'.", fn);
+  hfp = NULL;
+  hts = hts_hopen(ra, fn, "r");
+  check(hts != NULL, "Error opening '%s' as sequence data.", fn);
+  return hts;
+
+error:
+  if(ra) hclose_abruptly(ra);
+  if(hfp) hclose_abruptly(hfp);
+  return NULL;
+}
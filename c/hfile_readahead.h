@@ -0,0 +1,58 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __hfile_readahead_h__
+#define __hfile_readahead_h__
+
+#include <stddef.h>
+#include "htslib/hfile.h"
+#include "htslib/hts.h"
+
+// Environment variable holding the readahead buffer size when no option is given
+#define HFILE_READAHEAD_ENV "PCAP_READAHEAD"
+// Smallest buffer accepted, sizes are rounded up to a multiple of HFILE_READAHEAD_ALIGN
+#define HFILE_READAHEAD_MIN 65536
+#define HFILE_READAHEAD_ALIGN 4096
+
+/*
+ * Wraps an open hFILE with two buffers of buffer_size bytes. A dedicated
+ * thread fills one buffer with a single large read of inner while the reader
+ * consumes the other, so storage latency overlaps with decoding. Reads start
+ * on HFILE_READAHEAD_ALIGN boundaries. Seeking is supported, seeks inside the
+ * buffered data are free, others restart the prefetch at the new offset.
+ * The returned handle owns inner. Read only.
+ */
+hFILE *hfile_readahead_wrap(hFILE *inner, size_t buffer_size);
+
+/*
+ * Parses a size such as 65536, 512K, 16M or 1G into size. With str NULL the
+ * value of HFILE_READAHEAD_ENV is used, or 0 when that is unset. 0 or "off"
+ * disable readahead, otherwise the size is rounded up to a multiple of
+ * HFILE_READAHEAD_ALIGN and must be at least HFILE_READAHEAD_MIN.
+ */
+int hfile_readahead_size(const char *str, size_t *size);
+
+/*
+ * As hts_open(fn, "r"), reading through hfile_readahead_wrap when buffer_size
+ * is not 0. stdin and names carrying an index (##idx##) use plain hts_open.
+ */
+htsFile *hfile_readahead_hts_open(const char *fn, size_t buffer_size);
+
+#endif
@@ -0,0 +1,95 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <errno.h>
+#include "hfile_backend.h"
+#include "dbg.h"
+#include "hfile_tee.h"
+
+typedef struct {
+  hFILE base;
+  hFILE *inner;
+  hFILE *copy;
+} hFILE_tee;
+
+static ssize_t tee_read(hFILE *fpv, void *buffer, size_t nbytes){
+  hFILE_tee *fp = (hFILE_tee *) fpv;
+  ssize_t n = hread(fp->inner, buffer, nbytes);
+  if(n > 0 && hwrite(fp->copy, buffer, n) != n) return -1;
+  return n;
+}
+
+static ssize_t tee_write(hFILE *fpv, const void *buffer, size_t nbytes){
+  errno = EBADF;
+  return -1;
+}
+
+static off_t tee_seek(hFILE *fpv, off_t offset, int whence){
+  // htell() is answered by the base hFILE, a real seek would break the copy
+  errno = ESPIPE;
+  return -1;
+}
+
+static int tee_flush(hFILE *fpv){
+  return 0;
+}
+
+static int tee_close(hFILE *fpv){
+  hFILE_tee *fp = (hFILE_tee *) fpv;
+  int ret = hclose(fp->inner);
+  if(hclose(fp->copy) != 0) ret = -1;
+  return ret;
+}
+
+static const struct hFILE_backend tee_backend = {
+  tee_read, tee_write, tee_seek, tee_flush, tee_close
+};
+
+hFILE *hfile_tee_wrap(hFILE *inner, hFILE *copy){
+  hFILE_tee *fp = NULL;
+  check(inner != NULL, "No hFILE to wrap.");
+  check(copy != NULL, "No hFILE to copy to.");
+  fp = (hFILE_tee *) hfile_init(sizeof(hFILE_tee), "r", 0);
+  check(fp != NULL, "Error creating tee hFILE.");
+  fp->inner = inner;
+  fp->copy = copy;
+  fp->base.backend = &tee_backend;
+  return &fp->base;
+
+error:
+  return NULL;
+}
+
+int hfile_tee_drain(hFILE *tee){
+  hFILE_tee *fp = (hFILE_tee *) tee;
+  char buf[65536];
+  ssize_t n;
+  check(tee->backend == &tee_backend, "Not a tee hFILE.");
+  while((n = hread(fp->inner, buf, sizeof(buf))) > 0){
+    check(hwrite(fp->copy, buf, n) == n, "Error forwarding remaining input.");
+  }
+  check(n == 0, "Error reading remaining input.");
+  check(hflush(fp->copy) == 0, "Error flushing forwarded input.");
+  return 0;
+
+error:
+  return -1;
+}
@@ -0,0 +1,41 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __hfile_tee_h__
+#define __hfile_tee_h__
+
+#include "htslib/hfile.h"
+
+/*
+ * Wraps an open hFILE so that every byte read from inner is also written,
+ * unchanged, to copy as it is pulled in. Opening the result with hts_hopen
+ * lets a reader decode a stream while forwarding its raw (compressed) bytes.
+ * The returned handle owns both inner and copy, closing it closes both.
+ * Read only, seeking is refused.
+ */
+hFILE *hfile_tee_wrap(hFILE *inner, hFILE *copy);
+
+/*
+ * Forwards whatever the reader did not consume (e.g. bytes after the last
+ * record) to the copy and flushes it. Call before closing the reader.
+ */
+int hfile_tee_drain(hFILE *tee);
+
+#endif
@@ -22,11 +22,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include "dbg.h"
+#include "hfile_readahead.h"
+#include "ref_cache.h"
 #include "cram/cram.h"
 #include "htslib/thread_pool.h"
 #include "bam_access.h"
+#include "mismatch_access.h"
 
 char *input_file = NULL;
+char *readahead_opt = NULL;
+size_t readahead = 0;
 char *output_file = NULL;
 char *fn_ref = NULL;
 int nthreads = 0;
@@ -39,24 +44,10 @@ char* prog_desc="Marks a read as QCFAIL and adds aux tag 'mm' where the mismatch
 char* prog_cl = NULL;
 float mismatch_frac = 0.05;
 int debug=0;
-const char mm_tag[2] = "mm";
-const char tag_type = 'A';
-const char *MD_TAG = "MD";
-const char YES = 'Y';
 int is_correct_pp = 0;
 long long int marked_count = 0;
 hts_opt *in_opts = NULL;
 hts_opt *out_opts = NULL;
-#define _cop(c) ((c)&BAM_CIGAR_MASK)
-/*
-  Ignore mate unmapped,
-  read unmapped,
-  supplementary alignment,
-  not primary alignment,
-  read fails platform/vendor quality checks,
-  read is PCR or optical duplicate
-*/
-const int BAD_FLAGS = BAM_FUNMAP | BAM_FMUNMAP | BAM_FQCFAIL | BAM_FSECONDARY | BAM_FSUPPLEMENTARY;
 
 enum rw_opts {
   W_CRAM        = 1,
@@ -83,11 +74,14 @@ void print_usage (int exit_code){
     printf ("-i --input                  [bc]ram File path to read input [stdin].\n");
     printf ("-o --output                 Path to output [stdout].\n\n");
     printf ("Optional:\n");
+    printf ("-R --readahead              Read the input through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+    printf ("                            default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
     printf ("-@ --threads                number of BAM/CRAM compression threads.\n");
     printf ("-C --cram                   Use CRAM compression for output [default: bam].\n");
     printf ("-x --index                  Generate an index alongside output file (invalid when output is to stdout).\n");
     printf ("-t --mismatch-threshold     Mismatch threshold for marking read as QC fail [float](default: %f).\n",mismatch_frac);
-    printf ("-r --reference              load CRAM references from the specificed fasta file instead of @SQ headers when writing a CRAM file\n");
+    printf ("-r --reference              load CRAM references from the specificed fasta file instead of @SQ headers when writing a CRAM file,\n");
+    printf ("                            or from a ref_cache_build directory by the @SQ M5\n");
     printf ("-p --proper-pair-correct    Correct bwa-mem proper pairs (assumes a proper pair must have F/R orientation)\n");
     printf ("-n --input-fmt-option       option=value: set an option for CRAM input. As per --input-fmt-option in the samtools documentation http://www.htslib.org/doc/samtools.html#GLOBAL_OPTIONS\n");
     printf ("-u --output-fmt-option      option=value: set an option for CRAM output. As per --output-fmt-option in the samtools documentation http://www.htslib.org/doc/samtools.html#GLOBAL_OPTIONS\n");
@@ -113,6 +107,7 @@ int options(int argc, char *argv[]){
             {"cram",no_argument,0,'C'},
             {"index",no_argument,0,'x'},
             {"threads",required_argument,0,'@'},
+            {"readahead",required_argument,0,'R'},
             {"compression-level",required_argument,0,'l'},
             {"reference",required_argument,0,'r'},
             {"mismatch-threshold",required_argument,0,'t'},
@@ -125,7 +120,7 @@ int options(int argc, char *argv[]){
  int iarg = 0;
 
  //Iterate through options
-  while((iarg = getopt_long(argc, argv, "t:l:i:o:r:n:u:@:pCvxdh", long_opts, &index)) != -1){
+  while((iarg = getopt_long(argc, argv, "t:l:i:o:r:n:u:@:R:pCvxdh", long_opts, &index)) != -1){
    switch(iarg){
      case 'i':
        input_file = optarg;
@@ -147,6 +142,10 @@ int options(int argc, char *argv[]){
        debug=1;
        break;
 
+     case 'R':
+       readahead_opt = optarg;
+       break;
+
      case '@':
        if(sscanf(optarg, "%i", &nthreads) != 1){
           sentinel("Error parsing -@ nThreads) argument '%s'. Should be an integer",optarg);
@@ -211,6 +210,9 @@ int options(int argc, char *argv[]){
 
   }//End of iteration through options
 
+  //-R overrides $PCAP_READAHEAD
+  if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
+
   //Do some checking to ensure required arguments were passed and are accessible files
    if (input_file==NULL || strcmp(input_file,"/dev/stdin")==0) {
     input_file = "-";   // htslib recognises this as a special case
@@ -235,98 +237,6 @@ int options(int argc, char *argv[]){
     return 1;
 }
 
-float infer_mis_match_rate(bam1_t *b){
-  int match = 0;
-  int mismatch = 0;
-  int n_del = 0;
-  int n_insert = 0;
-  int totalmap = 0;
-  float return_val = 0;
-  uint8_t *tag_val = bam_aux_get(b,MD_TAG);
-  check(tag_val!=NULL,"Error retrieving md tag for read.");
-  if(tag_val==NULL){ //No MD tag present
-    return return_val;
-  }else{
-    char *md_val = bam_aux2Z(tag_val);
-    check(md_val!=NULL,"Error retrieving md tag value for read.");
-    //Iterate through string until we find a non number character
-    int i=0;
-    for(i=0;i<strlen(md_val);i++){
-      if(!isdigit(md_val[i])){ // Not a digit therefor we have a deletion or a mismatch
-        if(md_val[i]=='^'){//Deletion
-          mismatch = mismatch+1;
-          //Iterate to the next number as all following bases are the deleted bases
-          while(isalpha(md_val[i+1]) && i<strlen(md_val)){
-            i++;
-          }
-        }else{//Mismatch
-          mismatch = mismatch+1;
-        }
-      }else if(isdigit(md_val[i])){
-        //got a digit so build the number up.
-        char num[5] = "\0\0\0\0\0";
-        int index = 0;
-        while(isdigit(md_val[i]) && i<strlen(md_val)){
-          num[index] = md_val[i];
-          index++;
-          i++;
-        }
-        i--;
-        match = match + atoi(num);
-      }
-    }
-    //Now iterate through the cigar to calculate accurately with indels and non indels
-    uint32_t *cigar = bam_get_cigar(b);
-    //iterate through each cigar operation
-    int j=0;
-    for(j=0;j<b->core.n_cigar;j++){
-      int op = _cop(cigar[j]);
-      if(op == BAM_CINS) n_insert++;
-      if(op == BAM_CDEL) n_del++;
-    }
-
-    totalmap =  match + mismatch - n_del;
-    return_val = ((float)mismatch + (float)n_insert)/(float)totalmap;
-  }
-  return return_val;
-
-
-error:
-  return -1;
-}
-
-int checkMismatchStatus(bam1_t **b){
-  if ((*b)->core.flag & BAD_FLAGS) return 0; //Ignore bad flags
-  float mm_rate = infer_mis_match_rate(*b);
-  check(mm_rate>=0,"Error inferring mismatch rate for read.");
-  if(mm_rate>mismatch_frac){
-    //Add QC fail flag
-    (*b)->core.flag = (*b)->core.flag | BAM_FQCFAIL;
-    //Add mm tag
-    int chk = bam_aux_append(*b, mm_tag, tag_type, sizeof(YES), (uint8_t *) &YES);
-
-    check(chk==0,"Error adding mismatch tag to read %s.",bam_get_qname(*b));
-    uint8_t *p;
-    if((p = bam_aux_get(*b, mm_tag)) && bam_aux2A(p)!=YES){
-     sentinel("Error adding new tag to read %s.",bam_get_qname(*b));
-    }
-    marked_count = marked_count+1;
-  }
-  return 0;
-error:
-  return 1;
-}
-
-int checkProperPairedStatus(bam1_t **b){
-    if (!((*b)->core.flag & BAM_FPROPER_PAIR)) return 0; //Ignore non properly paired reads
-    if (((*b)->core.flag & BAM_FREVERSE && !((*b)->core.flag & BAM_FMREVERSE) )) return 0; //Ignore correct orientations
-    if (!((*b)->core.flag & BAM_FREVERSE) && (*b)->core.flag & BAM_FMREVERSE) return 0; //Ignore correct orientations
-    //We have a properly mapped marked read but the orientations of reads aren't correct for paired end reads
-    //Remove the properly paired flag from this read
-    (*b)->core.flag = (*b)->core.flag - BAM_FPROPER_PAIR;
-    return 0;
-}
-
 int main(int argc, char *argv[]){
   htsFile *input = NULL;
   htsFile *output = NULL;
@@ -343,7 +253,7 @@ int main(int argc, char *argv[]){
   time_t time_start = time(NULL);
 
   //Open bam file as object
-  input = hts_open(input_file,"r");
+  input = hfile_readahead_hts_open(input_file, readahead);
   check(input != NULL, "Error opening hts file for reading '%s'.",input_file);
 
   check(hts_opt_apply(input, in_opts)==0,"Error applying CRAM input options.");
@@ -380,8 +290,10 @@ int main(int argc, char *argv[]){
     output->fp.cram->header = cram_head;
 
     // Create CRAM references arrays
-    if (fn_ref)
+    if (fn_ref && !ref_cache_is_cache(fn_ref))
         ret = cram_set_option(output->fp.cram, CRAM_OPT_REFERENCE, fn_ref);
+    else if (fn_ref && ref_cache_export(fn_ref) != 0)
+        ret = -1;
     else
         // Attempt to fill out a cram->refs[] array from @SQ headers
         ret = cram_set_option(output->fp.cram, CRAM_OPT_REFERENCE, NULL);
@@ -418,12 +330,11 @@ int main(int argc, char *argv[]){
                                                   count/10000000,elapsed_time);
       time_start = time(NULL);
     }
-    int rd_check = 0;
-    rd_check = checkMismatchStatus(&b);
-    check(rd_check==0,"Error checking mismatch status of reads.");
+    int rd_check = mismatch_access_mark(b, mismatch_frac);
+    check(rd_check>=0,"Error checking mismatch status of reads.");
+    marked_count += rd_check;
     if(is_correct_pp == 1){
-        int pp_check = checkProperPairedStatus(&b);
-        check(pp_check==0, "Error checking proper paired status of read.");
+        mismatch_access_correct_proper_pair(b);
     }
     int res = sam_write1(output,new_head,b);
     check(res>=0,"Error writing read to output file.");
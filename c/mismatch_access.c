@@ -0,0 +1,132 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <ctype.h>
+#include <string.h>
+#include "dbg.h"
+#include "mismatch_access.h"
+
+#define _cop(c) ((c)&BAM_CIGAR_MASK)
+
+float infer_mis_match_rate(bam1_t *b){
+  int match = 0;
+  int mismatch = 0;
+  int n_del = 0;
+  int n_insert = 0;
+  int totalmap = 0;
+  float return_val = 0;
+  uint8_t *tag_val = bam_aux_get(b,"MD");
+  check(tag_val!=NULL,"Error retrieving md tag for read.");
+  if(tag_val==NULL){ //No MD tag present
+    return return_val;
+  }else{
+    char *md_val = bam_aux2Z(tag_val);
+    check(md_val!=NULL,"Error retrieving md tag value for read.");
+    //Iterate through string until we find a non number character
+    int i=0;
+    for(i=0;i<strlen(md_val);i++){
+      if(!isdigit(md_val[i])){ // Not a digit therefor we have a deletion or a mismatch
+        if(md_val[i]=='^'){//Deletion
+          mismatch = mismatch+1;
+          //Iterate to the next number as all following bases are the deleted bases
+          while(isalpha(md_val[i+1]) && i<strlen(md_val)){
+            i++;
+          }
+        }else{//Mismatch
+          mismatch = mismatch+1;
+        }
+      }else if(isdigit(md_val[i])){
+        //got a digit so build the number up.
+        char num[5] = "\0\0\0\0\0";
+        int index = 0;
+        while(isdigit(md_val[i]) && i<strlen(md_val)){
+          num[index] = md_val[i];
+          index++;
+          i++;
+        }
+        i--;
+        match = match + atoi(num);
+      }
+    }
+    //Now iterate through the cigar to calculate accurately with indels and non indels
+    uint32_t *cigar = bam_get_cigar(b);
+    //iterate through each cigar operation
+    int j=0;
+    for(j=0;j<b->core.n_cigar;j++){
+      int op = _cop(cigar[j]);
+      if(op == BAM_CINS) n_insert++;
+      if(op == BAM_CDEL) n_del++;
+    }
+
+    totalmap =  match + mismatch - n_del;
+    return_val = ((float)mismatch + (float)n_insert)/(float)totalmap;
+  }
+  return return_val;
+
+
+error:
+  return -1;
+}
+
+int check_mm_tag(bam1_t *b){
+  uint8_t *p;
+  if((p = bam_aux_get(b, MM_TAG)) && bam_aux2A(p)==MM_YES){
+    return 1;
+  }
+  return 0;
+}
+
+int mismatch_access_mark(bam1_t *b, float max_rate){
+  if (b->core.flag & MM_BAD_FLAGS) return 0; //Ignore bad flags
+  float mm_rate = infer_mis_match_rate(b);
+  check(mm_rate>=0,"Error inferring mismatch rate for read.");
+  if(mm_rate<=max_rate) return 0;
+  //Add QC fail flag
+  b->core.flag = b->core.flag | BAM_FQCFAIL;
+  //Add mm tag
+  char yes = MM_YES;
+  int chk = bam_aux_append(b, MM_TAG, 'A', sizeof(yes), (uint8_t *) &yes);
+  check(chk==0,"Error adding mismatch tag to read %s.",bam_get_qname(b));
+  uint8_t *p;
+  if((p = bam_aux_get(b, MM_TAG)) && bam_aux2A(p)!=MM_YES){
+    sentinel("Error adding new tag to read %s.",bam_get_qname(b));
+  }
+  return 1;
+error:
+  return -1;
+}
+
+void mismatch_access_correct_proper_pair(bam1_t *b){
+  if (!(b->core.flag & BAM_FPROPER_PAIR)) return; //Ignore non properly paired reads
+  if ((b->core.flag & BAM_FREVERSE) && !(b->core.flag & BAM_FMREVERSE)) return; //Ignore correct orientations
+  if (!(b->core.flag & BAM_FREVERSE) && (b->core.flag & BAM_FMREVERSE)) return; //Ignore correct orientations
+  //We have a properly mapped marked read but the orientations of reads aren't correct for paired end reads
+  b->core.flag &= ~BAM_FPROPER_PAIR;
+}
+
+int mismatch_access_modify_flag(bam1_t *b, int mode){
+  if(!check_mm_tag(b)) return 0;
+  if(mode == MM_FLAG_REMOVE){
+    b->core.flag &= ~BAM_FQCFAIL;
+  }else if(mode == MM_FLAG_REPLACE){
+    b->core.flag |= BAM_FQCFAIL;
+  }
+  return 1;
+}
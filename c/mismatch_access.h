@@ -0,0 +1,51 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __mismatch_access_h__
+#define __mismatch_access_h__
+
+#include "htslib/sam.h"
+
+#define MM_TAG "mm"
+#define MM_YES 'Y'
+
+// Reads that mismatchQc never marks.
+#define MM_BAD_FLAGS (BAM_FUNMAP | BAM_FMUNMAP | BAM_FQCFAIL | BAM_FSECONDARY | BAM_FSUPPLEMENTARY)
+
+// mmFlagModifier modes
+#define MM_FLAG_REMOVE  1
+#define MM_FLAG_REPLACE 2
+
+// Mismatch rate of a read from its MD tag and cigar indels, -1 without an MD tag or on error.
+float infer_mis_match_rate(bam1_t *b);
+
+// 1 when the read carries the mismatch QC tag mm:A:Y.
+int check_mm_tag(bam1_t *b);
+
+// Marks the read QC fail and adds mm:A:Y when the mismatch rate is above max_rate, 1 when marked, -1 on error.
+int mismatch_access_mark(bam1_t *b, float max_rate);
+
+// Removes the proper pair flag from proper pairs without F/R orientation.
+void mismatch_access_correct_proper_pair(bam1_t *b);
+
+// Removes (MM_FLAG_REMOVE) or reinstates (MM_FLAG_REPLACE) QC fail on reads with mm:A:Y, 1 when the tag is present.
+int mismatch_access_modify_flag(bam1_t *b, int mode);
+
+#endif
@@ -20,11 +20,16 @@
 
 #include <getopt.h>
 #include "dbg.h"
+#include "hfile_readahead.h"
+#include "ref_cache.h"
 #include "cram/cram.h"
 #include "htslib/thread_pool.h"
 #include "bam_access.h"
+#include "mismatch_access.h"
 
 char *input_file = NULL;
+char *readahead_opt = NULL;
+size_t readahead = 0;
 char *output_file = NULL;
 char *fn_ref = NULL;
 int nthreads = 0;
@@ -38,9 +43,6 @@ char* prog_cl = NULL;
 hts_opt *in_opts = NULL;
 hts_opt *out_opts = NULL;
 int debug=0;
-const char mm_tag[2] = "mm";
-const char tag_type = 'A';
-const char YES = 'Y';
 long long int marked_count = 0;
 
 enum rw_opts {
@@ -71,10 +73,13 @@ void print_usage (int exit_code){
   printf ("-m --remove                 Remove Vendor fail Qc flag where mmQC tag is present\n");
   printf ("-p --replace                Reinstate Vendor fail Qc flag where mmQC tag is present\n\n");
   printf ("Optional:\n");
+  printf ("-R --readahead              Read the input through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+  printf ("                            default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
   printf ("-@ --threads                number of BAM/CRAM compression threads.\n");
   printf ("-C --cram                   Use CRAM compression for output [default: bam].\n");
   printf ("-x --index                  Generate an index alongside output file (invalid when output is to stdout).\n");
-  printf ("-r --reference              load CRAM references from the specificed fasta file instead of @SQ headers when writing a CRAM file\n");
+  printf ("-r --reference              load CRAM references from the specificed fasta file instead of @SQ headers when writing a CRAM file,\n");
+    printf ("                            or from a ref_cache_build directory by the @SQ M5\n");
   printf ("-n --input-fmt-option       option=value: set an option for CRAM input. As per --input-fmt-option in the samtools documentation http://www.htslib.org/doc/samtools.html#GLOBAL_OPTIONS\n");
   printf ("-u --output-fmt-option      option=value: set an option for CRAM output. As per --output-fmt-option in the samtools documentation http://www.htslib.org/doc/samtools.html#GLOBAL_OPTIONS\n");
   printf ("-l --compression-level      0-9: set zlib compression level.\n\n");
@@ -99,6 +104,7 @@ int options(int argc, char *argv[]){
             {"input-fmt-option",required_argument,0,'n'},
             {"output-fmt-option",required_argument,0,'u'},
             {"threads",required_argument,0,'@'},
+            {"readahead",required_argument,0,'R'},
             {"compression-level",required_argument,0,'l'},
             {"reference",required_argument,0,'r'},
             {"remove",no_argument,0,'m'},
@@ -111,7 +117,7 @@ int options(int argc, char *argv[]){
  int iarg = 0;
 
  //Iterate through options
-  while((iarg = getopt_long(argc, argv, "l:i:o:r:@:n:u:Cvxdhmp", long_opts, &index)) != -1){
+  while((iarg = getopt_long(argc, argv, "l:i:o:r:@:R:n:u:Cvxdhmp", long_opts, &index)) != -1){
     switch(iarg){
       case 'i':
         input_file = optarg;
@@ -133,6 +139,10 @@ int options(int argc, char *argv[]){
         debug=1;
         break;
 
+      case 'R':
+        readahead_opt = optarg;
+        break;
+
       case '@':
         if(sscanf(optarg, "%i", &nthreads) != 1){
           sentinel("Error parsing -@ nThreads) argument '%s'. Should be an integer",optarg);
@@ -193,6 +203,8 @@ int options(int argc, char *argv[]){
     }; // End of args switch statement
 
   }//End of iteration through options
+  //-R overrides $PCAP_READAHEAD
+  if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
   //Do some checking to ensure required arguments were passed and are accessible files
   if (input_file==NULL || strcmp(input_file,"/dev/stdin")==0) {
     input_file = "-";   // htslib recognises this as a special case
@@ -247,7 +259,7 @@ int main(int argc, char *argv[]){
   check(problem==0,"Error parsing options.");
 
   //Open bam file as object
-  input = hts_open(input_file,"r");
+  input = hfile_readahead_hts_open(input_file, readahead);
   check(input != NULL, "Error opening hts file for reading '%s'.",input_file);
 
   check(hts_opt_apply(input, in_opts)==0,"Error applying CRAM input options.");
@@ -284,8 +296,10 @@ int main(int argc, char *argv[]){
     output->fp.cram->header = cram_head;
 
     // Create CRAM references arrays
-    if (fn_ref)
+    if (fn_ref && !ref_cache_is_cache(fn_ref))
         ret = cram_set_option(output->fp.cram, CRAM_OPT_REFERENCE, fn_ref);
+    else if (fn_ref && ref_cache_export(fn_ref) != 0)
+        ret = -1;
     else
         // Attempt to fill out a cram->refs[] array from @SQ headers
         ret = cram_set_option(output->fp.cram, CRAM_OPT_REFERENCE, NULL);
@@ -324,20 +338,8 @@ int main(int argc, char *argv[]){
                                                   count/10000000,elapsed_time);
       time_start = time(NULL);
     }
-    //Check to see if the read has the mm tag required.
-    int has_tag = 0;
-    has_tag = check_mm_tag(b);
-    check(has_tag>=0,"Error checking for mm tag in read.");
-    if(has_tag){
-      marked_count++;
-      if(wflags & RW_REMOVE){
-        b->core.flag -= BAM_FQCFAIL;
-      }else if(wflags & RW_REPLACE){
-        if(!(b->core.flag & BAM_FQCFAIL)){
-          b->core.flag += BAM_FQCFAIL;
-        }
-      }
-    }//End of check for presence of mm:A:Y tag
+    //Remove or reinstate QC fail where the read has the mm tag.
+    marked_count += mismatch_access_modify_flag(b, wflags & RW_REMOVE ? MM_FLAG_REMOVE : MM_FLAG_REPLACE);
     int res = sam_write1(output,new_head,b);
     check(res>=0,"Error writing read to output file.");
   }//End of iteration through each read in the xam file
@@ -375,11 +377,3 @@ int main(int argc, char *argv[]){
     if (p.pool) hts_tpool_destroy(p.pool);
     return 1;
 }
-
-int check_mm_tag(bam1_t *b){
-  uint8_t *p;
-  if((p = bam_aux_get(b, mm_tag)) && bam_aux2A(p)==YES){
-    return 1;
-  }
-  return 0;
-}
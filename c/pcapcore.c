@@ -0,0 +1,129 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "dbg.h"
+#include "pcapcore.h"
+#include "bam_access.h"
+#include "bam_stats_output.h"
+#include "bam_stats_calcs.h"
+#include "bam_stats_shard.h"
+#include "mismatch_access.h"
+
+struct pcap_stats_t {
+  rg_info_t **grps;
+  int grps_size;
+  stats_rd_t ***grp_stats;
+  int flags;
+  double rna_sd;
+  int rna_iter;
+};
+
+const char *pcapcore_version(void){
+  return VERSION;
+}
+
+int pcapcore_api_version(void){
+  return PCAPCORE_API_VERSION;
+}
+
+pcap_stats_t *pcap_stats_init(sam_hdr_t *head, int flags){
+  pcap_stats_t *st = calloc(1, sizeof(pcap_stats_t));
+  check_mem(st);
+  st->flags = flags;
+  st->rna_sd = BAM_STATS_RNA_SD;
+  st->rna_iter = BAM_STATS_RNA_ITERATIONS;
+  if(head){
+    st->grps = bam_access_parse_header(head, &st->grps_size, &st->grp_stats);
+    check(st->grps != NULL, "Error fetching read groups from header.");
+  }
+  return st;
+error:
+  pcap_stats_destroy(st);
+  return NULL;
+}
+
+int pcap_stats_add(pcap_stats_t *st, bam1_t *b){
+  if((st->flags & PCAP_STATS_SKIP_QCFAIL) && (b->core.flag & BAM_FQCFAIL)) return 0;
+  return bam_access_process_read(b, st->grps, st->grps_size, st->grp_stats, st->flags & PCAP_STATS_RNA ? 1 : 0);
+}
+
+int pcap_stats_set_rna_trim(pcap_stats_t *st, double sd_mult, int iterations){
+  if(sd_mult <= 0 || iterations < 0) return -1;
+  st->rna_sd = sd_mult;
+  st->rna_iter = iterations;
+  return 0;
+}
+
+int pcap_stats_merge(pcap_stats_t *dest, const pcap_stats_t *src){
+  return bam_stats_shard_sum(src->grps, src->grps_size, src->grp_stats, &dest->grps, &dest->grps_size, &dest->grp_stats);
+}
+
+int pcap_stats_write_shard(const pcap_stats_t *st, const char *file){
+  return bam_stats_shard_write(st->grps, st->grps_size, st->grp_stats, file);
+}
+
+int pcap_stats_merge_shard(pcap_stats_t *dest, const char *file){
+  return bam_stats_shard_merge(file, &dest->grps, &dest->grps_size, &dest->grp_stats);
+}
+
+int pcap_stats_write_bas(const pcap_stats_t *st, const char *bam_name, const char *file){
+  // bam_stats_output_print_results takes a basename of bam_name, which may modify its argument
+  char *name = strdup(bam_name);
+  char *out = strdup(file);
+  check_mem(name);
+  check_mem(out);
+  int res;
+  if(st->flags & PCAP_STATS_RNA){
+    res = bam_stats_output_print_results_trimmed(st->grps, st->grps_size, st->grp_stats, name, out, st->rna_sd, st->rna_iter);
+  }else{
+    res = bam_stats_output_print_results(st->grps, st->grps_size, st->grp_stats, name, out);
+  }
+  free(name);
+  free(out);
+  return res == 0 ? 0 : -1;
+error:
+  free(name);
+  free(out);
+  return -1;
+}
+
+void pcap_stats_destroy(pcap_stats_t *st){
+  if(st == NULL) return;
+  bam_access_free_groups(st->grps, st->grps_size, st->grp_stats);
+  free(st);
+}
+
+float pcap_mismatch_rate(bam1_t *b){
+  return infer_mis_match_rate(b);
+}
+
+int pcap_mismatch_mark(bam1_t *b, float max_rate){
+  return mismatch_access_mark(b, max_rate);
+}
+
+void pcap_proper_pair_correct(bam1_t *b){
+  mismatch_access_correct_proper_pair(b);
+}
+
+int pcap_mm_modify_flag(bam1_t *b, int mode){
+  return mismatch_access_modify_flag(b, mode == PCAP_MM_REMOVE ? MM_FLAG_REMOVE : MM_FLAG_REPLACE);
+}
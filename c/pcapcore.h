@@ -0,0 +1,92 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __pcapcore_h__
+#define __pcapcore_h__
+
+/*
+ * libpcapcore, the bam_stats and mismatch QC engines for use inside other tools.
+ *
+ * Only this header is installed.  Types are opaque and functions are only ever
+ * added, so code built against PCAPCORE_API_VERSION n works with any later
+ * library.  All functions returning int give a negative value on error.
+ *
+ * Stats usage, in the tool's own read loop:
+ *
+ *   pcap_stats_t *st = pcap_stats_init(head, 0);
+ *   while(sam_read1(in, head, b) >= 0) pcap_stats_add(st, b);
+ *   pcap_stats_write_bas(st, "sample.bam", "sample.bam.bas");
+ *   pcap_stats_destroy(st);
+ */
+
+#include "htslib/sam.h"
+
+#define PCAPCORE_API_VERSION 2
+
+// pcap_stats_init flags
+#define PCAP_STATS_RNA          1 // as bam_stats -a, secondary hits are counted and the insert size is trimmed
+#define PCAP_STATS_SKIP_QCFAIL  2 // as bam_stats -q, QC fail reads are ignored entirely
+
+// pcap_mm_modify_flag modes
+#define PCAP_MM_REMOVE  1
+#define PCAP_MM_REPLACE 2
+
+typedef struct pcap_stats_t pcap_stats_t;
+
+// Version of PCAP-core the library was built from.
+const char *pcapcore_version(void);
+
+// PCAPCORE_API_VERSION of the library.
+int pcapcore_api_version(void);
+
+// Accumulator with the read groups of head, or none when head is NULL (groups then come from merges).
+pcap_stats_t *pcap_stats_init(sam_hdr_t *head, int flags);
+
+// Adds one record, reads with an RG not in the header are an error.
+int pcap_stats_add(pcap_stats_t *st, bam1_t *b);
+
+// Sums src into dest, read groups missing from dest are added.
+int pcap_stats_merge(pcap_stats_t *dest, const pcap_stats_t *src);
+
+// PCAP_STATS_RNA insert size trimming, as bam_stats -D/-I. Defaults to 2 SD, 1 iteration. (API 2)
+int pcap_stats_set_rna_trim(pcap_stats_t *st, double sd_mult, int iterations);
+
+// Raw stats as a bam_stats shard (bam_stats -S), readable by pcap_stats_merge_shard and bam_stats -m.
+int pcap_stats_write_shard(const pcap_stats_t *st, const char *file);
+int pcap_stats_merge_shard(pcap_stats_t *dest, const char *file);
+
+// Writes the .bas, bam_name fills the bam_filename column ("-" for file writes to stdout).
+int pcap_stats_write_bas(const pcap_stats_t *st, const char *bam_name, const char *file);
+
+void pcap_stats_destroy(pcap_stats_t *st);
+
+// Mismatch rate from the MD tag and cigar as mismatchQc, -1 without an MD tag or on error.
+float pcap_mismatch_rate(bam1_t *b);
+
+// As mismatchQc, flags QC fail and adds mm:A:Y above max_rate. 1 when marked.
+int pcap_mismatch_mark(bam1_t *b, float max_rate);
+
+// As mismatchQc -p, drops the proper pair flag from pairs without F/R orientation.
+void pcap_proper_pair_correct(bam1_t *b);
+
+// As mmFlagModifier, PCAP_MM_REMOVE or PCAP_MM_REPLACE QC fail on reads with mm:A:Y. 1 when the tag is present.
+int pcap_mm_modify_flag(bam1_t *b, int mode);
+
+#endif
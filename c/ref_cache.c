@@ -0,0 +1,226 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dbg.h"
+#include "htslib/bgzf.h"
+#include "htslib/hts.h"
+#include "htslib/kstring.h"
+#include "ref_cache.h"
+
+// The one sequence being written while the fasta is read
+typedef struct {
+  kstring_t name;
+  kstring_t tmp;
+  FILE *out;
+  hts_md5_context *md5;
+  int64_t len;
+} cache_seq_t;
+
+// mkdir -p, path is modified while walking it but restored
+static int make_dirs(char *path){
+  char *p = path;
+  while(1){
+    p = strchr(p + 1, '/');
+    if(p) *p = '\0';
+    if(mkdir(path, 0755) != 0 && errno != EEXIST){
+      if(p) *p = '/';
+      return -1;
+    }
+    if(!p) return 0;
+    *p = '/';
+  }
+}
+
+static int seq_start(cache_seq_t *seq, const char *dir, const char *header){
+  int fd = -1;
+  size_t i = 1;
+  seq->name.l = 0;
+  while(header[i] && !isspace((unsigned char) header[i])) kputc(header[i++], &seq->name);
+  check(seq->name.l > 0, "Fasta header without a name.");
+  seq->tmp.l = 0;
+  ksprintf(&seq->tmp, "%s/.ref_cache.XXXXXX", dir);
+  fd = mkstemp(seq->tmp.s);
+  check(fd >= 0, "Error creating temporary file in '%s'.", dir);
+  // mkstemp creates 0600, the cache is read by every user of the node
+  check(fchmod(fd, 0644) == 0, "Error setting permissions of '%s'.", seq->tmp.s);
+  seq->out = fdopen(fd, "w");
+  check(seq->out != NULL, "Error opening '%s'.", seq->tmp.s);
+  hts_md5_reset(seq->md5);
+  seq->len = 0;
+  return 0;
+
+error:
+  if(fd >= 0){
+    close(fd);
+    unlink(seq->tmp.s);
+  }
+  return -1;
+}
+
+static int seq_finish(cache_seq_t *seq, const char *dir, FILE *dict){
+  unsigned char digest[16];
+  char hex[33];
+  kstring_t path = {0, 0, NULL};
+  int res = fclose(seq->out);
+  seq->out = NULL;
+  check(res == 0, "Error writing '%s'.", seq->tmp.s);
+  hts_md5_final(digest, seq->md5);
+  hts_md5_hex(hex, digest);
+  check(ref_cache_path(dir, hex, &path) == 0, "Error building cache path of %s.", seq->name.s);
+  // the leaf directory, then the sequence appears in one rename
+  *strrchr(path.s, '/') = '\0';
+  check(make_dirs(path.s) == 0, "Error creating cache directory '%s'.", path.s);
+  path.s[strlen(path.s)] = '/';
+  if(access(path.s, F_OK) == 0){
+    unlink(seq->tmp.s);
+  }else{
+    check(rename(seq->tmp.s, path.s) == 0, "Error moving '%s' to '%s'.", seq->tmp.s, path.s);
+  }
+  if(dict) check(fprintf(dict, "@SQ\tSN:%s\tLN:%"PRId64"\tM5:%s\n", seq->name.s, seq->len, hex) > 0, "Error writing dict.");
+  free(path.s);
+  return 0;
+
+error:
+  unlink(seq->tmp.s);
+  free(path.s);
+  return -1;
+}
+
+int ref_cache_build(const char *fasta, const char *dir, FILE *dict){
+  BGZF *fp = NULL;
+  kstring_t line = {0, 0, NULL};
+  kstring_t root = {0, 0, NULL};
+  cache_seq_t seq = {{0, 0, NULL}, {0, 0, NULL}, NULL, NULL, 0};
+  int n = 0;
+  int res;
+  size_t i, j;
+
+  check(strchr(dir, '%') == NULL, "Reference cache directory '%s' can't contain '%%'.", dir);
+  kputs(dir, &root);
+  check(make_dirs(root.s) == 0, "Error creating reference cache directory '%s'.", dir);
+  seq.md5 = hts_md5_init();
+  check_mem(seq.md5);
+  fp = bgzf_open(fasta, "r");
+  check(fp != NULL, "Error opening fasta file '%s'.", fasta);
+  if(dict) check(fprintf(dict, "@HD\tVN:1.6\n") > 0, "Error writing dict.");
+
+  while((res = bgzf_getline(fp, '\n', &line)) >= 0){
+    if(line.l > 0 && line.s[0] == '>'){
+      if(seq.out){
+        check(seq_finish(&seq, dir, dict) == 0, "Error adding %s to the cache.", seq.name.s);
+        n++;
+      }
+      check(seq_start(&seq, dir, line.s) == 0, "Error starting sequence in '%s'.", fasta);
+      continue;
+    }
+    if(line.l == 0) continue;
+    check(seq.out != NULL, "Sequence before the first header in '%s'.", fasta);
+    // as the M5 of the SAM spec, only characters 33-126 and uppercase
+    for(i=0, j=0; i<line.l; i++){
+      unsigned char c = line.s[i];
+      if(c < 33 || c > 126) continue;
+      line.s[j++] = toupper(c);
+    }
+    check(fwrite(line.s, 1, j, seq.out) == j, "Error writing '%s'.", seq.tmp.s);
+    hts_md5_update(seq.md5, line.s, j);
+    seq.len += j;
+  }
+  check(res == -1, "Error reading fasta file '%s'.", fasta);
+  if(seq.out){
+    check(seq_finish(&seq, dir, dict) == 0, "Error adding %s to the cache.", seq.name.s);
+    n++;
+  }
+  check(bgzf_close(fp) == 0, "Error closing fasta file '%s'.", fasta);
+  hts_md5_destroy(seq.md5);
+  free(seq.name.s);
+  free(seq.tmp.s);
+  free(line.s);
+  free(root.s);
+  return n;
+
+error:
+  if(seq.out){
+    fclose(seq.out);
+    unlink(seq.tmp.s);
+  }
+  if(fp) bgzf_close(fp);
+  if(seq.md5) hts_md5_destroy(seq.md5);
+  free(seq.name.s);
+  free(seq.tmp.s);
+  free(line.s);
+  free(root.s);
+  return -1;
+}
+
+int ref_cache_path(const char *dir, const char *md5, kstring_t *path){
+  int i;
+  for(i=0;i<32;i++){
+    if(!isxdigit((unsigned char) md5[i]) || isupper((unsigned char) md5[i])) return -1;
+  }
+  if(md5[32] != '\0') return -1;
+  path->l = 0;
+  return ksprintf(path, "%s/%.2s/%.2s/%s", dir, md5, md5 + 2, md5 + 4) < 0 ? -1 : 0;
+}
+
+int ref_cache_export(const char *dir){
+  char abs[PATH_MAX];
+  kstring_t cache = {0, 0, NULL};
+  kstring_t ref_path = {0, 0, NULL};
+  // children may run elsewhere
+  check(realpath(dir, abs) != NULL, "Error resolving reference cache directory '%s'.", dir);
+  check(strchr(abs, '%') == NULL && strchr(abs, ':') == NULL, "Reference cache directory '%s' can't contain '%%' or ':'.", abs);
+  kputs(abs, &cache);
+  kputs(REF_CACHE_LAYOUT, &cache);
+  const char *old = getenv("REF_PATH");
+  if(old == NULL || strstr(old, cache.s) == NULL){
+    kputs(cache.s, &ref_path);
+    if(old && *old) ksprintf(&ref_path, ":%s", old);
+    check(setenv("REF_PATH", ref_path.s, 1) == 0, "Error setting REF_PATH.");
+  }
+  if(getenv("REF_CACHE") == NULL) check(setenv("REF_CACHE", cache.s, 1) == 0, "Error setting REF_CACHE.");
+  free(cache.s);
+  free(ref_path.s);
+  return 0;
+
+error:
+  free(cache.s);
+  free(ref_path.s);
+  return -1;
+}
+
+int ref_cache_is_cache(const char *ref){
+  struct stat st;
+  return stat(ref, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+int ref_cache_set_reference(htsFile *fp, const char *ref){
+  if(ref == NULL) return 0;
+  if(ref_cache_is_cache(ref)) return ref_cache_export(ref);
+  return hts_set_fai_filename(fp, ref);
+}
@@ -0,0 +1,72 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __ref_cache_h__
+#define __ref_cache_h__
+
+#include <stdio.h>
+#include <stddef.h>
+#include "htslib/hts.h"
+#include "htslib/kstring.h"
+
+/*
+ * Reference cache in the htslib REF_CACHE layout, one file per sequence at
+ * <dir>/<md5 0-1>/<md5 2-3>/<md5 4-31> holding the uppercase sequence with
+ * no line breaks, keyed by the M5 of its @SQ line. htslib is the loader: it
+ * finds sequences through REF_PATH (see ref_cache_export) and maps local
+ * files read only, so every process shares a single copy through the page
+ * cache. The files are never modified once written.
+ */
+#define REF_CACHE_LAYOUT "/%2s/%2s/%s"
+
+/*
+ * Adds every sequence of fasta (plain or gzip) to dir, creating it as needed.
+ * Sequences already present are skipped and new files appear atomically, so
+ * concurrent builds into one dir are safe. When dict is not NULL a SAM header
+ * (@HD and @SQ with SN, LN and M5) of the fasta is written to it.
+ * Returns the number of sequences, -1 on error.
+ */
+int ref_cache_build(const char *fasta, const char *dir, FILE *dict);
+
+/*
+ * Writes the path of md5 (32 lowercase hex) within dir to path, -1 when md5 is malformed.
+ */
+int ref_cache_path(const char *dir, const char *md5, kstring_t *path);
+
+/*
+ * Points htslib at dir, putting it first in REF_PATH and setting REF_CACHE
+ * when that is unset, so CRAM in this process and its children is decoded and
+ * encoded from the cache by M5. Uses setenv, so call before starting threads.
+ */
+int ref_cache_export(const char *dir);
+
+/*
+ * 1 when ref names a cache directory rather than a fasta or fai.
+ */
+int ref_cache_is_cache(const char *ref);
+
+/*
+ * Sets the reference of fp from ref as the tools' -r option: a directory is
+ * a cache from ref_cache_build (see ref_cache_export), anything else a
+ * fasta or fai given to hts_set_fai_filename.
+ */
+int ref_cache_set_reference(htsFile *fp, const char *ref);
+
+#endif
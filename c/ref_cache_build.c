@@ -0,0 +1,156 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dbg.h"
+#include "ref_cache.h"
+
+char *input_file = NULL;
+char *cache_dir = NULL;
+char *dict_file = NULL;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: ref_cache_build -i ref.fa[.gz] -o dir [-D file] [-h] [-v]\n\n");
+  printf ("Lays out each sequence of a fasta once, uppercase and keyed by its MD5, in the htslib REF_CACHE\n");
+  printf ("layout (dir/%%2s/%%2s/%%s). Give dir as -r to the PCAP tools, or set REF_PATH and REF_CACHE to\n");
+  printf ("dir/%%2s/%%2s/%%s, and every process maps the same read only copy through the page cache.\n");
+  printf ("Sequences already in dir are kept, so concurrent or repeated builds are safe.\n\n");
+  printf ("-i --input                  Fasta file, plain or gzip compressed.\n");
+  printf ("-o --outdir                 Cache directory, created if needed.\n\n");
+  printf ("Optional:\n");
+  printf ("-D --dict                   Write a SAM header dict with the M5 of each sequence here, written last.\n\n");
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"input",required_argument,0,'i'},
+            {"outdir",required_argument,0,'o'},
+            {"dict",required_argument,0,'D'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "i:o:D:vh", long_opts, &index)) != -1){
+    switch(iarg){
+      case 'i':
+        input_file = optarg;
+        break;
+
+      case 'o':
+        cache_dir = optarg;
+        break;
+
+      case 'D':
+        dict_file = optarg;
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  if(input_file == NULL || check_exist(input_file) != 1){
+    printf("Input fasta (-i) %s does not exist.\n", input_file ? input_file : "");
+    print_usage(1);
+  }
+  if(cache_dir == NULL){
+    printf("Cache directory (-o) is required.\n");
+    print_usage(1);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  FILE *dict = NULL;
+  char *dict_tmp = NULL;
+  int n;
+
+  check(options(argc, argv) == 0, "Error parsing options.");
+  // the dict only appears once the cache holds every sequence it lists
+  if(dict_file){
+    dict_tmp = malloc(strlen(dict_file) + 5);
+    check_mem(dict_tmp);
+    sprintf(dict_tmp, "%s.tmp", dict_file);
+    dict = fopen(dict_tmp, "w");
+    check(dict != NULL, "Error opening '%s' for writing.", dict_tmp);
+  }
+  n = ref_cache_build(input_file, cache_dir, dict);
+  check(n >= 0, "Error building reference cache of '%s' in '%s'.", input_file, cache_dir);
+  if(dict){
+    int res = fclose(dict);
+    dict = NULL;
+    check(res == 0, "Error writing '%s'.", dict_tmp);
+    check(rename(dict_tmp, dict_file) == 0, "Error moving '%s' to '%s'.", dict_tmp, dict_file);
+    free(dict_tmp);
+  }
+  fprintf(stderr, "%d sequences from %s in %s\n", n, input_file, cache_dir);
+  return 0;
+
+error:
+  if(dict){
+    fclose(dict);
+    unlink(dict_tmp);
+  }
+  free(dict_tmp);
+  return 1;
+}
@@ -0,0 +1,133 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "dbg.h"
+#include "stats_arena.h"
+
+typedef struct {
+  stats_rd_t s;
+} __attribute__((aligned(STATS_ARENA_LINE))) stats_slot_t;
+
+typedef struct {
+  stats_rd_t *ends[2];  // grp_stats[rg] points here
+  stats_slot_t rd[2];
+} __attribute__((aligned(STATS_ARENA_LINE))) stats_block_t;
+
+typedef struct stats_slab_t {
+  struct stats_slab_t *next;
+  int n;
+  int used;
+  stats_block_t *blocks;
+  khash_t(ins) *hists;
+} stats_slab_t;
+
+typedef struct {
+  stats_slab_t *slabs;  // newest first
+  int size;
+  int capacity;         // of table
+  stats_rd_t **table[]; // handed out as grp_stats
+} stats_arena_t;
+
+static stats_arena_t *arena_of(stats_rd_t ***grp_stats){
+  return (stats_arena_t *) ((char *) grp_stats - offsetof(stats_arena_t, table));
+}
+
+static stats_slab_t *new_slab(int n){
+  stats_slab_t *slab = calloc(1, sizeof(stats_slab_t));
+  check_mem(slab);
+  slab->n = n;
+  check(posix_memalign((void **) &slab->blocks, STATS_ARENA_LINE, sizeof(stats_block_t) * n) == 0, "Out of memory.");
+  memset(slab->blocks, 0, sizeof(stats_block_t) * n);
+  // an all zero khash is a valid empty one, as from kh_init
+  slab->hists = calloc(n, sizeof(khash_t(ins)));
+  check_mem(slab->hists);
+  return slab;
+error:
+  if(slab){
+    free(slab->blocks);
+    free(slab);
+  }
+  return NULL;
+}
+
+int stats_arena_add(stats_rd_t ****grp_stats, int n){
+  stats_arena_t *arena = *grp_stats ? arena_of(*grp_stats) : NULL;
+  int size = arena ? arena->size : 0;
+  int i;
+  check(n > 0, "Invalid number of read groups %d.", n);
+
+  if(arena == NULL || size + n > arena->capacity){
+    int capacity = arena ? arena->capacity * 2 : n;
+    if(capacity < size + n) capacity = size + n;
+    stats_arena_t *grown = realloc(arena, sizeof(stats_arena_t) + sizeof(stats_rd_t **) * capacity);
+    check_mem(grown);
+    if(arena == NULL) memset(grown, 0, sizeof(stats_arena_t));
+    arena = grown;
+    arena->capacity = capacity;
+    *grp_stats = arena->table;
+  }
+
+  for(i=0;i<n;i++){
+    stats_slab_t *slab = arena->slabs;
+    if(slab == NULL || slab->used == slab->n){
+      // enough for the rest of this request, or as many again as already held
+      int want = n - i > size + i ? n - i : size + i;
+      slab = new_slab(want);
+      check(slab != NULL, "Error allocating stats for %d read groups.", want);
+      slab->next = arena->slabs;
+      arena->slabs = slab;
+    }
+    stats_block_t *block = &slab->blocks[slab->used];
+    block->ends[0] = &block->rd[0].s;
+    block->ends[1] = &block->rd[1].s;
+    block->rd[0].s.inserts = &slab->hists[slab->used]; // inserts are only counted for read 1
+    slab->used++;
+    arena->table[size+i] = block->ends;
+    arena->size++;
+  }
+  return size;
+
+error:
+  return -1;
+}
+
+void stats_arena_free(stats_rd_t ***grp_stats){
+  if(grp_stats == NULL) return;
+  stats_arena_t *arena = arena_of(grp_stats);
+  stats_slab_t *slab = arena->slabs;
+  while(slab){
+    stats_slab_t *next = slab->next;
+    int i;
+    // as kh_destroy, without freeing the pooled header
+    for(i=0;i<slab->used;i++){
+      kfree(slab->hists[i].keys);
+      kfree(slab->hists[i].flags);
+      kfree(slab->hists[i].vals);
+    }
+    free(slab->hists);
+    free(slab->blocks);
+    free(slab);
+    slab = next;
+  }
+  free(arena);
+}
@@ -0,0 +1,46 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __stats_arena_h__
+#define __stats_arena_h__
+
+#include "bam_access.h"
+
+/*
+ * Storage behind the grp_stats[rg][end] tables of bam_access.
+ *
+ * Each read group gets one fixed layout block holding its read 1 and read 2
+ * counters, every counter set on its own cache line(s) so threads updating
+ * different groups never share a line. Blocks are carved from slabs of many
+ * groups, and the read 1 insert histograms of a slab are one pooled array.
+ * Slabs never move once allocated, so adding groups only grows the table.
+ *
+ * A table must only be grown with stats_arena_add and freed with
+ * stats_arena_free (bam_access_free_groups does this).
+ */
+
+#define STATS_ARENA_LINE 64
+
+// Appends n zeroed groups to *grp_stats (NULL to start a table), returns the index of the first or -1.
+int stats_arena_add(stats_rd_t ****grp_stats, int n);
+
+void stats_arena_free(stats_rd_t ***grp_stats);
+
+#endif
@@ -0,0 +1,331 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+#include "dbg.h"
+#include "khash.h"
+#include "target_index.h"
+
+KHASH_MAP_INIT_STR(ti_name, int)
+
+#define TARGET_LINE_MAX 65536
+
+static const char sidecar_magic[8] = {'P','C','A','P','T','I','X',1};
+
+static int is_comment(const char *line){
+  while(isspace((unsigned char) *line)) line++;
+  return *line == '#';
+}
+
+static int add_contig(target_index_t *ti, const char *name){
+  khash_t(ti_name) *h = (khash_t(ti_name) *) ti->lookup;
+  ti_contig_t *tmp = (ti_contig_t *) realloc(ti->contigs, sizeof(ti_contig_t) * (ti->n_contigs+1));
+  check_mem(tmp);
+  ti->contigs = tmp;
+  ti_contig_t *c = &ti->contigs[ti->n_contigs];
+  c->name = strdup(name);
+  check_mem(c->name);
+  c->n = 0;
+  c->iv = NULL;
+  int absent;
+  khint_t k = kh_put(ti_name, h, c->name, &absent);
+  check(absent >= 0, "Error adding contig %s to target index.", name);
+  kh_value(h, k) = ti->n_contigs;
+  return ti->n_contigs++;
+error:
+  return -1;
+}
+
+static target_index_t *new_index(){
+  target_index_t *ti = (target_index_t *) calloc(1, sizeof(target_index_t));
+  check_mem(ti);
+  ti->lookup = kh_init(ti_name);
+  check_mem(ti->lookup);
+  return ti;
+error:
+  if(ti) free(ti);
+  return NULL;
+}
+
+static int cmp_interval(const void *a, const void *b){
+  const ti_interval_t *ia = (const ti_interval_t *) a;
+  const ti_interval_t *ib = (const ti_interval_t *) b;
+  if(ia->beg != ib->beg) return ia->beg < ib->beg ? -1 : 1;
+  if(ia->end != ib->end) return ia->end < ib->end ? -1 : 1;
+  return 0;
+}
+
+// sort and merge overlapping or abutting intervals in place
+static void merge_contig(ti_contig_t *c){
+  if(c->n == 0) return;
+  qsort(c->iv, c->n, sizeof(ti_interval_t), cmp_interval);
+  int out = 0;
+  int i;
+  for(i=1; i<c->n; i++){
+    if(c->iv[i].beg <= c->iv[out].end){
+      if(c->iv[i].end > c->iv[out].end) c->iv[out].end = c->iv[i].end;
+    }else{
+      c->iv[++out] = c->iv[i];
+    }
+  }
+  c->n = out+1;
+}
+
+target_index_t *target_index_parse(const char *file, int is_gff){
+  FILE *in = NULL;
+  target_index_t *ti = NULL;
+  int *cap = NULL;
+  char line[TARGET_LINE_MAX];
+
+  ti = new_index();
+  check(ti != NULL, "Error creating target index.");
+  in = fopen(file, "r");
+  check(in != NULL, "Error opening target file '%s'.", file);
+  while(fgets(line, TARGET_LINE_MAX, in) != NULL){
+    if(is_comment(line)) continue;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    char *cols[5] = {NULL};
+    int n_cols = 0;
+    char *ptr = NULL;
+    char *tok = strtok_r(line, "\t", &ptr);
+    while(tok != NULL && n_cols < 5){
+      cols[n_cols++] = tok;
+      tok = strtok_r(NULL, "\t", &ptr);
+    }
+    char *chr = cols[0];
+    char *start_col = is_gff ? cols[3] : cols[1];
+    char *end_col = is_gff ? cols[4] : cols[2];
+    check(n_cols >= (is_gff ? 5 : 3), "File doesn't appear to be %s formatted: %s", is_gff ? "GFF3" : "BED", line);
+    check(*start_col && *end_col && strspn(start_col, "0123456789") == strlen(start_col) && strspn(end_col, "0123456789") == strlen(end_col),
+            "File doesn't appear to be %s formatted: %s", is_gff ? "GFF3" : "BED", line);
+    hts_pos_t start = strtoll(start_col, NULL, 10);
+    hts_pos_t end = strtoll(end_col, NULL, 10);
+    if(is_gff){
+      check(start <= end, "Start greater than end position, not valid gff3: %s, %"PRIhts_pos", %"PRIhts_pos, chr, start, end);
+      start--; // 1-based inclusive to 0-based half open
+    }else{
+      check(start != end, "Start and end positions are the same, not bed format: %s, %"PRIhts_pos", %"PRIhts_pos, chr, start, end);
+      check(start < end, "Start greater than end position, not valid bed: %s, %"PRIhts_pos", %"PRIhts_pos, chr, start, end);
+    }
+
+    int c = target_index_contig(ti, chr);
+    if(c < 0){
+      c = add_contig(ti, chr);
+      check(c >= 0, "Error adding contig %s.", chr);
+      int *tmp = (int *) realloc(cap, sizeof(int) * ti->n_contigs);
+      check_mem(tmp);
+      cap = tmp;
+      cap[c] = 0;
+    }
+    ti_contig_t *contig = &ti->contigs[c];
+    if(contig->n == cap[c]){
+      cap[c] = cap[c] ? cap[c] * 2 : 64;
+      ti_interval_t *tmp = (ti_interval_t *) realloc(contig->iv, sizeof(ti_interval_t) * cap[c]);
+      check_mem(tmp);
+      contig->iv = tmp;
+    }
+    contig->iv[contig->n].beg = start;
+    contig->iv[contig->n].end = end;
+    contig->n++;
+  }
+  check(ti->n_contigs > 0, "No targets found in '%s'.", file);
+  fclose(in);
+  free(cap);
+  int c;
+  for(c=0; c<ti->n_contigs; c++) merge_contig(&ti->contigs[c]);
+  return ti;
+
+error:
+  if(in) fclose(in);
+  if(cap) free(cap);
+  target_index_destroy(ti);
+  return NULL;
+}
+
+static int source_stamp(const char *source, int64_t *size, int64_t *mtime){
+  struct stat st;
+  check(stat(source, &st) == 0, "Unable to stat target file '%s'.", source);
+  *size = (int64_t) st.st_size;
+  *mtime = (int64_t) st.st_mtime;
+  return 0;
+error:
+  return -1;
+}
+
+int target_index_save(const target_index_t *ti, const char *sidecar, const char *source){
+  FILE *out = NULL;
+  int64_t size, mtime;
+  check(source_stamp(source, &size, &mtime) == 0, "Error reading target file details.");
+  out = fopen(sidecar, "wb");
+  check(out != NULL, "Error opening target index '%s' for writing.", sidecar);
+  check(fwrite(sidecar_magic, 1, sizeof(sidecar_magic), out) == sizeof(sidecar_magic), "Error writing target index.");
+  int32_t n_contigs = ti->n_contigs;
+  check(fwrite(&size, sizeof(int64_t), 1, out) == 1, "Error writing target index.");
+  check(fwrite(&mtime, sizeof(int64_t), 1, out) == 1, "Error writing target index.");
+  check(fwrite(&n_contigs, sizeof(int32_t), 1, out) == 1, "Error writing target index.");
+  int c;
+  for(c=0; c<ti->n_contigs; c++){
+    const ti_contig_t *contig = &ti->contigs[c];
+    int32_t name_len = strlen(contig->name);
+    int32_t n = contig->n;
+    check(fwrite(&name_len, sizeof(int32_t), 1, out) == 1, "Error writing target index.");
+    check(fwrite(contig->name, 1, name_len, out) == (size_t) name_len, "Error writing target index.");
+    check(fwrite(&n, sizeof(int32_t), 1, out) == 1, "Error writing target index.");
+    check(fwrite(contig->iv, sizeof(ti_interval_t), n, out) == (size_t) n, "Error writing target index.");
+  }
+  check(fclose(out) == 0, "Error closing target index '%s'.", sidecar);
+  return 0;
+error:
+  if(out) fclose(out);
+  return -1;
+}
+
+target_index_t *target_index_read(const char *sidecar, const char *source){
+  FILE *in = NULL;
+  target_index_t *ti = NULL;
+  char *name = NULL;
+  char magic[sizeof(sidecar_magic)];
+  int64_t size, mtime, exp_size, exp_mtime;
+
+  check(source_stamp(source, &exp_size, &exp_mtime) == 0, "Error reading target file details.");
+  in = fopen(sidecar, "rb");
+  if(in == NULL) return NULL; // absent, not an error
+  check(fread(magic, 1, sizeof(magic), in) == sizeof(magic) && memcmp(magic, sidecar_magic, sizeof(magic)) == 0,
+          "File '%s' is not a target index.", sidecar);
+  int32_t n_contigs;
+  check(fread(&size, sizeof(int64_t), 1, in) == 1, "Error reading target index.");
+  check(fread(&mtime, sizeof(int64_t), 1, in) == 1, "Error reading target index.");
+  if(size != exp_size || mtime != exp_mtime){
+    fclose(in);
+    return NULL; // stale
+  }
+  check(fread(&n_contigs, sizeof(int32_t), 1, in) == 1, "Error reading target index.");
+  ti = new_index();
+  check(ti != NULL, "Error creating target index.");
+  int c;
+  for(c=0; c<n_contigs; c++){
+    int32_t name_len, n;
+    check(fread(&name_len, sizeof(int32_t), 1, in) == 1 && name_len > 0, "Error reading target index.");
+    name = (char *) malloc(name_len+1);
+    check_mem(name);
+    check(fread(name, 1, name_len, in) == (size_t) name_len, "Error reading target index.");
+    name[name_len] = '\0';
+    int idx = add_contig(ti, name);
+    check(idx >= 0, "Error adding contig %s.", name);
+    free(name);
+    name = NULL;
+    check(fread(&n, sizeof(int32_t), 1, in) == 1 && n >= 0, "Error reading target index.");
+    ti->contigs[idx].iv = (ti_interval_t *) malloc(sizeof(ti_interval_t) * (n ? n : 1));
+    check_mem(ti->contigs[idx].iv);
+    check(fread(ti->contigs[idx].iv, sizeof(ti_interval_t), n, in) == (size_t) n, "Error reading target index.");
+    ti->contigs[idx].n = n;
+  }
+  fclose(in);
+  return ti;
+
+error:
+  if(name) free(name);
+  if(in) fclose(in);
+  target_index_destroy(ti);
+  return NULL;
+}
+
+int target_index_is_gff(const char *file){
+  size_t len = strlen(file);
+  return (len > 5 && strcmp(file + len - 5, ".gff3") == 0) || (len > 4 && strcmp(file + len - 4, ".gff") == 0);
+}
+
+target_index_t *target_index_load(const char *file, int is_gff, const char *sidecar){
+  target_index_t *ti = NULL;
+  if(sidecar){
+    ti = target_index_read(sidecar, file);
+    if(ti) return ti;
+  }
+  ti = target_index_parse(file, is_gff);
+  check(ti != NULL, "Error parsing targets from '%s'.", file);
+  if(sidecar) check(target_index_save(ti, sidecar, file) == 0, "Error writing target index '%s'.", sidecar);
+  return ti;
+error:
+  target_index_destroy(ti);
+  return NULL;
+}
+
+int target_index_contig(const target_index_t *ti, const char *name){
+  khash_t(ti_name) *h = (khash_t(ti_name) *) ti->lookup;
+  khint_t k = kh_get(ti_name, h, name);
+  if(k == kh_end(h)) return -1;
+  return kh_value(h, k);
+}
+
+// first interval with end > pos
+static int first_ending_after(const ti_contig_t *c, hts_pos_t pos){
+  int lo = 0, hi = c->n;
+  while(lo < hi){
+    int mid = lo + (hi - lo) / 2;
+    if(c->iv[mid].end <= pos){
+      lo = mid + 1;
+    }else{
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+int target_index_overlaps(const target_index_t *ti, int contig, hts_pos_t beg, hts_pos_t end, int *first){
+  const ti_contig_t *c = &ti->contigs[contig];
+  int i = first_ending_after(c, beg);
+  *first = i;
+  int n = 0;
+  while(i+n < c->n && c->iv[i+n].beg < end) n++;
+  return n;
+}
+
+int target_index_contains(const target_index_t *ti, int contig, hts_pos_t pos){
+  const ti_contig_t *c = &ti->contigs[contig];
+  int i = first_ending_after(c, pos);
+  return i < c->n && c->iv[i].beg <= pos;
+}
+
+uint64_t target_index_total(const target_index_t *ti){
+  uint64_t total = 0;
+  int c, i;
+  for(c=0; c<ti->n_contigs; c++){
+    for(i=0; i<ti->contigs[c].n; i++) total += ti->contigs[c].iv[i].end - ti->contigs[c].iv[i].beg;
+  }
+  return total;
+}
+
+void target_index_destroy(target_index_t *ti){
+  if(ti == NULL) return;
+  int c;
+  for(c=0; c<ti->n_contigs; c++){
+    free(ti->contigs[c].name);
+    free(ti->contigs[c].iv);
+  }
+  free(ti->contigs);
+  if(ti->lookup) kh_destroy(ti_name, (khash_t(ti_name) *) ti->lookup);
+  free(ti);
+}
@@ -0,0 +1,80 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __target_index_h__
+#define __target_index_h__
+
+#include <stdint.h>
+#include "htslib/hts.h"
+
+/*
+ * Per contig, sorted and overlap merged target intervals from a BED or GFF3 file.
+ * Intervals are 0-based, half open. Contigs are held in order of first appearance.
+ */
+typedef struct {
+  hts_pos_t beg;
+  hts_pos_t end;
+} ti_interval_t;
+
+typedef struct {
+  char *name;
+  int n;
+  ti_interval_t *iv;
+} ti_contig_t;
+
+typedef struct {
+  int n_contigs;
+  ti_contig_t *contigs;
+  void *lookup; // name -> contig index
+} target_index_t;
+
+// 1 when the file name has a .gff or .gff3 extension, otherwise treated as BED.
+int target_index_is_gff(const char *file);
+
+target_index_t *target_index_parse(const char *file, int is_gff);
+
+/*
+ * Binary sidecar, tagged with the size and mtime of the target file it was built
+ * from so a stale sidecar is never used.
+ */
+int target_index_save(const target_index_t *ti, const char *sidecar, const char *source);
+target_index_t *target_index_read(const char *sidecar, const char *source);
+
+/*
+ * Uses sidecar when present and current, otherwise parses the target file and
+ * writes the sidecar. sidecar may be NULL to always parse.
+ */
+target_index_t *target_index_load(const char *file, int is_gff, const char *sidecar);
+
+// Index of contig in ti->contigs, -1 when there are no targets on it.
+int target_index_contig(const target_index_t *ti, const char *name);
+
+// Number of intervals overlapping [beg,end), *first is set to the first of them.
+int target_index_overlaps(const target_index_t *ti, int contig, hts_pos_t beg, hts_pos_t end, int *first);
+
+// 1 when pos is inside a target.
+int target_index_contains(const target_index_t *ti, int contig, hts_pos_t pos);
+
+// Total bases covered by the merged targets.
+uint64_t target_index_total(const target_index_t *ti);
+
+void target_index_destroy(target_index_t *ti);
+
+#endif
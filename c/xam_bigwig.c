@@ -0,0 +1,624 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "dbg.h"
+#include "hfile_readahead.h"
+#include "ref_cache.h"
+#include "htslib/sam.h"
+#include "htslib/thread_pool.h"
+#include "bigWig.h"
+#include "khash.h"
+#include "coverage_window.h"
+
+// runs handed from a contig worker to the writer in blocks of this many
+#define BW_CHUNK 65536
+// blocks held for contigs ahead of the writer before their workers wait, ~100MB
+#define BW_MAX_CHUNKS 128
+#define BW_ZOOMS 10
+
+static char *input_file = NULL;
+static char *readahead_opt = NULL;
+static size_t readahead = 0;
+static char *output_file = NULL;
+static char *ref_file = NULL;
+static int filter = 3844; // as PCAP::BigWig
+static int overlap = 0;
+static int zeroes = 0;
+static int nthreads = 1;
+
+typedef struct bw_chunk_t {
+  uint32_t n;
+  uint32_t start[BW_CHUNK];
+  uint32_t end[BW_CHUNK];
+  float value[BW_CHUNK];
+  struct bw_chunk_t *next;
+} bw_chunk_t;
+
+typedef struct {
+  bw_chunk_t *head;
+  bw_chunk_t *tail;
+  int done;
+} contig_out_t;
+
+typedef struct {
+  contig_out_t *out; // per contig, in header order
+  int n_contigs;
+  int next_tid;      // next contig for a worker
+  int write_tid;     // contig being written
+  int buffered;      // chunks not yet written
+  int failed;
+  htsThreadPool *pool;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+} bw_queue_t;
+
+// aligned (M/=/X) blocks of a read
+typedef struct {
+  int n;
+  int m;
+  hts_pos_t *beg;
+  hts_pos_t *end;
+} blocks_t;
+
+KHASH_MAP_INIT_STR(mate, blocks_t *)
+
+typedef struct {
+  bw_queue_t *queue;
+  int tid;
+  bw_chunk_t *cur;
+  blocks_t read;
+  blocks_t diff;
+  khash_t(mate) *mates; // blocks of the first read of overlapping pairs, by qname
+} bw_worker_t;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: xam_bigwig -i file -o file [-r ref.fa] [-F flags] [-a] [-z] [-@ threads] [-h] [-v]\n\n");
+  printf ("Depth of aligned bases (M/=/X, not D/N) written to a single BigWig with zoom levels,\n");
+  printf ("contigs are processed in parallel and streamed to the writer in header order.\n\n");
+  printf ("-i --input                  Indexed BAM/CRAM file.\n");
+  printf ("-o --output                 BigWig file to write.\n\n");
+  printf ("Optional:\n");
+  printf ("-r --reference              Reference fasta or ref_cache_build directory, may be required for CRAM.\n");
+  printf ("-F --filter                 Ignore reads with any of these flags [3844].\n");
+  printf ("-a --overlap                Count bases covered by both reads of a pair once.\n");
+  printf ("-z --zeroes                 Include zero depth runs.\n");
+  printf ("-R --readahead              Read the input through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+  printf ("                            default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
+  printf ("-@ --threads                Contigs processed in parallel, also the size of the shared decode pool [1].\n\n");
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"input",required_argument,0,'i'},
+            {"output",required_argument,0,'o'},
+            {"reference",required_argument,0,'r'},
+            {"filter",required_argument,0,'F'},
+            {"overlap",no_argument,0,'a'},
+            {"zeroes",no_argument,0,'z'},
+            {"threads",required_argument,0,'@'},
+            {"readahead",required_argument,0,'R'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "i:o:r:F:@:R:azvh", long_opts, &index)) != -1){
+    switch(iarg){
+      case 'i':
+        input_file = optarg;
+        break;
+
+      case 'o':
+        output_file = optarg;
+        break;
+
+      case 'r':
+        ref_file = optarg;
+        break;
+
+      case 'F':
+        if(sscanf(optarg, "%i", &filter) != 1 || filter < 0){
+          sentinel("Error parsing -F argument '%s'. Should be an integer >= 0",optarg);
+        }
+        break;
+
+      case 'a':
+        overlap = 1;
+        break;
+
+      case 'z':
+        zeroes = 1;
+        break;
+
+      case 'R':
+        readahead_opt = optarg;
+        break;
+
+      case '@':
+        if(sscanf(optarg, "%i", &nthreads) != 1 || nthreads < 1){
+          sentinel("Error parsing -@ argument '%s'. Should be an integer > 0",optarg);
+        }
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  //-R overrides $PCAP_READAHEAD
+  if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
+
+  if(input_file == NULL || check_exist(input_file) != 1){
+    printf("Input file (-i) must be an existing file.\n");
+    print_usage(1);
+  }
+  if(output_file == NULL){
+    printf("Output file (-o) must be defined.\n");
+    print_usage(1);
+  }
+  if(ref_file && check_exist(ref_file) != 1){
+    printf("Reference file (-r) %s does not exist.\n",ref_file);
+    print_usage(1);
+  }
+  return 0;
+
+  error:
+    return 1;
+}
+
+static int blocks_push(blocks_t *blk, hts_pos_t beg, hts_pos_t end){
+  if(blk->n && blk->end[blk->n-1] == beg){
+    // only split by insertions
+    blk->end[blk->n-1] = end;
+    return 0;
+  }
+  if(blk->n == blk->m){
+    blk->m = blk->m ? blk->m * 2 : 16;
+    blk->beg = (hts_pos_t *) realloc(blk->beg, sizeof(hts_pos_t) * blk->m);
+    check_mem(blk->beg);
+    blk->end = (hts_pos_t *) realloc(blk->end, sizeof(hts_pos_t) * blk->m);
+    check_mem(blk->end);
+  }
+  blk->beg[blk->n] = beg;
+  blk->end[blk->n] = end;
+  blk->n++;
+  return 0;
+error:
+  return -1;
+}
+
+static void blocks_free(blocks_t *blk){
+  free(blk->beg);
+  free(blk->end);
+  memset(blk, 0, sizeof(blocks_t));
+}
+
+static int read_blocks(const bam1_t *b, blocks_t *blk){
+  const uint32_t *cigar = bam_get_cigar(b);
+  hts_pos_t pos = b->core.pos;
+  uint32_t i;
+  blk->n = 0;
+  for(i=0; i<b->core.n_cigar; i++){
+    int op = bam_cigar_op(cigar[i]);
+    hts_pos_t len = bam_cigar_oplen(cigar[i]);
+    if(op == BAM_CMATCH || op == BAM_CEQUAL || op == BAM_CDIFF){
+      check(blocks_push(blk, pos, pos + len) == 0, "Error storing aligned blocks.");
+    }
+    if(bam_cigar_type(op) & 2) pos += len;
+  }
+  return 0;
+error:
+  return -1;
+}
+
+// blocks of a not covered by b, both sorted and non-overlapping
+static int blocks_subtract(const blocks_t *a, const blocks_t *b, blocks_t *out){
+  int j = 0;
+  int i;
+  out->n = 0;
+  for(i=0; i<a->n; i++){
+    hts_pos_t beg = a->beg[i];
+    while(j < b->n && b->end[j] <= beg) j++;
+    int k;
+    for(k=j; k<b->n && b->beg[k] < a->end[i]; k++){
+      if(b->beg[k] > beg) check(blocks_push(out, beg, b->beg[k]) == 0, "Error storing aligned blocks.");
+      if(b->end[k] > beg) beg = b->end[k];
+    }
+    if(beg < a->end[i]) check(blocks_push(out, beg, a->end[i]) == 0, "Error storing aligned blocks.");
+  }
+  return 0;
+error:
+  return -1;
+}
+
+static void mates_clear(khash_t(mate) *mates){
+  khint_t k;
+  for(k=kh_begin(mates); k!=kh_end(mates); k++){
+    if(!kh_exist(mates, k)) continue;
+    free((char *) kh_key(mates, k));
+    blocks_free(kh_value(mates, k));
+    free(kh_value(mates, k));
+  }
+  kh_clear(mate, mates);
+}
+
+/*
+ * With overlap the first read of a pair whose mate starts inside it keeps its blocks, the
+ * mate then only adds the bases the first read didn't cover.
+ */
+static const blocks_t *pair_blocks(bw_worker_t *w, const bam1_t *b){
+  if(!overlap || !(b->core.flag & BAM_FPAIRED) || b->core.flag & (BAM_FSECONDARY | BAM_FSUPPLEMENTARY)) return &w->read;
+  const char *qname = bam_get_qname(b);
+  khint_t k = kh_get(mate, w->mates, qname);
+  if(k != kh_end(w->mates)){
+    blocks_t *first = kh_value(w->mates, k);
+    check(blocks_subtract(&w->read, first, &w->diff) == 0, "Error removing mate overlap.");
+    free((char *) kh_key(w->mates, k));
+    blocks_free(first);
+    free(first);
+    kh_del(mate, w->mates, k);
+    return &w->diff;
+  }
+  if(b->core.flag & BAM_FMUNMAP || b->core.mtid != b->core.tid) return &w->read;
+  if(w->read.n == 0 || b->core.mpos < b->core.pos || b->core.mpos >= w->read.end[w->read.n-1]) return &w->read;
+  blocks_t *keep = (blocks_t *) calloc(1, sizeof(blocks_t));
+  check_mem(keep);
+  int i;
+  for(i=0; i<w->read.n; i++) check(blocks_push(keep, w->read.beg[i], w->read.end[i]) == 0, "Error storing aligned blocks.");
+  char *key = strdup(qname);
+  check_mem(key);
+  int absent;
+  k = kh_put(mate, w->mates, key, &absent);
+  check(absent >= 0, "Error storing mate blocks.");
+  kh_value(w->mates, k) = keep;
+  return &w->read;
+error:
+  return NULL;
+}
+
+// hands a chunk to the writer, workers ahead of the writer wait when too much is held
+static int publish(bw_worker_t *w){
+  bw_queue_t *queue = w->queue;
+  bw_chunk_t *chunk = w->cur;
+  w->cur = NULL;
+  pthread_mutex_lock(&queue->lock);
+  while(!queue->failed && w->tid != queue->write_tid && queue->buffered >= BW_MAX_CHUNKS){
+    pthread_cond_wait(&queue->cond, &queue->lock);
+  }
+  contig_out_t *out = &queue->out[w->tid];
+  if(out->tail){
+    out->tail->next = chunk;
+  }else{
+    out->head = chunk;
+  }
+  out->tail = chunk;
+  queue->buffered++;
+  int failed = queue->failed;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+  return failed ? -1 : 0;
+}
+
+// coverage_window run callback, touching runs of equal depth are joined
+static int push_run(void *data, int tid, hts_pos_t beg, hts_pos_t end, int32_t depth){
+  bw_worker_t *w = (bw_worker_t *) data;
+  if(depth == 0 && !zeroes) return 0;
+  bw_chunk_t *c = w->cur;
+  if(c && c->n && c->end[c->n-1] == beg && c->value[c->n-1] == (float) depth){
+    c->end[c->n-1] = end;
+    return 0;
+  }
+  if(c && c->n == BW_CHUNK){
+    check(publish(w) == 0, "Error passing runs to the writer.");
+    c = NULL;
+  }
+  if(c == NULL){
+    c = (bw_chunk_t *) malloc(sizeof(bw_chunk_t));
+    check_mem(c);
+    c->n = 0;
+    c->next = NULL;
+    w->cur = c;
+  }
+  c->start[c->n] = (uint32_t) beg;
+  c->end[c->n] = (uint32_t) end;
+  c->value[c->n] = (float) depth;
+  c->n++;
+  return 0;
+error:
+  return -1;
+}
+
+static int process_contig(htsFile *in, bam_hdr_t *head, hts_idx_t *idx, coverage_window_t *cw, bw_worker_t *w){
+  hts_itr_t *itr = NULL;
+  bam1_t *b = NULL;
+  int ret = -1;
+  check(coverage_window_seek(cw, w->tid) == 0, "Error starting contig %s.", head->target_name[w->tid]);
+  itr = sam_itr_queryi(idx, w->tid, 0, HTS_POS_MAX);
+  check(itr != NULL, "Error creating iterator for %s.", head->target_name[w->tid]);
+  b = bam_init1();
+  check_mem(b);
+  int r;
+  while((r = sam_itr_next(in, itr, b)) >= 0){
+    if(b->core.flag & filter) continue;
+    check(coverage_window_advance(cw, w->tid, b->core.pos) == 0, "Error advancing depth on %s.", head->target_name[w->tid]);
+    check(read_blocks(b, &w->read) == 0, "Error reading aligned blocks.");
+    const blocks_t *blk = pair_blocks(w, b);
+    check(blk != NULL, "Error checking mate overlap.");
+    int i;
+    for(i=0; i<blk->n; i++){
+      check(coverage_window_add_span(cw, blk->beg[i], blk->end[i]) == 0, "Error adding depth on %s.", head->target_name[w->tid]);
+    }
+  }
+  check(r == -1, "Error reading input for %s.", head->target_name[w->tid]);
+  check(coverage_window_finish_contig(cw) == 0, "Error finishing contig %s.", head->target_name[w->tid]);
+  if(w->cur) check(publish(w) == 0, "Error passing runs to the writer.");
+  ret = 0;
+
+error:
+  mates_clear(w->mates);
+  if(b) bam_destroy1(b);
+  if(itr) hts_itr_destroy(itr);
+  return ret;
+}
+
+static void *worker(void *data){
+  bw_queue_t *queue = (bw_queue_t *) data;
+  htsFile *in = NULL;
+  bam_hdr_t *head = NULL;
+  hts_idx_t *idx = NULL;
+  coverage_window_t *cw = NULL;
+  bw_worker_t w;
+  memset(&w, 0, sizeof(bw_worker_t));
+  w.queue = queue;
+  w.mates = kh_init(mate);
+  check_mem(w.mates);
+
+  // own handle and index, decompression from the shared pool
+  in = hfile_readahead_hts_open(input_file, readahead);
+  check(in != NULL, "Error opening hts file for reading '%s'.", input_file);
+  if(ref_file) check(ref_cache_set_reference(in, ref_file) == 0, "Error setting reference for input.");
+  if(queue->pool) check(hts_set_opt(in, HTS_OPT_THREAD_POOL, queue->pool) == 0, "Error attaching thread pool.");
+  head = sam_hdr_read(in);
+  check(head != NULL, "Error reading header from '%s'.", input_file);
+  idx = sam_index_load(in, input_file);
+  check(idx != NULL, "Error loading index for '%s'.", input_file);
+  cw = coverage_window_init(head, NULL);
+  check(cw != NULL, "Error creating coverage window.");
+  coverage_window_set_runs(cw, push_run, &w);
+
+  while(1){
+    pthread_mutex_lock(&queue->lock);
+    w.tid = queue->failed ? queue->n_contigs : queue->next_tid++;
+    pthread_mutex_unlock(&queue->lock);
+    if(w.tid >= queue->n_contigs) break;
+    check(process_contig(in, head, idx, cw, &w) == 0, "Error processing contig %s.", head->target_name[w.tid]);
+    pthread_mutex_lock(&queue->lock);
+    queue->out[w.tid].done = 1;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+  }
+  coverage_window_destroy(cw);
+  kh_destroy(mate, w.mates);
+  blocks_free(&w.read);
+  blocks_free(&w.diff);
+  hts_idx_destroy(idx);
+  bam_hdr_destroy(head);
+  hts_close(in);
+  return NULL;
+
+error:
+  pthread_mutex_lock(&queue->lock);
+  queue->failed = 1;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+  if(w.cur) free(w.cur);
+  coverage_window_destroy(cw);
+  if(w.mates) kh_destroy(mate, w.mates);
+  blocks_free(&w.read);
+  blocks_free(&w.diff);
+  if(idx) hts_idx_destroy(idx);
+  if(head) bam_hdr_destroy(head);
+  if(in) hts_close(in);
+  return NULL;
+}
+
+static int write_chunk(bigWigFile_t *bw, const char *chrom, const bw_chunk_t *c, int first){
+  uint32_t off = 0;
+  if(first){
+    // a new chromosome needs its name once, the rest append
+    check(bwAddIntervals(bw, &chrom, c->start, c->end, c->value, 1) == 0, "Error adding intervals for %s.", chrom);
+    off = 1;
+  }
+  if(c->n > off){
+    check(bwAppendIntervals(bw, c->start + off, c->end + off, c->value + off, c->n - off) == 0, "Error appending intervals for %s.", chrom);
+  }
+  return 0;
+error:
+  return -1;
+}
+
+// main thread, takes each contig's chunks in header order as the workers produce them
+static int write_contigs(bw_queue_t *queue, bam_hdr_t *head, bigWigFile_t *bw){
+  int tid;
+  for(tid=0; tid<queue->n_contigs; tid++){
+    contig_out_t *out = &queue->out[tid];
+    int first = 1;
+    while(1){
+      pthread_mutex_lock(&queue->lock);
+      while(!queue->failed && out->head == NULL && !out->done) pthread_cond_wait(&queue->cond, &queue->lock);
+      bw_chunk_t *c = out->head;
+      if(c){
+        out->head = c->next;
+        if(out->head == NULL) out->tail = NULL;
+        queue->buffered--;
+        pthread_cond_broadcast(&queue->cond);
+      }
+      int failed = queue->failed;
+      pthread_mutex_unlock(&queue->lock);
+      if(c == NULL){
+        check(!failed, "Coverage worker failed.");
+        break;
+      }
+      int res = failed ? -1 : write_chunk(bw, head->target_name[tid], c, first);
+      free(c);
+      check(res == 0, "Error writing coverage for %s.", head->target_name[tid]);
+      first = 0;
+    }
+    pthread_mutex_lock(&queue->lock);
+    queue->write_tid = tid + 1;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+  }
+  return 0;
+error:
+  pthread_mutex_lock(&queue->lock);
+  queue->failed = 1;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->lock);
+  return -1;
+}
+
+int main(int argc, char *argv[]){
+  htsFile *input = NULL;
+  bam_hdr_t *head = NULL;
+  bigWigFile_t *bw = NULL;
+  pthread_t *threads = NULL;
+  htsThreadPool p = {NULL, 0};
+  bw_queue_t queue;
+  memset(&queue, 0, sizeof(bw_queue_t));
+  int i, started = 0, bw_init = 0, status = 1;
+
+  int problem = options(argc,argv);
+  check(problem==0,"Error parsing options.");
+
+  input = hfile_readahead_hts_open(input_file, readahead);
+  check(input != NULL, "Error opening hts file for reading '%s'.", input_file);
+  head = sam_hdr_read(input);
+  check(head != NULL, "Error reading header from '%s'.", input_file);
+  check(head->n_targets > 0, "No contigs in header of '%s'.", input_file);
+
+  check(bwInit(1<<17) == 0, "Error initialising BigWig library.");
+  bw_init = 1;
+  bw = bwOpen(output_file, NULL, "w");
+  check(bw != NULL, "Error opening '%s' for writing.", output_file);
+  check(bwCreateHdr(bw, BW_ZOOMS) == 0, "Error creating BigWig header.");
+  bw->cl = bwCreateChromList((const char * const *) head->target_name, head->target_len, head->n_targets);
+  check(bw->cl != NULL, "Error creating BigWig chromosome list.");
+  check(bwWriteHdr(bw) == 0, "Error writing BigWig header.");
+
+  queue.n_contigs = head->n_targets;
+  queue.out = (contig_out_t *) calloc(queue.n_contigs, sizeof(contig_out_t));
+  check_mem(queue.out);
+  check(pthread_mutex_init(&queue.lock, NULL) == 0, "Error creating mutex.");
+  check(pthread_cond_init(&queue.cond, NULL) == 0, "Error creating condition.");
+
+  p.pool = hts_tpool_init(nthreads);
+  check(p.pool != NULL, "Error creating thread pool.");
+  queue.pool = &p;
+
+  int n_threads = nthreads < queue.n_contigs ? nthreads : queue.n_contigs;
+  threads = (pthread_t *) malloc(sizeof(pthread_t) * n_threads);
+  check_mem(threads);
+  for(started=0; started<n_threads; started++){
+    check(pthread_create(&threads[started], NULL, worker, &queue) == 0, "Error starting coverage thread.");
+  }
+  int res = write_contigs(&queue, head, bw);
+  for(i=0; i<started; i++){
+    check(pthread_join(threads[i], NULL) == 0, "Error joining coverage thread.");
+  }
+  started = 0;
+  check(res == 0 && queue.failed == 0, "Error generating coverage.");
+
+  // zoom levels are built on close
+  bwClose(bw);
+  bw = NULL;
+  status = 0;
+
+error:
+  if(started){
+    // let the workers see the failure and stop
+    pthread_mutex_lock(&queue.lock);
+    queue.failed = 1;
+    pthread_cond_broadcast(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+    for(i=0; i<started; i++) pthread_join(threads[i], NULL);
+  }
+  if(queue.out){
+    for(i=0; i<queue.n_contigs; i++){
+      while(queue.out[i].head){
+        bw_chunk_t *c = queue.out[i].head;
+        queue.out[i].head = c->next;
+        free(c);
+      }
+    }
+    free(queue.out);
+  }
+  if(threads) free(threads);
+  if(bw) bwClose(bw);
+  if(bw_init) bwCleanup();
+  if(p.pool) hts_tpool_destroy(p.pool);
+  if(head) bam_hdr_destroy(head);
+  if(input) hts_close(input);
+  return status;
+}
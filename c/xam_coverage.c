@@ -0,0 +1,397 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "dbg.h"
+#include "hfile_readahead.h"
+#include "ref_cache.h"
+#include "htslib/sam.h"
+#include "coverage_bins.h"
+#include "target_index.h"
+
+// same as the default pileup mask used for Bio::DB::HTS coverage
+static const uint16_t depth_filter = BAM_FUNMAP | BAM_FSECONDARY | BAM_FQCFAIL | BAM_FDUP;
+
+static char *input_file = NULL;
+static char *readahead_opt = NULL;
+static size_t readahead = 0;
+static char *target_file = NULL;
+static char *target_type = NULL;
+static char *output_file = NULL;
+static char *ref_file = NULL;
+static char *sidecar_file = NULL;
+static int nthreads = 1;
+
+typedef struct {
+  int tid;
+  const ti_contig_t *targets; // sorted and merged
+} contig_job_t;
+
+typedef struct {
+  contig_job_t *jobs;
+  int n_jobs;
+  int next_job;
+  int failed;
+  coverage_bins_t bins;
+  pthread_mutex_t lock;
+} job_queue_t;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: xam_coverage -i file -t file [-T bed|gff3] [-x file] [-o file] [-r ref.fa] [-@ threads] [-h] [-v]\n\n");
+  printf ("Fraction of target bases at each depth range, output matches xam_coverage_bins.pl.\n\n");
+  printf ("-i --input                  Indexed BAM/CRAM file.\n");
+  printf ("-t --targets                BED or GFF3 file of targets.\n\n");
+  printf ("Optional:\n");
+  printf ("-T --type                   Type of target file [bed|gff3], default from file extension.\n");
+  printf ("-x --target-index           Binary target index, used when current for the target file, otherwise created.\n");
+  printf ("-o --output                 File to write bin string to [stdout].\n");
+  printf ("-r --reference              Reference fasta or ref_cache_build directory, may be required for CRAM.\n");
+  printf ("-R --readahead              Read the input through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+  printf ("                            default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
+  printf ("-@ --threads                Number of contigs to process in parallel [1].\n\n");
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"input",required_argument,0,'i'},
+            {"targets",required_argument,0,'t'},
+            {"type",required_argument,0,'T'},
+            {"target-index",required_argument,0,'x'},
+            {"output",required_argument,0,'o'},
+            {"reference",required_argument,0,'r'},
+            {"threads",required_argument,0,'@'},
+            {"readahead",required_argument,0,'R'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "i:t:T:x:o:r:@:R:vh", long_opts, &index)) != -1){
+    switch(iarg){
+      case 'i':
+        input_file = optarg;
+        break;
+
+      case 't':
+        target_file = optarg;
+        break;
+
+      case 'T':
+        target_type = optarg;
+        break;
+
+      case 'x':
+        sidecar_file = optarg;
+        break;
+
+      case 'o':
+        output_file = optarg;
+        break;
+
+      case 'r':
+        ref_file = optarg;
+        break;
+
+      case 'R':
+        readahead_opt = optarg;
+        break;
+
+      case '@':
+        if(sscanf(optarg, "%i", &nthreads) != 1 || nthreads < 1){
+          sentinel("Error parsing -@ argument '%s'. Should be an integer > 0",optarg);
+        }
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  //-R overrides $PCAP_READAHEAD
+  if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
+
+  if(input_file == NULL || check_exist(input_file) != 1){
+    printf("Input file (-i) must be an existing file.\n");
+    print_usage(1);
+  }
+  if(target_file == NULL || check_exist(target_file) != 1){
+    printf("Target file (-t) must be an existing file.\n");
+    print_usage(1);
+  }
+  if(ref_file && check_exist(ref_file) != 1){
+    printf("Reference file (-r) %s does not exist.\n",ref_file);
+    print_usage(1);
+  }
+  if(target_type == NULL){
+    target_type = target_index_is_gff(target_file) ? "gff3" : "bed";
+  }
+  if(strcmp(target_type, "bed") != 0 && strcmp(target_type, "gff3") != 0){
+    printf("Target type (-T) must be bed or gff3, got '%s'.\n", target_type);
+    print_usage(1);
+  }
+  return 0;
+
+  error:
+    return 1;
+}
+
+static contig_job_t *build_jobs(bam_hdr_t *head, target_index_t *ti, int *n_jobs){
+  contig_job_t *jobs = (contig_job_t *) calloc(ti->n_contigs ? ti->n_contigs : 1, sizeof(contig_job_t));
+  check_mem(jobs);
+  int n = 0;
+  int c;
+  for(c=0; c<ti->n_contigs; c++){
+    // contigs absent from the input still count towards total bases
+    int tid = sam_hdr_name2tid(head, ti->contigs[c].name);
+    if(tid < 0) continue;
+    jobs[n].tid = tid;
+    jobs[n].targets = &ti->contigs[c];
+    n++;
+  }
+  *n_jobs = n;
+  return jobs;
+error:
+  return NULL;
+}
+
+static int process_job(htsFile *in, bam_hdr_t *head, hts_idx_t *idx, contig_job_t *job, coverage_bins_t *bins){
+  char **regions = NULL;
+  hts_pos_t *offset = NULL;
+  int32_t *diff = NULL;
+  hts_itr_t *itr = NULL;
+  bam1_t *b = NULL;
+  int i, ret = -1;
+  const char *chr = sam_hdr_tid2name(head, job->tid);
+  const ti_contig_t *tgt = job->targets;
+
+  regions = (char **) calloc(tgt->n, sizeof(char *));
+  offset = (hts_pos_t *) malloc(sizeof(hts_pos_t) * (tgt->n+1));
+  check_mem(regions);
+  check_mem(offset);
+  offset[0] = 0;
+  for(i=0; i<tgt->n; i++){
+    size_t len = strlen(chr) + 64;
+    regions[i] = (char *) malloc(len);
+    check_mem(regions[i]);
+    snprintf(regions[i], len, "{%s}:%"PRIhts_pos"-%"PRIhts_pos, chr, tgt->iv[i].beg+1, tgt->iv[i].end);
+    // difference array per target, one extra slot for the end
+    offset[i+1] = offset[i] + (tgt->iv[i].end - tgt->iv[i].beg) + 1;
+  }
+  diff = (int32_t *) calloc(offset[tgt->n], sizeof(int32_t));
+  check_mem(diff);
+
+  // one iterator over all targets of the contig, each read is seen once
+  itr = sam_itr_regarray(idx, head, regions, tgt->n);
+  check(itr != NULL, "Error creating iterator for targets on %s.", chr);
+  b = bam_init1();
+  check_mem(b);
+  int lo = 0;
+  int r;
+  while((r = sam_itr_next(in, itr, b)) >= 0){
+    if(b->core.flag & depth_filter) continue;
+    hts_pos_t rbeg = b->core.pos;
+    hts_pos_t rend = bam_endpos(b);
+    // reads are sorted and targets don't overlap, targets before this read can't overlap later reads
+    while(lo < tgt->n && tgt->iv[lo].end <= rbeg) lo++;
+    int k;
+    for(k=lo; k<tgt->n && tgt->iv[k].beg < rend; k++){
+      const ti_interval_t *t = &tgt->iv[k];
+      hts_pos_t s = rbeg > t->beg ? rbeg : t->beg;
+      hts_pos_t e = rend < t->end ? rend : t->end;
+      diff[offset[k] + (s - t->beg)]++;
+      diff[offset[k] + (e - t->beg)]--;
+    }
+  }
+  check(r == -1, "Error reading input for targets on %s.", chr);
+
+  for(i=0; i<tgt->n; i++){
+    hts_pos_t len = tgt->iv[i].end - tgt->iv[i].beg;
+    int32_t *d = diff + offset[i];
+    int32_t depth = 0;
+    uint64_t run = 0;
+    hts_pos_t p;
+    for(p=0; p<len; p++){
+      int32_t next = depth + d[p];
+      if(p && next != depth){
+        coverage_bins_add(bins, (uint32_t) depth, run);
+        run = 0;
+      }
+      depth = next;
+      run++;
+    }
+    coverage_bins_add(bins, (uint32_t) depth, run);
+  }
+  ret = 0;
+
+error:
+  if(b) bam_destroy1(b);
+  if(itr) hts_itr_destroy(itr);
+  if(regions){
+    for(i=0; i<tgt->n; i++) free(regions[i]);
+    free(regions);
+  }
+  free(offset);
+  free(diff);
+  return ret;
+}
+
+static void *worker(void *data){
+  job_queue_t *queue = (job_queue_t *) data;
+  htsFile *in = NULL;
+  bam_hdr_t *head = NULL;
+  hts_idx_t *idx = NULL;
+  coverage_bins_t bins;
+  memset(&bins, 0, sizeof(coverage_bins_t));
+
+  // each worker has its own handle so contigs are decoded in parallel
+  in = hfile_readahead_hts_open(input_file, readahead);
+  check(in != NULL, "Error opening hts file for reading '%s'.", input_file);
+  if(ref_file) check(ref_cache_set_reference(in, ref_file) == 0, "Error setting reference for input.");
+  head = sam_hdr_read(in);
+  check(head != NULL, "Error reading header from '%s'.", input_file);
+  idx = sam_index_load(in, input_file);
+  check(idx != NULL, "Error loading index for '%s'.", input_file);
+
+  while(1){
+    pthread_mutex_lock(&queue->lock);
+    int j = queue->failed ? queue->n_jobs : queue->next_job++;
+    pthread_mutex_unlock(&queue->lock);
+    if(j >= queue->n_jobs) break;
+    check(process_job(in, head, idx, &queue->jobs[j], &bins) == 0, "Error processing contig %d.", queue->jobs[j].tid);
+  }
+  pthread_mutex_lock(&queue->lock);
+  coverage_bins_merge(&queue->bins, &bins);
+  pthread_mutex_unlock(&queue->lock);
+  hts_idx_destroy(idx);
+  bam_hdr_destroy(head);
+  hts_close(in);
+  return NULL;
+
+error:
+  pthread_mutex_lock(&queue->lock);
+  queue->failed = 1;
+  pthread_mutex_unlock(&queue->lock);
+  if(idx) hts_idx_destroy(idx);
+  if(head) bam_hdr_destroy(head);
+  if(in) hts_close(in);
+  return NULL;
+}
+
+int main(int argc, char *argv[]){
+  htsFile *input = NULL;
+  bam_hdr_t *head = NULL;
+  target_index_t *ti = NULL;
+  contig_job_t *jobs = NULL;
+  pthread_t *threads = NULL;
+  FILE *out = NULL;
+  job_queue_t queue;
+  memset(&queue, 0, sizeof(job_queue_t));
+  int i, status = 1;
+
+  int problem = options(argc,argv);
+  check(problem==0,"Error parsing options.");
+
+  input = hfile_readahead_hts_open(input_file, readahead);
+  check(input != NULL, "Error opening hts file for reading '%s'.", input_file);
+  head = sam_hdr_read(input);
+  check(head != NULL, "Error reading header from '%s'.", input_file);
+
+  ti = target_index_load(target_file, strcmp(target_type, "gff3") == 0, sidecar_file);
+  check(ti != NULL, "Error loading targets from '%s'.", target_file);
+  queue.bins.total_bases = target_index_total(ti);
+
+  jobs = build_jobs(head, ti, &queue.n_jobs);
+  check(jobs != NULL, "Error grouping targets by contig.");
+  queue.jobs = jobs;
+  check(pthread_mutex_init(&queue.lock, NULL) == 0, "Error creating mutex.");
+
+  int n_threads = nthreads < queue.n_jobs ? nthreads : queue.n_jobs;
+  if(n_threads > 0){
+    threads = (pthread_t *) malloc(sizeof(pthread_t) * n_threads);
+    check_mem(threads);
+    for(i=0; i<n_threads; i++){
+      check(pthread_create(&threads[i], NULL, worker, &queue) == 0, "Error starting coverage thread.");
+    }
+    for(i=0; i<n_threads; i++){
+      check(pthread_join(threads[i], NULL) == 0, "Error joining coverage thread.");
+    }
+  }
+  check(queue.failed == 0, "Error calculating coverage.");
+
+  out = output_file ? fopen(output_file, "w") : stdout;
+  check(out != NULL, "Error opening '%s' for writing.", output_file);
+  check(coverage_bins_print(&queue.bins, out) == 0, "Error writing coverage bins.");
+  check(fprintf(out, "\n") == 1, "Error writing coverage bins.");
+  if(output_file) check(fclose(out) == 0, "Error closing '%s'.", output_file);
+  out = NULL;
+  status = 0;
+
+error:
+  if(out && output_file) fclose(out);
+  if(threads) free(threads);
+  if(jobs) free(jobs);
+  target_index_destroy(ti);
+  if(head) bam_hdr_destroy(head);
+  if(input) hts_close(input);
+  return status;
+}
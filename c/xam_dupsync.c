@@ -0,0 +1,417 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "hfile_readahead.h"
+#include "ref_cache.h"
+#include "khash.h"
+#include "htslib/sam.h"
+#include "htslib/kstring.h"
+#include "htslib/thread_pool.h"
+
+KHASH_SET_INIT_STR(names)
+
+#define MAX_NAME_FILES 1024
+
+char *input_file = NULL;
+char *readahead_opt = NULL;
+size_t readahead = 0;
+char *output_file = NULL;
+char *out_fmt = "bam";
+char *ref_file = NULL;
+char *shard_bed = NULL;
+char *collect_file = NULL;
+char *name_files[MAX_NAME_FILES];
+int n_name_files = 0;
+int nthreads = 0;
+int debug = 0;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: xam_dupsync -o file [-i file] [-O fmt] [-r ref.fa] [-L shard.bed -N names.txt] [-n names.txt ...] [-@ threads] [-h] [-v]\n\n");
+  printf ("Synchronises duplicate flags between shards that were duplicate marked independently.\n");
+  printf ("With -L/-N the names of duplicate reads whose mate or supplementary alignments fall outside\n");
+  printf ("the shard are recorded.  With -n reads with a recorded name are flagged as duplicate.\n\n");
+  printf ("-o --output                 File path to write BAM/CRAM to.\n\n");
+  printf ("Optional:\n");
+  printf ("-i --input                  [bc]ram File path to read input [stdin].\n");
+  printf ("-O --output-fmt             Format and options as for 'samtools view --output-fmt' [%s].\n", out_fmt);
+  printf ("-r --reference              Reference fasta or ref_cache_build directory, required for CRAM.\n");
+  printf ("-L --shard                  BED file of the contigs in this shard (only first column is used).\n");
+  printf ("-N --collect                Write names of duplicates with alignments outside of the shard to this file.\n");
+  printf ("-n --names                  File of read names to flag as duplicate, may be repeated.\n");
+  printf ("-R --readahead              Read the input through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+  printf ("                            default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
+  printf ("-@ --threads                Number of BAM/CRAM (de)compression threads [0].\n\n");
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-d --debug     Turn on debug mode.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"debug",no_argument,0,'d'},
+            {"input",required_argument,0,'i'},
+            {"output",required_argument,0,'o'},
+            {"output-fmt",required_argument,0,'O'},
+            {"reference",required_argument,0,'r'},
+            {"shard",required_argument,0,'L'},
+            {"collect",required_argument,0,'N'},
+            {"names",required_argument,0,'n'},
+            {"threads",required_argument,0,'@'},
+            {"readahead",required_argument,0,'R'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "i:o:O:r:L:N:n:@:R:vdh", long_opts, &index)) != -1){
+    switch(iarg){
+      case 'i':
+        input_file = optarg;
+        break;
+
+      case 'o':
+        output_file = optarg;
+        break;
+
+      case 'O':
+        out_fmt = optarg;
+        break;
+
+      case 'r':
+        ref_file = optarg;
+        break;
+
+      case 'L':
+        shard_bed = optarg;
+        break;
+
+      case 'N':
+        collect_file = optarg;
+        break;
+
+      case 'n':
+        check(n_name_files < MAX_NAME_FILES, "Too many -n files, max %d.", MAX_NAME_FILES);
+        name_files[n_name_files++] = optarg;
+        break;
+
+      case 'R':
+        readahead_opt = optarg;
+        break;
+
+      case '@':
+        if(sscanf(optarg, "%i", &nthreads) != 1){
+          sentinel("Error parsing -@ nThreads) argument '%s'. Should be an integer",optarg);
+        }
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case 'd':
+        debug=1;
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  //-R overrides $PCAP_READAHEAD
+  if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
+
+  if (input_file==NULL || strcmp(input_file,"/dev/stdin")==0) {
+    input_file = "-";   // htslib recognises this as a special case
+  }
+  if (strcmp(input_file,"-") != 0) {
+    if(check_exist(input_file) != 1){
+      printf("Input file (-i) %s does not exist.\n",input_file);
+      print_usage(1);
+    }
+  }
+  if(output_file == NULL){
+    printf("Output file (-o) must be defined.\n");
+    print_usage(1);
+  }
+  if((shard_bed == NULL) != (collect_file == NULL)){
+    printf("Options -L and -N must be used together.\n");
+    print_usage(1);
+  }
+  int i;
+  for(i=0;i<n_name_files;i++){
+    if(check_exist(name_files[i]) != 1){
+      printf("Names file (-n) %s does not exist.\n",name_files[i]);
+      print_usage(1);
+    }
+  }
+  return 0;
+
+  error:
+    return 1;
+}
+
+/*
+ * Marks each contig listed in the first column of the bed file as within the shard.
+ */
+uint8_t *load_shard(bam_hdr_t *head, char *bed){
+  FILE *fp = NULL;
+  char *line = NULL;
+  size_t len = 0;
+  uint8_t *in_shard = calloc(sam_hdr_nref(head), sizeof(uint8_t));
+  check_mem(in_shard);
+  fp = fopen(bed, "r");
+  check(fp != NULL, "Error opening shard bed '%s'.", bed);
+  while(getline(&line, &len, fp) != -1){
+    char *name = strtok(line, "\t\n");
+    if(name == NULL || name[0] == '#') continue;
+    int tid = sam_hdr_name2tid(head, name);
+    check(tid >= 0, "Contig '%s' from '%s' is not in the header.", name, bed);
+    in_shard[tid] = 1;
+  }
+  free(line);
+  fclose(fp);
+  return in_shard;
+
+error:
+  free(line);
+  if(fp) fclose(fp);
+  free(in_shard);
+  return NULL;
+}
+
+int load_names(khash_t(names) *names, char *file){
+  FILE *fp = NULL;
+  char *line = NULL;
+  size_t len = 0;
+  ssize_t l;
+  int ret;
+  fp = fopen(file, "r");
+  check(fp != NULL, "Error opening names file '%s'.", file);
+  while((l = getline(&line, &len, fp)) != -1){
+    if(l > 0 && line[l-1] == '\n') line[--l] = '\0';
+    if(l == 0) continue;
+    khint_t k = kh_get(names, names, line);
+    if(k != kh_end(names)) continue;
+    char *name = strdup(line);
+    check_mem(name);
+    kh_put(names, names, name, &ret);
+    check(ret >= 0, "Error storing read name.");
+  }
+  free(line);
+  fclose(fp);
+  return 0;
+
+error:
+  free(line);
+  if(fp) fclose(fp);
+  return -1;
+}
+
+/*
+ * True when the mate or any supplementary (SA tag) alignment is on a contig outside of the shard.
+ */
+int crosses_shard(bam1_t *b, bam_hdr_t *head, uint8_t *in_shard){
+  if(b->core.flag & BAM_FPAIRED && !(b->core.flag & BAM_FMUNMAP) && b->core.mtid >= 0 && !in_shard[b->core.mtid]) return 1;
+  uint8_t *sa = bam_aux_get(b, "SA");
+  if(sa == NULL) return 0;
+  char *sa_str = bam_aux2Z(sa);
+  if(sa_str == NULL) return 0;
+  // SA:Z:rname,pos,strand,CIGAR,mapQ,NM;...
+  kstring_t rname = {0,0,NULL};
+  int crosses = 0;
+  char *entry = sa_str;
+  while(*entry && !crosses){
+    char *comma = strchr(entry, ',');
+    if(comma == NULL) break;
+    rname.l = 0;
+    kputsn(entry, comma - entry, &rname);
+    int tid = sam_hdr_name2tid(head, rname.s);
+    if(tid >= 0 && !in_shard[tid]) crosses = 1;
+    char *next = strchr(comma, ';');
+    if(next == NULL) break;
+    entry = next + 1;
+  }
+  free(rname.s);
+  return crosses;
+}
+
+int main(int argc, char *argv[]){
+  htsFile *input = NULL;
+  htsFile *output = NULL;
+  bam_hdr_t *head = NULL;
+  bam1_t *b = NULL;
+  FILE *collect = NULL;
+  uint8_t *in_shard = NULL;
+  khash_t(names) *names = NULL;
+  khash_t(names) *written = NULL;
+  htsFormat fmt = {0};
+  htsThreadPool p = {NULL, 0};
+  uint64_t count = 0;
+  uint64_t collected = 0;
+  uint64_t flagged = 0;
+  uint64_t flagged_np = 0;
+  khint_t k;
+  int ret = 0;
+  int i = 0;
+  int status = 1;
+
+  int problem = options(argc,argv);
+  check(problem==0,"Error parsing options.");
+
+  check(hts_parse_format(&fmt, out_fmt) == 0, "Error parsing output format '%s'.", out_fmt);
+  check(fmt.format == bam || fmt.format == cram, "Output format must be bam or cram, got '%s'.", out_fmt);
+  if(fmt.format == cram) check(ref_file != NULL, "Reference (-r) is required for CRAM output.");
+
+  names = kh_init(names);
+  for(i=0;i<n_name_files;i++){
+    check(load_names(names, name_files[i]) == 0, "Error loading names.");
+  }
+  if(debug==1) fprintf(stderr,"Loaded %"PRIu32" names.\n", kh_size(names));
+
+  input = hfile_readahead_hts_open(input_file, readahead);
+  check(input != NULL, "Error opening hts file for reading '%s'.",input_file);
+  if(ref_file) check(ref_cache_set_reference(input, ref_file) == 0, "Error setting reference for input.");
+  head = sam_hdr_read(input);
+  check(head != NULL, "Error reading header from opened hts file '%s'.",input_file);
+
+  if (nthreads > 0) {
+    p.pool = hts_tpool_init(nthreads);
+    check(p.pool != NULL,"Error creating thread pool");
+    hts_set_opt(input,  HTS_OPT_THREAD_POOL, &p);
+  }
+
+  if(shard_bed){
+    in_shard = load_shard(head, shard_bed);
+    check(in_shard != NULL, "Error loading shard contigs.");
+    collect = fopen(collect_file, "w");
+    check(collect != NULL, "Error opening '%s' for writing.", collect_file);
+    written = kh_init(names);
+  }
+
+  output = sam_open_format(output_file, fmt.format == cram ? "wc" : "wb", &fmt);
+  check(output != NULL, "Error opening hts file for writing '%s'.", output_file);
+  if(ref_file) check(ref_cache_set_reference(output, ref_file) == 0, "Error setting reference for output.");
+  if(p.pool) hts_set_opt(output, HTS_OPT_THREAD_POOL, &p);
+  check(sam_hdr_write(output, head) == 0, "Error writing header to '%s'.", output_file);
+
+  b = bam_init1();
+  check_mem(b);
+  while((ret = sam_read1(input, head, b)) >= 0){
+    count++;
+    if(b->core.flag & BAM_FDUP){
+      if(collect && crosses_shard(b, head, in_shard)){
+        char *qname = bam_get_qname(b);
+        k = kh_get(names, written, qname);
+        if(k == kh_end(written)){
+          char *name = strdup(qname);
+          check_mem(name);
+          kh_put(names, written, name, &ret);
+          check(ret >= 0, "Error storing read name.");
+          check(fprintf(collect, "%s\n", qname) > 0, "Error writing to '%s'.", collect_file);
+          collected++;
+        }
+      }
+    }
+    else if(kh_size(names) > 0){
+      k = kh_get(names, names, bam_get_qname(b));
+      if(k != kh_end(names)){
+        b->core.flag |= BAM_FDUP;
+        flagged++;
+        if(b->core.flag & (BAM_FSECONDARY|BAM_FSUPPLEMENTARY)) flagged_np++;
+      }
+    }
+    check(sam_write1(output, head, b) >= 0, "Error writing read %"PRIu64" to '%s'.", count, output_file);
+  }
+  check(ret == -1, "Error reading input '%s'.", input_file);
+
+  ret = hts_close(output);
+  output = NULL;
+  check(ret == 0, "Error closing '%s'.", output_file);
+  if(collect){
+    ret = fclose(collect);
+    collect = NULL;
+    check(ret == 0, "Error closing '%s'.", collect_file);
+  }
+  // consumed when merging duplicate metrics
+  fprintf(stderr, "DUPSYNC: %"PRIu64" reads, %"PRIu64" names collected, %"PRIu64" reads flagged, %"PRIu64" non primary\n",
+            count, collected, flagged, flagged_np);
+  status = 0;
+
+error:
+  if(b) bam_destroy1(b);
+  if(output) hts_close(output);
+  if(collect) fclose(collect);
+  free(in_shard);
+  if(names){
+    for(k = kh_begin(names); k != kh_end(names); ++k){
+      if(kh_exist(names, k)) free((char *) kh_key(names, k));
+    }
+    kh_destroy(names, names);
+  }
+  if(written){
+    for(k = kh_begin(written); k != kh_end(written); ++k){
+      if(kh_exist(written, k)) free((char *) kh_key(written, k));
+    }
+    kh_destroy(names, written);
+  }
+  if(head) bam_hdr_destroy(head);
+  if(input) hts_close(input);
+  if(fmt.specific) hts_opt_free(fmt.specific);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return status;
+}
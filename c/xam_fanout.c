@@ -0,0 +1,445 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "hfile_readahead.h"
+#include "ref_cache.h"
+#include "htslib/sam.h"
+#include "htslib/hfile.h"
+#include "htslib/thread_pool.h"
+#include "bam_access.h"
+#include "bam_stats_output.h"
+#include "bam_stats_calcs.h"
+#include "bam_stats_shard.h"
+#include "hfile_md5.h"
+#include "coverage_window.h"
+
+char *input_file = NULL;
+char *readahead_opt = NULL;
+size_t readahead = 0;
+char *output_file = NULL;
+char *out_fmt = NULL;
+char *ref_file = NULL;
+char *idx_file = NULL;
+char *md5_file = NULL;
+int md5sum_fmt = 0;
+char *bas_file = NULL;
+char *shard_out = NULL;
+char **shard_in = NULL;
+int shard_in_size = 0;
+char *coverage_out = NULL;
+char *depth_hist_out = NULL;
+char *target_file = NULL;
+int use_csi = 0;
+int rna = 0;
+double rna_sd = BAM_STATS_RNA_SD;
+int rna_iter = BAM_STATS_RNA_ITERATIONS;
+int nthreads = 0;
+int debug = 0;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: xam_fanout -o file [-i file] [-O fmt] [-r ref.fa] [-x file [-c]] [-m file] [-b file] [-s file] [-S file ...] [-C file] [-H file] [-t targets] [-@ threads] [-h] [-v]\n\n");
+  printf ("Decodes the input once and from the same records writes BAM/CRAM, builds the index,\n");
+  printf ("hashes the compressed output and generates bam_stats (bas) output.\n\n");
+  printf ("-o --output                 File path to write BAM/CRAM to.\n\n");
+  printf ("Optional:\n");
+  printf ("-i --input                  [bc]ram File path to read input [stdin].\n");
+  printf ("-O --output-fmt             Format and options as for 'samtools view --output-fmt', e.g. 'cram,seqs_per_slice=10000'\n");
+  printf ("                            [bam, or cram when output ends .cram].\n");
+  printf ("-r --reference              Reference fasta or ref_cache_build directory, required for CRAM.\n");
+  printf ("-x --index                  Build index on the fly and write to this file (.bai/.csi/.crai).\n");
+  printf ("-c --csi                    Index is CSI rather than BAI (BAM only).\n");
+  printf ("-m --md5                    Write md5 of the output file to this file.\n");
+  printf ("-M --md5sum                 Write the md5 file as 'md5sum -b' of a stream ('<md5> *-') rather than the bare digest.\n");
+  printf ("-b --bas                    Write bam_stats output to this file.\n");
+  printf ("-s --shard-out              Write raw stats of this stream to a shard file, see bam_stats -S.\n");
+  printf ("-S --shard                  Stats shard of an upstream part of this data, repeat for each shard.\n");
+  printf ("                            When given the bas (-b) is the sum of the shards with only duplicate\n");
+  printf ("                            counts taken from this stream.\n");
+  printf ("-C --coverage               Write depth bins of this stream to this file, see bam_stats (coordinate sorted only).\n");
+  printf ("-H --depth-hist             Write the depth histogram of this stream to this file (coordinate sorted only).\n");
+  printf ("-t --targets                Restrict -C and -H to the targets in this bed|gff3 file, default whole genome.\n");
+  printf ("-a --rna                    Uses the RNA method of calculating insert size, see bam_stats.\n");
+  printf ("-D --rna-sd                 With -a, the 'sd' multiplier of the standard deviation [%.1f].\n", BAM_STATS_RNA_SD);
+  printf ("-I --rna-iter               With -a, number of times the trimming is repeated [%d].\n", BAM_STATS_RNA_ITERATIONS);
+  printf ("-R --readahead              Read the input through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+  printf ("                            default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
+  printf ("-@ --threads                Number of BAM/CRAM (de)compression threads [0].\n\n");
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-d --debug     Turn on debug mode.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"debug",no_argument,0,'d'},
+            {"input",required_argument,0,'i'},
+            {"output",required_argument,0,'o'},
+            {"output-fmt",required_argument,0,'O'},
+            {"reference",required_argument,0,'r'},
+            {"index",required_argument,0,'x'},
+            {"csi",no_argument,0,'c'},
+            {"md5",required_argument,0,'m'},
+            {"md5sum",no_argument,0,'M'},
+            {"bas",required_argument,0,'b'},
+            {"shard-out",required_argument,0,'s'},
+            {"shard",required_argument,0,'S'},
+            {"coverage",required_argument,0,'C'},
+            {"depth-hist",required_argument,0,'H'},
+            {"targets",required_argument,0,'t'},
+            {"rna",no_argument,0,'a'},
+            {"rna-sd",required_argument,0,'D'},
+            {"rna-iter",required_argument,0,'I'},
+            {"threads",required_argument,0,'@'},
+            {"readahead",required_argument,0,'R'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "i:o:O:r:x:m:b:s:S:C:H:t:@:R:D:I:cMavdh", long_opts, &index)) != -1){
+    switch(iarg){
+      case 'i':
+        input_file = optarg;
+        break;
+
+      case 'o':
+        output_file = optarg;
+        break;
+
+      case 'O':
+        out_fmt = optarg;
+        break;
+
+      case 'r':
+        ref_file = optarg;
+        break;
+
+      case 'x':
+        idx_file = optarg;
+        break;
+
+      case 'c':
+        use_csi = 1;
+        break;
+
+      case 'm':
+        md5_file = optarg;
+        break;
+
+      case 'M':
+        md5sum_fmt = 1;
+        break;
+
+      case 'b':
+        bas_file = optarg;
+        break;
+
+      case 's':
+        shard_out = optarg;
+        break;
+
+      case 'S':
+        shard_in = realloc(shard_in, sizeof(char *) * (shard_in_size+1));
+        check_mem(shard_in);
+        shard_in[shard_in_size++] = optarg;
+        break;
+
+      case 'C':
+        coverage_out = optarg;
+        break;
+
+      case 'H':
+        depth_hist_out = optarg;
+        break;
+
+      case 't':
+        target_file = optarg;
+        break;
+
+      case 'a':
+        rna = 1;
+        break;
+
+      case 'D':
+        if(sscanf(optarg, "%lf", &rna_sd) != 1 || rna_sd <= 0){
+          sentinel("Error parsing -D argument '%s'. Should be a number > 0",optarg);
+        }
+        break;
+
+      case 'I':
+        if(sscanf(optarg, "%i", &rna_iter) != 1 || rna_iter < 0){
+          sentinel("Error parsing -I argument '%s'. Should be an integer >= 0",optarg);
+        }
+        break;
+
+      case 'R':
+        readahead_opt = optarg;
+        break;
+
+      case '@':
+        if(sscanf(optarg, "%i", &nthreads) != 1){
+          sentinel("Error parsing -@ nThreads) argument '%s'. Should be an integer",optarg);
+        }
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case 'd':
+        debug=1;
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  //-R overrides $PCAP_READAHEAD
+  if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
+
+  if (input_file==NULL || strcmp(input_file,"/dev/stdin")==0) {
+    input_file = "-";   // htslib recognises this as a special case
+  }
+  if (strcmp(input_file,"-") != 0) {
+    if(check_exist(input_file) != 1){
+      printf("Input file (-i) %s does not exist.\n",input_file);
+      print_usage(1);
+    }
+  }
+  if(output_file == NULL){
+    printf("Output file (-o) must be defined.\n");
+    print_usage(1);
+  }
+  if(ref_file){
+    if(check_exist(ref_file) != 1){
+      printf("Reference file (-r) %s does not exist.\n",ref_file);
+      print_usage(1);
+    }
+  }
+  int i=0;
+  for(i=0;i<shard_in_size;i++){
+    if(check_exist(shard_in[i]) != 1){
+      printf("Stats shard (-S) %s does not exist.\n",shard_in[i]);
+      print_usage(1);
+    }
+  }
+  if(shard_in_size > 0 && bas_file == NULL){
+    printf("Stats shards (-S) are only used with bas output (-b).\n");
+    print_usage(1);
+  }
+  if(target_file){
+    if(coverage_out == NULL && depth_hist_out == NULL){
+      printf("Targets (-t) only apply to coverage (-C/-H).\n");
+      print_usage(1);
+    }
+    if(check_exist(target_file) != 1){
+      printf("Target file (-t) %s does not exist.\n",target_file);
+      print_usage(1);
+    }
+  }
+  if(out_fmt == NULL){
+    size_t len = strlen(output_file);
+    out_fmt = (len > 5 && strcmp(output_file + len - 5, ".cram") == 0) ? "cram" : "bam";
+  }
+  return 0;
+
+  error:
+    return 1;
+}
+
+int main(int argc, char *argv[]){
+  htsFile *input = NULL;
+  htsFile *output = NULL;
+  hFILE *hout = NULL;
+  bam_hdr_t *head = NULL;
+  bam_hdr_t *stats_head = NULL;
+  bam1_t *b = NULL;
+  hts_md5_context *md5 = NULL;
+  target_index_t *ti = NULL;
+  coverage_window_t *cw = NULL;
+  rg_info_t **grps = NULL;
+  stats_rd_t ***grp_stats = NULL;
+  int grps_size = 0;
+  htsFormat fmt = {0};
+  htsThreadPool p = {NULL, 0};
+  uint64_t count = 0;
+  int ret = 0;
+  int status = 1;
+
+  int problem = options(argc,argv);
+  check(problem==0,"Error parsing options.");
+
+  check(hts_parse_format(&fmt, out_fmt) == 0, "Error parsing output format '%s'.", out_fmt);
+  check(fmt.format == bam || fmt.format == cram, "Output format must be bam or cram, got '%s'.", out_fmt);
+  if(fmt.format == cram) check(ref_file != NULL, "Reference (-r) is required for CRAM output.");
+  if(fmt.format == cram) check(use_csi == 0, "CSI index (-c) is only valid for BAM output.");
+
+  input = hfile_readahead_hts_open(input_file, readahead);
+  check(input != NULL, "Error opening hts file for reading '%s'.",input_file);
+  if(ref_file) check(ref_cache_set_reference(input, ref_file) == 0, "Error setting reference for input.");
+  head = sam_hdr_read(input);
+  check(head != NULL, "Error reading header from opened hts file '%s'.",input_file);
+
+  if (nthreads > 0) {
+    p.pool = hts_tpool_init(nthreads);
+    check(p.pool != NULL,"Error creating thread pool");
+    hts_set_opt(input,  HTS_OPT_THREAD_POOL, &p);
+  }
+
+  // compressed bytes are hashed as they pass to the file, no re-read of the output
+  hout = hopen(output_file, "w");
+  check(hout != NULL, "Error opening '%s' for writing.", output_file);
+  if(md5_file){
+    md5 = hts_md5_init();
+    check(md5 != NULL, "Error creating md5 context.");
+    hFILE *wrapped = hfile_md5_wrap(hout, md5);
+    check(wrapped != NULL, "Error wrapping output for md5.");
+    hout = wrapped;
+  }
+  output = hts_hopen(hout, output_file, fmt.format == cram ? "wc" : "wb");
+  check(output != NULL, "Error opening hts file for writing '%s'.", output_file);
+  hout = NULL; // now owned by output
+  if(ref_file) check(ref_cache_set_reference(output, ref_file) == 0, "Error setting reference for output.");
+  check(hts_opt_apply(output, fmt.specific) == 0, "Error applying output format options '%s'.", out_fmt);
+  if(p.pool) hts_set_opt(output, HTS_OPT_THREAD_POOL, &p);
+  check(sam_hdr_write(output, head) == 0, "Error writing header to '%s'.", output_file);
+  if(idx_file){
+    check(sam_idx_init(output, head, use_csi ? 14 : 0, idx_file) == 0, "Error initialising index '%s'.", idx_file);
+  }
+
+  if(bas_file || shard_out){
+    // parsing is destructive on header text
+    stats_head = bam_hdr_dup(head);
+    check(stats_head != NULL, "Error copying header.");
+    grps = bam_access_parse_header(stats_head, &grps_size, &grp_stats);
+    check(grps != NULL, "Error fetching read groups from header.");
+  }
+  int i=0;
+  for(i=0;i<shard_in_size;i++){
+    check(bam_stats_shard_merge(shard_in[i], &grps, &grps_size, &grp_stats) == 0, "Error merging stats shard '%s'.", shard_in[i]);
+  }
+  if(shard_in_size > 0){
+    // shards predate duplicate marking, only duplicates are counted from this stream
+    for(i=0;i<grps_size;i++){
+      grp_stats[i][0]->dups = 0;
+      grp_stats[i][1]->dups = 0;
+    }
+  }
+
+  if(coverage_out || depth_hist_out){
+    if(target_file){
+      ti = target_index_load(target_file, target_index_is_gff(target_file), NULL);
+      check(ti != NULL, "Error loading targets from '%s'.", target_file);
+    }
+    cw = coverage_window_init(head, ti);
+    check(cw != NULL, "Error creating coverage window.");
+  }
+
+  b = bam_init1();
+  check_mem(b);
+  while((ret = sam_read1(input, head, b)) >= 0){
+    count++;
+    if(shard_in_size > 0){
+      check(bam_access_count_dup(b, grps, grps_size, grp_stats, rna) == 0, "Error counting duplicates for read %"PRIu64".", count);
+    }else if(grps){
+      check(bam_access_process_read(b, grps, grps_size, grp_stats, rna) == 0, "Error generating stats for read %"PRIu64".", count);
+    }
+    if(cw) check(coverage_window_add(cw, b) == 0, "Error adding read %"PRIu64" to coverage, input must be coordinate sorted.", count);
+    check(sam_write1(output, head, b) >= 0, "Error writing read %"PRIu64" to '%s'.", count, output_file);
+  }
+  check(ret == -1, "Error reading input '%s'.", input_file);
+
+  if(idx_file) check(sam_idx_save(output) == 0, "Error writing index '%s'.", idx_file);
+  ret = hts_close(output);
+  output = NULL;
+  check(ret == 0, "Error closing '%s'.", output_file);
+  if(md5_file) check(hfile_md5_write_hex(md5, md5_file, md5sum_fmt ? "-" : NULL) == 0, "Error writing md5 file.");
+  if(shard_out){
+    check(bam_stats_shard_write(grps, grps_size, grp_stats, shard_out) == 0, "Error writing stats shard '%s'.", shard_out);
+  }
+  if(bas_file){
+    if(rna){
+      check(bam_stats_output_print_results_trimmed(grps, grps_size, grp_stats, output_file, bas_file, rna_sd, rna_iter) == 0, "Error writing bam_stats output to file.");
+    }else{
+      check(bam_stats_output_print_results(grps, grps_size, grp_stats, output_file, bas_file) == 0, "Error writing bam_stats output to file.");
+    }
+  }
+  if(cw){
+    check(coverage_window_finish(cw) == 0, "Error finishing coverage.");
+    check(coverage_window_write(cw, coverage_out, depth_hist_out) == 0, "Error writing coverage.");
+  }
+  if(debug==1) fprintf(stderr,"Processed %"PRIu64" reads.\n", count);
+  status = 0;
+
+error:
+  if(b) bam_destroy1(b);
+  if(output) hts_close(output);
+  if(hout) hclose_abruptly(hout);
+  if(md5) hts_md5_destroy(md5);
+  coverage_window_destroy(cw);
+  target_index_destroy(ti);
+  bam_access_free_groups(grps, grps_size, grp_stats);
+  if(stats_head) bam_hdr_destroy(stats_head);
+  if(head) bam_hdr_destroy(head);
+  if(input) hts_close(input);
+  if(fmt.specific) hts_opt_free(fmt.specific);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  if(shard_in) free(shard_in);
+  return status;
+}
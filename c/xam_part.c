@@ -0,0 +1,131 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "xam_part.h"
+
+// Position on a reference of weight w and length len at cumulative weight at, c0 being the reference start
+static hts_pos_t weight_pos(uint64_t at, uint64_t c0, uint64_t w, hts_pos_t len){
+  return (hts_pos_t) ((long double) (at - c0) / w * len);
+}
+
+xam_part_t *xam_part_init(htsFile *input, bam_hdr_t *head, const char *file, int rem, int mod){
+  xam_part_t *part = NULL;
+  uint64_t *weight = NULL;
+  check(mod > 0 && rem >= 0 && rem < mod, "Invalid partition %d/%d, require 0 <= rem < mod.", rem, mod);
+
+  part = (xam_part_t *) calloc(1, sizeof(xam_part_t));
+  check_mem(part);
+  part->idx = sam_index_load(input, file);
+  check(part->idx != NULL, "Partitioning requires an index for '%s'.", file);
+
+  int n = head->n_targets;
+  // final element is the unplaced reads
+  weight = (uint64_t *) calloc(n+1, sizeof(uint64_t));
+  check_mem(weight);
+  int tid;
+  if(hts_idx_fmt(part->idx) == HTS_FMT_CRAI){
+    // no meta-data, spread by length and leave the unplaced reads to the last part
+    for(tid=0; tid<n; tid++) weight[tid] = head->target_len[tid];
+  }else{
+    for(tid=0; tid<n; tid++){
+      uint64_t mapped, unmapped;
+      // no meta-data for a reference without reads
+      if(hts_idx_get_stat(part->idx, tid, &mapped, &unmapped) == 0) weight[tid] = mapped + unmapped;
+    }
+    weight[n] = hts_idx_get_n_no_coor(part->idx);
+  }
+
+  uint64_t total = 0;
+  for(tid=0; tid<=n; tid++) total += weight[tid];
+
+  // part rem owns cumulative weight [lo,hi), references are cut at the matching positions
+  uint64_t lo = total / mod * rem + total % mod * rem / mod;
+  uint64_t hi = total / mod * (rem+1) + total % mod * (rem+1) / mod;
+  part->tid = 0;
+  part->end_tid = 0;
+  uint64_t c0 = 0;
+  for(tid=0; tid<n; tid++){
+    uint64_t c1 = c0 + weight[tid];
+    if(weight[tid] > 0 && c0 < hi && lo < c1){
+      if(part->end_tid == 0){
+        part->tid = tid;
+        part->beg = lo > c0 ? weight_pos(lo, c0, weight[tid], head->target_len[tid]) : 0;
+      }
+      part->end_tid = tid+1;
+      part->end = hi < c1 ? weight_pos(hi, c0, weight[tid], head->target_len[tid]) : HTS_POS_MAX;
+    }
+    c0 = c1;
+  }
+  // unplaced reads can't be split, they go to the part their start falls in
+  if(weight[n] == 0 || total == 0){
+    part->no_coor = rem == mod-1;
+  }else{
+    part->no_coor = c0 >= lo && c0 < hi;
+  }
+  free(weight);
+  return part;
+
+error:
+  if(weight) free(weight);
+  xam_part_destroy(part);
+  return NULL;
+}
+
+int xam_part_next(htsFile *input, xam_part_t *part, bam1_t *b){
+  while(1){
+    if(part->itr){
+      int ret;
+      while((ret = sam_itr_next(input, part->itr, b)) >= 0){
+        // overlaps the range but starts in the previous part
+        if(b->core.pos >= part->itr_beg) return ret;
+      }
+      sam_itr_destroy(part->itr);
+      part->itr = NULL;
+      if(ret < -1) return ret;
+    }
+    if(part->tid < part->end_tid){
+      hts_pos_t end = part->tid == part->end_tid-1 ? part->end : HTS_POS_MAX;
+      part->itr_beg = part->beg;
+      part->beg = 0;
+      part->itr = sam_itr_queryi(part->idx, part->tid, part->itr_beg, end);
+      check(part->itr != NULL, "Error creating iterator for reference %d.", part->tid);
+      part->tid++;
+    }else if(part->no_coor){
+      part->no_coor = 0;
+      part->itr_beg = -1;
+      part->itr = sam_itr_queryi(part->idx, HTS_IDX_NOCOOR, 0, 0);
+      check(part->itr != NULL, "Error creating iterator for unplaced reads.");
+    }else{
+      return -1;
+    }
+  }
+error:
+  return -2;
+}
+
+void xam_part_destroy(xam_part_t *part){
+  if(part == NULL) return;
+  if(part->itr) sam_itr_destroy(part->itr);
+  if(part->idx) hts_idx_destroy(part->idx);
+  free(part);
+}
@@ -0,0 +1,54 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __xam_part_h__
+#define __xam_part_h__
+
+#include "htslib/sam.h"
+
+/*
+ * Disjoint partitioning of an indexed BAM/CRAM for parallel readers.
+ *
+ * Part rem of mod is a contiguous coordinate range, possibly spanning or splitting
+ * references, plus the unplaced reads for one part. Ranges are chosen so that parts
+ * hold roughly equal numbers of records, using the index counts spread evenly along
+ * each reference, or reference lengths for CRAI which has no counts. A record belongs
+ * to the range its start position falls in, so each record is decoded by exactly one
+ * part.
+ */
+typedef struct {
+  hts_idx_t *idx;
+  hts_itr_t *itr;
+  int tid;           // next reference to query
+  int end_tid;       // exclusive
+  hts_pos_t beg;     // start of the range on the first reference
+  hts_pos_t end;     // end (exclusive) of the range on the last reference
+  hts_pos_t itr_beg; // records of the current iterator starting before this belong to the previous part
+  int no_coor;       // unplaced reads still to be read by this part
+} xam_part_t;
+
+xam_part_t *xam_part_init(htsFile *input, bam_hdr_t *head, const char *file, int rem, int mod);
+
+// Same return values as sam_read1.
+int xam_part_next(htsFile *input, xam_part_t *part, bam1_t *b);
+
+void xam_part_destroy(xam_part_t *part);
+
+#endif
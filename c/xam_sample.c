@@ -0,0 +1,377 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "xam_sample.h"
+#include "bam_stats_calcs.h"
+
+#define XAM_SAMPLE_WINDOW 65536
+#define XAM_SAMPLE_MIN_WINDOWS 100
+#define XAM_SAMPLE_Z95 1.959964
+
+static int push_tally(xam_sample_t *smp){
+  if(smp->n_tally == smp->m_tally){
+    smp->m_tally = smp->m_tally ? smp->m_tally * 2 : 256;
+    xam_sample_tally_t *tally = realloc(smp->tally, sizeof(xam_sample_tally_t) * smp->m_tally);
+    check_mem(tally);
+    smp->tally = tally;
+  }
+  memset(&smp->tally[smp->n_tally++], 0, sizeof(xam_sample_tally_t));
+  return 0;
+error:
+  return -1;
+}
+
+xam_sample_t *xam_sample_init(htsFile *input, bam_hdr_t *head, const char *file, double fraction){
+  xam_sample_t *smp = NULL;
+  check(fraction > 0 && fraction < 1, "Invalid sample fraction %f, require 0 < fraction < 1.", fraction);
+
+  smp = (xam_sample_t *) calloc(1, sizeof(xam_sample_t));
+  check_mem(smp);
+  smp->fraction = fraction;
+  smp->cur = -1;
+  smp->inserts = kh_init(ins);
+  check_mem(smp->inserts);
+  smp->idx = sam_index_load(input, file);
+  check(smp->idx != NULL, "Sampling requires an index for '%s'.", file);
+
+  int tid;
+  smp->has_counts = 1;
+  for(tid=0; tid<head->n_targets; tid++){
+    smp->genome_len += head->target_len[tid];
+    uint64_t mapped, unmapped;
+    if(hts_idx_get_stat(smp->idx, tid, &mapped, &unmapped) != 0){
+      smp->has_counts = 0;
+      continue;
+    }
+    smp->placed_total += mapped + unmapped;
+  }
+  check(smp->genome_len > 0, "Sampling requires reference sequences in the header of '%s'.", file);
+  if(smp->has_counts){
+    smp->no_coor_total = hts_idx_get_n_no_coor(smp->idx);
+  }else{
+    smp->placed_total = 0;
+    log_warn("Index of '%s' holds no record counts, unplaced reads are excluded from the estimates.", file);
+  }
+
+  // evenly spaced windows, centred in their stride
+  double target = fraction * (double) smp->genome_len;
+  int n = (int) ceil(target / XAM_SAMPLE_WINDOW);
+  if(n < XAM_SAMPLE_MIN_WINDOWS) n = XAM_SAMPLE_MIN_WINDOWS;
+  if((uint64_t) n > smp->genome_len) n = (int) smp->genome_len;
+  double width = target / n;
+  if(width < 1) width = 1;
+  double stride = (double) smp->genome_len / n;
+  double offset = (stride - width) / 2;
+
+  smp->windows = (xam_sample_window_t *) malloc(sizeof(xam_sample_window_t) * n);
+  check_mem(smp->windows);
+  uint64_t cum = 0;
+  tid = 0;
+  int i;
+  for(i=0; i<n; i++){
+    uint64_t g = (uint64_t) (offset + i * stride);
+    while(tid < head->n_targets && g >= cum + head->target_len[tid]){
+      cum += head->target_len[tid];
+      tid++;
+    }
+    if(tid == head->n_targets) break;
+    xam_sample_window_t *w = &smp->windows[smp->n_windows++];
+    w->tid = tid;
+    w->beg = g - cum;
+    w->end = (uint64_t) (offset + i * stride + width) - cum;
+    if(w->end > head->target_len[tid]) w->end = head->target_len[tid];
+    smp->sampled_len += w->end - w->beg;
+  }
+  return smp;
+
+error:
+  xam_sample_destroy(smp);
+  return NULL;
+}
+
+int xam_sample_next(htsFile *input, xam_sample_t *smp, bam1_t *b){
+  while(1){
+    if(smp->itr){
+      int ret = sam_itr_next(input, smp->itr, b);
+      if(ret >= 0 && smp->cur < smp->n_windows){
+        // taken by the window it starts in
+        if(b->core.pos < smp->windows[smp->cur].beg) continue;
+        smp->placed_read++;
+        smp->tally[smp->n_tally-1].records++;
+        return ret;
+      }
+      if(ret >= 0 && smp->no_coor_read < smp->no_coor_budget){
+        // unplaced reads are clustered in chunks the size of an average window
+        uint64_t chunk = smp->placed_read / (smp->n_windows ? smp->n_windows : 1);
+        if(chunk == 0) chunk = 1;
+        if(smp->no_coor_read % chunk == 0) check(push_tally(smp) == 0, "Error growing sample tallies.");
+        smp->no_coor_read++;
+        smp->tally[smp->n_tally-1].records++;
+        return ret;
+      }
+      sam_itr_destroy(smp->itr);
+      smp->itr = NULL;
+      if(ret < -1) return ret;
+    }
+    if(smp->cur >= smp->n_windows) return -1;
+    smp->cur++;
+    if(smp->cur < smp->n_windows){
+      xam_sample_window_t *w = &smp->windows[smp->cur];
+      smp->itr = sam_itr_queryi(smp->idx, w->tid, w->beg, w->end);
+      check(smp->itr != NULL, "Error creating iterator for %d:%"PRIhts_pos"-%"PRIhts_pos".", w->tid, w->beg, w->end);
+      check(push_tally(smp) == 0, "Error growing sample tallies.");
+      smp->tally[smp->n_tally-1].len = w->end - w->beg;
+    }else if(smp->no_coor_total > 0){
+      // same rate as the placed reads
+      double rate = smp->placed_total ? (double) smp->placed_read / smp->placed_total : smp->fraction;
+      smp->no_coor_budget = (uint64_t) ceil(rate * smp->no_coor_total);
+      smp->itr = sam_itr_queryi(smp->idx, HTS_IDX_NOCOOR, 0, 0);
+      check(smp->itr != NULL, "Error creating iterator for unplaced reads.");
+    }
+  }
+error:
+  return -2;
+}
+
+int xam_sample_tally(xam_sample_t *smp, bam1_t *b, int rna){
+  // same selection as bam_access_process_read
+  if (b->core.flag & BAM_FSECONDARY && rna == 0) return 0;
+  if (b->core.flag & BAM_FSUPPLEMENTARY) return 0;
+  check(smp->n_tally > 0, "Read tallied before it was sampled.");
+  xam_sample_tally_t *t = &smp->tally[smp->n_tally-1];
+
+  t->reads++;
+  if(b->core.flag & BAM_FDUP) t->dups++;
+  if(b->core.flag & BAM_FUNMAP || b->core.flag & BAM_FQCFAIL) return 0;
+
+  t->mapped++;
+  uint8_t *nm = bam_aux_get(b,"NM");
+  if(nm){
+    int64_t nm_val = bam_aux2i(nm);
+    if(nm_val > 0) t->divergent += nm_val;
+  }
+  t->mapped_bases += bam_access_get_mapped_base_count_from_cigar(b);
+
+  if(b->core.flag & BAM_FREAD1){
+    if(!(b->core.flag & BAM_FMUNMAP)) t->mapped_pairs++;
+    if(b->core.flag & BAM_FPROPER_PAIR){
+      uint32_t ins = llabs(b->core.isize);
+      t->proper++;
+      t->ins_n++;
+      t->ins_sum += ins;
+      check(bam_access_add_insert(smp->inserts, ins) == 0, "Error adding insert size to sample histogram.");
+    }
+  }
+  return 0;
+error:
+  return -1;
+}
+
+double xam_sample_scale(xam_sample_t *smp){
+  if(smp->has_counts){
+    uint64_t read = smp->placed_read + smp->no_coor_read;
+    return read ? (double) (smp->placed_total + smp->no_coor_total) / read : 0;
+  }
+  return smp->sampled_len ? (double) smp->genome_len / smp->sampled_len : 0;
+}
+
+static uint64_t scale_count(uint64_t val, double scale){
+  return (uint64_t) llround((double) val * scale);
+}
+
+void xam_sample_scale_stats(xam_sample_t *smp, int grps_size, stats_rd_t ***grp_stats){
+  double scale = xam_sample_scale(smp);
+  int i, rd;
+  for(i=0;i<grps_size;i++){
+    for(rd=0;rd<2;rd++){
+      stats_rd_t *s = grp_stats[i][rd];
+      s->count = scale_count(s->count, scale);
+      s->dups = scale_count(s->dups, scale);
+      s->gc = scale_count(s->gc, scale);
+      s->umap = scale_count(s->umap, scale);
+      s->divergent = scale_count(s->divergent, scale);
+      s->mapped_bases = scale_count(s->mapped_bases, scale);
+      s->proper = scale_count(s->proper, scale);
+      s->mapped_pairs = scale_count(s->mapped_pairs, scale);
+      s->inter_chr_pairs = scale_count(s->inter_chr_pairs, scale);
+      s->qc_fail = scale_count(s->qc_fail, scale);
+    }
+  }
+}
+
+/*
+ * Ratio estimator sum(y)/sum(x) over the tallies with its standard error from the
+ * spread of y - R*x between clusters, fpc is the finite population correction.
+ */
+static double ratio_estimate(const double *y, const double *x, int n, double fpc, double *se){
+  double sy = 0, sx = 0;
+  int i;
+  for(i=0;i<n;i++){
+    sy += y[i];
+    sx += x[i];
+  }
+  *se = 0;
+  if(sx == 0) return 0;
+  double r = sy / sx;
+  if(n < 2) return r;
+  double ss = 0;
+  for(i=0;i<n;i++) ss += (y[i] - r * x[i]) * (y[i] - r * x[i]);
+  double xbar = sx / n;
+  *se = sqrt(fpc * ss / ((double) (n - 1) * n * xbar * xbar));
+  return r;
+}
+
+static int cmp_u64(const void *a, const void *b){
+  uint64_t va = *(const uint64_t *) a;
+  uint64_t vb = *(const uint64_t *) b;
+  return va < vb ? -1 : (va > vb);
+}
+
+// Smallest insert size with at least p of the histogram at or below it.
+static double hist_quantile(khash_t(ins) *inserts, double p){
+  uint64_t n = 0, key, val;
+  uint64_t *keys = malloc(sizeof(uint64_t) * (kh_size(inserts) ? kh_size(inserts) : 1));
+  if(keys == NULL) return NAN;
+  int i = 0;
+  kh_foreach(inserts, key, val, { keys[i++] = key; n += val; });
+  qsort(keys, i, sizeof(uint64_t), cmp_u64);
+  if(p < 0) p = 0;
+  if(p > 1) p = 1;
+  double q = NAN;
+  uint64_t cum = 0;
+  int j;
+  for(j=0;j<i;j++){
+    cum += kh_val(inserts, kh_get(ins, inserts, keys[j]));
+    if(cum >= p * n){
+      q = (double) keys[j];
+      break;
+    }
+  }
+  free(keys);
+  return q;
+}
+
+static double clamp01(double v){
+  return v < 0 ? 0 : (v > 1 ? 1 : v);
+}
+
+#define _tally_vec(dst, field) for(i=0;i<n;i++) dst[i] = (double) smp->tally[i].field
+
+int xam_sample_write_estimates(xam_sample_t *smp, FILE *out){
+  double *y = NULL, *x = NULL;
+  int n = smp->n_tally;
+  int i;
+  int chk;
+  double scale = xam_sample_scale(smp);
+  double fpc = 1 - (double) smp->sampled_len / smp->genome_len;
+  double est, se;
+
+  y = malloc(sizeof(double) * (n ? n : 1));
+  x = malloc(sizeof(double) * (n ? n : 1));
+  check_mem(y);
+  check_mem(x);
+
+  chk = fprintf(out, "# estimated from an index sample of %.6g of the genome: %d windows, %"PRIu64" records read, scale %.3f\n",
+                  (double) smp->sampled_len / smp->genome_len, smp->n_windows, smp->placed_read + smp->no_coor_read, scale);
+  check(chk > 0, "Error writing estimates.");
+  chk = fprintf(out, "metric\testimate\tci95_low\tci95_high\n");
+  check(chk > 0, "Error writing estimates.");
+
+  // reads per record (BAI/CSI) or per sampled base (CRAI), scaled back up
+  _tally_vec(y, reads);
+  if(smp->has_counts){
+    _tally_vec(x, records);
+  }else{
+    _tally_vec(x, len);
+  }
+  est = ratio_estimate(y, x, n, fpc, &se);
+  double total = smp->has_counts ? (double) (smp->placed_total + smp->no_coor_total) : (double) smp->genome_len;
+  chk = fprintf(out, "total_reads\t%.0f\t%.0f\t%.0f\n", est * total,
+                  fmax(0, (est - XAM_SAMPLE_Z95 * se) * total), (est + XAM_SAMPLE_Z95 * se) * total);
+  check(chk > 0, "Error writing estimates.");
+
+  struct { const char *name; size_t y; size_t x; } rates[] = {
+    {"mapped_fraction", offsetof(xam_sample_tally_t, mapped), offsetof(xam_sample_tally_t, reads)},
+    {"duplicate_rate", offsetof(xam_sample_tally_t, dups), offsetof(xam_sample_tally_t, reads)},
+    {"proper_pair_fraction", offsetof(xam_sample_tally_t, proper), offsetof(xam_sample_tally_t, mapped_pairs)},
+    {"divergence_rate", offsetof(xam_sample_tally_t, divergent), offsetof(xam_sample_tally_t, mapped_bases)},
+  };
+  int r;
+  for(r=0; r<(int) (sizeof(rates)/sizeof(rates[0])); r++){
+    for(i=0;i<n;i++){
+      y[i] = (double) *(uint64_t *) ((char *) &smp->tally[i] + rates[r].y);
+      x[i] = (double) *(uint64_t *) ((char *) &smp->tally[i] + rates[r].x);
+    }
+    est = ratio_estimate(y, x, n, fpc, &se);
+    chk = fprintf(out, "%s\t%.6f\t%.6f\t%.6f\n", rates[r].name, est,
+                    clamp01(est - XAM_SAMPLE_Z95 * se), clamp01(est + XAM_SAMPLE_Z95 * se));
+    check(chk > 0, "Error writing estimates.");
+  }
+
+  // insert size, precision of sd and median from the effective sample size of the mean
+  double mean = 0, sd = 0, median = 0;
+  bam_stats_calcs_calculate_mean_sd_median_insert_size(smp->inserts, &mean, &sd, &median);
+  _tally_vec(y, ins_sum);
+  _tally_vec(x, ins_n);
+  est = ratio_estimate(y, x, n, fpc, &se);
+  uint64_t ins_n = 0;
+  for(i=0;i<n;i++) ins_n += smp->tally[i].ins_n;
+  double n_eff = ins_n;
+  if(ins_n > 1 && sd > 0 && se > 0){
+    double deff = (se * se) / (fpc * sd * sd / ins_n);
+    if(deff > 1) n_eff = ins_n / deff;
+  }
+  chk = fprintf(out, "mean_insert_size\t%.3f\t%.3f\t%.3f\n", est, est - XAM_SAMPLE_Z95 * se, est + XAM_SAMPLE_Z95 * se);
+  check(chk > 0, "Error writing estimates.");
+  double sd_se = n_eff > 1 ? sd / sqrt(2 * (n_eff - 1)) : 0;
+  chk = fprintf(out, "insert_size_sd\t%.3f\t%.3f\t%.3f\n", sd, fmax(0, sd - XAM_SAMPLE_Z95 * sd_se), sd + XAM_SAMPLE_Z95 * sd_se);
+  check(chk > 0, "Error writing estimates.");
+  // Woodruff interval, quantiles either side of the median by the error on its rank
+  double p_se = n_eff > 0 ? sqrt(fpc * 0.25 / n_eff) : 0;
+  double med_lo = ins_n ? hist_quantile(smp->inserts, 0.5 - XAM_SAMPLE_Z95 * p_se) : 0;
+  double med_hi = ins_n ? hist_quantile(smp->inserts, 0.5 + XAM_SAMPLE_Z95 * p_se) : 0;
+  chk = fprintf(out, "median_insert_size\t%.3f\t%.3f\t%.3f\n", median, fmin(med_lo, median), fmax(med_hi, median));
+  check(chk > 0, "Error writing estimates.");
+
+  free(y);
+  free(x);
+  return 0;
+
+error:
+  if(y) free(y);
+  if(x) free(x);
+  return -1;
+}
+
+void xam_sample_destroy(xam_sample_t *smp){
+  if(smp == NULL) return;
+  if(smp->itr) sam_itr_destroy(smp->itr);
+  if(smp->idx) hts_idx_destroy(smp->idx);
+  if(smp->windows) free(smp->windows);
+  if(smp->tally) free(smp->tally);
+  if(smp->inserts) kh_destroy(ins, smp->inserts);
+  free(smp);
+}
@@ -0,0 +1,103 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#ifndef __xam_sample_h__
+#define __xam_sample_h__
+
+#include <stdio.h>
+#include "htslib/sam.h"
+#include "bam_access.h"
+
+/*
+ * Approximate stats from an index driven sample of a BAM/CRAM.
+ *
+ * The reference space is covered by evenly spaced windows (systematic sample) whose
+ * total length is the requested fraction of the genome. Only the BGZF blocks or CRAM
+ * containers the index maps to a window are read, a record is taken by the window
+ * its start position falls in. When the index holds record counts (BAI/CSI) the
+ * unplaced reads are sampled at the same rate as the placed ones and counts are scaled
+ * by records in file over records read, otherwise (CRAI) unplaced reads are skipped and
+ * counts are scaled by genome length over sampled length.
+ *
+ * Each window is a cluster for variance estimation, confidence intervals on rates are
+ * from the ratio estimator variance between windows.
+ */
+
+typedef struct {
+  uint64_t records;    // read from the file, before selection
+  uint64_t len;        // window length, 0 for unplaced reads
+  uint64_t reads;
+  uint64_t mapped;
+  uint64_t dups;
+  uint64_t mapped_pairs;
+  uint64_t proper;
+  uint64_t mapped_bases;
+  uint64_t divergent;
+  uint64_t ins_n;
+  double ins_sum;
+} xam_sample_tally_t;
+
+typedef struct {
+  int tid;
+  hts_pos_t beg;
+  hts_pos_t end;
+} xam_sample_window_t;
+
+typedef struct {
+  double fraction;
+  hts_idx_t *idx;
+  hts_itr_t *itr;
+  xam_sample_window_t *windows;
+  int n_windows;
+  int cur;             // window being read, n_windows once placed reads are done
+  int has_counts;      // index holds record counts
+  uint64_t genome_len;
+  uint64_t sampled_len;
+  uint64_t placed_total;
+  uint64_t no_coor_total;
+  uint64_t placed_read;
+  uint64_t no_coor_read;
+  uint64_t no_coor_budget;
+  xam_sample_tally_t *tally;  // one per window, then per chunk of unplaced reads
+  int n_tally;
+  int m_tally;
+  khash_t(ins) *inserts;      // pooled over read groups for the interval on the median
+} xam_sample_t;
+
+xam_sample_t *xam_sample_init(htsFile *input, bam_hdr_t *head, const char *file, double fraction);
+
+// Same return values as sam_read1.
+int xam_sample_next(htsFile *input, xam_sample_t *smp, bam1_t *b);
+
+// Record the read in the current window, pass the reads given to bam_access_process_read.
+int xam_sample_tally(xam_sample_t *smp, bam1_t *b, int rna);
+
+// Multiplier from sampled to estimated counts, only valid once all reads are read.
+double xam_sample_scale(xam_sample_t *smp);
+
+// Scale the counts of the stats stores to whole file estimates, insert size histograms are untouched.
+void xam_sample_scale_stats(xam_sample_t *smp, int grps_size, stats_rd_t ***grp_stats);
+
+// Write the estimates with 95% confidence intervals, tab separated.
+int xam_sample_write_estimates(xam_sample_t *smp, FILE *out);
+
+void xam_sample_destroy(xam_sample_t *smp);
+
+#endif
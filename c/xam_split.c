@@ -0,0 +1,371 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <getopt.h>
+#include <inttypes.h>
+#include "dbg.h"
+#include "hfile_readahead.h"
+#include "khash.h"
+#include "htslib/sam.h"
+#include "htslib/thread_pool.h"
+
+KHASH_MAP_INIT_STR(rgout, int)
+
+// Exit status used to signal input that is not pair adjacent, caller should fall back to collate
+#define EXIT_DISORDER 3
+// Grouped input may hold orphans up to ORPHAN_PCT of reads, the floor stops a few early
+// orphans being judged against a handful of reads
+#define ORPHAN_PCT 1
+#define ORPHAN_FLOOR 1000
+
+char *input_file = NULL;
+char *readahead_opt = NULL;
+size_t readahead = 0;
+char *out_dir = NULL;
+char *unknown_name = "unknown.bam";
+uint64_t pairs_per_chunk = 0;
+int nthreads = 0;
+int clevel = 1;
+int debug = 0;
+
+typedef struct {
+  char *id;
+  htsFile *out;
+  int chunk;
+  uint64_t pairs;
+} rg_out_t;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: xam_split -o dir [-i file] [-n pairs] [-@ threads] [-h] [-v]\n\n");
+  printf ("Splits pair adjacent (name collated/grouped) BAM/CRAM by readgroup without a collate step.\n");
+  printf ("Output is written as <dir>/<RG-ID>_i.bam, or <dir>/<RG-ID>_i.NNN.bam when -n is set.\n");
+  printf ("Exits with status %d as soon as mates are found not to be adjacent so the caller can\n", EXIT_DISORDER);
+  printf ("fall back to samtools collate. Orphan reads are only tolerated when the header declares\n");
+  printf ("SO:queryname or GO:query, and then only while they number at most %d or %d%% of reads read so far.\n\n",
+            ORPHAN_FLOOR, ORPHAN_PCT);
+  printf ("-o --outdir                 Folder to write output to.\n\n");
+  printf ("Optional:\n");
+  printf ("-i --input                  [bc]ram File path to read input [stdin].\n");
+  printf ("-n --pairs                  Maximum read pairs per output file [0, unlimited].\n");
+  printf ("-u --unknown                File name (in outdir) for reads with no/unknown readgroup [%s].\n", unknown_name);
+  printf ("-R --readahead              Read the input through two SIZE (e.g. 16M) prefetch buffers, for network filesystems,\n");
+  printf ("                            default $%s, 0 is off.\n", HFILE_READAHEAD_ENV);
+  printf ("-@ --threads                Number of BAM/CRAM (de)compression threads [0].\n");
+  printf ("-l --compression-level      0-9: set output compression level [%d].\n\n", clevel);
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-d --debug     Turn on debug mode.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"debug",no_argument,0,'d'},
+            {"input",required_argument,0,'i'},
+            {"outdir",required_argument,0,'o'},
+            {"pairs",required_argument,0,'n'},
+            {"unknown",required_argument,0,'u'},
+            {"threads",required_argument,0,'@'},
+            {"readahead",required_argument,0,'R'},
+            {"compression-level",required_argument,0,'l'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "i:o:n:u:@:R:l:vdh", long_opts, &index)) != -1){
+    switch(iarg){
+      case 'i':
+        input_file = optarg;
+        break;
+
+      case 'o':
+        out_dir = optarg;
+        break;
+
+      case 'n':
+        if(sscanf(optarg, "%"SCNu64, &pairs_per_chunk) != 1){
+          sentinel("Error parsing -n (pairs) argument '%s'. Should be an integer",optarg);
+        }
+        break;
+
+      case 'u':
+        unknown_name = optarg;
+        break;
+
+      case 'R':
+        readahead_opt = optarg;
+        break;
+
+      case '@':
+        if(sscanf(optarg, "%i", &nthreads) != 1){
+          sentinel("Error parsing -@ nThreads) argument '%s'. Should be an integer",optarg);
+        }
+        break;
+
+      case 'l':
+        if(sscanf(optarg, "%i", &clevel) != 1 || clevel < 0 || clevel > 9){
+          sentinel("Error parsing -l (compression level) argument '%s'. Should be an integer 0-9",optarg);
+        }
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case 'd':
+        debug=1;
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  //-R overrides $PCAP_READAHEAD
+  if(hfile_readahead_size(readahead_opt, &readahead) != 0) print_usage(1);
+
+  if (input_file==NULL || strcmp(input_file,"/dev/stdin")==0) {
+    input_file = "-";   // htslib recognises this as a special case
+  }
+  if (strcmp(input_file,"-") != 0) {
+    if(check_exist(input_file) != 1){
+      printf("Input file (-i) %s does not exist.\n",input_file);
+      print_usage(1);
+    }
+  }
+  if(out_dir == NULL){
+    printf("Output folder (-o) must be defined.\n");
+    print_usage(1);
+  }
+  return 0;
+
+  error:
+    return 1;
+}
+
+int header_declares_grouped(bam_hdr_t *head){
+  kstring_t ks = {0,0,NULL};
+  int grouped = 0;
+  if(sam_hdr_find_tag_hd(head, "SO", &ks) == 0 && strcmp(ks.s, "queryname") == 0) grouped = 1;
+  if(!grouped && sam_hdr_find_tag_hd(head, "GO", &ks) == 0 && strcmp(ks.s, "query") == 0) grouped = 1;
+  free(ks.s);
+  return grouped;
+}
+
+int open_rg_output(rg_out_t *rgo, bam_hdr_t *head, htsThreadPool *p){
+  kstring_t fname = {0,0,NULL};
+  char mode[5];
+  if(rgo->id == NULL){
+    check(ksprintf(&fname, "%s/%s", out_dir, unknown_name) >= 0, "Error building output name.");
+  }
+  else if(pairs_per_chunk == 0){
+    check(ksprintf(&fname, "%s/%s_i.bam", out_dir, rgo->id) >= 0, "Error building output name.");
+  }
+  else{
+    check(ksprintf(&fname, "%s/%s_i.%03d.bam", out_dir, rgo->id, rgo->chunk) >= 0, "Error building output name.");
+  }
+  sprintf(mode, "wb%d", clevel);
+  rgo->out = hts_open(fname.s, mode);
+  check(rgo->out != NULL, "Error opening '%s' for writing.", fname.s);
+  if(p->pool) hts_set_opt(rgo->out, HTS_OPT_THREAD_POOL, p);
+  check(sam_hdr_write(rgo->out, head) == 0, "Error writing header to '%s'.", fname.s);
+  if(debug==1) fprintf(stderr,"Opened %s\n", fname.s);
+  free(fname.s);
+  return 0;
+
+error:
+  free(fname.s);
+  return -1;
+}
+
+int close_rg_output(rg_out_t *rgo){
+  int ret = 0;
+  if(rgo->out) ret = hts_close(rgo->out);
+  rgo->out = NULL;
+  return ret;
+}
+
+/*
+ * Writes a read (b2 NULL) or pair to the output for its readgroup, rolling to the next chunk
+ * once the pair limit is reached.
+ */
+int write_group(rg_out_t *outs, khash_t(rgout) *rg_idx, int unknown, bam_hdr_t *head, htsThreadPool *p, bam1_t *b1, bam1_t *b2){
+  int idx = unknown;
+  uint8_t *rg = bam_aux_get(b1, "RG");
+  if(rg){
+    khint_t k = kh_get(rgout, rg_idx, bam_aux2Z(rg));
+    if(k != kh_end(rg_idx)) idx = kh_val(rg_idx, k);
+  }
+  rg_out_t *rgo = &outs[idx];
+  if(pairs_per_chunk > 0 && rgo->id != NULL && rgo->pairs == pairs_per_chunk){
+    check(close_rg_output(rgo) == 0, "Error closing output for readgroup %s.", rgo->id);
+    rgo->chunk++;
+    rgo->pairs = 0;
+  }
+  if(rgo->out == NULL){
+    check(open_rg_output(rgo, head, p) == 0, "Error opening output.");
+  }
+  check(sam_write1(rgo->out, head, b1) >= 0, "Error writing read.");
+  if(b2) check(sam_write1(rgo->out, head, b2) >= 0, "Error writing read.");
+  rgo->pairs++;
+  return 0;
+
+error:
+  return -1;
+}
+
+int main(int argc, char *argv[]){
+  htsFile *input = NULL;
+  bam_hdr_t *head = NULL;
+  bam1_t *b = NULL;
+  bam1_t *pending = NULL;
+  rg_out_t *outs = NULL;
+  khash_t(rgout) *rg_idx = NULL;
+  int n_rg = 0;
+  int i = 0;
+  int ret = 0;
+  int status = 1;
+  uint64_t count = 0;
+  uint64_t orphans = 0;
+  htsThreadPool p = {NULL, 0};
+
+  int problem = options(argc,argv);
+  check(problem==0,"Error parsing options.");
+
+  input = hfile_readahead_hts_open(input_file, readahead);
+  check(input != NULL, "Error opening hts file for reading '%s'.",input_file);
+  head = sam_hdr_read(input);
+  check(head != NULL, "Error reading header from opened hts file '%s'.",input_file);
+
+  if (nthreads > 0) {
+    p.pool = hts_tpool_init(nthreads);
+    check(p.pool != NULL,"Error creating thread pool");
+    hts_set_opt(input,  HTS_OPT_THREAD_POOL, &p);
+  }
+
+  int grouped = header_declares_grouped(head);
+  if(debug==1) fprintf(stderr,"Header %s grouping by name.\n", grouped ? "declares" : "does not declare");
+
+  // one output per @RG, final element for reads with no/unknown readgroup
+  n_rg = sam_hdr_count_lines(head, "RG");
+  check(n_rg >= 0, "Error counting readgroups in header.");
+  outs = calloc(n_rg+1, sizeof(rg_out_t));
+  check_mem(outs);
+  rg_idx = kh_init(rgout);
+  for(i=0;i<n_rg;i++){
+    const char *id = sam_hdr_line_name(head, "RG", i);
+    check(id != NULL, "Error retrieving readgroup %d from header.", i);
+    outs[i].id = strdup(id);
+    khint_t k = kh_put(rgout, rg_idx, outs[i].id, &ret);
+    check(ret >= 0, "Error storing readgroup %s.", id);
+    kh_val(rg_idx, k) = i;
+  }
+
+  b = bam_init1();
+  pending = bam_init1();
+  int has_pending = 0;
+  while((ret = sam_read1(input, head, b)) >= 0){
+    count++;
+    if(!(b->core.flag & BAM_FPAIRED)){
+      check(write_group(outs, rg_idx, n_rg, head, &p, b, NULL) == 0, "Error writing unpaired read.");
+      continue;
+    }
+    if(!has_pending){
+      bam1_t *tmp = pending; pending = b; b = tmp;
+      has_pending = 1;
+      continue;
+    }
+    if(strcmp(bam_get_qname(pending), bam_get_qname(b)) == 0){
+      check(write_group(outs, rg_idx, n_rg, head, &p, pending, b) == 0, "Error writing read pair.");
+      has_pending = 0;
+      continue;
+    }
+    // mate of pending is not adjacent
+    orphans++;
+    if(!grouped || (orphans > ORPHAN_FLOOR && orphans * 100 > count * ORPHAN_PCT)){
+      fprintf(stderr, "Mates are not adjacent ('%s' followed by '%s' at record %"PRIu64"), input requires collation.\n",
+                bam_get_qname(pending), bam_get_qname(b), count);
+      status = EXIT_DISORDER;
+      goto error;
+    }
+    check(write_group(outs, rg_idx, n_rg, head, &p, pending, NULL) == 0, "Error writing orphan read.");
+    bam1_t *tmp = pending; pending = b; b = tmp;
+  }
+  check(ret == -1, "Error reading input '%s'.", input_file);
+  if(has_pending){
+    orphans++;
+    check(grouped, "Final paired read '%s' has no mate.", bam_get_qname(pending));
+    check(write_group(outs, rg_idx, n_rg, head, &p, pending, NULL) == 0, "Error writing orphan read.");
+  }
+  if(debug==1 || orphans > 0) fprintf(stderr,"Processed %"PRIu64" reads, %"PRIu64" orphans.\n", count, orphans);
+
+  for(i=0;i<=n_rg;i++){
+    check(close_rg_output(&outs[i]) == 0, "Error closing output.");
+  }
+  status = 0;
+
+error:
+  if(b) bam_destroy1(b);
+  if(pending) bam_destroy1(pending);
+  if(outs){
+    for(i=0;i<=n_rg;i++){
+      close_rg_output(&outs[i]);
+      free(outs[i].id);
+    }
+    free(outs);
+  }
+  if(rg_idx) kh_destroy(rgout, rg_idx);
+  if(head) bam_hdr_destroy(head);
+  if(input) hts_close(input);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return status;
+}
@@ -0,0 +1,678 @@
+/*       LICENCE
+* PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+* Copyright (C) 2014-2018 ICGC PanCancer Project
+* Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+*
+* This program is free software; you can redistribute it and/or
+* modify it under the terms of the GNU General Public License
+* as published by the Free Software Foundation; either version 2
+* of the License, or (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program; if not see:
+*   http://www.gnu.org/licenses/gpl-2.0.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include "dbg.h"
+#include "htslib/sam.h"
+#include "htslib/faidx.h"
+#include "htslib/kstring.h"
+#include "htslib/thread_pool.h"
+
+#define MAX_CONTIGS 4096
+#define MAX_CIGAR 64
+#define FASTA_LINE 60
+// indels are kept this far from the read ends so reads never start or end on one
+#define INDEL_EDGE 5
+
+char *output_file = NULL;
+char *out_fmt = "bam";
+char *ref_out = NULL;
+char *contig_spec = "chr1:10000000";
+uint64_t n_pairs = 1000000;
+int read_len = 150;
+int n_groups = 1;
+double insert_mean = 350;
+double insert_sd = 50;
+double mm_rate = 0.005;
+double indel_rate = 0.0005;
+double dup_frac = 0.02;
+uint64_t seed = 1;
+int name_sort = 0;
+int nthreads = 0;
+
+char *contig_names[MAX_CONTIGS];
+hts_pos_t contig_lens[MAX_CONTIGS];
+int n_contigs = 0;
+
+typedef struct {
+  uint32_t cigar[MAX_CIGAR];
+  int n_cigar;
+  hts_pos_t span;
+} synth_aln_t;
+
+typedef struct {
+  hts_pos_t pos;
+  uint64_t order;
+  bam1_t *b;
+} pending_t;
+
+// mates waiting to be written in coordinate order, a binary min-heap on pos
+typedef struct {
+  pending_t *recs;
+  size_t n;
+  size_t m;
+  uint64_t order;
+} pending_heap_t;
+
+int check_exist(char *fname){
+	FILE *fp;
+	if((fp = fopen(fname,"r"))){
+		fclose(fp);
+		return 1;
+	}
+	return 0;
+}
+
+void print_version (int exit_code){
+  printf ("%s\n",VERSION);
+	exit(exit_code);
+}
+
+void print_usage (int exit_code){
+  printf ("Usage: xam_synth -o file [-R ref.fa] [-O fmt] [-c contigs] [-n pairs] [-s seed] [options] [-h] [-v]\n\n");
+  printf ("Writes a deterministic synthetic paired-end BAM/CRAM for scale testing.  The same seed and options\n");
+  printf ("always give the same records.  Reads carry RG, NM, MD, MC and AS tags consistent with the alignment.\n\n");
+  printf ("-o --output                 File path to write BAM/CRAM to.\n\n");
+  printf ("Optional:\n");
+  printf ("-R --write-ref              Write the synthetic reference and its .fai here, required for CRAM.\n");
+  printf ("-O --output-fmt             Format and options as for 'samtools view --output-fmt' [%s].\n", out_fmt);
+  printf ("-c --contigs                Comma separated name:length contig set [%s].\n", contig_spec);
+  printf ("-n --pairs                  Number of read pairs [%"PRIu64"].\n", n_pairs);
+  printf ("-l --read-length            Read length [%d].\n", read_len);
+  printf ("-g --read-groups            Number of read groups, pairs are assigned at random [%d].\n", n_groups);
+  printf ("-I --insert-mean            Mean insert size of the normal insert distribution [%.0f].\n", insert_mean);
+  printf ("-z --insert-sd              Standard deviation of the insert distribution [%.0f].\n", insert_sd);
+  printf ("-m --mismatch-rate          Per base mismatch rate [%g].\n", mm_rate);
+  printf ("-x --indel-rate             Per base indel rate, insertions and deletions of 1-3 bases [%g].\n", indel_rate);
+  printf ("-D --dup-frac               Fraction of pairs that are duplicates of the previous pair [%g].\n", dup_frac);
+  printf ("-q --queryname              Write name sorted output, default coordinate sorted.\n");
+  printf ("-s --seed                   Seed [%"PRIu64"].\n", seed);
+  printf ("-@ --threads                Number of BAM/CRAM compression threads [0].\n\n");
+  printf ("Other:\n");
+  printf ("-h --help      Display this usage information.\n");
+  printf ("-v --version   Prints the version number.\n\n");
+  exit(exit_code);
+}
+
+int parse_contigs(char *spec){
+  char *copy = strdup(spec);
+  check_mem(copy);
+  char *save = NULL;
+  char *tok = strtok_r(copy, ",", &save);
+  while(tok != NULL){
+    char *colon = strrchr(tok, ':');
+    check(colon != NULL && colon != tok, "Contig '%s' should be name:length.", tok);
+    check(n_contigs < MAX_CONTIGS, "Too many contigs, max %d.", MAX_CONTIGS);
+    *colon = '\0';
+    char *end = NULL;
+    long long len = strtoll(colon + 1, &end, 10);
+    check(*end == '\0' && len > 0, "Invalid length for contig '%s'.", tok);
+    contig_names[n_contigs] = strdup(tok);
+    check_mem(contig_names[n_contigs]);
+    contig_lens[n_contigs] = len;
+    n_contigs++;
+    tok = strtok_r(NULL, ",", &save);
+  }
+  free(copy);
+  check(n_contigs > 0, "No contigs in '%s'.", spec);
+  return 0;
+  error:
+    free(copy);
+    return 1;
+}
+
+int options(int argc, char *argv[]){
+  const struct option long_opts[] =
+  {
+            {"version",no_argument, 0, 'v'},
+            {"help",no_argument,0,'h'},
+            {"output",required_argument,0,'o'},
+            {"write-ref",required_argument,0,'R'},
+            {"output-fmt",required_argument,0,'O'},
+            {"contigs",required_argument,0,'c'},
+            {"pairs",required_argument,0,'n'},
+            {"read-length",required_argument,0,'l'},
+            {"read-groups",required_argument,0,'g'},
+            {"insert-mean",required_argument,0,'I'},
+            {"insert-sd",required_argument,0,'z'},
+            {"mismatch-rate",required_argument,0,'m'},
+            {"indel-rate",required_argument,0,'x'},
+            {"dup-frac",required_argument,0,'D'},
+            {"queryname",no_argument,0,'q'},
+            {"seed",required_argument,0,'s'},
+            {"threads",required_argument,0,'@'},
+            { NULL, 0, NULL, 0}
+
+ }; //End of declaring opts
+
+ int index = 0;
+ int iarg = 0;
+
+ //Iterate through options
+  while((iarg = getopt_long(argc, argv, "o:R:O:c:n:l:g:I:z:m:x:D:qs:@:vh", long_opts, &index)) != -1){
+    switch(iarg){
+      case 'o':
+        output_file = optarg;
+        break;
+
+      case 'R':
+        ref_out = optarg;
+        break;
+
+      case 'O':
+        out_fmt = optarg;
+        break;
+
+      case 'c':
+        contig_spec = optarg;
+        break;
+
+      case 'n':
+        check(sscanf(optarg, "%"SCNu64, &n_pairs) == 1, "Error parsing -n argument '%s'. Should be an integer.", optarg);
+        break;
+
+      case 'l':
+        check(sscanf(optarg, "%i", &read_len) == 1, "Error parsing -l argument '%s'. Should be an integer.", optarg);
+        break;
+
+      case 'g':
+        check(sscanf(optarg, "%i", &n_groups) == 1, "Error parsing -g argument '%s'. Should be an integer.", optarg);
+        break;
+
+      case 'I':
+        check(sscanf(optarg, "%lf", &insert_mean) == 1, "Error parsing -I argument '%s'. Should be a number.", optarg);
+        break;
+
+      case 'z':
+        check(sscanf(optarg, "%lf", &insert_sd) == 1, "Error parsing -z argument '%s'. Should be a number.", optarg);
+        break;
+
+      case 'm':
+        check(sscanf(optarg, "%lf", &mm_rate) == 1, "Error parsing -m argument '%s'. Should be a number.", optarg);
+        break;
+
+      case 'x':
+        check(sscanf(optarg, "%lf", &indel_rate) == 1, "Error parsing -x argument '%s'. Should be a number.", optarg);
+        break;
+
+      case 'D':
+        check(sscanf(optarg, "%lf", &dup_frac) == 1, "Error parsing -D argument '%s'. Should be a number.", optarg);
+        break;
+
+      case 'q':
+        name_sort = 1;
+        break;
+
+      case 's':
+        check(sscanf(optarg, "%"SCNu64, &seed) == 1, "Error parsing -s argument '%s'. Should be an integer.", optarg);
+        break;
+
+      case '@':
+        if(sscanf(optarg, "%i", &nthreads) != 1){
+          sentinel("Error parsing -@ nThreads) argument '%s'. Should be an integer",optarg);
+        }
+        break;
+
+      case 'h':
+        print_usage(0);
+        break;
+
+      case 'v':
+        print_version(0);
+        break;
+
+      case '?':
+        print_usage (1);
+        break;
+
+      default:
+        print_usage (1);
+
+    }; // End of args switch statement
+
+  }//End of iteration through options
+
+  if(output_file == NULL){
+    printf("Output file (-o) must be defined.\n");
+    print_usage(1);
+  }
+  check(read_len > 2 * INDEL_EDGE && read_len <= 10000, "Read length (-l) must be between %d and 10000.", 2 * INDEL_EDGE + 1);
+  check(n_groups > 0, "Read groups (-g) must be at least 1.");
+  check(insert_sd >= 0 && insert_mean >= read_len, "Insert mean (-I) must be at least the read length and sd (-z) positive.");
+  check(mm_rate >= 0 && mm_rate < 1, "Mismatch rate (-m) must be in [0,1).");
+  check(indel_rate >= 0 && indel_rate < 1, "Indel rate (-x) must be in [0,1).");
+  check(dup_frac >= 0 && dup_frac < 1, "Duplicate fraction (-D) must be in [0,1).");
+  check(parse_contigs(contig_spec) == 0, "Error parsing contigs (-c).");
+  return 0;
+
+  error:
+    return 1;
+}
+
+// splitmix64, fixed so output is identical across platforms and libc
+uint64_t rng_next(uint64_t *state){
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+double rng_unit(uint64_t *state){
+  return (double) (rng_next(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+char rng_base(uint64_t *state){
+  // ~41% GC, roughly human
+  double r = rng_unit(state);
+  if(r < 0.295) return 'A';
+  if(r < 0.5) return 'C';
+  if(r < 0.705) return 'G';
+  return 'T';
+}
+
+char rng_other_base(uint64_t *state, char base){
+  static const char bases[] = "ACGT";
+  char alt;
+  do{
+    alt = bases[rng_next(state) & 3];
+  }while(alt == base);
+  return alt;
+}
+
+hts_pos_t max_insert(){
+  return (hts_pos_t) ceil(insert_mean + 6 * insert_sd);
+}
+
+hts_pos_t rng_insert(uint64_t *state){
+  // Box-Muller, clipped to [read length, mean + 6sd]
+  double u1 = rng_unit(state), u2 = rng_unit(state);
+  double z = sqrt(-2.0 * log(u1 > 0 ? u1 : 1e-300)) * cos(2.0 * M_PI * u2);
+  hts_pos_t ins = (hts_pos_t) llround(insert_mean + z * insert_sd);
+  if(ins < read_len) ins = read_len;
+  if(ins > max_insert()) ins = max_insert();
+  return ins;
+}
+
+/*
+ * The bases of a contig depend only on the seed and contig index, so the reference can be
+ * regenerated rather than held for the whole genome.
+ */
+char *make_contig(int tid){
+  uint64_t state = seed ^ (0xa0761d6478bd642fULL * (uint64_t) (tid + 1));
+  char *seq = malloc(contig_lens[tid] + 1);
+  check_mem(seq);
+  hts_pos_t i;
+  for(i=0;i<contig_lens[tid];i++) seq[i] = rng_base(&state);
+  seq[contig_lens[tid]] = '\0';
+  return seq;
+  error:
+    return NULL;
+}
+
+int write_reference(char *fasta){
+  FILE *fp = NULL;
+  char *seq = NULL;
+  int tid;
+  fp = fopen(fasta, "w");
+  check(fp != NULL, "Error opening '%s' for writing.", fasta);
+  for(tid=0;tid<n_contigs;tid++){
+    seq = make_contig(tid);
+    check(seq != NULL, "Error generating contig %s.", contig_names[tid]);
+    check(fprintf(fp, ">%s\n", contig_names[tid]) > 0, "Error writing to '%s'.", fasta);
+    hts_pos_t i;
+    for(i=0;i<contig_lens[tid];i+=FASTA_LINE){
+      hts_pos_t len = contig_lens[tid] - i < FASTA_LINE ? contig_lens[tid] - i : FASTA_LINE;
+      check(fwrite(seq + i, 1, len, fp) == len && fputc('\n', fp) != EOF, "Error writing to '%s'.", fasta);
+    }
+    free(seq);
+    seq = NULL;
+  }
+  check(fclose(fp) == 0, "Error closing '%s'.", fasta);
+  fp = NULL;
+  check(fai_build(fasta) == 0, "Error indexing '%s'.", fasta);
+  return 0;
+  error:
+    free(seq);
+    if(fp) fclose(fp);
+    return 1;
+}
+
+// @SQ UR points at the written reference so CRAM readers can find it without REF_PATH
+sam_hdr_t *make_header(int argc, char *argv[], char *ref_path){
+  kstring_t text = {0, 0, NULL};
+  kstring_t cl = {0, 0, NULL};
+  sam_hdr_t *head = NULL;
+  int i;
+  ksprintf(&text, "@HD\tVN:1.6\tSO:%s\n", name_sort ? "queryname" : "coordinate");
+  for(i=0;i<n_contigs;i++){
+    ksprintf(&text, "@SQ\tSN:%s\tLN:%"PRIhts_pos, contig_names[i], contig_lens[i]);
+    if(ref_path) ksprintf(&text, "\tUR:file:%s", ref_path);
+    kputc('\n', &text);
+  }
+  for(i=0;i<n_groups;i++){
+    ksprintf(&text, "@RG\tID:synth.%d\tPL:ILLUMINA\tPU:synth_%d\tLB:synth_lib_%d\tSM:synth\n", i + 1, i + 1, i + 1);
+  }
+  check(text.s != NULL, "Error building header text.");
+  head = sam_hdr_parse(text.l, text.s);
+  check(head != NULL, "Error parsing generated header.");
+  for(i=0;i<argc;i++) ksprintf(&cl, "%s%s", i ? " " : "", argv[i]);
+  check(sam_hdr_add_pg(head, "xam_synth", "PN", "xam_synth", "VN", VERSION, "CL", cl.s, NULL) == 0, "Error adding @PG to header.");
+  free(text.s);
+  free(cl.s);
+  return head;
+  error:
+    free(text.s);
+    free(cl.s);
+    if(head) sam_hdr_destroy(head);
+    return NULL;
+}
+
+void synth_cigar(uint64_t *state, synth_aln_t *aln){
+  int q = 0, run = 0;
+  aln->n_cigar = 0;
+  aln->span = 0;
+  while(q < read_len){
+    if(q >= INDEL_EDGE && read_len - q > INDEL_EDGE && aln->n_cigar < MAX_CIGAR - 3 && rng_unit(state) < indel_rate){
+      int len = 1 + (int) (rng_next(state) % 3);
+      if(run){
+        aln->cigar[aln->n_cigar++] = bam_cigar_gen(run, BAM_CMATCH);
+        aln->span += run;
+        run = 0;
+      }
+      if(rng_next(state) & 1){
+        if(len > read_len - q - INDEL_EDGE) len = read_len - q - INDEL_EDGE;
+        aln->cigar[aln->n_cigar++] = bam_cigar_gen(len, BAM_CINS);
+        q += len;
+      }else{
+        aln->cigar[aln->n_cigar++] = bam_cigar_gen(len, BAM_CDEL);
+        aln->span += len;
+      }
+      continue;
+    }
+    run++;
+    q++;
+  }
+  aln->cigar[aln->n_cigar++] = bam_cigar_gen(run, BAM_CMATCH);
+  aln->span += run;
+}
+
+/*
+ * Fills sequence, quality and MD for an alignment at pos, returns the edit distance for NM.
+ */
+int synth_fill(uint64_t *state, const char *ref, hts_pos_t pos, synth_aln_t *aln, char *seq, char *qual, kstring_t *md){
+  int i, j, q = 0, run = 0, nm = 0;
+  hts_pos_t r = pos;
+  md->l = 0;
+  for(i=0;i<aln->n_cigar;i++){
+    int op = bam_cigar_op(aln->cigar[i]);
+    int len = bam_cigar_oplen(aln->cigar[i]);
+    if(op == BAM_CMATCH){
+      for(j=0;j<len;j++,q++,r++){
+        if(rng_unit(state) < mm_rate){
+          seq[q] = rng_other_base(state, ref[r]);
+          ksprintf(md, "%d%c", run, ref[r]);
+          run = 0;
+          nm++;
+        }else{
+          seq[q] = ref[r];
+          run++;
+        }
+      }
+    }else if(op == BAM_CINS){
+      for(j=0;j<len;j++,q++) seq[q] = rng_base(state);
+      nm += len;
+    }else if(op == BAM_CDEL){
+      ksprintf(md, "%d^", run);
+      kputsn(ref + r, len, md);
+      r += len;
+      run = 0;
+      nm += len;
+    }
+  }
+  ksprintf(md, "%d", run);
+  for(q=0;q<read_len;q++) qual[q] = 25 + (char) (rng_next(state) % 16);
+  return nm;
+}
+
+void cigar_str(synth_aln_t *aln, kstring_t *str){
+  int i;
+  str->l = 0;
+  for(i=0;i<aln->n_cigar;i++) ksprintf(str, "%d%c", bam_cigar_oplen(aln->cigar[i]), bam_cigar_opchr(aln->cigar[i]));
+}
+
+int pending_push(pending_heap_t *heap, bam1_t *b){
+  if(heap->n == heap->m){
+    heap->m = heap->m ? heap->m * 2 : 256;
+    pending_t *tmp = realloc(heap->recs, sizeof(pending_t) * heap->m);
+    check_mem(tmp);
+    heap->recs = tmp;
+  }
+  size_t i = heap->n++;
+  pending_t rec = {b->core.pos, heap->order++, b};
+  while(i > 0){
+    size_t parent = (i - 1) / 2;
+    pending_t *p = &heap->recs[parent];
+    if(p->pos < rec.pos || (p->pos == rec.pos && p->order < rec.order)) break;
+    heap->recs[i] = *p;
+    i = parent;
+  }
+  heap->recs[i] = rec;
+  return 0;
+  error:
+    return -1;
+}
+
+bam1_t *pending_pop(pending_heap_t *heap){
+  bam1_t *top = heap->recs[0].b;
+  pending_t last = heap->recs[--heap->n];
+  size_t i = 0;
+  while(1){
+    size_t child = 2 * i + 1;
+    if(child >= heap->n) break;
+    if(child + 1 < heap->n){
+      pending_t *a = &heap->recs[child], *b = &heap->recs[child + 1];
+      if(b->pos < a->pos || (b->pos == a->pos && b->order < a->order)) child++;
+    }
+    pending_t *c = &heap->recs[child];
+    if(last.pos < c->pos || (last.pos == c->pos && last.order < c->order)) break;
+    heap->recs[i] = *c;
+    i = child;
+  }
+  if(heap->n) heap->recs[i] = last;
+  return top;
+}
+
+// write pending records before pos, all of them when pos is negative
+int pending_flush(pending_heap_t *heap, htsFile *output, sam_hdr_t *head, hts_pos_t pos){
+  while(heap->n > 0 && (pos < 0 || heap->recs[0].pos < pos)){
+    bam1_t *b = pending_pop(heap);
+    int ret = sam_write1(output, head, b);
+    bam_destroy1(b);
+    check(ret >= 0, "Error writing to '%s'.", output_file);
+  }
+  return 0;
+  error:
+    return -1;
+}
+
+int main(int argc, char *argv[]){
+  htsFormat fmt = {0};
+  htsThreadPool p = {NULL, 0};
+  htsFile *output = NULL;
+  sam_hdr_t *head = NULL;
+  pending_heap_t heap = {NULL, 0, 0, 0};
+  kstring_t md = {0, 0, NULL};
+  kstring_t mc[2] = {{0, 0, NULL}, {0, 0, NULL}};
+  char *ref = NULL;
+  char *ref_path = NULL;
+  char *seq = NULL;
+  char *qual = NULL;
+  bam1_t *b = NULL;
+  uint64_t state;
+  uint64_t written_pairs = 0;
+  uint64_t dups = 0;
+  uint64_t total_len = 0;
+  int status = 1;
+  int ret = 0;
+  int tid;
+
+  int problem = options(argc,argv);
+  check(problem==0,"Error parsing options.");
+
+  check(hts_parse_format(&fmt, out_fmt) == 0, "Error parsing output format '%s'.", out_fmt);
+  check(fmt.format == bam || fmt.format == cram, "Output format must be bam or cram, got '%s'.", out_fmt);
+  if(fmt.format == cram) check(ref_out != NULL, "Reference (-R) is required for CRAM output.");
+  for(tid=0;tid<n_contigs;tid++){
+    check(contig_lens[tid] > max_insert(), "Contig %s is shorter than the maximum insert size %"PRIhts_pos".", contig_names[tid], max_insert());
+    total_len += contig_lens[tid];
+  }
+
+  if(ref_out){
+    check(write_reference(ref_out) == 0, "Error writing reference '%s'.", ref_out);
+    ref_path = realpath(ref_out, NULL);
+    check(ref_path != NULL, "Error resolving path of '%s'.", ref_out);
+  }
+
+  head = make_header(argc, argv, ref_path);
+  check(head != NULL, "Error creating header.");
+
+  if (nthreads > 0) {
+    p.pool = hts_tpool_init(nthreads);
+    check(p.pool != NULL,"Error creating thread pool");
+  }
+  output = sam_open_format(output_file, fmt.format == cram ? "wc" : "wb", &fmt);
+  check(output != NULL, "Error opening hts file for writing '%s'.", output_file);
+  if(ref_out) check(hts_set_fai_filename(output, ref_out) == 0, "Error setting reference for output.");
+  if(p.pool) hts_set_opt(output, HTS_OPT_THREAD_POOL, &p);
+  check(sam_hdr_write(output, head) == 0, "Error writing header to '%s'.", output_file);
+
+  seq = malloc(read_len + 1);
+  qual = malloc(read_len);
+  check_mem(seq);
+  check_mem(qual);
+  seq[read_len] = '\0';
+
+  state = seed;
+  for(tid=0;tid<n_contigs;tid++){
+    // pairs in proportion to contig length, the last contig takes the rounding
+    uint64_t contig_pairs = tid == n_contigs - 1 ? n_pairs - written_pairs
+                          : (uint64_t) ((double) n_pairs * (double) contig_lens[tid] / (double) total_len);
+    if(contig_pairs == 0) continue;
+    ref = make_contig(tid);
+    check(ref != NULL, "Error generating contig %s.", contig_names[tid]);
+    double stride = (double) (contig_lens[tid] - max_insert()) / (double) contig_pairs;
+    hts_pos_t start = 0, insert = 0;
+    uint64_t i;
+    for(i=0;i<contig_pairs;i++){
+      synth_aln_t aln[2];
+      hts_pos_t pos[2];
+      int nm[2], r, is_dup = 0;
+      // duplicates share the outer coordinates of the pair before them, starts otherwise stratified so they stay sorted
+      if(i > 0 && rng_unit(&state) < dup_frac){
+        is_dup = 1;
+        dups++;
+      }else{
+        start = (hts_pos_t) (((double) i + rng_unit(&state)) * stride);
+        insert = rng_insert(&state);
+      }
+      int rg = (int) (rng_next(&state) % n_groups);
+      int read1_left = (int) (rng_next(&state) & 1);
+      synth_cigar(&state, &aln[0]);
+      synth_cigar(&state, &aln[1]);
+      pos[0] = start;
+      pos[1] = start + insert - aln[1].span;
+      if(pos[1] < start) pos[1] = start;
+      hts_pos_t end = pos[0] + aln[0].span > pos[1] + aln[1].span ? pos[0] + aln[0].span : pos[1] + aln[1].span;
+      cigar_str(&aln[0], &mc[0]);
+      cigar_str(&aln[1], &mc[1]);
+
+      if(name_sort == 0) check(pending_flush(&heap, output, head, start) == 0, "Error writing sorted records.");
+
+      char qname[32];
+      int qname_len = snprintf(qname, sizeof(qname), "SYN%012"PRIu64, written_pairs + i);
+      char rg_id[32];
+      snprintf(rg_id, sizeof(rg_id), "synth.%d", rg + 1);
+      // r is the leftmost (forward) read when 0, write in read1/read2 order
+      int order[2] = {read1_left ? 0 : 1, read1_left ? 1 : 0};
+      int k;
+      for(k=0;k<2;k++){
+        r = order[k];
+        uint16_t flag = BAM_FPAIRED | BAM_FPROPER_PAIR | (k == 0 ? BAM_FREAD1 : BAM_FREAD2)
+                      | (r == 0 ? BAM_FMREVERSE : BAM_FREVERSE);
+        if(is_dup) flag |= BAM_FDUP;
+        nm[r] = synth_fill(&state, ref, pos[r], &aln[r], seq, qual, &md);
+        hts_pos_t tlen = r == 0 ? end - start : -(end - start);
+        b = bam_init1();
+        check_mem(b);
+        check(bam_set1(b, qname_len, qname, flag, tid, pos[r], 60, aln[r].n_cigar, aln[r].cigar,
+                        tid, pos[1 - r], tlen, read_len, seq, qual, 64 + md.l + mc[1 - r].l) >= 0,
+                        "Error building record %s.", qname);
+        int32_t as = read_len - 5 * nm[r];
+        check(bam_aux_append(b, "RG", 'Z', strlen(rg_id) + 1, (uint8_t *) rg_id) == 0
+          && bam_aux_append(b, "NM", 'i', 4, (uint8_t *) &nm[r]) == 0
+          && bam_aux_append(b, "MD", 'Z', md.l + 1, (uint8_t *) md.s) == 0
+          && bam_aux_append(b, "MC", 'Z', mc[1 - r].l + 1, (uint8_t *) mc[1 - r].s) == 0
+          && bam_aux_append(b, "AS", 'i', 4, (uint8_t *) &as) == 0, "Error adding tags to %s.", qname);
+        if(name_sort){
+          ret = sam_write1(output, head, b);
+          bam_destroy1(b);
+          b = NULL;
+          check(ret >= 0, "Error writing to '%s'.", output_file);
+        }else{
+          check(pending_push(&heap, b) == 0, "Error queueing record %s.", qname);
+          b = NULL;
+        }
+      }
+    }
+    check(pending_flush(&heap, output, head, -1) == 0, "Error writing sorted records.");
+    written_pairs += contig_pairs;
+    free(ref);
+    ref = NULL;
+  }
+
+  ret = hts_close(output);
+  output = NULL;
+  check(ret == 0, "Error closing '%s'.", output_file);
+  fprintf(stderr, "SYNTH: %"PRIu64" pairs, %"PRIu64" reads, %"PRIu64" duplicate pairs\n", written_pairs, written_pairs * 2, dups);
+  status = 0;
+
+error:
+  if(b) bam_destroy1(b);
+  while(heap.n > 0) bam_destroy1(pending_pop(&heap));
+  free(heap.recs);
+  if(output) hts_close(output);
+  if(head) sam_hdr_destroy(head);
+  free(ref);
+  free(ref_path);
+  free(seq);
+  free(qual);
+  free(md.s);
+  free(mc[0].s);
+  free(mc[1].s);
+  for(tid=0;tid<n_contigs;tid++) free(contig_names[tid]);
+  if(fmt.specific) hts_opt_free(fmt.specific);
+  if (p.pool) hts_tpool_destroy(p.pool);
+  return status;
+}
@@ -35,6 +35,7 @@ use List::Util qw(first);
 use Data::UUID;
 
 use PCAP::Threaded;
+use PCAP::Bam::Shard;
 
 const my $BAMCOLLATE => q{(%s colsbs=268435456 collate=1 reset=1 exclude=SECONDARY,QCFAIL,SUPPLEMENTARY classes=F,F2 T=%s filename=%s level=1 > %s)};
 
@@ -148,9 +149,14 @@ sub merge_or_mark_lanes {
                               $tools{samtools}, $options->{reference}, $out_fmt, $helper_threads;
       my $md5      = sprintf q{%s -b > %s.md5},
                             $tools{md5sum}, $marked;
-      my $stats    = sprintf q{%s -o %s.bas -@ %d},
-                              $tools{bam_stats}, $marked, $helper_threads;
-      push @commands, qq{$merge | pee "$stats" "$compress | pee '$idx' '$md5' 'cat > $marked'"};
+      my $stats    = sprintf q{%s -o %s.bas -@ %d%s},
+                              $tools{bam_stats}, $marked, $helper_threads, coverage_args($options, $marked);
+      if(exists $options->{legacy}) {
+        push @commands, qq{$merge | pee "$stats" "$compress | pee '$idx' '$md5' 'cat > $marked'"};
+      }
+      else {
+        push @commands, qq{$merge | }._fanout($options, $marked, $out_fmt, $options->{'noindex'} ? undef : $idx_type, $helper_threads);
+      }
   }
   else {
     my $merge;
@@ -182,12 +188,17 @@ sub merge_or_mark_lanes {
                            $tools{samtools}, $helper_threads, $idx_csi_flag, $marked, $idx_type;
     my $md5      = sprintf q{%s -b > %s.md5},
                            $tools{md5sum}, $marked;
-    my $stats    = sprintf q{%s -o %s.bas -@ %d},
-                           $tools{bam_stats}, $marked, $helper_threads;
-    push @commands, qq{$merge | $markdup | pee "$compress | pee 'cat > $marked' '$idx' '$md5'" "$stats" };
+    my $stats    = sprintf q{%s -o %s.bas -@ %d%s},
+                           $tools{bam_stats}, $marked, $helper_threads, coverage_args($options, $marked);
+    if(exists $options->{legacy}) {
+      push @commands, qq{$merge | $markdup | pee "$compress | pee 'cat > $marked' '$idx' '$md5'" "$stats" };
+    }
+    else {
+      push @commands, qq{$merge | $markdup | }._fanout($options, $marked, $out_fmt, $idx_type, $helper_threads);
+    }
   }
 
-  if($options->{'cram'}) {
+  if($options->{'cram'} && exists $options->{legacy}) {
     push @commands, sprintf $CRAM_CHKSUM, $marked, $marked;
   }
 
@@ -258,6 +269,10 @@ sub merge_and_mark_dup {
     $idx_csi_flag = '-c';
   }
 
+  if(($options->{'mark_shards'} || 0) > 1 && !exists $options->{legacy} && !$options->{'nomarkdup'}) {
+    return PCAP::Bam::Shard::merge_and_mark_dup($options, $marked, $out_fmt, $idx_type, @bams);
+  }
+
   if(defined $options->{'nomarkdup'} && $options->{'nomarkdup'} == 1) {
     my $merge    = sprintf q{%s merge -u -@ %d - %s},
                             $tools{samtools}, $helper_threads, $input_str;
@@ -267,9 +282,14 @@ sub merge_and_mark_dup {
                           $tools{samtools}, $helper_threads, $idx_csi_flag, $marked, $idx_type;
     my $md5      = sprintf q{%s -b > %s.md5},
                            $tools{md5sum}, $marked;
-    my $stats    = sprintf q{%s -o %s.bas -@ %d},
-                            $tools{bam_stats}, $marked, $helper_threads;
-    push @commands, qq{$merge $mismatchQc | pee "$stats" "$compress | pee '$idx' '$md5' 'cat > $marked'"};
+    my $stats    = sprintf q{%s -o %s.bas -@ %d%s},
+                            $tools{bam_stats}, $marked, $helper_threads, coverage_args($options, $marked);
+    if(exists $options->{legacy}) {
+      push @commands, qq{$merge $mismatchQc | pee "$stats" "$compress | pee '$idx' '$md5' 'cat > $marked'"};
+    }
+    else {
+      push @commands, qq{$merge $mismatchQc | }._fanout($options, $marked, $out_fmt, $idx_type, $helper_threads, stats_shards($options, @bams));
+    }
   }
   else {
     my $merge;
@@ -301,12 +321,17 @@ sub merge_and_mark_dup {
                            $tools{samtools}, $helper_threads, $idx_csi_flag, $marked, $idx_type;
     my $md5      = sprintf q{%s -b > %s.md5},
                            $tools{md5sum}, $marked;
-    my $stats    = sprintf q{%s -o %s.bas -@ %d},
-                           $tools{bam_stats}, $marked, $helper_threads;
-    push @commands, qq{$merge $mismatchQc | $markdup | pee "$compress | pee 'cat > $marked' '$idx' '$md5'" "$stats" };
+    my $stats    = sprintf q{%s -o %s.bas -@ %d%s},
+                           $tools{bam_stats}, $marked, $helper_threads, coverage_args($options, $marked);
+    if(exists $options->{legacy}) {
+      push @commands, qq{$merge $mismatchQc | $markdup | pee "$compress | pee 'cat > $marked' '$idx' '$md5'" "$stats" };
+    }
+    else {
+      push @commands, qq{$merge $mismatchQc | $markdup | }._fanout($options, $marked, $out_fmt, $idx_type, $helper_threads, stats_shards($options, @bams));
+    }
   }
 
-  if($options->{'cram'}) {
+  if($options->{'cram'} && exists $options->{legacy}) {
     push @commands, sprintf $CRAM_CHKSUM, $marked, $marked;
   }
 
@@ -315,6 +340,47 @@ sub merge_and_mark_dup {
   return $marked;
 }
 
+# bam_stats shards written alongside each *_sorted.bam, only returned when every input has one
+sub stats_shards {
+  my ($options, @bams) = @_;
+  # mismatchQc changes QC fail flags after the shards were generated
+  return () if(defined $options->{'mmqc'} || exists $options->{legacy});
+  my @shards;
+  for my $bam(@bams) {
+    (my $shard = $bam) =~ s/\.bam$/.stats/;
+    return () unless(-e $shard);
+    push @shards, $shard;
+  }
+  return @shards;
+}
+
+# single decode of the final stream: compress, index, md5 and bas generation
+sub _fanout {
+  my ($options, $marked, $out_fmt, $idx_type, $threads, @shards) = @_;
+  my $fanout = _which('xam_fanout') || die "Unable to find 'xam_fanout' in path";
+  my $command = sprintf q{%s -O %s -r %s -@ %d -m %s.md5 -b %s.bas -o %s},
+                        $fanout, $out_fmt, $options->{reference}, $threads, $marked, $marked, $marked;
+  # md5 file keeps the format of the legacy pipelines, md5sum -b of the stream for BAM, bare digest for CRAM
+  $command .= q{ -M} unless($options->{'cram'});
+  if(defined $idx_type) {
+    $command .= sprintf q{ -x %s.%s}, $marked, $idx_type;
+    $command .= q{ -c} if($idx_type eq 'csi');
+  }
+  # shards carry everything but duplicate counts
+  $command .= join q{}, map { " -S $_" } @shards;
+  $command .= coverage_args($options, $marked);
+  return $command;
+}
+
+# depth bins and histogram gathered by bam_stats/xam_fanout as the final file streams past
+sub coverage_args {
+  my ($options, $marked) = @_;
+  return q{} if(!exists $options->{'coverage'} || $options->{'qnamesort'});
+  my $args = sprintf q{ -C %s.coverage -H %s.depth}, $marked, $marked;
+  $args .= sprintf q{ -t %s}, $options->{'coverage'} if(length $options->{'coverage'});
+  return $args;
+}
+
 sub bam_stats {
   # uncoverable subroutine
   my $options = shift;
@@ -615,6 +681,23 @@ Resulting data is of the form:
   $outdir/$sample.bam.md5
   $outdir/$sample.met
 
+=item stats_shards
+
+  my @shards = PCAP::Bam::stats_shards($options, @bams);
+
+Returns the bam_stats shard (C<*_sorted.stats>) for each of the BAM files, or an empty list if any is
+missing or if C<mmqc> or C<legacy> are in use.  When shards are available the final C<.bas> is generated by
+summing them, only duplicate counts are taken from the marked output.
+
+=item coverage_args
+
+  my $args = PCAP::Bam::coverage_args($options, $marked);
+
+Returns the C<bam_stats>/C<xam_fanout> options to write the depth bins (C<$marked.coverage>, as
+C<xam_coverage>) and depth histogram (C<$marked.depth>) in the same pass that generates the C<.bas>.
+Empty unless C<coverage> is set in C<$options>, when it is non-empty it is the bed|gff3 file of targets
+to restrict the coverage to.  Never applied to C<qnamesort> output as coordinate order is required.
+
 =item sample_name
 
 Takes BAM or Bio::DB::HTS object as input and returns the sample name found in the header.
@@ -7,6 +7,8 @@ use warnings FATAL=>'all';
 use autodie;
 use Carp;
 use Const::Fast;
+use Try::Tiny;
+use Capture::Tiny qw(capture);
 
 use Bio::DB::HTS;
 
@@ -30,6 +32,7 @@ sub _init {
   $hts->max_pileup_cnt($MAX_PILEUP_DEPTH);
   $self->{'hts'} = $hts;
   $self->{'targets'} = parse_targets_file($options);
+  $self->{'options'} = $options;
   return 1;
 }
 
@@ -39,6 +42,11 @@ sub target_types {
 
 sub build_depth{
   my $self = shift;
+  my $engine = $self->{'options'}->{'engine'} || 'c';
+  if($engine eq 'c') {
+    my $xam_coverage = try { PCAP::_which('xam_coverage') };
+    return $self->_build_depth_c($xam_coverage) if(defined $xam_coverage);
+  }
 	my $total_bases = 0;
 	my %depth_bins;
   foreach my $ref_ex(@{$self->{'targets'}}) {
@@ -62,6 +70,17 @@ sub build_depth{
 	return $depth_data;
 }
 
+sub _build_depth_c {
+  my ($self, $xam_coverage) = @_;
+  my $options = $self->{'options'};
+  my @command = ($xam_coverage, '-i', $options->{'xam'}, '-t', $options->{'target'},
+                  '-T', $options->{'type'}, '-@', $options->{'threads'} || 1);
+  my ($stdout, $stderr, $exit) = capture { system(@command); };
+  croak "Failed to execute: @command\n$stderr" if($exit);
+  chomp $stdout;
+  return $stdout;
+}
+
 sub build_final_bins {
 	my ($depth_bins, $total_bases) = @_;
 	my %final_bins;
@@ -107,15 +126,41 @@ sub build_final_bins {
 sub parse_targets_file{
   my ($opts) = @_;
   if($opts->{'type'} eq $GFF_TYPE){
-    return parse_gff($opts->{'target'});
+    return merge_targets(parse_gff($opts->{'target'}));
   }elsif($opts->{'type'} eq $BED_TYPE){
-    return parse_bed($opts->{'target'});
+    return merge_targets(parse_bed($opts->{'target'}));
   }
   else {
     croak "Invalid 'type' detected";
   }
 }
 
+sub merge_targets {
+  my ($targets) = @_;
+  my %by_chr;
+  my @chr_order;
+  for my $target(@{$targets}) {
+    push @chr_order, $target->[0] unless(exists $by_chr{$target->[0]});
+    push @{$by_chr{$target->[0]}}, $target;
+  }
+  my @merged;
+  for my $chr(@chr_order) {
+    my @sorted = sort { $a->[1] <=> $b->[1] || $a->[2] <=> $b->[2] } @{$by_chr{$chr}};
+    my $current = [@{shift @sorted}];
+    for my $target(@sorted) {
+      # overlapping or abutting, 1-based inclusive
+      if($target->[1] <= $current->[2] + 1) {
+        $current->[2] = $target->[2] if($target->[2] > $current->[2]);
+        next;
+      }
+      push @merged, $current;
+      $current = [@{$target}];
+    }
+    push @merged, $current;
+  }
+  return \@merged;
+}
+
 sub parse_bed{
   my ($file) =@_;
   my $FH;
@@ -168,7 +213,9 @@ Constructs the coverage object.  Expects a hash of the following form for instan
 
  {'xam' => $bam_cram_filename,
   'target' => $bed_gff3_filename,
-  'type' => $type_as_string }
+  'type' => $type_as_string,
+  'threads' => $contigs_in_parallel, # optional
+  'engine' => 'c'|'perl' }           # optional
 
 Where 'type' can be 'bed' or 'gff3'
 
@@ -178,7 +225,11 @@ Returns a list of valid types.
 
 =item build_depth
 
-Calculates the depth over each of the targets
+Calculates the depth over each of the targets.
+
+When C<xam_coverage> is found in the path it performs the whole calculation, reading all targets of
+a contig through one index iterator and processing C<'threads'> contigs in parallel.  Otherwise, or when
+C<'engine' =E<gt> 'perl'> is included in the options, Bio::DB::HTS coverage features are used.
 
 =item build_final_bins
 
@@ -186,7 +237,13 @@ Condenses the per target data into fraction of targets covered at various depths
 
 =item parse_targets_file
 
-Abstracts reading of specific target file formats
+Abstracts reading of specific target file formats, returns merged targets (see C<merge_targets>)
+
+=item merge_targets
+
+Sorts targets by start within each contig and merges those that overlap or abut so that no base is
+counted twice.  Contigs remain in order of first appearance.  The same merging is applied by the
+C<xam_coverage> target index.
 
 =item parse_bed
 
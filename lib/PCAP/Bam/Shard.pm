@@ -0,0 +1,339 @@
+package PCAP::Bam::Shard;
+
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 ICGC PanCancer Project
+# Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+
+use PCAP;
+
+use strict;
+use autodie qw(:all);
+use English qw( -no_match_vars );
+use warnings FATAL => 'all';
+use Const::Fast qw(const);
+use Carp qw(croak);
+use File::Spec;
+use File::Path qw(make_path);
+
+use PCAP::Threaded;
+
+const my $SHARD_DIR => 'shards';
+const my $UNMAPPED_REGION => q{'*'};
+const my @MET_ORDER => ('READ', 'WRITTEN', 'EXCLUDED', 'EXAMINED', 'PAIRED', 'SINGLE',
+                        'DUPLICATE PAIR', 'DUPLICATE SINGLE', 'DUPLICATE PAIR OPTICAL',
+                        'DUPLICATE SINGLE OPTICAL', 'DUPLICATE NON PRIMARY',
+                        'DUPLICATE NON PRIMARY OPTICAL', 'DUPLICATE PRIMARY TOTAL',
+                        'DUPLICATE TOTAL', 'ESTIMATED_LIBRARY_SIZE');
+# primary reads flagged by xam_dupsync are the later mate of a duplicate pair, secondary and
+# supplementary records are counted apart as samtools markdup (Picard) does
+const my @SYNC_MET_KEYS => ('DUPLICATE PAIR', 'DUPLICATE PRIMARY TOTAL', 'DUPLICATE TOTAL');
+const my @SYNC_NP_MET_KEYS => ('DUPLICATE NON PRIMARY', 'DUPLICATE TOTAL');
+
+sub merge_and_mark_dup {
+  my ($options, $marked, $out_fmt, $idx_type, @bams) = @_;
+  my $tmp = $options->{'tmp'};
+
+  my $shard_count = prepare($options, @bams);
+
+  my $threads = PCAP::Threaded->new($options->{'threads'});
+  my $per_job = int ($options->{'threads'} / $shard_count);
+  $per_job = 1 if($per_job < 1);
+  $options->{'shard_threads'} = $per_job;
+  # shards are only concatenated and decoded once more by xam_fanout, which compresses to $out_fmt
+  $options->{'shard_out_fmt'} = 'bam,level=0';
+  $threads->add_function('shard_index', \&shard_index);
+  $threads->add_function('shard_mark', \&shard_mark, $per_job);
+  $threads->add_function('shard_sync', \&shard_sync, $per_job);
+
+  $threads->run(scalar @bams, 'shard_index', $options);
+  $threads->run($shard_count, 'shard_mark', $options);
+  $threads->run($shard_count, 'shard_sync', $options);
+  finalise($options, $marked, $out_fmt, $idx_type, PCAP::Bam::stats_shards($options, @bams));
+  return $marked;
+}
+
+sub contig_groups {
+  my ($dict, $shards) = @_;
+  croak "Number of shards must be a positive integer: $shards\n" if($shards !~ m/^[[:digit:]]+$/ || $shards == 0);
+  my @contigs;
+  my $total = 0;
+  open my $DICT, '<', $dict;
+  while(my $line = <$DICT>) {
+    next unless($line =~ m/^\@SQ/);
+    my ($name) = $line =~ m/\tSN:([^\t\n]+)/;
+    my ($len) = $line =~ m/\tLN:([[:digit:]]+)/;
+    push @contigs, [$name, $len];
+    $total += $len;
+  }
+  close $DICT;
+  croak "No \@SQ lines found in $dict\n" unless(@contigs);
+
+  # shards must be contiguous in header order so they can be concatenated and remain sorted
+  my @groups = ([]);
+  my $cumulative = 0;
+  for my $i(0..$#contigs) {
+    my $ctg = $contigs[$i];
+    my $remaining = scalar @contigs - $i;
+    if(@{$groups[-1]} && scalar @groups < $shards
+        && ($cumulative >= $total * (scalar @groups) / $shards || $remaining <= $shards - scalar @groups)) {
+      push @groups, [];
+    }
+    push @{$groups[-1]}, $ctg;
+    $cumulative += $ctg->[1];
+  }
+  return \@groups;
+}
+
+sub prepare {
+  my ($options, @bams) = @_;
+  my $shard_dir = File::Spec->catdir($options->{'tmp'}, $SHARD_DIR);
+  make_path($shard_dir) unless(-d $shard_dir);
+  my $groups = contig_groups($options->{'dict'}, $options->{'mark_shards'});
+  my $shard = 0;
+  for my $group(@{$groups}) {
+    $shard++;
+    open my $BED, '>', _shard_file($options, $shard, 'bed');
+    printf $BED "%s\t0\t%d\n", @{$_} for(@{$group});
+    close $BED;
+  }
+  # final shard is always the unplaced reads
+  $options->{'shard_count'} = $shard + 1;
+  $options->{'shard_inputs'} = [sort @bams];
+  return $options->{'shard_count'};
+}
+
+sub shard_index {
+  my ($index, $options) = @_;
+  my $tmp = $options->{'tmp'};
+  return 1 if PCAP::Threaded::success_exists(File::Spec->catdir($tmp, 'progress'), $index);
+  my $samtools = _which('samtools') || die "Unable to find 'samtools' in path";
+  my $bam = $options->{'shard_inputs'}->[$index - 1];
+  # csi as contigs may exceed the bai limit
+  my $command = sprintf q{%s index -c %s}, $samtools, $bam;
+  PCAP::Threaded::external_process_handler(File::Spec->catdir($tmp, 'logs'), $command, $index);
+  PCAP::Threaded::touch_success(File::Spec->catdir($tmp, 'progress'), $index);
+  return 1;
+}
+
+sub shard_mark {
+  my ($index, $options) = @_;
+  my $tmp = $options->{'tmp'};
+  return 1 if PCAP::Threaded::success_exists(File::Spec->catdir($tmp, 'progress'), $index);
+
+  my %tools;
+  for my $tool(qw(samtools xam_dupsync mismatchQc)) {
+    $tools{$tool} = _which($tool) || die "Unable to find '$tool' in path";
+  }
+  my $threads = $options->{'shard_threads'};
+  my $inputs = join q{ }, @{$options->{'shard_inputs'}};
+  my $unmapped = $index == $options->{'shard_count'};
+  my $bed = _shard_file($options, $index, 'bed');
+  my $region = $unmapped ? "-R $UNMAPPED_REGION" : "-L $bed";
+
+  my $merge = sprintf q{%s merge -u -@ %d %s - %s}, $tools{samtools}, $threads, $region, $inputs;
+  my $mismatchQc = q{};
+  if(defined $options->{'mmqc'}) {
+    $mismatchQc = sprintf q{ | %s -l 0 -t %.2f -p}, $tools{'mismatchQc'}, $options->{'mmqcfrac'};
+  }
+  my $markdup = sprintf q{%s markdup --mode %s --output-fmt bam,level=0 -S --include-fails -T %s -@ %d -f %s - -},
+                        $tools{samtools}, $options->{'dupmode'}, _shard_file($options, $index, 'strmdup'),
+                        $threads, _shard_file($options, $index, 'met');
+  my $marked = _shard_file($options, $index, 'marked.bam');
+  my $dupsync;
+  if($unmapped) {
+    $dupsync = sprintf q{cat > %s}, $marked;
+  }
+  else {
+    # record duplicates whose mates/supplementary alignments are decided in this shard but live in another
+    $dupsync = sprintf q{%s -L %s -N %s -O bam,level=0 -o %s},
+                       $tools{xam_dupsync}, $bed, _shard_file($options, $index, 'names'), $marked;
+  }
+  my @commands = ('set -o pipefail', "$merge $mismatchQc | $markdup | $dupsync");
+  PCAP::Threaded::external_process_handler(File::Spec->catdir($tmp, 'logs'), \@commands, $index);
+  PCAP::Threaded::touch_success(File::Spec->catdir($tmp, 'progress'), $index);
+  return 1;
+}
+
+sub shard_sync {
+  my ($index, $options) = @_;
+  my $tmp = $options->{'tmp'};
+  return 1 if PCAP::Threaded::success_exists(File::Spec->catdir($tmp, 'progress'), $index);
+  my $xam_dupsync = _which('xam_dupsync') || die "Unable to find 'xam_dupsync' in path";
+
+  my $names = q{};
+  for my $shard(1..$options->{'shard_count'}) {
+    next if($shard == $index);
+    my $file = _shard_file($options, $shard, 'names');
+    $names .= " -n $file" if(-s $file);
+  }
+  my $marked = _shard_file($options, $index, 'marked.bam');
+  my $command = sprintf q{%s -i %s -O %s -r %s -@ %d -o %s%s 2>&1 | tee %s >&2},
+                        $xam_dupsync, $marked, $options->{'shard_out_fmt'}, $options->{'reference'},
+                        $options->{'shard_threads'}, _final_shard($options, $index), $names,
+                        _shard_file($options, $index, 'sync');
+  my @commands = ('set -o pipefail', $command, "rm -f $marked");
+  PCAP::Threaded::external_process_handler(File::Spec->catdir($tmp, 'logs'), \@commands, $index);
+  PCAP::Threaded::touch_success(File::Spec->catdir($tmp, 'progress'), $index);
+  return 1;
+}
+
+sub finalise {
+  my ($options, $marked, $out_fmt, $idx_type, @stats_shards) = @_;
+  my $tmp = $options->{'tmp'};
+  return 1 if PCAP::Threaded::success_exists(File::Spec->catdir($tmp, 'progress'), 0);
+
+  my $samtools = _which('samtools') || die "Unable to find 'samtools' in path";
+  my @finals = map { _final_shard($options, $_) } (1..$options->{'shard_count'});
+
+  # shards are contiguous in header order, so block level concatenation remains sorted,
+  # one xam_fanout pass then compresses, indexes, hashes and generates the bas
+  my @commands = ('set -o pipefail');
+  push @commands, sprintf q{%s cat %s | %s}, $samtools, (join q{ }, @finals),
+                          PCAP::Bam::_fanout($options, $marked, $out_fmt, $idx_type, $options->{'threads'}, @stats_shards);
+  push @commands, sprintf q{rm -f %s}, join q{ }, @finals;
+
+  PCAP::Threaded::external_process_handler(File::Spec->catdir($tmp, 'logs'), \@commands, 0);
+  merge_metrics($options, "$marked.met");
+  PCAP::Threaded::touch_success(File::Spec->catdir($tmp, 'progress'), 0);
+  return 1;
+}
+
+sub merge_metrics {
+  my ($options, $met) = @_;
+  my %totals;
+  my $command;
+  for my $shard(1..$options->{'shard_count'}) {
+    open my $MET, '<', _shard_file($options, $shard, 'met');
+    while(my $line = <$MET>) {
+      chomp $line;
+      my ($key, $value) = split /: /, $line, 2;
+      next unless(defined $value);
+      if($key eq 'COMMAND') {
+        $command ||= $value;
+        next;
+      }
+      $totals{$key} += $value if($value =~ m/^[[:digit:]]+$/);
+    }
+    close $MET;
+    my $sync = _shard_file($options, $shard, 'sync');
+    next unless(-e $sync);
+    open my $SYNC, '<', $sync;
+    while(my $line = <$SYNC>) {
+      next unless($line =~ m/^DUPSYNC: .* ([[:digit:]]+) reads flagged, ([[:digit:]]+) non primary/);
+      my ($flagged, $non_primary) = ($1, $2);
+      $totals{$_} += $flagged - $non_primary for(@SYNC_MET_KEYS);
+      $totals{$_} += $non_primary for(@SYNC_NP_MET_KEYS);
+    }
+    close $SYNC;
+  }
+  $totals{'ESTIMATED_LIBRARY_SIZE'} = estimate_library_size($totals{'PAIRED'} || 0,
+                                                            $totals{'DUPLICATE PAIR'} || 0,
+                                                            $totals{'DUPLICATE PAIR OPTICAL'} || 0);
+  open my $OUT, '>', $met;
+  printf $OUT "COMMAND: %s (%d shards)\n", $command || q{}, $options->{'shard_count'};
+  for my $key(@MET_ORDER) {
+    printf $OUT "%s: %d\n", $key, $totals{$key} || 0;
+  }
+  close $OUT;
+  return 1;
+}
+
+# as samtools markdup (Picard), shard counts can be summed but the estimate must be recalculated
+sub estimate_library_size {
+  my ($paired_reads, $dup_reads, $optical) = @_;
+  my $pairs = int ($paired_reads / 2);
+  my $dup_pairs = int (($dup_reads - $optical) / 2);
+  return 0 unless($pairs > $dup_pairs && $dup_pairs > 0);
+  my $unique = $pairs - $dup_pairs;
+  my $f = sub { my $x = shift; return $unique / $x - 1 + exp(-$pairs / $x); };
+  my ($m, $M) = (1.0, 100.0);
+  return 0 if($f->($m * $unique) < 0);
+  $M *= 10 while($f->($M * $unique) > 0);
+  for(1..40) {
+    my $r = ($m + $M) / 2;
+    my $u = $f->($r * $unique);
+    if($u > 0) { $m = $r; }
+    elsif($u < 0) { $M = $r; }
+    else { last; }
+  }
+  return int ($unique * ($m + $M) / 2);
+}
+
+sub _shard_file {
+  my ($options, $shard, $ext) = @_;
+  return File::Spec->catfile($options->{'tmp'}, $SHARD_DIR, "shard_$shard.$ext");
+}
+
+sub _final_shard {
+  my ($options, $shard) = @_;
+  my ($fmt) = $options->{'shard_out_fmt'} =~ m/^([^,]+)/;
+  return _shard_file($options, $shard, "final.$fmt");
+}
+
+1;
+
+__END__
+
+=head1 NAME
+
+PCAP::Bam::Shard - Region sharded merge and duplicate marking
+
+=head2 Methods
+
+=over 4
+
+=item merge_and_mark_dup
+
+  PCAP::Bam::Shard::merge_and_mark_dup($options, $marked, $out_fmt, $idx_type, @bams);
+
+Merge and duplicate mark coordinate sorted BAMs as 'mark_shards' independent jobs plus one for
+unplaced reads.  Each shard is a contiguous run of contigs (header order) so the shards can be
+concatenated with 'samtools cat' without re-sorting.
+
+Duplicates decided in one shard whose mate or supplementary alignments are in another shard are
+recorded by xam_dupsync and flagged in the other shards as each is written (uncompressed BAM).  The
+shards are concatenated and a single xam_fanout pass compresses to the final format while it
+builds the index, md5 and bas.
+
+The duplicate metrics of each shard are summed into '$marked.met', reads flagged across shards
+are counted as duplicate pairs (secondary and supplementary records as duplicate non primary) and
+the library size estimate is recalculated.
+
+=item contig_groups
+
+  my $groups = PCAP::Bam::Shard::contig_groups($dict, $shards);
+
+Split the @SQ entries of a sequence dictionary into at most $shards contiguous groups of similar
+total length.  Returns an array ref of groups, each an array ref of [name, length].
+
+=item estimate_library_size
+
+  my $size = PCAP::Bam::Shard::estimate_library_size($paired_reads, $duplicate_pair_reads, $optical);
+
+Library size estimate as reported by 'samtools markdup'.
+
+=back
+
+=head2 Threaded steps
+
+C<shard_index>, C<shard_mark> and C<shard_sync> are L<PCAP::Threaded> callbacks, C<prepare>
+writes the shard BED files and C<finalise> concatenates the shards, summing any bam_stats shards into the C<.bas>.
+
+=cut
@@ -31,6 +31,8 @@ use Carp qw(croak carp);
 use Const::Fast qw( const );
 use Try::Tiny;
 use File::Basename;
+use File::Spec;
+use File::Temp qw(tempdir);
 
 use List::Util qw(sum sum0 first);
 use Bio::DB::HTS;
@@ -61,6 +63,8 @@ const my $INSERT_SMOOTH => 15;
 
 const my @PAIRED_PROPERTIES => qw(proper);
 
+const my $SHARD_MAGIC => "#bam_stats_shard\t1";
+
 1;
 
 sub new{
@@ -103,7 +107,26 @@ sub init{
   $self->{_file_path} = $path;
   $self->{_qualiy_scoring} = $q_scoring;
   $self->{_groups} = $groups;
-  _process_reads($groups,$sam,$q_scoring, $mod, $rem) unless(defined $args{-no_proc});
+  return if(defined $args{-no_proc});
+
+  # C engine can't generate quality plots, partitions require an index
+  my $engine = $args{-engine} || 'c';
+  if($engine eq 'c' && !$q_scoring) {
+    my $bam_stats = try { PCAP::_which('bam_stats') };
+    if(defined $bam_stats) {
+      my $processed = try {
+        _process_reads_c($groups, $path, $bam_stats, $mod, $rem);
+        1;
+      } catch {
+        warn "WARN: bam_stats failed, falling back to perl implementation: $_";
+        $groups = _parse_header($sam);
+        $self->{_groups} = $groups;
+        0;
+      };
+      return if($processed);
+    }
+  }
+  _process_reads($groups,$sam,$q_scoring, $mod, $rem);
 }
 
 sub merge_json_stats {
@@ -156,6 +179,63 @@ sub _parse_header {
   return \%groups;
 }
 
+sub _process_reads_c {
+  my ($groups, $path, $bam_stats, $mod, $rem) = @_;
+  my $tmpdir = tempdir('pcapBamStatsXXXX', TMPDIR => 1, CLEANUP => 1);
+  my $shard = File::Spec->catfile($tmpdir, 'stats.shard');
+  # QC fail reads are skipped entirely, as _process_reads
+  my @part = $mod > 1 ? ('-P', "$rem/$mod") : ();
+  system($bam_stats, '-q', @part, '-i', $path, '-S', $shard);
+  load_shard($groups, $shard);
+  return 1;
+}
+
+sub load_shard {
+  my ($groups, $shard) = @_;
+  open my $SHARD, '<', $shard;
+  my $magic = <$SHARD>;
+  croak "$shard is not a bam_stats shard\n" unless(defined $magic && $magic =~ m/^$SHARD_MAGIC$/);
+  my $rg_ref;
+  while(my $line = <$SHARD>) {
+    chomp $line;
+    my ($type, @fields) = split /\t/, $line;
+    if($type eq 'RG') {
+      $rg_ref = $groups->{$fields[0]} ||= {};
+      next;
+    }
+    croak "Data before RG line in $shard\n" unless(defined $rg_ref);
+    if($type eq 'R') {
+      my ($rd, $length, $count, $dups, $gc, $umap, $divergent, $mapped_bases,
+          $proper, $mapped_pairs, $inter_chr_pairs) = @fields;
+      # keys are only created for reads seen, as _process_reads
+      next unless($count);
+      my $read = $rd + 1;
+      $rg_ref->{'length_'.$read} = $length;
+      $rg_ref->{'fqp_'.$read} = [];
+      $rg_ref->{'count_'.$read} = $count;
+      $rg_ref->{'gc_'.$read} = $gc;
+      $rg_ref->{'dup_'.$read} = $dups if($dups);
+      $rg_ref->{'unmap_'.$read} = $umap if($umap);
+      $rg_ref->{'total_divergent_bases_'.$read} = $divergent if($divergent);
+      $rg_ref->{'total_mapped_bases_'.$read} = $mapped_bases if($count > $umap);
+      if($read == 1) {
+        $rg_ref->{'inserts'} = {};
+        $rg_ref->{'proper'} = $proper if($proper);
+        $rg_ref->{'mapped_pairs'} = $mapped_pairs if($mapped_pairs);
+        $rg_ref->{'inter_chr_pairs'} = $inter_chr_pairs if($inter_chr_pairs);
+      }
+    }
+    elsif($type eq 'I') {
+      $rg_ref->{'inserts'}->{$fields[0]} = $fields[1];
+    }
+    else {
+      croak "Unrecognised line in $shard: $line\n";
+    }
+  }
+  close $SHARD;
+  return $groups;
+}
+
 sub _process_reads {
   my ($groups, $sam, $qualiy_scoring, $mod, $rem) = @_;
   my $bam = $sam->hts_file;
@@ -972,6 +1052,21 @@ PCAP::Bam::Stats - Generate mapping and read statistics for a BAM.
 
 Initialise the object.
 
+Reads are processed by the C C<bam_stats> engine (via a stats shard, see C<load_shard>) when it is
+found in the path, otherwise, or when quality plots (C<-qscoring>) are requested, the perl implementation
+is used.  C<-engine =E<gt> 'perl'> forces the perl implementation.
+
+C<-mod>/C<-rem> select part C<rem> of C<mod> disjoint parts of the input, combine the workers through
+C<merge_json_stats>.  With the C engine each part is a contiguous set of references read via the index
+(C<bam_stats -P>) so every record is decoded once.  The perl implementation, or an input without an index,
+falls back to reading every record and keeping those where C<count % mod == rem>.
+
+=item load_shard
+
+ PCAP::Bam::Stats::load_shard($groups, $shard_file);
+
+Adds the content of a C<bam_stats -S> shard to the C<_groups> structure.
+
 =item bas
 
   $stats->bas($fh);
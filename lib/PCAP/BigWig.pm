@@ -28,9 +28,15 @@ use autodie qw(:all);
 use English qw( -no_match_vars );
 use warnings FATAL => 'all';
 use File::Spec;
+use Try::Tiny;
 
 use PCAP::Threaded;
 
+# xam_bigwig does the per-contig work in one process, no bamToBw step is needed
+sub native {
+  return try { _which('xam_bigwig') };
+}
+
 sub bamToBw {
   my ($index, $options) = @_;
 
@@ -38,6 +44,7 @@ sub bamToBw {
 
   return if(exists $options->{'index'} && $index != $options->{'index'});
   return if PCAP::Threaded::success_exists(File::Spec->catdir($tmp, 'progress'), $index);
+  return if(native());
 
   my $filter = 3844; # see https://broadinstitute.github.io/picard/explain-flags.html
   $filter = $options->{'filter'} if(exists $options->{'filter'});
@@ -72,10 +79,24 @@ sub generateBw {
 
   my $outfile = File::Spec->catfile($options->{'outdir'}, $options->{'sample'}.'.bw');
 
-  my $command = sprintf '%s -p %s -f %s -o %s', _which('bwjoin'),
-                                                $options->{'tmp'},
-                                                $options->{'reference'}.'.fai',
-                                                $outfile;
+  my $command;
+  if(my $xam_bigwig = native()) {
+    my $filter = 3844;
+    $filter = $options->{'filter'} if(exists $options->{'filter'});
+    $command = sprintf '%s -F %d -z -@ %d -i %s -r %s -o %s', $xam_bigwig,
+                                                             $filter,
+                                                             $options->{'threads'},
+                                                             $options->{'bam'},
+                                                             $options->{'reference'},
+                                                             $outfile;
+    $command .= q{ -a} if(exists $options->{'overlap'});
+  }
+  else {
+    $command = sprintf '%s -p %s -f %s -o %s', _which('bwjoin'),
+                                               $options->{'tmp'},
+                                               $options->{'reference'}.'.fai',
+                                               $outfile;
+  }
 
   PCAP::Threaded::external_process_handler(File::Spec->catdir($tmp, 'logs'), $command, 0);
 
@@ -94,9 +115,14 @@ Support module to generate BigWig coverage files from a BAM or CRAM file.
 
 =over 2
 
+=item native
+
+Returns the path to C<xam_bigwig> when installed, otherwise undef.
+
 =item bamToBw
 
 Generates BigWig files on a pre-chromosome basis to allow parallel (or short-recovery) processing.
+Does nothing when L</native> is available as C<generateBw> does all of the work.
 
 =item mergeBw
 
@@ -104,6 +130,10 @@ Merges the full set of BigWig files into an intermediate BedGraph file
 
 =item generateBw
 
-Converts merged BedGraph to a full BigWig file.
+Joins the per-chromosome BigWig files into the final BigWig file.  When L</native> is available the
+final file is instead written directly from the BAM/CRAM by C<xam_bigwig>: contigs are processed in
+parallel (C<threads>) with a shared decode pool and streamed into a single BigWig writer, including
+zoom levels, so there is no per-contig process or join pass.  Reads matching C<filter> (3844) are
+ignored and C<overlap> counts bases covered by both reads of a pair once.
 
 =back
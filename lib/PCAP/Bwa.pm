@@ -43,14 +43,22 @@ const my $TAG_STRIP => q{-x AM -x MD -x NM -x RT -x SM -x X0 -x X1 -x XA -x XG -
 
 const my $FALSE_RG => q{@RG\tID:%s\tSM:%s\tLB:default\tPL:ILLUMINA};
 
-const my $READPAIR_SPLITSIZE => 10,
-const my $PAIRED_FQ_LINE_MULT => 4;
-const my $INTERLEAVED_FQ_LINE_MULT => 8;
+const my $READPAIR_SPLITSIZE => 10;
 const my $BAM_MULT => 2;
 const my $MILLION => 1_000_000;
 
 const my $BWA_MEM_MAX_CORES => 6;
 
+# resource estimates (MB) for job packing, refined at runtime from measured peak RSS
+const my $SORT_MEM_PER_THREAD => 2048; # matches 'samtools sort -m 2G'
+const my $MAP_OVERHEAD_MEM => 1024;
+const my $SPLIT_MEM => 1024;
+const my @BWA_INDEX_EXT => qw(amb ann bwt pac sa);
+const my @BWA_MEM2_INDEX_EXT => qw(0123 amb ann bwt.2bit.64 pac);
+
+# htslib REF_PATH/REF_CACHE layout of a ref_cache_build directory
+const my $REF_CACHE_LAYOUT => '%2s/%2s/%s';
+
 sub bwa_mem_max_cores {
   return $BWA_MEM_MAX_CORES;
 }
@@ -91,6 +99,32 @@ sub mem_setup {
       copy("$options->{reference}.fai", "$options->{tmp}/decomp.fa.fai") unless(-e "$options->{decomp_ref}.fai");
     }
   }
+  ref_cache_setup($options);
+  return 1;
+}
+
+sub ref_cache_setup {
+  my $options = shift;
+  my $builder = _which('ref_cache_build') || return 0;
+  my $cache = File::Spec->catdir($options->{'tmp'}, 'ref_cache');
+  # the dict is written last, so it marks a complete cache
+  unless(-e "$cache.dict") {
+    my $ref = exists $options->{'decomp_ref'} ? $options->{'decomp_ref'} : $options->{'reference'};
+    system([0], $builder, '-i', $ref, '-o', $cache, '-D', "$cache.dict");
+  }
+  return ref_cache_env($options);
+}
+
+sub ref_cache_env {
+  my $options = shift;
+  my $cache = File::Spec->catdir($options->{'tmp'}, 'ref_cache');
+  return 0 unless(-e "$cache.dict");
+  my $layout = File::Spec->rel2abs($cache).'/'.$REF_CACHE_LAYOUT;
+  my $ref_path = defined $ENV{'REF_PATH'} ? $ENV{'REF_PATH'} : q{};
+  if(index($ref_path, $layout) < 0) {
+    $ENV{'REF_PATH'} = length $ref_path ? "$layout:$ref_path" : $layout;
+  }
+  $ENV{'REF_CACHE'} = $layout unless(defined $ENV{'REF_CACHE'});
   return 1;
 }
 
@@ -149,6 +183,23 @@ sub mem_mapmax {
   return (scalar @files);
 }
 
+sub split_in_cost {
+  my ($index, $options) = @_;
+  my $input = $options->{'meta_set'}->[$index - 1];
+  my $size = 0;
+  if($input->fastq) {
+    my @files = ($input->in.'.'.$input->fastq);
+    if($input->paired_fq) {
+      @files = map { $input->in.($input->illumina_fq ? "_R${_}_001." : "_$_.").$input->fastq } (1,2);
+    }
+    $size += -s $_ || 0 for(@files);
+  }
+  else {
+    $size = -s $input->in || 0;
+  }
+  return $size;
+}
+
 sub split_in {
   my ($index, $options) = @_;
   return 1 if(exists $options->{'index'} && $index != $options->{'index'});
@@ -174,36 +225,32 @@ sub split_in {
     my @commands;
     # if fastq input
     if($input->fastq) {
+      # plain and bgzip fastq are only indexed (virtual split), bwa_mem streams each slice with fastq_slice
+      my $fq_split = sprintf '%s -x -@ %d -n %s -o %s'
+                            , _which('fastq_split') || die "Unable to find 'fastq_split' in path"
+                            , $options->{threads_per_split}
+                            , $fragment_size * $MILLION
+                            , $split_folder;
       # paired fq input
       if($input->paired_fq) {
         my $fq1 = $input->in.($input->illumina_fq ? '_R1_001.' : '_1.').$input->fastq;
         my $fq2 = $input->in.($input->illumina_fq ? '_R2_001.' : '_2.').$input->fastq;
-        if($input->fastq =~ m/[.]gz$/ || $fragment_size > 5000) {
+        if($fragment_size > 5000) {
           symlink $fq1, File::Spec->catfile($split_folder, 'pairedfq1.0.'.$input->fastq);
           symlink $fq2, File::Spec->catfile($split_folder, 'pairedfq2.0.'.$input->fastq);
         }
         else {
-          push @commands,  sprintf 'split -a 3 -d -l %s %s %s.'
-                                  , $fragment_size * $MILLION * $PAIRED_FQ_LINE_MULT
-                                  , $fq1
-                                  , File::Spec->catfile($split_folder, 'pairedfq1');
-          push @commands,  sprintf 'split -a 3 -d -l %s %s %s.'
-                                  , $fragment_size * $MILLION * $PAIRED_FQ_LINE_MULT
-                                  , $fq2
-                                  , File::Spec->catfile($split_folder, 'pairedfq2');
+          push @commands, sprintf '%s -1 %s -2 %s', $fq_split, $fq1, $fq2;
         }
       }
       # interleaved FQ
       else {
         my $fq_i = $input->in.'.'.$input->fastq;
-        if($input->fastq =~ m/[.]gz$/ || $fragment_size > 5000) {
+        if($fragment_size > 5000) {
           symlink $fq_i, File::Spec->catfile($split_folder, 'i.'.$input->fastq);
         }
         else {
-          push @commands,  sprintf 'split -a 3 -d -l %s %s %s.'
-                                  , $fragment_size * $MILLION * $INTERLEAVED_FQ_LINE_MULT
-                                  , $fq_i
-                                  , File::Spec->catfile($split_folder, 'i');
+          push @commands, sprintf '%s -i %s', $fq_split, $fq_i;
         }
       }
     }
@@ -227,10 +274,17 @@ sub split_in {
         my $split = sprintf '%s split --output-fmt bam,level=1 -@ %d -u %s/unknown.bam -f %s/%%!_i.bam -', $samtools, $helpers, $split_folder, $split_folder;
         $collate_split = sprintf '%s | %s', $collate, $split;
       }
-      my $cmd = sprintf '%s | %s | %s', $mmQcStrip, $view, $collate_split;
+      my $reads = sprintf '%s | %s', $mmQcStrip, $view;
       # treat as interleaved fastq
       push @commands, 'set -o pipefail';
-      push @commands, $cmd;
+      if(exists $options->{legacy}) {
+        push @commands, sprintf '%s | %s', $reads, $collate_split;
+      }
+      else {
+        my $xam_split = sprintf '%s -@ %d -n %s -o %s', _which('xam_split') || die "Unable to find 'xam_split' in path",
+                                $helpers, $fragment_size * $MILLION, $split_folder;
+        push @commands, _xam_split_or_collate($reads, $xam_split, $collate_split, $split_folder);
+      }
       push @commands, "rm -rf $collate_folder"; # cleanup temp folder
     }
 
@@ -240,6 +294,47 @@ sub split_in {
   return 1;
 }
 
+sub _xam_split_or_collate {
+  my ($reads, $xam_split, $collate_split, $split_folder) = @_;
+  # pair adjacent input can be split directly, xam_split exits 3 when collation is required
+  return (sprintf('%s | %s || XAM_SPLIT_RC=$?', $reads, $xam_split),
+          sprintf('if [ "${XAM_SPLIT_RC:-0}" -eq 3 ]; then rm -f %s/*.bam; %s | %s; elif [ "${XAM_SPLIT_RC:-0}" -ne 0 ]; then exit $XAM_SPLIT_RC; fi',
+                  $split_folder, $reads, $collate_split));
+}
+
+sub split_in_resources {
+  my $options = shift;
+  return ($options->{'threads_per_split'} || 1, $SPLIT_MEM);
+}
+
+sub bwa_mem_resources {
+  my $options = shift;
+  my $threads = $options->{'map_threads'};
+  $threads = $options->{'threads'} if($options->{'threads'} < $options->{'map_threads'});
+  my $index_mb = 0;
+  for my $ext(exists $options->{'bwamem2'} ? @BWA_MEM2_INDEX_EXT : @BWA_INDEX_EXT) {
+    my $size = -s $options->{'reference'}.'.'.$ext;
+    $index_mb += $size / $MILLION if($size);
+  }
+  my $mem = int ($index_mb + ($SORT_MEM_PER_THREAD * $threads) + $MAP_OVERHEAD_MEM);
+  return ($threads, $mem);
+}
+
+sub bwa_mem_cost {
+  my ($index, $options) = @_;
+  my $split = $options->{'to_map'}->[$index - 1];
+  # cost is the bytes of input the job reads, so virtual and physical splits order together
+  if($split =~ m/[.]fqs$/) {
+    # virtual split, span of the slice in the original file
+    open my $FQS, '<', $split;
+    my (undef, undef, undef, $bytes) = split /\t/, <$FQS>;
+    close $FQS;
+    chomp $bytes;
+    return $bytes;
+  }
+  return -s $split || 0;
+}
+
 sub bwa_mem {
   my ($index, $options) = @_;
   return 1 if(exists $options->{'index'} && $index != $options->{'index'});
@@ -270,7 +365,7 @@ sub bwa_mem {
       $rg_line = q{'}.$input->rg_header(q{\t}).q{'};
     }
     else {
-      my ($rg) = $split =~ m{/split/[[:digit:]]+/(.+)_i\.(?:fq_[[:digit:]]+\.)?(?:gz|bam)$};
+      my ($rg) = $split =~ m{/split/[[:digit:]]+/(.+)_i\.(?:fq_[[:digit:]]+\.|[[:digit:]]+\.)?(?:gz|bam)$};
       ($rg_line, undef) = PCAP::Bam::rg_line_for_output($input->in, $options->{'sample'}, undef, $rg);
       if($rg_line) {
         $rg_line =~ s/('+)/'"$1"'/g;
@@ -300,7 +395,7 @@ sub bwa_mem {
     $ENV{SHELL} = '/bin/bash'; # ensure bash to allow pipefail
 
     my %tools;
-    for my $tool(qw(samtools reheadSQ bwa-postalt)) {
+    for my $tool(qw(samtools reheadSQ bwa-postalt fastq_slice xam_fanout)) {
       $tools{$tool} = _which($tool) || die "Unable to find '$tool' in path";
     }
 
@@ -318,11 +413,16 @@ sub bwa_mem {
     # uncoverable branch false
     $split =~ s/'/\\'/g;
     if($input->fastq) {
-      $bwa .= ' '.$split;
+      my @ends = ($split);
       if($input->paired_fq) {
         my $split2 = $split;
         $split2 =~ s/pairedfq1(\.[[:digit:]]+)/pairedfq2$1/;
-        $bwa .= ' '.$split2;
+        push @ends, $split2;
+      }
+      for my $end(@ends) {
+        # virtual split, stream the slice from the original file
+        $end = sprintf '<(%s -i %s)', $tools{fastq_slice}, $end if($end =~ m/[.]fqs$/);
+        $bwa .= ' '.$end;
       }
     }
     else {
@@ -358,8 +458,9 @@ sub bwa_mem {
                             $tools{samtools}, $threads;
     my $sort      = sprintf q{%s sort -m 2G --output-fmt bam,level=0 -T %s -@ %d -},
                             $tools{samtools}, $sort_tmp, $threads;
-    my $calmd     = sprintf q{%s calmd --output-fmt bam,level=1 -Q -@ %d - %s > %s_sorted.bam},
-                            $tools{samtools}, $threads, $ref, $sorted_bam_stub;
+    # stats shard is collected here, in parallel, so the final merge only has to count duplicates
+    my $calmd     = sprintf q{%s calmd --output-fmt bam,level=0 -Q -@ %d - %s | %s -O bam,level=1 -@ %d -s %s_sorted.stats -o %s_sorted.bam},
+                            $tools{samtools}, $threads, $ref, $tools{xam_fanout}, $threads, $sorted_bam_stub, $sorted_bam_stub;
     my $bwakit = q{};
     if(exists $options->{'bwakit'} && defined $options->{'bwakit'}) {
       # must be before fixmate as thats where we convert to BAM
@@ -478,6 +579,29 @@ PCAP::Bwa - Generate BWA mappings
 
 Not a prefect representation of version as any text has to be removed to allow comparison.
 
+=item mem_setup
+
+  PCAP::Bwa::mem_setup($options);
+
+Decompresses a gzipped reference to tmp when no uncompressed copy sits next to it, then runs
+ref_cache_setup.
+
+=item ref_cache_setup
+
+  PCAP::Bwa::ref_cache_setup($options);
+
+When ref_cache_build is installed, lays out the reference once in tmp/ref_cache (uppercase
+sequences keyed by M5, the htslib REF_CACHE layout) and calls ref_cache_env. Every CRAM
+reader and writer of the run then maps the same copy through the page cache. Returns 0 when
+ref_cache_build is not available.
+
+=item ref_cache_env
+
+  PCAP::Bwa::ref_cache_env($options);
+
+Puts tmp/ref_cache first in REF_PATH, and sets REF_CACHE when it is unset, so child processes
+find reference sequence by M5 in the cache. Returns 0 when no complete cache exists.
+
 =item bwa_aln
 
   PCAP::Bwa::bwa_aln($options);
@@ -502,6 +626,35 @@ See L<PCAP::Bwa::Meta::files_to_meta|PCAP::Bwa::Meta/files_to_meta>.
     -reference  : Path to reference fa[.gz]
     -threads    : Total threads available to process
 
+  Each split produces *_sorted.bam and a bam_stats shard *_sorted.stats, the shards are summed
+  to generate the final .bas so that the merge step only needs to count duplicates.
+
+=item split_in_cost
+
+  PCAP::Bwa::split_in_cost($index, $options);
+
+Relative cost of splitting the specified element of the meta_set, the size of its input file(s).
+Used by PCAP::Threaded to start the largest inputs first.
+
+=item bwa_mem_cost
+
+  PCAP::Bwa::bwa_mem_cost($index, $options);
+
+Relative cost of mapping the specified element of 'to_map', the bytes of input it reads: the span
+of the slice in the original file for virtual splits, otherwise file size.
+
+=item split_in_resources
+
+  my ($cpus, $mem_mb) = PCAP::Bwa::split_in_resources($options);
+
+CPUs and memory (MB) for a single split job, for L<PCAP::Threaded::set_resources|PCAP::Threaded/set_resources>.
+
+=item bwa_mem_resources
+
+  my ($cpus, $mem_mb) = PCAP::Bwa::bwa_mem_resources($options);
+
+CPUs and memory (MB) for a single mapping job, index size plus sort buffers ('-m 2G' per thread).
+
 =item sampe
 
   Pan::Cancer::Bwa::sampe($index, $options)
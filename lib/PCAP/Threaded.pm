@@ -35,11 +35,28 @@ use Capture::Tiny qw(capture);
 use Const::Fast qw(const);
 use Scalar::Util qw(looks_like_number);
 use Time::HiRes qw(usleep);
+use POSIX qw(WNOHANG);
+use JSON;
 
-our $CAN_USE_THREADS = eval 'use threads; 1' || 0;
+our $CAN_USE_THREADS = eval 'use threads; use threads::shared; 1' || 0;
 
 our $OUT_ERR = 1;
 
+# wall, user, sys, max RSS (KB), fs inputs, fs outputs (512 byte blocks), exit status
+const my $TIME_FORMAT => join "\t", qw(%e %U %S %M %I %O %x);
+const my $FS_BLOCK => 512;
+const my @TELEMETRY_COLS => qw(step index start wall_s user_s sys_s max_rss_kb read_bytes write_bytes exit);
+const my $TELEMETRY_STUB => 'telemetry';
+# process tree RSS sampling, interval doubles from MIN to MAX so long jobs cost little to watch
+const my $RSS_POLL_MIN_S => 0.05;
+const my $RSS_POLL_MAX_S => 1;
+
+# set within each job so external_process_handler can attribute measured peak memory
+our $CURRENT_FUNCTION;
+# function_name => largest peak RSS (KB) seen for a single job, summed over its concurrent processes
+our %PEAK_RSS_KB;
+&threads::shared::share(\%PEAK_RSS_KB) if($CAN_USE_THREADS);
+
 sub new {
   my ($class, $max_threads) = @_;
   croak "Number of threads was NAN: $max_threads" if(defined $max_threads && !looks_like_number($max_threads));
@@ -53,7 +70,9 @@ sub new {
   }
 
   my $self = {'threads' => $max_threads,
-              'join_interval' => 1,};
+              'join_interval' => 1,
+              'start_interval' => 0,
+              'max_memory' => 0,};
   bless $self, $class;
 
   return $self;
@@ -74,18 +93,51 @@ sub use_out_err {
 }
 
 sub add_function {
-  my ($self, $function_name, $function_ref, $divisor) = @_;
+  my ($self, $function_name, $function_ref, $divisor, $cost_ref) = @_;
   croak "Function $function_name has already been defined.\n" if(exists $self->{'functions'}->{$function_name}->{'code'});
   my $ref_type = ref $function_ref;
   $ref_type ||= 'not a reference';
   croak "Second argument to add_function should be a code reference, I got '$ref_type'.\n" unless('CODE' eq ref $function_ref);
 
+  if(defined $cost_ref) {
+    croak "Fourth argument to add_function should be a code reference.\n" unless('CODE' eq ref $cost_ref);
+    $self->{'functions'}->{$function_name}->{'cost'} = $cost_ref;
+  }
+
   $self->{'functions'}->{$function_name}->{'code'} = $function_ref;
   $self->{'functions'}->{$function_name}->{'threads'} = $self->_suitable_threads($divisor);
 
   return 1;
 }
 
+sub set_resources {
+  my ($self, $function_name, $cpus, $mem_mb) = @_;
+  croak "Unable to find '$function_name', please check your declaration of add_function()\n."
+    unless(exists $self->{'functions'}->{$function_name}->{'code'});
+  croak "CPUs per job must be a positive integer: $cpus\n" if(!defined $cpus || $cpus !~ m/^[[:digit:]]+$/ || $cpus == 0);
+  $mem_mb ||= 0;
+  croak "Memory per job must be a positive integer (MB): $mem_mb\n" if($mem_mb !~ m/^[[:digit:]]+$/);
+  $self->{'functions'}->{$function_name}->{'threads'} = $self->_suitable_threads($cpus);
+  $self->{'functions'}->{$function_name}->{'mem'} = $mem_mb;
+  return 1;
+}
+
+sub max_memory {
+  my ($self, $mem_mb) = @_;
+  if(defined $mem_mb) {
+    croak 'max_memory must be an integer (MB)' if($mem_mb !~ m/^[[:digit:]]+$/);
+    $self->{'max_memory'} = $mem_mb;
+  }
+  $self->{'max_memory'};
+}
+
+sub peak_memory {
+  my ($self, $function_name) = @_;
+  my $kb = $PEAK_RSS_KB{$function_name};
+  return 0 unless(defined $kb);
+  return int(($kb + 1023) / 1024);
+}
+
 sub thread_join_interval {
   my ($self, $sec) = @_;
   if(defined $sec) {
@@ -96,6 +148,16 @@ sub thread_join_interval {
   $self->{'join_interval'};
 }
 
+sub thread_start_interval {
+  my ($self, $sec) = @_;
+  if(defined $sec) {
+    croak 'start_interval must be a number' unless(looks_like_number($sec));
+    croak 'start_interval must be 0 or more' if($sec < 0);
+    $self->{'start_interval'} = $sec;
+  }
+  $self->{'start_interval'};
+}
+
 sub run {
   my ($self, $iterations, $function_name, @params) = @_;
   croak 'Iterations must be defined' unless(defined $iterations);
@@ -104,49 +166,284 @@ sub run {
   croak "Unable to find '$function_name', please check your declaration of add_function()\n."
     unless(exists $self->{'functions'}->{$function_name}->{'code'});
 
-  my $function_ref = $self->{'functions'}->{$function_name}->{'code'};
+  my $code_ref = $self->{'functions'}->{$function_name}->{'code'};
+  my $function_ref = sub {
+    local $CURRENT_FUNCTION = $function_name;
+    return $code_ref->(@_);
+  };
   my $thread_count = $self->{'functions'}->{$function_name}->{'threads'};
-
-  my $start_interval = 6; # initial scaling
-  if($self->{'threads'} >= 8) {
-    # when core count is higher spread the scaling up over 2 minutes
-    $start_interval = int 120 / $self->{'threads'};
-    $start_interval = 6 if($start_interval < 6);
-  }
+  my @order = $self->_job_order($function_name, $iterations, @params);
 
   # uncoverable branch true
   if($thread_count > 1 && $CAN_USE_THREADS) {
     # reserve 0 for when people want to use 'success_exists/touch_success' for non-threaded steps
     # makes it easy to see in progress area which steps are threaded
-    my $index = 1;
-    while($index <= $iterations) {
-      while(threads->list(threads::all()) < $thread_count && $index <= $iterations) {
-        threads->create($function_ref, $index++, @params);
-        last if($index > $iterations);
-        usleep($start_interval * 1_000_000);
+    my $done = 0;
+    my $failed = 0;
+    &threads::shared::share(\$done);
+    &threads::shared::share(\$failed);
+    # each worker signals on exit so the next job is dispatched immediately rather than on a poll
+    my $worker = sub {
+      my $ok = eval { $function_ref->(@_); 1 };
+      my $err = $EVAL_ERROR;
+      {
+        lock($done);
+        $done++;
+        $failed++ unless($ok);
+        &threads::shared::cond_signal(\$done);
       }
-      $start_interval = 0.1; # once the initial scale up is complete start interval can be tiny.
-      sleep $self->thread_join_interval while(threads->list(threads::joinable()) == 0);
-      for my $thr(threads->list(threads::joinable())) {
-        $thr->join;
-        if(my $err = $thr->error) { die "Thread error: $err\n"; }
+      die $err unless($ok);
+      return;
+    };
+
+    my $started = 0;
+    my $error;
+    my $start_interval = $self->thread_start_interval;
+    while(@order && $failed == 0) {
+      # memory estimate is refined as jobs complete, so re-evaluate each time round
+      my $slots = $self->_job_slots($function_name, $thread_count);
+      while($started - $done < $slots && @order) {
+        threads->create($worker, shift @order, @params);
+        $started++;
+        usleep($start_interval * 1_000_000) if($start_interval && @order);
       }
+      $start_interval = 0; # only applied to the initial scale up
+      $self->_wait_for_exit(\$done, $started, $slots) if(@order);
+      $error = _join_threads(threads::joinable());
+      last if($error);
     }
-    # last gasp for any remaining threads
-    sleep $self->thread_join_interval while(threads->list(threads::running()) > 0);
-    for my $thr(threads->list(threads::joinable())) {
-      $thr->join;
-      if(my $err = $thr->error) { die "Thread error: $err\n"; }
-    }
+    # last gasp for any remaining threads, allow all to finish before reporting errors
+    my $last_error = _join_threads();
+    $error ||= $last_error;
+    die "Thread error: $error\n" if($error);
   }
   else {
-    for my $index(1..$iterations) {
+    for my $index(@order) {
       &{$function_ref}($index, @params);
     }
   }
   return 1;
 }
 
+sub _job_order {
+  my ($self, $function_name, $iterations, @params) = @_;
+  my @order = (1..$iterations);
+  my $cost_ref = $self->{'functions'}->{$function_name}->{'cost'};
+  if(defined $cost_ref) {
+    # longest first, sort is stable so equal cost retains index order
+    my %cost = map { $_ => $cost_ref->($_, @params) } @order;
+    @order = sort { $cost{$b} <=> $cost{$a} } @order;
+  }
+  return @order;
+}
+
+sub _job_slots {
+  my ($self, $function_name, $thread_count) = @_;
+  my $budget = $self->max_memory;
+  my $mem = $self->{'functions'}->{$function_name}->{'mem'} || 0;
+  my $peak = $self->peak_memory($function_name);
+  $mem = $peak if($peak > $mem);
+  return $thread_count if($budget == 0 || $mem == 0);
+  my $slots = int ($budget / $mem);
+  $slots = $thread_count if($slots > $thread_count);
+  $slots = 1 if($slots < 1); # always allow progress, even if over budget
+  return $slots;
+}
+
+sub _record_peak_rss {
+  my $kb = shift;
+  return 0 unless(defined $CURRENT_FUNCTION && $kb);
+  lock(%PEAK_RSS_KB) if($CAN_USE_THREADS);
+  $PEAK_RSS_KB{$CURRENT_FUNCTION} = $kb if(!exists $PEAK_RSS_KB{$CURRENT_FUNCTION} || $PEAK_RSS_KB{$CURRENT_FUNCTION} < $kb);
+  return $kb;
+}
+
+sub _tree_rss_kb {
+  my $root = shift;
+  return 0 unless(-d '/proc');
+  no autodie;
+  my $page_kb = POSIX::sysconf(POSIX::_SC_PAGESIZE()) / 1024;
+  # kernels without CONFIG_PROC_CHILDREN have no children files, find the tree from every ppid instead
+  my $children = -e "/proc/$$/task/$$/children" ? undef : _proc_children();
+  my ($kb, @queue) = (0, $root);
+  while(defined (my $pid = shift @queue)) {
+    # processes may exit while the tree is walked
+    open my $STAT, '<', "/proc/$pid/stat" or next;
+    my $stat = <$STAT>;
+    close $STAT;
+    next unless(defined $stat);
+    # comm may hold spaces, fields after it are fixed
+    my @fields = split / /, substr $stat, rindex($stat, ')') + 2;
+    $kb += $fields[21] * $page_kb;
+    if(defined $children) {
+      push @queue, @{$children->{$pid}} if(exists $children->{$pid});
+      next;
+    }
+    opendir my $TASKS, "/proc/$pid/task" or next;
+    for my $tid(grep { m/^[[:digit:]]+$/ } readdir $TASKS) {
+      open my $CHILDREN, '<', "/proc/$pid/task/$tid/children" or next;
+      my $list = <$CHILDREN>;
+      close $CHILDREN;
+      push @queue, split / /, $list if(defined $list);
+    }
+    closedir $TASKS;
+  }
+  return int $kb;
+}
+
+sub _proc_children {
+  no autodie;
+  my %children;
+  opendir my $PROC, '/proc' or return \%children;
+  for my $pid(grep { m/^[[:digit:]]+$/ } readdir $PROC) {
+    open my $STAT, '<', "/proc/$pid/stat" or next;
+    my $stat = <$STAT>;
+    close $STAT;
+    next unless(defined $stat);
+    my @fields = split / /, substr $stat, rindex($stat, ')') + 2;
+    push @{$children{$fields[1]}}, $pid;
+  }
+  closedir $PROC;
+  return \%children;
+}
+
+sub _rss_sampler {
+  my ($pid, $PEAK) = @_;
+  my ($peak_kb, $interval, $stop) = (0, $RSS_POLL_MIN_S, 0);
+  local $SIG{'TERM'} = sub { $stop = 1; };
+  until($stop) {
+    my $kb = _tree_rss_kb($pid);
+    $peak_kb = $kb if($kb > $peak_kb);
+    # TERM cuts the sleep short
+    Time::HiRes::sleep($interval) unless($stop);
+    $interval *= 2 if($interval < $RSS_POLL_MAX_S);
+  }
+  print $PEAK "$peak_kb\n";
+  close $PEAK;
+  POSIX::_exit(0);
+}
+
+sub _sampled_system {
+  my $command = shift;
+  my $pid = fork;
+  if($pid == 0) {
+    no autodie;
+    exec('bash', '-c', $command) or POSIX::_exit(127);
+  }
+  # sampling runs in its own process so the blocking wait sees the exit as soon as it happens
+  pipe my $PEAK_R, my $PEAK_W;
+  my $sampler = fork;
+  if($sampler == 0) {
+    close $PEAK_R;
+    _rss_sampler($pid, $PEAK_W);
+  }
+  close $PEAK_W;
+  waitpid $pid, 0;
+  my $status = $CHILD_ERROR;
+  kill 'TERM', $sampler;
+  my $peak_kb = <$PEAK_R>;
+  close $PEAK_R;
+  waitpid $sampler, 0;
+  die sprintf "Command \"%s\" unexpectedly returned exit value %d\n", $command, $status >> 8 if($status);
+  return defined $peak_kb ? $peak_kb + 0 : 0;
+}
+
+sub _record_telemetry {
+  my ($time_file, $step, $index, $start, $tree_kb) = @_;
+  return unless(-e $time_file);
+  my $last;
+  open my $TIME, '<', $time_file;
+  while(my $line = <$TIME>) {
+    # on failure GNU time writes a 'Command exited...' line before the format
+    $last = $line if($line =~ m/\t/);
+  }
+  close $TIME;
+  return unless(defined $last);
+  chomp $last;
+  my ($wall, $user, $sys, $rss, $fs_in, $fs_out, $exit) = split /\t/, $last;
+  # time reports the largest single process, sampling sums the processes of a pipeline
+  $rss = $tree_kb if(defined $tree_kb && $tree_kb > $rss);
+  my @record = ($step, $index, sprintf('%.3f', $start), $wall, $user, $sys, $rss,
+                $fs_in * $FS_BLOCK, $fs_out * $FS_BLOCK, $exit);
+  open $TIME, '>', $time_file;
+  print $TIME join("\t", @record),"\n";
+  close $TIME;
+  _record_peak_rss($rss);
+  return \@record;
+}
+
+sub write_telemetry {
+  my $logdir = shift;
+  my @records;
+  for my $time_file(glob File::Spec->catfile($logdir, '*.time')) {
+    open my $TIME, '<', $time_file;
+    my $line = <$TIME>;
+    close $TIME;
+    next unless(defined $line);
+    chomp $line;
+    my @fields = split /\t/, $line;
+    next unless(scalar @fields == scalar @TELEMETRY_COLS);
+    push @records, \@fields;
+  }
+  @records = sort { $a->[2] <=> $b->[2] || $a->[0] cmp $b->[0] || $a->[1] cmp $b->[1] } @records;
+
+  my $tsv = File::Spec->catfile($logdir, $TELEMETRY_STUB.'.tsv');
+  open my $TSV, '>', $tsv;
+  print $TSV join("\t", @TELEMETRY_COLS),"\n";
+  print $TSV join("\t", @{$_}),"\n" for(@records);
+  close $TSV;
+
+  # per step summary, cpu vs wall shows where scaling will help
+  my (@jobs, %steps);
+  for my $rec(@records) {
+    my %job;
+    @job{@TELEMETRY_COLS} = @{$rec};
+    $job{$_} += 0 for(grep { $_ ne 'step' && $_ ne 'index' } @TELEMETRY_COLS);
+    push @jobs, \%job;
+    my $step = $steps{$job{'step'}} ||= {'jobs' => 0, 'wall_s' => 0, 'cpu_s' => 0, 'max_rss_kb' => 0,
+                                         'read_bytes' => 0, 'write_bytes' => 0, 'failed' => 0,
+                                         'first_start' => $job{'start'}, 'last_end' => 0};
+    $step->{'jobs'}++;
+    $step->{'failed'}++ if($job{'exit'});
+    $step->{'wall_s'} += $job{'wall_s'};
+    $step->{'cpu_s'} += $job{'user_s'} + $job{'sys_s'};
+    $step->{'read_bytes'} += $job{'read_bytes'};
+    $step->{'write_bytes'} += $job{'write_bytes'};
+    $step->{'max_rss_kb'} = $job{'max_rss_kb'} if($job{'max_rss_kb'} > $step->{'max_rss_kb'});
+    my $end = $job{'start'} + $job{'wall_s'};
+    $step->{'last_end'} = $end if($end > $step->{'last_end'});
+  }
+  for my $step(values %steps) {
+    $step->{'span_s'} = sprintf('%.3f', $step->{'last_end'} - $step->{'first_start'}) + 0;
+  }
+
+  my $json = File::Spec->catfile($logdir, $TELEMETRY_STUB.'.json');
+  open my $JSON, '>', $json;
+  print $JSON JSON->new->canonical->pretty->encode({'jobs' => \@jobs, 'steps' => \%steps});
+  close $JSON;
+  return scalar @records;
+}
+
+sub _wait_for_exit {
+  my ($self, $done, $started, $thread_count) = @_;
+  lock(${$done});
+  # timeout is only a safety net, workers signal on exit
+  while($started - ${$done} >= $thread_count) {
+    &threads::shared::cond_timedwait($done, time + $self->thread_join_interval);
+  }
+  return 1;
+}
+
+sub _join_threads {
+  my @state = @_; # empty for all threads
+  my $error;
+  for my $thr(threads->list(@state)) {
+    $thr->join;
+    if(my $err = $thr->error) { $error ||= $err; }
+  }
+  return $error;
+}
+
 sub _suitable_threads {
   my ($self, $divisor) = @_;
   my $suitable_threads = $self->{'threads'};
@@ -210,31 +507,38 @@ sub external_process_handler {
     @commands = ($command_in);
   }
 
+  my $caller = (caller(1))[3];
+  $caller =~ s/::/_/g;
+  my $suffix = join q{.}, @indexes;
+  my $time = File::Spec->catfile($tmp, "$caller.$suffix.time");
+  my $timed = sprintf q{/usr/bin/time -o %s -f '%s'}, $time, $TIME_FORMAT;
+
   if(&use_out_err == 0) {
     # these may be marshalled to different files so output both
     try {
       for my $c(@commands) {
         warn "\nErrors from command: $c\n\n";
         print "\nOutput from command: $c\n\n";
-        system("/usr/bin/time bash $c");
+        my $start = Time::HiRes::time();
+        my $tree_kb = _sampled_system("$timed bash $c");
+        _record_telemetry($time, $caller, $suffix, $start, $tree_kb);
       }
     }
     catch { die $_; };
   }
   else {
-    my $caller = (caller(1))[3];
-    $caller =~ s/::/_/g;
-    my $suffix = join q{.}, @indexes;
-
     my $script = _create_script(\@commands, File::Spec->catfile($tmp, "$caller.$suffix"));
 
     my $out = File::Spec->catfile($tmp, "$caller.$suffix.out");
     my $err = File::Spec->catfile($tmp, "$caller.$suffix.err");
 
+    my $start = Time::HiRes::time();
+    my $tree_kb;
     try {
-      system("/usr/bin/time bash $script 1> $out 2> $err");
+      $tree_kb = _sampled_system("$timed bash $script 1> $out 2> $err");
     }
     catch {
+      _record_telemetry($time, $caller, $suffix, $start);
       sleep 5; # give files time to close
       warn "\nTHREAD_EXITED: General output can be found in this file, last 10 lines below: $out\n";
       system(sprintf q(tail -n 10 %s | perl -ne 'print qq{STDOUT: $_};'), $out);
@@ -243,6 +547,7 @@ sub external_process_handler {
       die "\nTHREAD_EXITED: Wrapper script message:\n".$_;
     };
 
+    _record_telemetry($time, $caller, $suffix, $start, $tree_kb);
     unlink $script; # only leave scripts if we fail
     if($ENV{PCAP_THREADED_REM_LOGS}) {
       unlink $err;
@@ -310,11 +615,37 @@ Generate a threaded processing object with the defined number of threads.
 
 Register a named coderef to be run using threads.
 
-  $threads->add_function($function_name, $coderef [, $divisor]);
+  $threads->add_function($function_name, $coderef [, $divisor [, $cost_coderef]]);
 
   function_name - Text to address function by in L<run()|PCAP::Threaded/run>.
   coderef       - Reference to subroutine.
   divisor       - See L<_suitable_threads()|PCAP::Threaded/_suitable_threads>.
+  cost_coderef  - Optional, called as $cost_coderef->($index, @params) for each iteration
+                  before L<run()|PCAP::Threaded/run> starts, returns a relative size (e.g. input bytes).
+                  Iterations are started largest first, the index passed to coderef is unchanged.
+
+=item set_resources
+
+Declare the CPUs and memory (MB) each iteration of a function needs.
+
+  $threads->set_resources($function_name, $cpus, $mem_mb);
+
+CPUs replace any divisor given to L<add_function()|PCAP::Threaded/add_function>.  When
+L<max_memory()|PCAP::Threaded/max_memory> is set, concurrent iterations are limited so that
+their combined memory fits the budget.  The per-iteration estimate is the larger of C<$mem_mb> and
+the peak RSS measured for completed iterations of the same function (see
+L<external_process_handler|PCAP::Threaded/external_process_handler>).
+
+=item max_memory
+
+Set/get the memory budget (MB) for concurrent iterations of a function, 0 (default) is unlimited.
+
+=item peak_memory
+
+  my $mb = $threads->peak_memory($function_name);
+
+Largest peak RSS (MB) measured for a single iteration of the function, 0 if none.  An iteration's
+RSS is the sum over all of its processes that run at the same time (e.g. both sides of a pipe).
 
 =item run
 
@@ -331,6 +662,9 @@ callback registered in add_function.
   function_name - Name of function as defined in L<add_function()|PCAP::Threaded/add_function>.
   @params       - Any additional params for the coderef.
 
+Each thread signals the main process as it exits, so the next iteration is started as soon as a
+slot becomes free.
+
 =back
 
 =head2 Utility Methods
@@ -355,7 +689,13 @@ Enable redirect of stdout/stderr to files when calling external_process_handler.
 
 =item thread_join_interval
 
-Set/get the number of seconds to wait between thread joins.  Default 1.
+Set/get the maximum number of seconds to wait for a thread exit notification before checking
+for finished threads.  Default 1.
+
+=item thread_start_interval
+
+Set/get the number of seconds to wait between starting threads during the initial scale up.
+Default 0.
 
 =back
 
@@ -405,6 +745,29 @@ separated from the script itself.  Added to simplify interpretation of any issue
 
 If you don't want to capture stdout/stderr see <disable_out_err>.
 
+Resource usage of each command is captured by C</usr/bin/time> into C<logdir/CALLER.INDEX.time>
+as a single tab separated record (see L<write_telemetry|PCAP::Threaded/write_telemetry>).  While
+the command runs a separate sampler process polls the RSS of the command's own process tree (Linux
+C</proc>), so the recorded peak covers every process of a pipeline running at once rather than the
+largest one.  The handler blocks on the command itself, so completion is seen immediately.  When
+called within L<run()|PCAP::Threaded/run> the peak RSS is also recorded against the running
+function, refining the memory estimate used for later iterations.
+
+=item write_telemetry
+
+  PCAP::Threaded::write_telemetry($logdir);
+
+Aggregates the C<*.time> records in C<$logdir> into C<telemetry.tsv> (one job per row ordered
+by start) and C<telemetry.json> (jobs plus a per-step summary) in the same directory.  Returns the
+number of jobs.
+
+  step, index - caller and index as used for the log file names
+  start       - epoch seconds
+  wall_s, user_s, sys_s
+  max_rss_kb  - peak RSS of the job, summed over its concurrently running processes
+  read_bytes, write_bytes - file system I/O
+  exit        - exit status of the job
+
 ($index_2... may be useful for some other implementation, see L<bwa_aln()|PCAP::Bwa/bwa_aln>).
 
 =back
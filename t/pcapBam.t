@@ -23,6 +23,7 @@ use Test::More;
 use Test::Fatal;
 use Test::Warn;
 use File::Spec;
+use File::Temp qw(tempdir);
 use Try::Tiny qw(try catch finally);
 use Const::Fast qw(const);
 
@@ -151,4 +152,23 @@ subtest 'header_info checks' => sub {
       , 'Die when no sample found (and die flag set)');
 };
 
+subtest 'stats_shards checks' => sub {
+  my $dir = tempdir( CLEANUP => 1 );
+  my @bams = map { File::Spec->catfile($dir, $_.'_sorted.bam') } (1..2);
+  my @shards = map { File::Spec->catfile($dir, $_.'_sorted.stats') } (1..2);
+  for(@bams, $shards[0]) { open my $FH, '>', $_; close $FH; }
+  is_deeply([PCAP::Bam::stats_shards({}, @bams)], [], 'No shards unless all inputs have one');
+  open my $FH, '>', $shards[1]; close $FH;
+  is_deeply([PCAP::Bam::stats_shards({}, @bams)], \@shards, 'Shard per input');
+  is_deeply([PCAP::Bam::stats_shards({'mmqc' => 1}, @bams)], [], 'No shards with mmqc');
+  is_deeply([PCAP::Bam::stats_shards({'legacy' => undef}, @bams)], [], 'No shards with legacy');
+};
+
+subtest 'coverage_args checks' => sub {
+  is(PCAP::Bam::coverage_args({}, 'out.bam'), q{}, 'No coverage unless requested');
+  is(PCAP::Bam::coverage_args({'coverage' => q{}}, 'out.bam'), ' -C out.bam.coverage -H out.bam.depth', 'Whole genome coverage');
+  is(PCAP::Bam::coverage_args({'coverage' => 'tgt.bed'}, 'out.bam'), ' -C out.bam.coverage -H out.bam.depth -t tgt.bed', 'Targeted coverage');
+  is(PCAP::Bam::coverage_args({'coverage' => q{}, 'qnamesort' => 1}, 'out.bam'), q{}, 'No coverage for name sorted output');
+};
+
 done_testing();
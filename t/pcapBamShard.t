@@ -0,0 +1,81 @@
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 ICGC PanCancer Project
+# Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+use strict;
+use Test::More;
+use Test::Fatal;
+use Const::Fast qw(const);
+use File::Temp qw(tempdir);
+
+const my $MODULE => 'PCAP::Bam::Shard';
+
+subtest 'Initialisation checks' => sub {
+  use_ok($MODULE);
+};
+
+subtest 'contig_groups checks' => sub {
+  my $dir = tempdir( CLEANUP => 1 );
+  my $dict = "$dir/ref.dict";
+  open my $D, '>', $dict or die $!;
+  print $D "\@HD\tVN:1.0\tSO:unsorted\n";
+  printf $D "\@SQ\tSN:%s\tLN:%d\tM5:x\n", @{$_} for(['1', 100], ['2', 90], ['3', 60], ['4', 30], ['5', 10], ['6', 10]);
+  close $D;
+  like(exception{ PCAP::Bam::Shard::contig_groups($dict, 0) }
+      , qr/Number of shards must be a positive integer/
+      , 'Fail when shards == 0');
+  my $names = sub { [ map { join q{,}, map { $_->[0] } @{$_} } @{$_[0]} ] };
+  is_deeply($names->(PCAP::Bam::Shard::contig_groups($dict, 1)), ['1,2,3,4,5,6'], 'Single shard');
+  is_deeply($names->(PCAP::Bam::Shard::contig_groups($dict, 3)), ['1', '2,3', '4,5,6'], 'Contiguous balanced shards');
+  is_deeply($names->(PCAP::Bam::Shard::contig_groups($dict, 10)), ['1', '2', '3', '4', '5', '6'], 'No more shards than contigs');
+};
+
+subtest 'estimate_library_size checks' => sub {
+  is(PCAP::Bam::Shard::estimate_library_size(2000, 0, 0), 0, 'No duplicates, no estimate');
+  my $size = PCAP::Bam::Shard::estimate_library_size(2000, 200, 0);
+  # unique pairs = size * (1 - exp(-pairs/size))
+  my $unique = $size * (1 - exp(-1000 / $size));
+  ok(abs($unique - 900) < 1, 'Estimate satisfies library size equation');
+};
+
+subtest 'merge_metrics checks' => sub {
+  my $dir = tempdir( CLEANUP => 1 );
+  mkdir "$dir/shards" or die $!;
+  my $options = {'tmp' => $dir, 'shard_count' => 2};
+  for my $shard(1, 2) {
+    open my $MET, '>', "$dir/shards/shard_$shard.met" or die $!;
+    print $MET "COMMAND: samtools markdup\nPAIRED: 1000\nDUPLICATE PAIR: 100\nDUPLICATE NON PRIMARY: 2\n";
+    print $MET "DUPLICATE PRIMARY TOTAL: 100\nDUPLICATE TOTAL: 102\n";
+    close $MET;
+  }
+  open my $SYNC, '>', "$dir/shards/shard_2.sync" or die $!;
+  print $SYNC "DUPSYNC: 500 reads, 0 names collected, 7 reads flagged, 3 non primary\n";
+  close $SYNC;
+  ok(PCAP::Bam::Shard::merge_metrics($options, "$dir/out.met"), 'Metrics merged');
+  open my $MET, '<', "$dir/out.met" or die $!;
+  my %got = map { chomp; split /: /, $_, 2 } <$MET>;
+  close $MET;
+  is($got{'PAIRED'}, 2000, 'Shard counts summed');
+  is($got{'DUPLICATE PAIR'}, 204, 'Flagged primary reads are duplicate pairs');
+  is($got{'DUPLICATE PRIMARY TOTAL'}, 204, 'Flagged primary reads in primary total');
+  is($got{'DUPLICATE NON PRIMARY'}, 7, 'Flagged supplementary reads are non primary');
+  is($got{'DUPLICATE TOTAL'}, 211, 'All flagged reads in total');
+};
+
+done_testing();
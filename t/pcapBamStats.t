@@ -0,0 +1,88 @@
+##########LICENCE##########
+# PCAP - NGS reference implementations and helper code for the ICGC/TCGA Pan-Cancer Analysis Project
+# Copyright (C) 2014-2018 ICGC PanCancer Project
+# Copyright (C) 2018-2021 Cancer, Ageing and Somatic Mutation, Genome Research Limited
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not see:
+#   http://www.gnu.org/licenses/gpl-2.0.html
+##########LICENCE##########
+
+use strict;
+use Test::More;
+use Test::Fatal;
+use Const::Fast qw(const);
+use File::Temp qw(tempdir);
+
+const my $MODULE => 'PCAP::Bam::Stats';
+
+subtest 'Initialisation checks' => sub {
+  use_ok($MODULE);
+};
+
+subtest 'load_shard checks' => sub {
+  my $dir = tempdir( CLEANUP => 1 );
+  my $shard = "$dir/test.stats";
+  open my $S, '>', $shard or die $!;
+  print $S "#bam_stats_shard\t1\n";
+  print $S "RG\t1\tSAMPLE\tILLUMINA\t1_1\tLIB\n";
+  print $S join("\t", qw(R 0 100 10 2 400 1 30 900 8 9 1 0)), "\n";
+  print $S join("\t", qw(R 1 100 10 0 410 0 20 1000 0 0 0 0)), "\n";
+  print $S "I\t300\t5\n";
+  print $S "I\t310\t3\n";
+  print $S "RG\t2\tSAMPLE\tILLUMINA\t1_2\tLIB\n";
+  print $S join("\t", qw(R 0 0 0 0 0 0 0 0 0 0 0 0)), "\n";
+  print $S join("\t", qw(R 1 0 0 0 0 0 0 0 0 0 0 0)), "\n";
+  close $S;
+
+  my $groups = { '1' => { 'head' => "\@RG\tID:1" } };
+  PCAP::Bam::Stats::load_shard($groups, $shard);
+  is_deeply($groups->{'1'}, { 'head' => "\@RG\tID:1",
+                              'length_1' => 100, 'length_2' => 100,
+                              'fqp_1' => [], 'fqp_2' => [],
+                              'count_1' => 10, 'count_2' => 10,
+                              'gc_1' => 400, 'gc_2' => 410,
+                              'dup_1' => 2, 'unmap_1' => 1,
+                              'total_divergent_bases_1' => 30, 'total_divergent_bases_2' => 20,
+                              'total_mapped_bases_1' => 900, 'total_mapped_bases_2' => 1000,
+                              'proper' => 8, 'mapped_pairs' => 9, 'inter_chr_pairs' => 1,
+                              'inserts' => { 300 => 5, 310 => 3 } }
+            , 'Shard mapped to perl stats structure');
+  is_deeply($groups->{'2'}, {}, 'No keys for read group without reads');
+
+  open $S, '>', $shard or die $!;
+  print $S "R\t0\n";
+  close $S;
+  like(exception{ PCAP::Bam::Stats::load_shard({}, $shard) }
+      , qr/is not a bam_stats shard/
+      , 'Fail on non-shard file');
+};
+
+subtest 'engine parity checks' => sub {
+  my $bam_stats = eval { PCAP::_which('bam_stats') };
+  plan skip_all => 'bam_stats not found in path' unless(defined $bam_stats);
+  for my $bam(qw(t/data/Stats.bam t/data/Stats_mate_unmapped.bam)) {
+    my $perl = new_ok($MODULE => [-path => $bam, -engine => 'perl']);
+    # direct call, init falls back to perl if bam_stats fails
+    my $c = new_ok($MODULE => [-path => $bam, -no_proc => 1]);
+    PCAP::Bam::Stats::_process_reads_c($c->{_groups}, $bam, $bam_stats, 1, 0);
+    is_deeply([sort keys %{$c->{_groups}}], [sort keys %{$perl->{_groups}}], "$bam: read groups match");
+    for my $rg(sort keys %{$perl->{_groups}}) {
+      my ($p_rg, $c_rg) = ($perl->{_groups}->{$rg}, $c->{_groups}->{$rg});
+      is_deeply([sort keys %{$c_rg}], [sort keys %{$p_rg}], "$bam: fields match for RG $rg");
+      is_deeply($c_rg->{$_}, $p_rg->{$_}, "$bam: $_ matches for RG $rg") for(sort keys %{$p_rg});
+    }
+  }
+};
+
+done_testing();
@@ -22,6 +22,8 @@ use strict;
 use Test::More;
 use Test::Fatal;
 use File::Spec;
+use File::Path qw(make_path remove_tree);
+use File::Temp qw(tempdir);
 use Try::Tiny qw(try catch finally);
 use Const::Fast qw(const);
 
@@ -36,4 +38,29 @@ subtest 'Non object checks' => sub {
   ok(PCAP::Bwa::bwamem2_version(), 'Version returned for bwa-mem2');
 };
 
+subtest 'xam_split fallback checks' => sub {
+  my $dir = tempdir( CLEANUP => 1 );
+  my $split_folder = "$dir/split";
+  # stand in for xam_split, leaves a partial output before exiting with the given status
+  my $xam_split = sprintf q{bash -c 'cat > /dev/null; touch %s/partial_i.bam; exit $0'}, $split_folder;
+  my $collate_split = "cat > $split_folder/collated.txt";
+  my %cases = (0 => [0, 1, 0], 3 => [0, 0, 1], 1 => [1, 1, 0]);
+  for my $rc(sort keys %cases) {
+    my ($exit, $partial, $collated) = @{$cases{$rc}};
+    make_path($split_folder);
+    my @commands = ('set -o pipefail',
+                    PCAP::Bwa::_xam_split_or_collate(q{printf 'reads\n'}, "$xam_split $rc", $collate_split, $split_folder));
+    my $script = PCAP::Threaded::_create_script(\@commands, "$dir/split_$rc");
+    is(system("bash $script > /dev/null 2>&1") >> 8, $exit, "xam_split exit $rc: script exit status");
+    is(-e "$split_folder/partial_i.bam" ? 1 : 0, $partial, "xam_split exit $rc: xam_split output retained");
+    is(-e "$split_folder/collated.txt" ? 1 : 0, $collated, "xam_split exit $rc: collate fallback run");
+    if($collated) {
+      open my $COLLATED, '<', "$split_folder/collated.txt" or die $!;
+      is(<$COLLATED>, "reads\n", "xam_split exit $rc: collate fallback given all reads");
+      close $COLLATED;
+    }
+    remove_tree($split_folder);
+  }
+};
+
 done_testing();
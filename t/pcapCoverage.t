@@ -59,6 +59,19 @@ subtest 'Object access BED' => sub {
   is($cov->build_depth, $EXP_RESULT, "Expected result GFF3");
 };
 
+subtest 'Object access BED perl engine' => sub {
+  my $cov = new_ok('PCAP::Bam::Coverage', [{xam => $input_bam,
+                                            type => $BED_TYPE,
+                                            target => $bed,
+                                            engine => 'perl'}]);
+  is($cov->build_depth, $EXP_RESULT, "Expected result BED, perl engine");
+};
+
+subtest 'merge_targets' => sub {
+  my $merged = PCAP::Bam::Coverage::merge_targets([['1', 101, 200], ['2', 11, 20], ['1', 151, 250],
+                                                   ['1', 251, 300], ['1', 501, 600], ['1', 501, 600]]);
+  is_deeply($merged, [['1', 101, 300], ['1', 501, 600], ['2', 11, 20]], 'Overlapping, abutting and duplicate targets merged');
+};
 
 subtest 'bed no output file' => sub {
   my $cmd = sprintf($COMMAND_STDOUT,$script,$input_bam,$bed,$BED_TYPE);
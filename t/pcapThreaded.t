@@ -46,6 +46,9 @@ subtest 'add_function checks' => sub {
   like(exception{$obj->add_function('not_a_ref', &add_one)}
       , qr/Second argument to add_function should be a code reference, I got /m
       , 'Modify message when not a reference, where coderef expected');
+  like(exception{$obj->add_function('bad_cost', \&add_one, undef, 1)}
+      , qr/Fourth argument to add_function should be a code reference/m
+      , 'Fail when cost is not a coderef');
 
 };
 
@@ -73,6 +76,10 @@ subtest 'run checks' => sub {
   like(exception{$obj->run(1, 'to_fail')}
       , qr/Expected to fail/
       , 'Fail when function throws error');
+  my @seen;
+  $obj->add_function('record', sub { push @seen, shift; }, undef, sub { my ($index, $costs) = @_; $costs->[$index-1] });
+  ok($obj->run(4, 'record', [5, 20, 1, 20]), 'Success with cost ordering');
+  is_deeply(\@seen, [2, 4, 1, 3], 'Iterations started largest cost first');
 ## breaks Devel::Cover
 #  $obj = new_ok($MODULE => [2]);
 #  $obj->add_function('add_one', \&add_one);
@@ -89,6 +96,11 @@ subtest 'thread object coniguration' => sub {
   is($obj->thread_join_interval, 1, 'Default value for thread_join_interval = 1');
   is($obj->thread_join_interval(2), 2, 'Changing value for thread_join_interval = 2');
   is($obj->thread_join_interval, 2, 'Following change to 2, thread_join_interval = 2');
+  is($obj->thread_start_interval, 0, 'Default value for thread_start_interval = 0');
+  is($obj->thread_start_interval(0.5), 0.5, 'Changing value for thread_start_interval = 0.5');
+  like(exception{$obj->thread_start_interval(-1)}
+      , qr/start_interval must be 0 or more/
+      , 'Fail when start interval negative');
 };
 
 subtest 'completion utility checks' => sub {
@@ -111,6 +123,24 @@ subtest 'completion utility checks (legacy)' => sub {
 subtest 'external process handling' => sub {
   my $dir = tempdir( CLEANUP => 1 );
   ok(PCAP::Threaded::external_process_handler($dir, 'ls', 1), 'External process executes');
+  my @time_files = glob "$dir/*.1.time";
+  is(scalar @time_files, 1, 'Time record written');
+  is(PCAP::Threaded::write_telemetry($dir), 1, 'Telemetry aggregated');
+  ok(-s "$dir/telemetry.tsv", 'Telemetry TSV written');
+  ok(-s "$dir/telemetry.json", 'Telemetry JSON written');
+  like(exception{PCAP::Threaded::_sampled_system('exit 3')}
+      , qr/unexpectedly returned exit value 3/
+      , 'Fail when command fails');
+  SKIP: {
+    skip 'no /proc', 3 unless(-d '/proc');
+    ok(PCAP::Threaded::_tree_rss_kb($$) > 0, 'Process tree RSS measured');
+    my $child = fork;
+    if($child == 0) { sleep 5; POSIX::_exit(0); }
+    ok(PCAP::Threaded::_tree_rss_kb($$) > PCAP::Threaded::_tree_rss_kb($child), 'Process tree RSS includes children');
+    kill 'TERM', $child;
+    waitpid $child, 0;
+    ok(PCAP::Threaded::_sampled_system('sleep 0.3') > 0, 'Command RSS sampled');
+  }
 };
 
 subtest 'thread divisor checks' => sub {
@@ -124,6 +154,52 @@ subtest 'thread divisor checks' => sub {
   is($obj->_suitable_threads(2), 1, 'Return 1 when result is < 1');
 };
 
+subtest 'resource packing checks' => sub {
+  $obj = new_ok($MODULE => [1]);
+  $obj->add_function('add_one', \&add_one);
+  like(exception{$obj->set_resources('undeclared', 1, 10)}
+      , qr/Unable to find 'undeclared'/
+      , 'Fail when function not declared');
+  like(exception{$obj->set_resources('add_one', 0, 10)}
+      , qr/CPUs per job must be a positive integer/
+      , 'Fail when cpus == 0');
+  like(exception{$obj->set_resources('add_one', 1, 'x')}
+      , qr/Memory per job must be a positive integer/
+      , 'Fail when memory not a number');
+  like(exception{$obj->max_memory('1G')}
+      , qr/max_memory must be an integer/
+      , 'Fail when budget not an integer');
+  is($obj->max_memory, 0, 'Default value for max_memory = 0');
+  ok($obj->set_resources('add_one', 1, 3000), 'Declare resources');
+  is($obj->_job_slots('add_one', 8), 8, 'No budget, slots limited by cpus');
+  is($obj->max_memory(10000), 10000, 'Set budget');
+  is($obj->_job_slots('add_one', 8), 3, 'Slots limited by memory');
+  is($obj->_job_slots('add_one', 2), 2, 'Slots limited by cpus within budget');
+
+  my $dir = tempdir( CLEANUP => 1 );
+  is(PCAP::Threaded::_record_peak_rss(6291456), 0, 'Peak not recorded outside of run');
+  {
+    local $PCAP::Threaded::CURRENT_FUNCTION = 'add_one';
+    my $time = "$dir/add_one.1.time";
+    open my $TIME, '>', $time or die $!;
+    print $TIME "Command exited with non-zero status 1\n1.50\t1.00\t0.25\t6291456\t8\t16\t1\n";
+    close $TIME;
+    is_deeply(PCAP::Threaded::_record_telemetry($time, 'add_one', 1, 10)
+            , ['add_one', 1, '10.000', '1.50', '1.00', '0.25', 6291456, 4096, 8192, 1]
+            , 'Time record parsed');
+    open $TIME, '>', $time or die $!;
+    print $TIME "1.50\t1.00\t0.25\t6291456\t8\t16\t0\n";
+    close $TIME;
+    is(PCAP::Threaded::_record_telemetry($time, 'add_one', 1, 10, 7340032)->[6]
+            , 7340032
+            , 'Summed process tree RSS replaces single process max');
+  }
+  is($obj->peak_memory('add_one'), 7168, 'Peak memory in MB');
+  is($obj->_job_slots('add_one', 8), 1, 'Measured peak refines estimate');
+  is($obj->max_memory(1000), 1000, 'Set budget below single job');
+  is($obj->_job_slots('add_one', 8), 1, 'Always allow one job');
+};
+
 done_testing();
 
 